@@ -0,0 +1,185 @@
+#! /bin/bash
+# source: bench.sh
+# Copyright Gerhard Rieger
+# Published under the GNU General Public License V.2, see file COPYING
+
+# this script measures how many system calls socat issues per megabyte of
+# transferred data in typical data loop scenarios. It is meant for comparing
+# two builds, e.g. before and after a change to the transfer engine:
+#   SOCAT_BASE=/tmp/old/socat ./bench.sh
+# RELAY_OPTS passes additional options to the socat under test, e.g.
+#   RELAY_OPTS="-e io_uring" ./bench.sh
+# The numbers are taken from socat's own debug log (one line per system call
+# wrapper); "waits/MB" counts the select(), poll() and epoll_wait() calls
+# among them. With strace installed, "strace -c" output is appended.
+# usage: bench.sh [-m MB] [case ...]
+# cases: relay chain udp (default: all)
+
+SOCAT=${SOCAT:-./socat}
+SOCAT_BASE=${SOCAT_BASE:-}
+RELAY_OPTS=${RELAY_OPTS:-}
+MB=16
+PORT=${PORT:-$((RANDOM+20000))}
+LOCALHOST=127.0.0.1
+TD=${TMPDIR:-/tmp}/socat-bench.$$
+
+while [ "$1" ]; do
+    case "X$1" in
+    X-m) shift; MB="$1" ;;
+    X-m*) MB="${1#-m}" ;;
+    X-*) echo "usage: $0 [-m MB] [case ...]" >&2; exit 1 ;;
+    *) break ;;
+    esac
+    shift
+done
+CASES="${*:-relay chain udp}"
+
+mkdir -p "$TD" || exit 1
+trap 'rm -rf "$TD"; kill $(jobs -p) 2>/dev/null' EXIT
+dd if=/dev/urandom of="$TD/data" bs=1048576 count="$MB" 2>/dev/null
+
+waittcp4port () {
+    local i=0
+    while [ $i -lt 50 ]; do
+	if ss -ltn 2>/dev/null |grep -q ":$1 " ||
+	   netstat -ltn 2>/dev/null |grep -q ":$1 "; then
+	    return 0
+	fi
+	sleep 0.1; i=$((i+1))
+    done
+    return 1
+}
+
+# print the syscalls of the data loop found in a socat -d -d -d -d log
+countcalls () {
+    sed -n '/starting .*data transfer loop/,$p' "$1" |
+    grep -v ' -> ' |grep -v ' D xio' |
+    sed -n 's/^.* D \([a-z_0-9]*\)(.*$/\1/p' |
+    sort |uniq -c |sort -rn
+}
+
+report () {
+    local name="$1" log="$2" total waits
+    total=$(countcalls "$log" |awk '{ s += $1 } END { print s+0 }')
+    waits=$(countcalls "$log" |
+	awk '$2 ~ /^(select|pselect|poll|ppoll|epoll_wait|epoll_pwait)$/ { s += $1 } END { print s+0 }')
+    printf "%-28s %8d calls  %8.1f calls/MB  %7.1f waits/MB\n" "$name" \
+	"$total" "$(awk "BEGIN { print $total/$MB }")" \
+	"$(awk "BEGIN { print $waits/$MB }")"
+    countcalls "$log" |head -8 |sed 's/^/    /'
+}
+
+# relay: source -> TCP -> socat under test -> TCP -> sink
+bench_relay () {
+    local bin="$1" name="$2" log="$TD/relay.$3.log"
+    local p1=$PORT p2=$((PORT+1))
+    PORT=$((PORT+2))
+    "$bin" -u TCP4-LISTEN:$p2,reuseaddr,bind=$LOCALHOST OPEN:/dev/null,wronly &
+    local sink=$!
+    waittcp4port $p2 || { echo "$name: sink did not start" >&2; return 1; }
+    $STRACE "$bin" -d -d -d -d -lf "$log" $RELAY_OPTS \
+	TCP4-LISTEN:$p1,reuseaddr,bind=$LOCALHOST TCP4:$LOCALHOST:$p2 \
+	2>"$TD/strace.out" &
+    local relay=$!
+    waittcp4port $p1 || { echo "$name: relay did not start" >&2; return 1; }
+    "$bin" -u OPEN:"$TD/data" TCP4:$LOCALHOST:$p1
+    wait $relay; wait $sink
+    report "$name" "$log"
+    if [ "$STRACE" ]; then
+	grep -E '^ *[0-9.]+ +[0-9.]+ |total' "$TD/strace.out" |
+	sed 's/^/    strace: /'
+    fi
+}
+
+# chain: file -> three reverse NOP addresses, each served by its own thread
+# -> /dev/null; compares the transports between the threads: socketpairs
+# (-cS, the default) and shared memory rings (-cr). The time is taken from a
+# run without log
+bench_chain () {
+    local bin="$1" name="$2" log c t0 t1
+    for c in S r; do
+	log="$TD/chain.$3.$c.log"
+	t0=$(date +%s%N)
+	"$bin" -c$c -u OPEN:"$TD/data" "^NOP|^NOP|^NOP|OPEN:/dev/null,wronly"
+	t1=$(date +%s%N)
+	$STRACE "$bin" -d -d -d -d -lf "$log" -c$c -u OPEN:"$TD/data" \
+	    "^NOP|^NOP|^NOP|OPEN:/dev/null,wronly" 2>"$TD/strace.out"
+	report "$name -c$c" "$log"
+	printf "    %.1f MB/s\n" "$(awk "BEGIN { print $MB*1000000000/($t1-$t0) }")"
+	if [ "$STRACE" ]; then
+	    grep -E '^ *[0-9.]+ +[0-9.]+ |total' "$TD/strace.out" |
+	    sed 's/^/    strace: /'
+	fi
+    done
+}
+
+# udp: file -> UDP datagrams of 1200 bytes -> socat under test -> UDP ->
+# sink, all on loopback. Case "plain" sends single datagrams, "single" also
+# has the relay receive and send them one per call (batch=1); with "gso" the
+# source coalesces 40 datagrams per write (udp-segment), relay and sink read
+# them as one (udp-gro), and the relay passes them on with UDP_SEGMENT. UDP
+# has no EOF, so relay and sink stop after 1s without data; datagrams that
+# did not make it through (the source is not paced) are reported as lost.
+# Calls are counted per MB that arrived
+bench_udp () {
+    local bin="$1" name="$2" log c p1 p2 srcopts sndopts rlyopts outopts
+    local sink relay t0 t1 got
+    for c in plain single gso; do
+	outopts=
+	case $c in
+	plain) srcopts="-b 1200" sndopts= rlyopts= ;;
+	single) srcopts="-b 1200" sndopts= rlyopts=",batch=1" outopts=",batch=1" ;;
+	gso) srcopts="-b 48000" sndopts=",udp-segment=1200" rlyopts=",udp-gro" ;;
+	esac
+	for log in "" "$TD/udp.$3.$c.log"; do
+	    p1=$PORT p2=$((PORT+1))
+	    PORT=$((PORT+2))
+	    rm -f "$TD/udp.out"
+	    "$bin" -T 1 -u UDP4-RECV:$p2,rcvbuf=4000000$rlyopts CREATE:"$TD/udp.out" &
+	    sink=$!
+	    if [ "$log" ]; then
+		$STRACE "$bin" -d -d -d -d -lf "$log" -T 1 $RELAY_OPTS -u \
+		    UDP4-RECV:$p1,rcvbuf=4000000$rlyopts \
+		    UDP4-SENDTO:$LOCALHOST:$p2$outopts 2>"$TD/strace.out" &
+	    else
+		"$bin" -T 1 $RELAY_OPTS -u UDP4-RECV:$p1,rcvbuf=4000000$rlyopts \
+		    UDP4-SENDTO:$LOCALHOST:$p2$outopts &
+	    fi
+	    relay=$!
+	    sleep 0.5
+	    t0=$(date +%s%N)
+	    "$bin" $srcopts -u OPEN:"$TD/data" \
+		UDP4-SENDTO:$LOCALHOST:$p1$sndopts
+	    wait $relay; wait $sink
+	    t1=$(($(date +%s%N)-1000000000))	# the timeout of the sink
+	    got=$(wc -c <"$TD/udp.out")
+	    if [ -z "$log" ]; then
+		printf "%-28s %8.1f MB/s  %5.1f%% lost\n" "$name $c" \
+		    "$(awk "BEGIN { print $got/1048576*1000000000/($t1-$t0) }")" \
+		    "$(awk "BEGIN { print 100-100*$got/($MB*1048576) }")"
+		continue
+	    fi
+	    MB=$(awk "BEGIN { print $got/1048576 }") report "$name $c" "$log"
+	    if [ "$STRACE" ]; then
+		grep -E '^ *[0-9.]+ +[0-9.]+ |total' "$TD/strace.out" |
+		sed 's/^/    strace: /'
+	    fi
+	done
+    done
+}
+
+STRACE=
+if type strace >/dev/null 2>&1; then
+    STRACE="strace -c -f"
+fi
+
+echo "transferring $MB MB per case"
+for c in $CASES; do
+    if ! type bench_$c >/dev/null 2>&1; then
+	echo "$0: unknown case \"$c\"" >&2; exit 1
+    fi
+    if [ "$SOCAT_BASE" ]; then
+	bench_$c "$SOCAT_BASE" "$c (base)" base
+    fi
+    bench_$c "$SOCAT" "$c" new
+done
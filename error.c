@@ -40,6 +40,7 @@ struct diag_opts {
 
 
 static void _diag_exit(int status);
+static void _diag_flush(void);
 
 
 struct diag_opts diagopts =
@@ -105,7 +106,9 @@ struct sermsg {
 static int diaginitialized;
 static int diag_sock_send = -1;
 static int diag_sock_recv = -1;
-static int diag_msg_avail = 0;       /* !=0: messages from within signal handler may be waiting */
+static volatile sig_atomic_t diag_msg_avail = 0;	/* !=0: messages from within signal handler may be waiting */
+static pthread_key_t diag_exitkey;	/* exit level of a thread, see 'E' */
+static bool diag_haveexitkey;
 
 static int diag_init(void) {
    int handlersocks[2];
@@ -116,6 +119,7 @@ static int diag_init(void) {
    diaginitialized = 1;
    /* gcc with GNU libc refuses to set this in the initializer */
    diagopts.logfile = stderr;
+   diag_haveexitkey = (pthread_key_create(&diag_exitkey, NULL) == 0);
    if (socketpair(AF_UNIX, SOCK_DGRAM, 0, handlersocks) < 0) {
       diag_sock_send = -1;
       diag_sock_recv = -1;
@@ -127,6 +131,18 @@ static int diag_init(void) {
 }
 #define DIAG_INIT ((void)(diaginitialized || diag_init()))
 
+/* the exit level that applies to the calling thread: the one set with
+   diag_set_int('E', ...) in this thread, else the process wide one */
+static int diag_exitlevel(void) {
+   void *level;
+
+   if (diag_haveexitkey &&
+       (level = pthread_getspecific(diag_exitkey)) != NULL) {
+      return (int)(intptr_t)level - 1;
+   }
+   return diagopts.exitlevel;
+}
+
 
 void diag_set(char what, const char *arg) {
    DIAG_INIT;
@@ -176,6 +192,12 @@ void diag_set_int(char what, int arg) {
    switch (what) {
    case 'D': diagopts.msglevel = arg; break;
    case 'e': diagopts.exitlevel = arg; break;
+   case 'E': /* only for the calling thread; -1 reverts to 'e' */
+      if (diag_haveexitkey) {
+	 pthread_setspecific(diag_exitkey,
+			     arg < 0 ? NULL : (void *)(intptr_t)(arg+1));
+      }
+      break;
    case 'x': diagopts.exitstatus = arg; break;
    case 'h': diagopts.withhostname = arg;
       if ((diagopts.hostname = getenv("HOSTNAME")) == NULL) {
@@ -195,6 +217,7 @@ int diag_get_int(char what) {
    case 's': return diagopts.logfile == stderr;
    case 'd': case 'D': return diagopts.msglevel;
    case 'e': return diagopts.exitlevel;
+   case 'E': return diag_exitlevel();
    }
    return -1;
 }
@@ -224,8 +247,7 @@ void msg(int level, const char *format, ...) {
 
    /* in normal program flow (not in signal handler) */
    /* first flush the queue of datagrams from the socket */
-   if (diag_msg_avail && !diag_in_handler) {
-      diag_msg_avail = 0;    /* _before_ flush to prevent inconsistent state when signal occurs inbetween */
+   if (!diag_in_handler) {
       diag_flush();
    }
 
@@ -325,7 +347,7 @@ void msg2(
    strncpy(bufp, text, BUFLEN-(bufp-buff)-1);
    strcat(bufp, "\n");
    _msg(level, buff, syslp);
-   if (level >= diagopts.exitlevel) {
+   if (level >= diag_exitlevel()) {
       if (E_NOTICE >= diagopts.msglevel) {
 	 snprintf_r(syslp, 16, "N exit(%d)\n", exitcode?exitcode:(diagopts.exitstatus?diagopts.exitstatus:1));
 	 _msg(E_NOTICE, buff, syslp);
@@ -346,8 +368,18 @@ static void _msg(int level, const char *buff, const char *syslp) {
 }
 
 
-/* handle the messages in the queue */
+/* handle the messages in the queue. This is called very often, e.g. around
+   each system call of the transfer loop; it does not perform a system call
+   when no signal handler has sent a message */
 void diag_flush(void) {
+   if (!diag_msg_avail) {
+      return;
+   }
+   diag_msg_avail = 0;    /* _before_ recv() to not miss messages sent meanwhile */
+   _diag_flush();
+}
+
+static void _diag_flush(void) {
    struct diag_dgram recv_dgram;
    char exitmsg[20];
    while (recv(diag_sock_recv, &recv_dgram, sizeof(recv_dgram)-1, MSG_DONTWAIT) > 0) {
@@ -418,6 +450,7 @@ void diag_exit(int status) {
 	   |MSG_NOSIGNAL
 #endif
 	   );
+      diag_msg_avail = 1;
       return;
    }
    _diag_exit(status);
@@ -448,7 +481,7 @@ int diag_select(int nfds, fd_set *readfds, fd_set *writefds,
 	 /* select terminated not due to diag_sock_recv, normalt continuation */
 	 break;
       }
-      diag_flush();
+      _diag_flush();
       if (readfds)   { memcpy(readfds,   &save_readfds,   sizeof(*readfds)); }
       if (writefds)  { memcpy(writefds,  &save_writefds,  sizeof(*writefds)); }
       if (exceptfds) { memcpy(exceptfds, &save_exceptfds, sizeof(*exceptfds)); }
@@ -149,6 +149,28 @@ int main(int argc, const char *argv[]) {
 	 }
 	 xioparams->bufsiz = strtoul(a, (char **)&a, 0);
 	 break;
+      case 'e': if (arg1[0][2]) {
+	    a = *arg1+2;
+	 } else {
+	    ++arg1, --argc;
+	    if ((a = *arg1) == NULL) {
+	       Error("option -e requires an argument; use option \"-h\" for help");
+	       Exit(1);
+	    }
+	 }
+	 if (!strcmp(a, "poll")) {
+	    xioparams->engine = XIOENGINE_POLL;
+	 } else if (!strcmp(a, "io_uring")) {
+#if HAVE_IO_URING
+	    xioparams->engine = XIOENGINE_URING;
+#else
+	    Warn("io_uring engine not available, using poll");
+#endif
+	 } else {
+	    Error1("unknown engine \"%s\"; use option \"-h\" for help", a);
+	    Exit(1);
+	 }
+	 break;
       case 's':
 	 diag_set_int('e', E_FATAL); break;
       case 't': if (arg1[0][2]) {
@@ -229,6 +251,13 @@ int main(int argc, const char *argv[]) {
 	 case 'Y': xioparams->pipetype = XIOCOMM_PTYS;        break;
 	 case 'y': xioparams->pipetype = XIOCOMM_PTY;         break;
 	 case 't': xioparams->pipetype = XIOCOMM_TCP;         break;
+	 case 'r':
+#if HAVE_SHMRINGS
+	    xioparams->pipetype = XIOCOMM_SHMRINGS;
+#else
+	    Warn("shared memory rings not available, using socketpairs");
+#endif
+	    break;
 	 case '0': case '1': case '2': case '3': case '4':
 	 case '5': case '6': case '7': case '8': case '9':
 	    xioparams->pipetype = atoi(&arg1[0][2]); break;
@@ -368,6 +397,7 @@ void socat_usage(FILE *fd) {
    fputs("      -v     verbose data traffic, text\n", fd);
    fputs("      -x     verbose data traffic, hexadecimal\n", fd);
    fputs("      -b<size_t>     set data buffer size (8192)\n", fd);
+   fputs("      -e<engine>     data transfer engine: poll (default) or io_uring\n", fd);
    fputs("      -s     sloppy (continue on error)\n", fd);
    fputs("      -t<timeout>    wait seconds before closing second channel\n", fd);
    fputs("      -T<timeout>    total inactivity timeout in seconds\n", fd);
@@ -572,15 +602,15 @@ int socat(int argc, const char *address1, const char *address2) {
 
    /* open the first (left most) address */
    if (xioparams->lefttoright) {
-      if ((xfd1 = socat_open(address1, XIO_RDONLY, XIO_MAYFORK|XIO_MAYCHILD|XIO_MAYCONVERT)) == NULL) {
+      if ((xfd1 = socat_open(address1, XIO_RDONLY, XIO_MAYFORK|XIO_MAYCHILD|XIO_MAYCONVERT|XIO_MAYMUX)) == NULL) {
 	 return -1;
       }
    } else if (xioparams->righttoleft) {
-      if ((xfd1 = socat_open(address1, XIO_WRONLY, XIO_MAYFORK|XIO_MAYCHILD|XIO_MAYCONVERT)) == NULL) {
+      if ((xfd1 = socat_open(address1, XIO_WRONLY, XIO_MAYFORK|XIO_MAYCHILD|XIO_MAYCONVERT|XIO_MAYMUX)) == NULL) {
 	 return -1;
       }
    } else {
-      if ((xfd1 = socat_open(address1, XIO_RDWR, XIO_MAYFORK|XIO_MAYCHILD|XIO_MAYCONVERT)) == NULL) {
+      if ((xfd1 = socat_open(address1, XIO_RDWR, XIO_MAYFORK|XIO_MAYCHILD|XIO_MAYCONVERT|XIO_MAYMUX)) == NULL) {
 	 return -1;
       }
    }
@@ -594,6 +624,11 @@ int socat(int argc, const char *address1, const char *address2) {
    }
 #endif
 
+   if (xfd1->tag != XIO_TAG_DUAL && (xfd1->stream.flags & XIO_DOESMUX)) {
+      /* opens the second address for each accepted connection */
+      return xiomux_socat(xfd1, address2);
+   }
+
    /* second (right) addresses chain */
    if (XIO_WRITABLE(xfd1)) {
       if (XIO_READABLE(xfd1)) {
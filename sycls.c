@@ -541,6 +541,38 @@ ssize_t Write(int fd, const void *buf, size_t count) {
    return result;
 }
 
+#if HAVE_SPLICE
+ssize_t Splice(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out,
+	       size_t len, unsigned int flags) {
+   ssize_t result;
+   int _errno;
+   if (!diag_in_handler) diag_flush();
+   Debug6("splice(%d, %p, %d, %p, "F_Zu", 0x%x)",
+	  fd_in, off_in, fd_out, off_out, len, flags);
+   result = splice(fd_in, off_in, fd_out, off_out, len, flags);
+   _errno = errno;
+   if (!diag_in_handler) diag_flush();
+   Debug1("splice -> "F_Zd, result);
+   errno = _errno;
+   return result;
+}
+#endif /* HAVE_SPLICE */
+
+#if HAVE_SENDFILE
+ssize_t Sendfile(int out_fd, int in_fd, off_t *offset, size_t count) {
+   ssize_t result;
+   int _errno;
+   if (!diag_in_handler) diag_flush();
+   Debug4("sendfile(%d, %d, %p, "F_Zu")", out_fd, in_fd, offset, count);
+   result = sendfile(out_fd, in_fd, offset, count);
+   _errno = errno;
+   if (!diag_in_handler) diag_flush();
+   Debug1("sendfile -> "F_Zd, result);
+   errno = _errno;
+   return result;
+}
+#endif /* HAVE_SENDFILE */
+
 int Fcntl(int fd, int cmd) {
    int result, _errno;
    if (!diag_in_handler) diag_flush();
@@ -824,6 +856,99 @@ int Pselect(int n, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
 }
 #endif /* 0 */
 
+#if HAVE_EPOLL_CREATE1
+int Epoll_create1(int flags) {
+   int result, _errno;
+   Debug1("epoll_create1(%d)", flags);
+   result = epoll_create1(flags);
+   _errno = errno;
+   Info2("epoll_create1(%d) -> %d", flags, result);
+   errno = _errno;
+   return result;
+}
+
+int Epoll_ctl(int epfd, int op, int fd, struct epoll_event *event) {
+   int result, _errno;
+   Debug4("epoll_ctl(%d, %d, %d, {0x%x,})",
+	  epfd, op, fd, event?event->events:0);
+   result = epoll_ctl(epfd, op, fd, event);
+   _errno = errno;
+   Debug1("epoll_ctl() -> %d", result);
+   errno = _errno;
+   return result;
+}
+
+/* we only show the first returned event; hope this is enough for most cases.
+   */
+int Epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+	       int timeout) {
+   int result, _errno;
+   if (!diag_in_handler) diag_flush();
+   Debug4("epoll_wait(%d, %p, %d, %d)", epfd, events, maxevents, timeout);
+   result = epoll_wait(epfd, events, maxevents, timeout);
+   _errno = errno;
+   if (!diag_in_handler) diag_flush();
+   if (result > 0) {
+      Debug3("epoll_wait(, {0x%x,%d}, ) -> %d",
+	     events[0].events, events[0].data.fd, result);
+   } else {
+      Debug1("epoll_wait() -> %d", result);
+   }
+   errno = _errno;
+   return result;
+}
+#endif /* HAVE_EPOLL_CREATE1 */
+
+#if HAVE_IO_URING
+/* there are no libc functions for io_uring, we use the system calls */
+pid_t Gettid(void) {
+   pid_t result;
+   int _errno;
+   Debug("gettid()");
+   result = (pid_t)syscall(SYS_gettid);
+   _errno = errno;
+   Debug1("gettid() -> "F_pid, result);
+   errno = _errno;
+   return result;
+}
+
+int Io_uring_setup(unsigned int entries, struct io_uring_params *p) {
+   int result, _errno;
+   Debug2("io_uring_setup(%u, %p)", entries, p);
+   result = syscall(__NR_io_uring_setup, entries, p);
+   _errno = errno;
+   Info2("io_uring_setup(%u, ) -> %d", entries, result);
+   errno = _errno;
+   return result;
+}
+
+int Io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+		   unsigned int flags, const void *arg, size_t argsz) {
+   int result, _errno;
+   if (!diag_in_handler) diag_flush();
+   Debug6("io_uring_enter(%d, %u, %u, 0x%x, %p, "F_Zu")",
+	  fd, to_submit, min_complete, flags, arg, argsz);
+   result = syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+		    arg, argsz);
+   _errno = errno;
+   if (!diag_in_handler) diag_flush();
+   Debug1("io_uring_enter() -> %d", result);
+   errno = _errno;
+   return result;
+}
+
+int Io_uring_register(int fd, unsigned int opcode, const void *arg,
+		      unsigned int nr_args) {
+   int result, _errno;
+   Debug4("io_uring_register(%d, %u, %p, %u)", fd, opcode, arg, nr_args);
+   result = syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+   _errno = errno;
+   Debug1("io_uring_register() -> %d", result);
+   errno = _errno;
+   return result;
+}
+#endif /* HAVE_IO_URING */
+
 pid_t Fork(void) {
    pid_t pid;
    int _errno;
@@ -881,6 +1006,16 @@ int Sigprocmask(int how, const sigset_t *set, sigset_t *oldset) {
    return result;
 }
 
+int Sigsuspend(const sigset_t *mask) {
+   int _errno, result;
+   Debug1("sigsuspend({0x%lx})", *(unsigned long *)mask);
+   result = sigsuspend(mask);
+   _errno = errno;
+   Debug1("sigsuspend() -> %d", result);
+   errno = _errno;
+   return result;
+}
+
 unsigned int Alarm(unsigned int seconds) {
    unsigned int retval;
    Debug1("alarm(%u)", seconds);
@@ -1227,8 +1362,58 @@ int Sendto(int s, const void *mesg, size_t len, int flags,
    errno = _errno;
    return retval;
 }
+
+int Sendmsg(int s, const struct msghdr *msgh, int flags) {
+   int retval, _errno;
+   char infobuff[256];
+
+   if (!diag_in_handler) diag_flush();
+#if defined(HAVE_STRUCT_MSGHDR_MSGCONTROL) && defined(HAVE_STRUCT_MSGHDR_MSGCONTROLLEN)
+   Debug9("sendmsg(%d, %p{%s,%u,%p,"F_Zu",%p,"F_Zu"}, %d)", s, msgh,
+	  msgh->msg_name?sockaddr_info(msgh->msg_name, msgh->msg_namelen, infobuff, sizeof(infobuff)):"NULL",
+	  msgh->msg_namelen, msgh->msg_iov, (size_t)msgh->msg_iovlen,
+	  msgh->msg_control, (size_t)msgh->msg_controllen, flags);
+#else
+   Debug7("sendmsg(%d, %p{%s,%u,%p,"F_Zu"}, %d)", s, msgh,
+	  msgh->msg_name?sockaddr_info(msgh->msg_name, msgh->msg_namelen, infobuff, sizeof(infobuff)):"NULL",
+	  msgh->msg_namelen, msgh->msg_iov, (size_t)msgh->msg_iovlen, flags);
+#endif
+   retval = sendmsg(s, msgh, flags);
+   _errno = errno;
+   if (!diag_in_handler) diag_flush();
+   Debug1("sendmsg() -> %d", retval);
+   errno = _errno;
+   return retval;
+}
 #endif /* _WITH_SOCKET */
 
+#if HAVE_MMSG
+int Recvmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags,
+	     struct timespec *timeout) {
+   int retval, _errno;
+   if (!diag_in_handler) diag_flush();
+   Debug5("recvmmsg(%d, %p, %u, %d, %p)", s, msgvec, vlen, flags, timeout);
+   retval = recvmmsg(s, msgvec, vlen, flags, timeout);
+   _errno = errno;
+   if (!diag_in_handler) diag_flush();
+   Debug1("recvmmsg() -> %d", retval);
+   errno = _errno;
+   return retval;
+}
+
+int Sendmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags) {
+   int retval, _errno;
+   if (!diag_in_handler) diag_flush();
+   Debug4("sendmmsg(%d, %p, %u, %d)", s, msgvec, vlen, flags);
+   retval = sendmmsg(s, msgvec, vlen, flags);
+   _errno = errno;
+   if (!diag_in_handler) diag_flush();
+   Debug1("sendmmsg() -> %d", retval);
+   errno = _errno;
+   return retval;
+}
+#endif /* HAVE_MMSG */
+
 #if _WITH_SOCKET
 int Shutdown(int fd, int how) {
    int retval, _errno;
@@ -1569,6 +1754,20 @@ int Pthread_join(pthread_t thread, void **value_ptr) {
    return result;
 }
 
+#if HAVE_PTHREAD_TIMEDJOIN_NP
+int Pthread_timedjoin_np(pthread_t thread, void **value_ptr,
+			 const struct timespec *abstime) {
+   int result, _errno;
+   Debug4("pthread_timedjoin_np(%p, %p, {%ld,%09ld})", thread, value_ptr,
+	  (long)abstime->tv_sec, (long)abstime->tv_nsec);
+   result = pthread_timedjoin_np(thread, value_ptr, abstime);
+   _errno = errno;
+   Debug1("pthread_timedjoin_np() -> %d", result);
+   errno = _errno;
+   return result;
+}
+#endif /* HAVE_PTHREAD_TIMEDJOIN_NP */
+
 int Mkstemp(char *template) {
    int result, _errno;
    Debug1("mkstemp(\"%s\")", template);
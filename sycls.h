@@ -56,6 +56,13 @@ int Dup2(int oldfd, int newfd);
 int Pipe(int filedes[2]);
 ssize_t Read(int fd, void *buf, size_t count);
 ssize_t Write(int fd, const void *buf, size_t count);
+#if HAVE_SPLICE
+ssize_t Splice(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out,
+	       size_t len, unsigned int flags);
+#endif /* HAVE_SPLICE */
+#if HAVE_SENDFILE
+ssize_t Sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
+#endif /* HAVE_SENDFILE */
 int Fcntl(int fd, int cmd);
 int Fcntl_l(int fd, int cmd, long arg);
 int Fcntl_lock(int fd, int cmd, struct flock *l);
@@ -79,6 +86,20 @@ int Select(int n, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
 	   struct timeval *timeout);
 int Pselect(int n, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
 	    struct timespec *timeout, const sigset_t *sigmask);
+#if HAVE_EPOLL_CREATE1
+int Epoll_create1(int flags);
+int Epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
+int Epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+	       int timeout);
+#endif /* HAVE_EPOLL_CREATE1 */
+#if HAVE_IO_URING
+pid_t Gettid(void);
+int Io_uring_setup(unsigned int entries, struct io_uring_params *p);
+int Io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+		   unsigned int flags, const void *arg, size_t argsz);
+int Io_uring_register(int fd, unsigned int opcode, const void *arg,
+		      unsigned int nr_args);
+#endif /* HAVE_IO_URING */
 pid_t Fork(void);
 pid_t Waitpid(pid_t pid, int *status, int options);
 #ifndef HAVE_TYPE_SIGHANDLER
@@ -88,6 +109,7 @@ sighandler_t Signal(int signum, sighandler_t handler);
 int Sigaction(int signum, const struct sigaction *act,
 	      struct sigaction *oldact);
 int Sigprocmask(int how, const sigset_t *set, sigset_t *oset);
+int Sigsuspend(const sigset_t *mask);
 unsigned int Alarm(unsigned int seconds);
 int Kill(pid_t pid, int sig);
 int Link(const char *oldpath, const char *newpath);
@@ -111,8 +133,14 @@ int Recvmsg(int s, struct msghdr *msg, int flags);
 int Send(int s, const void *mesg, size_t len, int flags);
 int Sendto(int s, const void *msg, size_t len, int flags,
 	   const struct sockaddr *to, socklen_t tolen);
+int Sendmsg(int s, const struct msghdr *msgh, int flags);
 int Shutdown(int fd, int how);
 #endif /* _WITH_SOCKET */
+#if HAVE_MMSG
+int Recvmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags,
+	     struct timespec *timeout);
+int Sendmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags);
+#endif /* HAVE_MMSG */
 unsigned int Sleep(unsigned int seconds);
 void Usleep(unsigned long usec);
 unsigned int Nanosleep(const struct timespec *req, struct timespec *rem);
@@ -144,6 +172,10 @@ void Abort(void);
 int Pthread_create(pthread_t *thread, const pthread_attr_t *attr,
 		   void *(*start_routine)(void *), void *arg);
 int Pthread_join(pthread_t thread, void **value_ptr);
+#if HAVE_PTHREAD_TIMEDJOIN_NP
+int Pthread_timedjoin_np(pthread_t thread, void **value_ptr,
+			 const struct timespec *abstime);
+#endif
 int Mkstemp(char *template);
 int Setenv(const char *name, const char *value, int overwrite);
 void Unsetenv(const char *name);
@@ -205,6 +237,8 @@ int Gzclose(gzFile file) {
 #define Pipe(f) pipe(f)
 #define Read(f,b,c) read(f,b,c)
 #define Write(f,b,c) write(f,b,c)
+#define Splice(i,o,j,p,l,f) splice(i,o,j,p,l,f)
+#define Sendfile(o,i,p,c) sendfile(o,i,p,c)
 #define Fcntl(f,c) fcntl(f,c)
 #define Fcntl_l(f,c,a) fcntl(f,c,a)
 #define Fcntl_lock(f,c,l) fcntl(f,c,l)
@@ -224,11 +258,19 @@ int Gzclose(gzFile file) {
 #define Poll(u, n, t) poll(u, n, t)
 #define Select(n,r,w,e,t) select(n,r,w,e,t)
 #define Pselect(n,r,w,e,t,s) select(n,r,w,e,t,s)
+#define Epoll_create1(f) epoll_create1(f)
+#define Epoll_ctl(e,o,f,v) epoll_ctl(e,o,f,v)
+#define Epoll_wait(e,v,m,t) epoll_wait(e,v,m,t)
+#define Gettid() ((pid_t)syscall(SYS_gettid))
+#define Io_uring_setup(e,p) syscall(__NR_io_uring_setup,e,p)
+#define Io_uring_enter(f,s,m,l,a,z) syscall(__NR_io_uring_enter,f,s,m,l,a,z)
+#define Io_uring_register(f,o,a,n) syscall(__NR_io_uring_register,f,o,a,n)
 #define Fork() fork()
 #define Waitpid(p,s,o) waitpid(p,s,o)
 #define Signal(s,h) signal(s,h)
 #define Sigaction(s,a,o) sigaction(s,a,o)
 #define Sigprocmask(h,s,o) sigprocmask(h,s,o)
+#define Sigsuspend(m) sigsuspend(m)
 #define Alarm(s) alarm(s)
 #define Kill(p,s) kill(p,s)
 #define Link(o,n) link(o,n)
@@ -249,6 +291,9 @@ int Gzclose(gzFile file) {
 #define Recvmsg(s,m,f) recvmsg(s,m,f)
 #define Send(s,m,l,f) send(s,m,l,f)
 #define Sendto(s,b,bl,f,t,tl) sendto(s,b,bl,f,t,tl)
+#define Sendmsg(s,m,f) sendmsg(s,m,f)
+#define Recvmmsg(s,m,v,f,t) recvmmsg(s,m,v,f,t)
+#define Sendmmsg(s,m,v,f) sendmmsg(s,m,v,f)
 #define Shutdown(f,h) shutdown(f,h)
 #define Sleep(s) sleep(s)
 #define Usleep(u) usleep(u)
@@ -277,6 +322,7 @@ int Gzclose(gzFile file) {
 #define Abort() abort()
 #define Pthread_create(t,attr,s,arg) pthread_create(t,attr,s,arg)
 #define Pthread_join(t,ptr) pthread_join(t,ptr)
+#define Pthread_timedjoin_np(t,ptr,a) pthread_timedjoin_np(t,ptr,a)
 #define Mkstemp(t) mkstemp(t)
 #define Setenv(n,v,o) setenv(n,v,o)
 #define Unsetenv(n) unsetenv(n)
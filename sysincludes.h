@@ -93,6 +93,24 @@
 #if HAVE_SYS_FILE_H
 #include <sys/file.h>	/* LOCK_EX, on AIX directly included */
 #endif
+#if HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>	/* epoll_create1(), epoll_wait() */
+#endif
+#if HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>	/* sendfile() */
+#endif
+#if HAVE_SYS_PRCTL_H
+#include <sys/prctl.h>	/* prctl(PR_SET_PDEATHSIG) */
+#endif
+#if HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>	/* eventfd() */
+#include <sys/mman.h>		/* mmap() of the chain rings */
+#endif
+#if HAVE_IO_URING
+#include <sys/syscall.h>	/* __NR_io_uring_setup, SYS_gettid */
+#include <sys/mman.h>		/* mmap() of the io_uring rings */
+#include <linux/io_uring.h>	/* struct io_uring_sqe */
+#endif
 #if WITH_IP4 || WITH_IP6
 #  if HAVE_NETINET_IN_H
 #include <netinet/in.h>	/* struct sockaddr_in, htonl() */
@@ -108,6 +126,9 @@
 #  if HAVE_NETINET_TCP_H
 #include <netinet/tcp.h>	/* TCP_RFC1323 */
 #  endif
+#  if HAVE_UDP_SEGMENT
+#include <netinet/udp.h>	/* UDP_SEGMENT, UDP_GRO */
+#  endif
 #  if HAVE_NETINET_IP6_H && _WITH_IP6
 #include <netinet/ip6.h>
 #  endif
@@ -184,6 +205,7 @@
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <openssl/rand.h>
+#include <sys/mman.h>		/* mmap() of the TLS session cache */
 #endif
 
 #endif /* !defined(__sysincludes_h_included) */
@@ -19,11 +19,16 @@
 /* Substitute for Write():
    Try to write all bytes before returning; this handles EINTR,
    EAGAIN/EWOULDBLOCK, and partial write situations. The drawback is that this
-   function might block even with O_NONBLOCK option.
-   Returns <0 on unhandled error, errno valid
+   function might block even with O_NONBLOCK option; tmo limits the total
+   time it waits for the fd to take data (NULL: no limit).
+   Returns <0 on unhandled error, errno valid; errno is ETIMEDOUT when tmo
+   expired
    Will only return <0 or bytes
 */
-ssize_t writefull(int fd, const void *buff, size_t bytes) {
+ssize_t writefull(int fd, const void *buff, size_t bytes,
+		  const struct timeval *tmo) {
+   struct timeval now, deadline, rest;
+   bool timed = false;
    size_t writt = 0;
    ssize_t chk;
    while (1) {
@@ -31,12 +36,34 @@ ssize_t writefull(int fd, const void *buff, size_t bytes) {
       if (chk < 0) {
 	 switch (errno) {
 	 case EINTR:
+	    continue;
 	 case EAGAIN:
 #if EAGAIN != EWOULDBLOCK
 	 case EWOULDBLOCK:
 #endif
-	    Warn4("write(%d, %p, "F_Zu"): %s", fd, (const char *)buff+writt, bytes-writt, strerror(errno));
-	    Sleep(1); continue;
+	    {
+	       /* nonblocking fd is full: wait until it takes data again */
+	       struct pollfd pfd;
+	       Info4("write(%d, %p, "F_Zu"): %s", fd, (const char *)buff+writt, bytes-writt, strerror(errno));
+	       if (tmo != NULL) {
+		  gettimeofday(&now, NULL);
+		  if (!timed) {
+		     timeradd(&now, tmo, &deadline);
+		     timed = true;
+		  }
+		  if (!timercmp(&now, &deadline, <)) {
+		     errno = ETIMEDOUT;
+		     return -1;
+		  }
+		  timersub(&deadline, &now, &rest);
+	       }
+	       pfd.fd = fd;  pfd.events = POLLOUT;
+	       if (xiopoll(&pfd, 1, tmo != NULL ? &rest : NULL) < 0 &&
+		   errno != EINTR) {
+		  return -1;
+	       }
+	    }
+	    continue;
 	 default: return -1;
 	 }
       } else if (writt+chk < bytes) {
@@ -51,6 +78,32 @@ ssize_t writefull(int fd, const void *buff, size_t bytes) {
    return writt;
 }
 
+/* like writefull(), but does not wait when a nonblocking fd does not take
+   more data (EAGAIN/EWOULDBLOCK).
+   Returns the number of bytes written, which may be less than bytes (even 0),
+   or <0 on other errors, errno valid */
+ssize_t writeavail(int fd, const void *buff, size_t bytes) {
+   size_t writt = 0;
+   ssize_t chk;
+   while (writt < bytes) {
+      chk = Write(fd, (const char *)buff + writt, bytes - writt);
+      if (chk < 0) {
+	 switch (errno) {
+	 case EINTR:
+	    continue;
+	 case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+	 case EWOULDBLOCK:
+#endif
+	    return writt;
+	 default: return -1;
+	 }
+      }
+      writt += chk;
+   }
+   return writt;
+}
+
 #if WITH_UNIX
 void socket_un_init(struct sockaddr_un *sa) {
 #if HAVE_STRUCT_SOCKADDR_SALEN
@@ -557,6 +610,169 @@ int xiopoll(struct pollfd fds[], unsigned long nfds, struct timeval *timeout) {
 }
    
 
+#if HAVE_EPOLL_CREATE1
+/* prepares the epoll instance for xioepoll().
+   returns 0 on success, or -1 if epoll is not available (errno valid) */
+int xioepoll_init(struct xioepoll *ep) {
+   ep->nreg = 0;
+   if ((ep->epfd = Epoll_create1(EPOLL_CLOEXEC)) < 0) {
+      Info1("epoll_create1(EPOLL_CLOEXEC): %s", strerror(errno));
+      return -1;
+   }
+   return 0;
+}
+
+void xioepoll_exit(struct xioepoll *ep) {
+   if (ep->epfd >= 0) {
+      Close(ep->epfd);
+      ep->epfd = -1;
+   }
+   ep->nreg = 0;
+}
+
+/* replaces the epoll instance after xioepoll() reported ESTALE. The caller
+   must register the new ep->epfd wherever it had registered the old one.
+   returns 0 on success, or -1 (errno valid) */
+int xioepoll_renew(struct xioepoll *ep) {
+   Info1("epoll instance %d has stale registrations, recreating it",
+	 ep->epfd);
+   xioepoll_exit(ep);
+   return xioepoll_init(ep);
+}
+
+/* adds, modifies, and removes epoll registrations so they match the interests
+   in fds[]; unchanged interests cost no system call.
+   returns 0 on success, or -1 with errno set; EPERM means that one of the fds
+   does not support epoll (e.g. a regular file) */
+static int xioepoll_sync(struct xioepoll *ep, struct pollfd fds[], unsigned long nfds) {
+   struct {
+      int fd;
+      uint32_t events;
+   } want[XIOEPOLL_MAXFDS];
+   unsigned int nwant = 0;
+   unsigned int i, j;
+   struct epoll_event ev;
+   int result;
+
+   /* a socket appears twice, once for reading and once for writing */
+   for (i = 0; i < nfds; ++i) {
+      if (fds[i].fd < 0)  { continue; }
+      for (j = 0; j < nwant; ++j) {
+	 if (want[j].fd == fds[i].fd)  { break; }
+      }
+      if (j == nwant) {
+	 if (nwant == XIOEPOLL_MAXFDS)  { errno = EINVAL; return -1; }
+	 want[j].fd = fds[i].fd;  want[j].events = 0;  ++nwant;
+      }
+      if (fds[i].events & POLLIN)   { want[j].events |= EPOLLIN; }
+      if (fds[i].events & POLLOUT)  { want[j].events |= EPOLLOUT; }
+   }
+
+   /* remove what is no longer of interest */
+   for (i = 0; i < ep->nreg; ) {
+      for (j = 0; j < nwant; ++j) {
+	 if (want[j].fd == ep->reg[i].fd)  { break; }
+      }
+      if (j < nwant)  { ++i; continue; }
+      /* fails with EBADF when the fd has already been closed; that's ok */
+      Epoll_ctl(ep->epfd, EPOLL_CTL_DEL, ep->reg[i].fd, NULL);
+      ep->reg[i] = ep->reg[--ep->nreg];
+   }
+
+   for (j = 0; j < nwant; ++j) {
+      for (i = 0; i < ep->nreg; ++i) {
+	 if (ep->reg[i].fd == want[j].fd)  { break; }
+      }
+      if (i < ep->nreg && ep->reg[i].events == want[j].events) {
+	 continue;
+      }
+      ev.events  = want[j].events;
+      ev.data.fd = want[j].fd;
+      if (i < ep->nreg) {
+	 result = Epoll_ctl(ep->epfd, EPOLL_CTL_MOD, want[j].fd, &ev);
+	 if (result < 0 && errno == ENOENT) {
+	    /* fd was closed and its number reused */
+	    result = Epoll_ctl(ep->epfd, EPOLL_CTL_ADD, want[j].fd, &ev);
+	 }
+      } else {
+	 result = Epoll_ctl(ep->epfd, EPOLL_CTL_ADD, want[j].fd, &ev);
+	 if (result < 0 && errno == EEXIST) {
+	    result = Epoll_ctl(ep->epfd, EPOLL_CTL_MOD, want[j].fd, &ev);
+	 }
+      }
+      if (result < 0) {
+	 int _errno = errno;
+	 Info3("epoll_ctl(%d, , %d, ): %s",
+	       ep->epfd, want[j].fd, strerror(errno));
+	 errno = _errno;
+	 return -1;
+      }
+      if (i == ep->nreg)  { ++ep->nreg; }
+      ep->reg[i].fd     = want[j].fd;
+      ep->reg[i].events = want[j].events;
+   }
+   return 0;
+}
+
+/* a replacement of xiopoll() for the transfer engine: same interface and
+   results, but the fds stay registered with the kernel between calls.
+   returns -1 with errno=EPERM when one of the fds cannot be handled with
+   epoll; the caller should then fall back to xiopoll(). Returns -1 with
+   errno=ESTALE when a registration survived the close() of its fd; the
+   caller should then call xioepoll_renew() and try again */
+int xioepoll(struct xioepoll *ep, struct pollfd fds[], unsigned long nfds, struct timeval *timeout) {
+   struct epoll_event events[XIOEPOLL_MAXFDS];
+   unsigned long k;
+   int ms, n, i;
+   int result;
+
+   if (timeout == NULL) {
+      ms = -1;
+   } else {
+      /* round up, otherwise short timeouts would result in a busy loop */
+      ms = 1000*timeout->tv_sec + (timeout->tv_usec+999)/1000;
+   }
+
+   if (xioepoll_sync(ep, fds, nfds) < 0) {
+      return -1;
+   }
+   for (k = 0; k < nfds; ++k) {
+      fds[k].revents = 0;
+   }
+   n = Epoll_wait(ep->epfd, events, XIOEPOLL_MAXFDS, ms);
+   if (n < 0)  { return n; }
+
+   for (i = 0; i < n; ++i) {
+      bool known = false;
+      for (k = 0; k < nfds; ++k) {
+	 if (fds[k].fd < 0 || fds[k].fd != events[i].data.fd)  { continue; }
+	 known = true;
+	 if (events[i].events & EPOLLIN) {
+	    fds[k].revents |= (fds[k].events & POLLIN);
+	 }
+	 if (events[i].events & EPOLLOUT) {
+	    fds[k].revents |= (fds[k].events & POLLOUT);
+	 }
+	 if (events[i].events & EPOLLERR)  { fds[k].revents |= POLLERR; }
+	 if (events[i].events & EPOLLHUP)  { fds[k].revents |= POLLHUP; }
+      }
+      if (!known) {
+	 /* a registration survived a close() because the file was dup()'ed
+	    elsewhere and cannot be removed anymore. Only the owner of the
+	    instance knows where else it is registered */
+	 errno = ESTALE;
+	 return -1;
+      }
+   }
+
+   result = 0;
+   for (k = 0; k < nfds; ++k) {
+      if (fds[k].revents)  { ++result; }
+   }
+   return result;
+}
+#endif /* HAVE_EPOLL_CREATE1 */
+
 #if _WITH_TCP || _WITH_UDP
 /* returns port in network byte order;
    ipproto==IPPROTO_UDP resolves as UDP service, every other value resolves as
@@ -41,7 +41,9 @@ struct xiorange {
 } ;
 #endif /* _WITH_SOCKET */
  
-extern ssize_t writefull(int fd, const void *buff, size_t bytes);
+extern ssize_t writefull(int fd, const void *buff, size_t bytes,
+			 const struct timeval *tmo);
+extern ssize_t writeavail(int fd, const void *buff, size_t bytes);
 
 #if _WITH_SOCKET
 extern socklen_t socket_init(int af, union sockaddr_union *sa);
@@ -84,6 +86,24 @@ extern const char *hstrerror(int err);
 
 extern int xiopoll(struct pollfd fds[], unsigned long nfds, struct timeval *timeout);
 
+#if HAVE_EPOLL_CREATE1
+#define XIOEPOLL_MAXFDS 4	/* the transfer engine polls at most 4 fds */
+/* keeps the file descriptors registered with an epoll instance between calls
+   of xioepoll(), so that unchanged interests cost no system call */
+struct xioepoll {
+   int epfd;
+   unsigned int nreg;		/* number of valid entries in reg[] */
+   struct {
+      int fd;
+      uint32_t events;		/* EPOLLIN, EPOLLOUT */
+   } reg[XIOEPOLL_MAXFDS];
+} ;
+extern int xioepoll_init(struct xioepoll *ep);
+extern int xioepoll(struct xioepoll *ep, struct pollfd fds[], unsigned long nfds, struct timeval *timeout);
+extern void xioepoll_exit(struct xioepoll *ep);
+extern int xioepoll_renew(struct xioepoll *ep);
+#endif /* HAVE_EPOLL_CREATE1 */
+
 extern int parseport(const char *portname, int proto);
 
 extern int ifindexbyname(const char *ifname, int anysock);
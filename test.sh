@@ -12733,6 +12733,1506 @@ PORT=$((PORT+1))
 N=$((N+1))
 
 
+# socat 2.0.0-b10 moves data between plain stream fds with splice() when no
+# conversions are active
+NAME=SPLICE_TCP
+case "$TESTS" in
+*%$N%*|*%functions%*|*%engine%*|*%tcp%*|*%$NAME%*)
+TEST="$NAME: transfer between TCP sockets with splice()"
+# relay data through a TCP echo server and check that it arrives unchanged and
+# that the client has transferred it with splice()
+if ! eval $NUMCOND; then :;
+elif [ "$UNAME" != Linux ]; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}only on Linux$NORMAL\n" $N
+    numCANT=$((numCANT+1))
+else
+tf="$td/test$N.stdout"
+te="$td/test$N.stderr"
+tdiff="$td/test$N.diff"
+da="test$N $(date) $RANDOM"
+CMD0="$TRACE $SOCAT $opts TCP4-LISTEN:$PORT,reuseaddr PIPE"
+CMD1="$TRACE $SOCAT $opts -d -d -d TCP4:$LOCALHOST:$PORT STDIO"
+printf "test $F_n $TEST... " $N
+$CMD0 >/dev/null 2>"${te}0" &
+pid0=$!
+waittcp4port $PORT 1
+echo "$da" |$CMD1 >"${tf}1" 2>"${te}1"
+rc1=$?
+kill $pid0 2>/dev/null; wait
+if [ $rc1 -ne 0 ]; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0 &"
+    echo "$CMD1"
+    cat "${te}0"
+    cat "${te}1"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif ! echo "$da" |diff - "${tf}1" >"$tdiff"; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0 &"
+    echo "$CMD1"
+    cat "$tdiff"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif ! grep -q "transferred .* bytes from .* (splice)" "${te}1"; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD1"
+    echo "no splice() transfer found" >&2
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+else
+    $PRINTF "$OK\n"
+    numOK=$((numOK+1))
+fi
+fi # NUMCOND
+ ;;
+esac
+PORT=$((PORT+1))
+N=$((N+1))
+
+
+# test if socat sends a regular file to a socket with sendfile(), starting at
+# the current offset and stopping after readbytes
+NAME=SENDFILE_READBYTES
+case "$TESTS" in
+*%$N%*|*%functions%*|*%engine%*|*%tcp%*|*%readbytes%*|*%$NAME%*)
+TEST="$NAME: send file to TCP socket with sendfile() and readbytes"
+if ! eval $NUMCOND; then :;
+elif [ "$UNAME" != Linux ]; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}only on Linux$NORMAL\n" $N
+    numCANT=$((numCANT+1))
+else
+ti="$td/test$N.file"
+tf="$td/test$N.stdout"
+te="$td/test$N.stderr"
+tdiff="$td/test$N.diff"
+da="test$N $(date) $RANDOM"
+echo "skip$N" >"$ti"
+echo "$da" >>"$ti"
+echo "this line must not be sent" >>"$ti"
+CMD0="$TRACE $SOCAT $opts -u TCP4-LISTEN:$PORT,reuseaddr STDOUT"
+CMD1="$TRACE $SOCAT $opts -d -d -d -u STDIN,readbytes=$(echo "$da" |wc -c) TCP4:$LOCALHOST:$PORT"
+printf "test $F_n $TEST... " $N
+$CMD0 >"$tf" 2>"${te}0" &
+pid0=$!
+waittcp4port $PORT 1
+{ read x; $CMD1 2>"${te}1"; } <"$ti"
+rc1=$?
+wait $pid0
+if [ $rc1 -ne 0 ]; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0 &"
+    echo "$CMD1"
+    cat "${te}0"
+    cat "${te}1"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif ! echo "$da" |diff - "$tf" >"$tdiff"; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0 &"
+    echo "$CMD1"
+    cat "$tdiff"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif ! grep -q "transferred .* bytes from .* (sendfile)" "${te}1"; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD1"
+    echo "no sendfile() transfer found" >&2
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+else
+    $PRINTF "$OK\n"
+    numOK=$((numOK+1))
+fi
+fi # NUMCOND
+ ;;
+esac
+PORT=$((PORT+1))
+N=$((N+1))
+
+
+# test the io_uring data transfer engine with a bidirectional relay
+NAME=ENGINE_IO_URING
+case "$TESTS" in
+*%$N%*|*%functions%*|*%engine%*|*%tcp%*|*%$NAME%*)
+TEST="$NAME: relay TCP data with the io_uring engine"
+if ! eval $NUMCOND; then :;
+elif [ "$UNAME" != Linux ]; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}only on Linux$NORMAL\n" $N
+    numCANT=$((numCANT+1))
+else
+tf="$td/test$N.stdout"
+te="$td/test$N.stderr"
+tdiff="$td/test$N.diff"
+da="test$N $(date) $RANDOM"
+PORT1=$PORT; PORT=$((PORT+1))
+CMD0="$TRACE $SOCAT $opts TCP4-LISTEN:$PORT1,reuseaddr PIPE"
+CMD1="$TRACE $SOCAT $opts -d -d -d -e io_uring TCP4-LISTEN:$PORT,reuseaddr TCP4:$LOCALHOST:$PORT1"
+CMD2="$TRACE $SOCAT $opts - TCP4:$LOCALHOST:$PORT"
+printf "test $F_n $TEST... " $N
+$CMD0 >/dev/null 2>"${te}0" &
+pid0=$!
+waittcp4port $PORT1 1
+$CMD1 2>"${te}1" &
+pid1=$!
+waittcp4port $PORT 1
+echo "$da" |$CMD2 >"$tf" 2>"${te}2"
+rc2=$?
+kill $pid0 $pid1 2>/dev/null; wait
+if grep -q "using poll" "${te}1"; then
+    $PRINTF "${YELLOW}io_uring not available${NORMAL}\n"
+    numCANT=$((numCANT+1))
+elif [ $rc2 -ne 0 ]; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0 &"
+    echo "$CMD1 &"
+    echo "$CMD2"
+    cat "${te}0" "${te}1" "${te}2"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif ! echo "$da" |diff - "$tf" >"$tdiff"; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0 &"
+    echo "$CMD1 &"
+    echo "$CMD2"
+    cat "$tdiff"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif ! grep -q "starting io_uring data transfer loop" "${te}1"; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD1"
+    echo "io_uring engine not used" >&2
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+else
+    $PRINTF "$OK\n"
+    numOK=$((numOK+1))
+fi
+fi # NUMCOND
+ ;;
+esac
+PORT=$((PORT+1))
+N=$((N+1))
+
+
+NAME=ENGINE_IO_URING_TIMEOUT
+case "$TESTS" in
+*%$N%*|*%functions%*|*%engine%*|*%timeout%*|*%$NAME%*)
+TEST="$NAME: io_uring engine keeps the inactivity timeout across interrupted waits"
+# socat is stopped and continued every 0.4s, which interrupts io_uring_enter();
+# without data the inactivity timeout must still trigger after 2s
+if ! eval $NUMCOND; then :;
+elif [ "$UNAME" != Linux ]; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}only on Linux$NORMAL\n" $N
+    numCANT=$((numCANT+1))
+else
+te="$td/test$N.stderr"
+CMD="$TRACE $SOCAT $opts -d -d -d -u -e io_uring -T 2 - /dev/null"
+printf "test $F_n $TEST... " $N
+sleep 8 |$CMD 2>"$te" &
+pid=$!
+for i in 1 2 3 4 5 6 7 8 9 10; do
+    sleep 0.4
+    kill -STOP $pid 2>/dev/null; kill -CONT $pid 2>/dev/null
+done
+if kill -0 $pid 2>/dev/null; then running=1; else running=; fi
+wait
+if grep -q "using poll" "$te"; then
+    $PRINTF "${YELLOW}io_uring not available${NORMAL}\n"
+    numCANT=$((numCANT+1))
+elif [ "$running" ] || ! grep -q "inactivity timeout triggered" "$te"; then
+    $PRINTF "$FAILED\n"
+    echo "sleep 8 |$CMD"
+    cat "$te" >&2
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+else
+    $PRINTF "$OK\n"
+    numOK=$((numOK+1))
+fi
+fi # NUMCOND
+ ;;
+esac
+N=$((N+1))
+
+
+# test option multiplex: several concurrent clients are served by one process
+NAME=MULTIPLEX_TCP4
+case "$TESTS" in
+*%$N%*|*%functions%*|*%tcp%*|*%tcp4%*|*%listen%*|*%$NAME%*)
+TEST="$NAME: relay concurrent TCP connections in one process"
+if ! eval $NUMCOND; then :;
+elif [ "$UNAME" != Linux ]; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}only on Linux$NORMAL\n" $N
+    numCANT=$((numCANT+1))
+elif ! testoptions multiplex >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}multiplex not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+else
+tf="$td/test$N.stdout"
+te="$td/test$N.stderr"
+tdiff="$td/test$N.diff"
+da="test$N $(date) $RANDOM"
+PORT1=$PORT; PORT=$((PORT+1))
+CMD0="$TRACE $SOCAT $opts TCP4-LISTEN:$PORT1,reuseaddr,fork PIPE"
+CMD1="$TRACE $SOCAT $opts -d -d TCP4-LISTEN:$PORT,reuseaddr,multiplex TCP4:$LOCALHOST:$PORT1"
+CMD2="$TRACE $SOCAT $opts - TCP4:$LOCALHOST:$PORT"
+printf "test $F_n $TEST... " $N
+$CMD0 >/dev/null 2>"${te}0" &
+pid0=$!
+waittcp4port $PORT1 1
+$CMD1 2>"${te}1" &
+pid1=$!
+waittcp4port $PORT 1
+# the first client keeps its connection open while the others are served
+(echo "$da 1"; sleep 2) |$CMD2 >"${tf}1" 2>"${te}2" &
+pid2=$!
+usleep 500000
+echo "$da 2" |$CMD2 >"${tf}2" 2>"${te}3"
+rc3=$?
+echo "$da 3" |$CMD2 >"${tf}3" 2>"${te}4"
+rc4=$?
+wait $pid2
+rc2=$?
+kill $pid0 $pid1 2>/dev/null; wait
+if [ $rc2 -ne 0 -o $rc3 -ne 0 -o $rc4 -ne 0 ]; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0 &"
+    echo "$CMD1 &"
+    echo "$CMD2"
+    cat "${te}0" "${te}1" "${te}2" "${te}3" "${te}4"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif ! (echo "$da 1"; echo "$da 2"; echo "$da 3") |diff - <(cat "${tf}1" "${tf}2" "${tf}3") >"$tdiff"; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0 &"
+    echo "$CMD1 &"
+    echo "$CMD2"
+    cat "$tdiff"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif grep -q "forked off child process" "${te}1"; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD1"
+    echo "connections were not multiplexed" >&2
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+else
+    $PRINTF "$OK\n"
+    numOK=$((numOK+1))
+fi
+fi # NUMCOND
+ ;;
+esac
+PORT=$((PORT+1))
+N=$((N+1))
+
+
+# test option thread: several concurrent clients are served by threads of one
+# process
+NAME=THREAD_TCP4
+case "$TESTS" in
+*%$N%*|*%functions%*|*%tcp%*|*%tcp4%*|*%listen%*|*%$NAME%*)
+TEST="$NAME: relay concurrent TCP connections in threads"
+if ! eval $NUMCOND; then :;
+elif ! testoptions thread >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}thread not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+else
+tf="$td/test$N.stdout"
+te="$td/test$N.stderr"
+tdiff="$td/test$N.diff"
+da="test$N $(date) $RANDOM"
+PORT1=$PORT; PORT=$((PORT+1))
+CMD0="$TRACE $SOCAT $opts TCP4-LISTEN:$PORT1,reuseaddr,fork PIPE"
+CMD1="$TRACE $SOCAT $opts -d -d TCP4-LISTEN:$PORT,reuseaddr,thread TCP4:$LOCALHOST:$PORT1"
+CMD2="$TRACE $SOCAT $opts - TCP4:$LOCALHOST:$PORT"
+printf "test $F_n $TEST... " $N
+$CMD0 >/dev/null 2>"${te}0" &
+pid0=$!
+waittcp4port $PORT1 1
+$CMD1 2>"${te}1" &
+pid1=$!
+waittcp4port $PORT 1
+# the first client keeps its connection open while the others are served
+(echo "$da 1"; sleep 2) |$CMD2 >"${tf}1" 2>"${te}2" &
+pid2=$!
+usleep 500000
+echo "$da 2" |$CMD2 >"${tf}2" 2>"${te}3"
+rc3=$?
+echo "$da 3" |$CMD2 >"${tf}3" 2>"${te}4"
+rc4=$?
+wait $pid2
+rc2=$?
+kill $pid0 $pid1 2>/dev/null; wait
+if [ $rc2 -ne 0 -o $rc3 -ne 0 -o $rc4 -ne 0 ]; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0 &"
+    echo "$CMD1 &"
+    echo "$CMD2"
+    cat "${te}0" "${te}1" "${te}2" "${te}3" "${te}4"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif ! (echo "$da 1"; echo "$da 2"; echo "$da 3") |diff - <(cat "${tf}1" "${tf}2" "${tf}3") >"$tdiff"; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0 &"
+    echo "$CMD1 &"
+    echo "$CMD2"
+    cat "$tdiff"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif grep -q "forked off child process" "${te}1"; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD1"
+    echo "connections were not handled by threads" >&2
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+else
+    $PRINTF "$OK\n"
+    numOK=$((numOK+1))
+fi
+fi # NUMCOND
+ ;;
+esac
+PORT=$((PORT+1))
+N=$((N+1))
+
+
+# test option prefork: worker processes serve the connections, and a
+# terminated worker is replaced
+NAME=PREFORK_TCP4
+case "$TESTS" in
+*%$N%*|*%functions%*|*%tcp%*|*%tcp4%*|*%listen%*|*%fork%*|*%$NAME%*)
+TEST="$NAME: TCP connections served by preforked workers"
+if ! eval $NUMCOND; then :;
+elif [ "$UNAME" != Linux ]; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}only on Linux$NORMAL\n" $N
+    numCANT=$((numCANT+1))
+elif ! testoptions prefork >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}prefork not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+else
+tf="$td/test$N.stdout"
+te="$td/test$N.stderr"
+tdiff="$td/test$N.diff"
+da="test$N $(date) $RANDOM"
+CMD1="$TRACE $SOCAT $opts -d -d TCP4-LISTEN:$PORT,reuseaddr,prefork=2 PIPE"
+CMD2="$TRACE $SOCAT $opts - TCP4:$LOCALHOST:$PORT"
+printf "test $F_n $TEST... " $N
+$CMD1 2>"${te}1" &
+pid1=$!
+waittcp4port $PORT 1
+echo "$da 1" |$CMD2 >"${tf}" 2>"${te}2"
+rc2=$?
+# a worker that terminates is replaced by the master process
+kill $(childprocess $pid1 |head -n 1 |awk '{ print $2; }') 2>/dev/null
+usleep 500000
+echo "$da 2" |$CMD2 >>"${tf}" 2>"${te}3"
+rc3=$?
+echo "$da 3" |$CMD2 >>"${tf}" 2>"${te}4"
+rc4=$?
+nworkers=$(childprocess $pid1 |wc -l)
+kill $pid1 2>/dev/null; wait
+if [ $rc2 -ne 0 -o $rc3 -ne 0 -o $rc4 -ne 0 ]; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD1 &"
+    echo "$CMD2"
+    cat "${te}1" "${te}2" "${te}3" "${te}4"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif ! (echo "$da 1"; echo "$da 2"; echo "$da 3") |diff - "$tf" >"$tdiff"; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD1 &"
+    echo "$CMD2"
+    cat "$tdiff"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif [ "$nworkers" -ne 2 ]; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD1 &"
+    echo "$nworkers instead of 2 worker processes" >&2
+    cat "${te}1"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+else
+    $PRINTF "$OK\n"
+    numOK=$((numOK+1))
+fi
+fi # NUMCOND
+ ;;
+esac
+PORT=$((PORT+1))
+N=$((N+1))
+
+
+# up to 2.0.0-b9 socat slept one second whenever a nonblocking output fd did
+# not take all data (EAGAIN); now the rest is kept and written when the fd
+# becomes writeable again
+NAME=NONBLOCK_WRITEQUEUE
+case "$TESTS" in
+*%$N%*|*%functions%*|*%engine%*|*%$NAME%*)
+TEST="$NAME: full nonblocking output does not stall the transfer"
+# socat writes large blocks to a nonblocking pipe whose reader starts late.
+# the escape option keeps the data in user space. check that all data arrives
+# and that the transfer does not take much longer than the readers delay
+if ! eval $NUMCOND; then :; else
+tf="$td/test$N.stdout"
+te="$td/test$N.stderr"
+CMD0="$TRACE $SOCAT $opts -b 200000 -u OPEN:/dev/zero,readbytes=4000000,escape=0x1d STDOUT,nonblock"
+printf "test $F_n $TEST... " $N
+t0=$(date +%s)
+$CMD0 2>"${te}0" |(sleep 1; wc -c) >"$tf"
+t1=$(date +%s)
+if [ "$(cat "$tf" |tr -d ' ')" != 4000000 ]; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0 |(sleep 1; wc -c)"
+    cat "${te}0"
+    cat "$tf"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif [ $((t1-t0)) -ge 3 ]; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0 |(sleep 1; wc -c)"
+    echo "transfer took $((t1-t0)) seconds" >&2
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+else
+    $PRINTF "$OK\n"
+    numOK=$((numOK+1))
+fi
+fi # NUMCOND
+ ;;
+esac
+N=$((N+1))
+
+
+# inter addresses like TEST and NOP are stacked in-process: the engine calls
+# their data methods directly, without a socketpair and a thread per address
+NAME=CHAIN_INPROCESS
+case "$TESTS" in
+*%$N%*|*%functions%*|*%chain%*|*%$NAME%*)
+TEST="$NAME: chain of test and nop addresses without threads"
+# send data through test|nop|test|pipe and check that it arrives with the
+# marks of both test addresses, and that no thread has been started
+if ! eval $NUMCOND; then :; else
+tf="$td/test$N.stdout"
+te="$td/test$N.stderr"
+tdiff="$td/test$N.diff"
+da="test$N $(date) $RANDOM"
+CMD0="$TRACE $SOCAT $opts -d -d -d STDIO test|nop|test|pipe"
+printf "test $F_n $TEST... " $N
+echo "$da" |$CMD0 >"$tf" 2>"$te"
+rc0=$?
+if [ $rc0 -ne 0 ]; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0"
+    cat "$te"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif ! echo -e "$da\n>><<\c" |diff - "$tf" >"$tdiff"; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0"
+    cat "$tdiff"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif grep -q "starting thread" "$te" ||
+     [ "$(grep -c "stacking address" "$te")" -ne 3 ]; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0"
+    echo "addresses were not stacked in-process" >&2
+    cat "$te"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+else
+    $PRINTF "$OK\n"
+    numOK=$((numOK+1))
+fi
+fi # NUMCOND
+ ;;
+esac
+N=$((N+1))
+
+
+# with option -cr the threads of reverse inter addresses are connected by
+# shared memory rings instead of socketpairs
+NAME=CHAIN_SHMRINGS
+case "$TESTS" in
+*%$N%*|*%functions%*|*%chain%*|*%$NAME%*)
+TEST="$NAME: chain of reverse nop addresses over shared memory rings"
+# send data through ^nop|^nop|pipe with option -cr and check that it arrives
+# unmodified, and that the links between the threads are rings
+if ! eval $NUMCOND; then :; else
+tf="$td/test$N.stdout"
+te="$td/test$N.stderr"
+tdiff="$td/test$N.diff"
+da="test$N $(date) $RANDOM"
+CMD0="$TRACE $SOCAT $opts -d -d -d -cr STDIO ^nop|^nop|pipe"
+printf "test $F_n $TEST... " $N
+echo "$da" |$CMD0 >"$tf" 2>"$te"
+rc0=$?
+if [ $rc0 -ne 0 ]; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0"
+    cat "$te"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif ! echo "$da" |diff - "$tf" >"$tdiff"; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0"
+    cat "$tdiff"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif [ "$(grep -c "created ring" "$te")" -ne 4 ]; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0"
+    echo "threads were not connected by rings" >&2
+    cat "$te"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+else
+    $PRINTF "$OK\n"
+    numOK=$((numOK+1))
+fi
+fi # NUMCOND
+ ;;
+esac
+N=$((N+1))
+
+
+# with option batch a relay of datagrams receives with recvmmsg() and sends
+# with sendmmsg(); the packets must arrive complete and in order
+NAME=UDP4_BATCH
+case "$TESTS" in
+*%$N%*|*%functions%*|*%ip4%*|*%ipapp%*|*%udp%*|*%$NAME%*)
+TEST="$NAME: relay UDP packets in recvmmsg()/sendmmsg() batches"
+if ! eval $NUMCOND; then :;
+elif [ "$UNAME" != Linux ]; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}only on Linux$NORMAL\n" $N
+    numCANT=$((numCANT+1))
+else
+tf="$td/test$N.stdout"
+te="$td/test$N.stderr"
+tdiff="$td/test$N.diff"
+ts1p=$PORT; PORT=$((PORT+1))
+ts2p=$PORT
+da="test$N $(date) $RANDOM"
+CMD0="$TRACE $SOCAT $opts -u UDP4-RECV:$ts2p,reuseaddr -"
+CMD1="$TRACE $SOCAT $opts -d -d -d -u UDP4-RECV:$ts1p,reuseaddr,batch=8 UDP4-SENDTO:$LOCALHOST:$ts2p,batch=8"
+CMD2="$TRACE $SOCAT $opts -b 4 -u - UDP4-SENDTO:$LOCALHOST:$ts1p"
+printf "test $F_n $TEST... " $N
+$CMD0 >"$tf" 2>"${te}0" &
+pid0=$!
+waitudp4port $ts2p 1
+$CMD1 2>"${te}1" &
+pid1=$!
+waitudp4port $ts1p 1
+echo "$da" |$CMD2 2>"${te}2"
+rc2=$?
+sleep 1
+kill $pid0 $pid1 2>/dev/null; wait
+if [ $rc2 -ne 0 ]; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0 &"
+    echo "$CMD1 &"
+    echo "$CMD2"
+    cat "${te}0" "${te}1" "${te}2"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif ! echo "$da" |diff - "$tf" >"$tdiff"; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0 &"
+    echo "$CMD1 &"
+    echo "$CMD2"
+    cat "${te}1" "$tdiff"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif ! grep -q "per sendmmsg()" "${te}1"; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD1 &"
+    echo "packets were not sent in batches" >&2
+    cat "${te}1"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+else
+    $PRINTF "$OK\n"
+    numOK=$((numOK+1))
+fi
+fi # NUMCOND
+ ;;
+esac
+PORT=$((PORT+1))
+N=$((N+1))
+
+
+# with option udp-gro the relay receives datagrams coalesced by the sender's
+# GSO (udp-segment) and must send them on as individual packets
+NAME=UDP4_GRO
+case "$TESTS" in
+*%$N%*|*%functions%*|*%ip4%*|*%ipapp%*|*%udp%*|*%$NAME%*)
+TEST="$NAME: relay UDP GSO segments received with udp-gro"
+if ! eval $NUMCOND; then :;
+elif [ "$UNAME" != Linux ]; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}only on Linux$NORMAL\n" $N
+    numCANT=$((numCANT+1))
+elif ! $SOCAT -hhh |grep -q "[[:space:]]udp-gro[[:space:]]"; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}option udp-gro not available$NORMAL\n" $N
+    numCANT=$((numCANT+1))
+else
+tf="$td/test$N.stdout"
+te="$td/test$N.stderr"
+tdiff="$td/test$N.diff"
+tdata="$td/test$N.data"
+ts1p=$PORT; PORT=$((PORT+1))
+ts2p=$PORT
+# four segments of 1000 bytes each, sent with one write
+awk 'BEGIN { for (i = 0; i < 4; ++i) { s = sprintf("%d", i); while (length(s) < 999) s = s "x"; print s } }' >"$tdata"
+CMD0="$TRACE $SOCAT $opts -d -d -u UDP4-RECV:$ts2p,reuseaddr -"
+CMD1="$TRACE $SOCAT $opts -d -d -d -u UDP4-RECV:$ts1p,reuseaddr,udp-gro UDP4-SENDTO:$LOCALHOST:$ts2p"
+CMD2="$TRACE $SOCAT $opts -b 4000 -u OPEN:$tdata UDP4-SENDTO:$LOCALHOST:$ts1p,udp-segment=1000"
+printf "test $F_n $TEST... " $N
+$CMD0 >"$tf" 2>"${te}0" &
+pid0=$!
+waitudp4port $ts2p 1
+$CMD1 2>"${te}1" &
+pid1=$!
+waitudp4port $ts1p 1
+$CMD2 2>"${te}2"
+rc2=$?
+sleep 1
+kill $pid0 $pid1 2>/dev/null; wait
+if grep -q "udp-gro: .*ignored\|udp-segment: .*ignored" "${te}1" "${te}2"; then
+    $PRINTF "${YELLOW}not supported by kernel$NORMAL\n"
+    numCANT=$((numCANT+1))
+elif [ $rc2 -ne 0 ]; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0 &"
+    echo "$CMD1 &"
+    echo "$CMD2"
+    cat "${te}0" "${te}1" "${te}2"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif ! diff "$tdata" "$tf" >"$tdiff"; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0 &"
+    echo "$CMD1 &"
+    echo "$CMD2"
+    cat "${te}1" "$tdiff"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif ! grep -q "received 4000 bytes in segments of 1000 bytes" "${te}1" ||
+     [ "$(grep -c "received packet with 1000 bytes" "${te}0")" -ne 4 ]; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0 &"
+    echo "$CMD1 &"
+    echo "segments were not coalesced and passed on as packets" >&2
+    cat "${te}0" "${te}1"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+else
+    $PRINTF "$OK\n"
+    numOK=$((numOK+1))
+fi
+fi # NUMCOND
+ ;;
+esac
+PORT=$((PORT+1))
+N=$((N+1))
+
+
+# test option multiplex with UDP-LISTEN: the packets of several concurrent
+# peers are told apart by their addresses in one process
+NAME=UDP4_MULTIPLEX
+case "$TESTS" in
+*%$N%*|*%functions%*|*%ip4%*|*%ipapp%*|*%udp%*|*%listen%*|*%$NAME%*)
+TEST="$NAME: relay concurrent UDP peers in one process"
+if ! eval $NUMCOND; then :;
+elif [ "$UNAME" != Linux ]; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}only on Linux$NORMAL\n" $N
+    numCANT=$((numCANT+1))
+elif ! testoptions multiplex >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}multiplex not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+else
+tf="$td/test$N.stdout"
+te="$td/test$N.stderr"
+tdiff="$td/test$N.diff"
+da="test$N $(date) $RANDOM"
+tsl=$PORT
+CMD1="$TRACE $SOCAT $opts -d -d -T 2 UDP4-LISTEN:$tsl,reuseaddr,multiplex PIPE"
+CMD2="$TRACE $SOCAT $opts -t 1 - UDP4:$LOCALHOST:$tsl"
+printf "test $F_n $TEST... " $N
+$CMD1 2>"${te}1" &
+pid1=$!
+waitudp4port $tsl 1
+# the first peer is still active while the second one is served
+(echo "$da 1"; sleep 1; echo "$da 1") |$CMD2 >"${tf}1" 2>"${te}2" &
+pid2=$!
+usleep 500000
+echo "$da 2" |$CMD2 >"${tf}2" 2>"${te}3"
+rc3=$?
+wait $pid2
+rc2=$?
+kill $pid1 2>/dev/null; wait
+if [ $rc2 -ne 0 -o $rc3 -ne 0 ]; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD1 &"
+    echo "$CMD2"
+    cat "${te}1" "${te}2" "${te}3"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif ! (echo "$da 1"; echo "$da 1"; echo "$da 2") |diff - <(cat "${tf}1" "${tf}2") >"$tdiff"; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD1 &"
+    echo "$CMD2"
+    cat "${te}1" "$tdiff"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif grep -q "forked off child process" "${te}1" ||
+     [ "$(grep -c "starting data transfer loop" "${te}1")" -ne 2 ]; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD1"
+    echo "peers were not multiplexed" >&2
+    cat "${te}1"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+else
+    $PRINTF "$OK\n"
+    numOK=$((numOK+1))
+fi
+fi # NUMCOND
+ ;;
+esac
+PORT=$((PORT+1))
+N=$((N+1))
+
+
+NAME=TCP4_ACL
+case "$TESTS" in
+*%$N%*|*%functions%*|*%security%*|*%tcp%*|*%tcp4%*|*%ip4%*|*%range%*|*%$NAME%*)
+TEST="$NAME: security of TCP4-L with ACL option"
+if ! eval $NUMCOND; then :;
+elif ! testoptions acl >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}acl not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+else
+# the more specific deny entry must win over the allow entry
+ta="$td/test$N.acl"
+echo "# test $N
+allow 127.0.0.0/8
+allow ::1/128
+deny  $SECONDADDR/32" >"$ta"
+testserversec "$N" "$TEST" "$opts -s" "tcp4-l:$PORT,reuseaddr,fork,retry=1" "" "acl=$ta" "tcp4:$SECONDADDR:$PORT,bind=$SECONDADDR" 4 tcp $PORT 0
+fi ;; # NUMCOND, acl
+esac
+PORT=$((PORT+1))
+N=$((N+1))
+
+
+NAME=TCP4_ACL_RELOAD
+case "$TESTS" in
+*%$N%*|*%functions%*|*%security%*|*%tcp%*|*%tcp4%*|*%ip4%*|*%range%*|*%signal%*|*%$NAME%*)
+TEST="$NAME: SIGHUP reloads ACL file of running listener"
+if ! eval $NUMCOND; then :;
+elif ! testoptions acl >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}acl not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+else
+tf="$td/test$N.stdout"
+te="$td/test$N.stderr"
+ta="$td/test$N.acl"
+da="test$N $(date) $RANDOM"
+tsl=$PORT
+echo "allow 127.0.0.0/8" >"$ta"
+CMD1="$TRACE $SOCAT $opts -d -d TCP4-LISTEN:$tsl,reuseaddr,fork,acl=$ta PIPE"
+CMD2="$TRACE $SOCAT $opts - TCP4:$LOCALHOST:$tsl"
+printf "test $F_n $TEST... " $N
+$CMD1 2>"${te}1" &
+pid1=$!
+waittcp4port $tsl 1
+echo "$da 1" |$CMD2 >"${tf}1" 2>"${te}2"
+rc2=$?
+echo "deny 127.0.0.0/8" >"$ta"
+kill -HUP $pid1 2>/dev/null
+usleep 200000
+echo "$da 2" |$CMD2 >"${tf}2" 2>"${te}3"
+kill -0 $pid1 2>/dev/null
+alive=$?
+kill $pid1 2>/dev/null; wait
+if [ $rc2 -ne 0 ] || ! echo "$da 1" |diff - "${tf}1" >/dev/null; then
+    $PRINTF "$NO_RESULT\n"
+    echo "$CMD1 &"
+    echo "$CMD2"
+    cat "${te}1" "${te}2"
+    numCANT=$((numCANT+1))
+elif [ $alive -ne 0 ]; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD1 &"
+    echo "listener did not survive SIGHUP" >&2
+    cat "${te}1"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif [ -s "${tf}2" ] || ! grep -q "reloaded 1 entries" "${te}1"; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD1 &"
+    echo "$CMD2"
+    cat "${te}1" "${te}3"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+else
+    $PRINTF "$OK\n"
+    numOK=$((numOK+1))
+fi
+fi # NUMCOND, acl
+ ;;
+esac
+PORT=$((PORT+1))
+N=$((N+1))
+
+
+NAME=TCPWRAPPERS_CACHE
+case "$TESTS" in
+*%$N%*|*%functions%*|*%tcp%*|*%tcp4%*|*%ip4%*|*%tcpwrap%*|*%$NAME%*)
+TEST="$NAME: tcpwrapper decisions cached until table changes"
+if ! eval $NUMCOND; then :;
+elif ! feat=$(testaddrs tcp ip4 libwrap) || ! runsip4 >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}$feat not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+else
+tf="$td/test$N.stdout"
+te="$td/test$N.stderr"
+da="test$N $(date) $RANDOM"
+ha="$td/test$N.hosts.allow"
+hd="$td/test$N.hosts.deny"
+$ECHO "test : ALL : allow" >"$ha"
+$ECHO "test : ALL : deny" >"$hd"
+CMD1="$TRACE $SOCAT $opts -d -d -d -d TCP4-LISTEN:$PORT,reuseaddr,fork,hosts-allow=$ha,hosts-deny=$hd,tcpwrap=test,tcpwrap-cache=16 pipe"
+CMD2="$TRACE $SOCAT $opts - TCP:$LOCALHOST:$PORT"
+printf "test $F_n $TEST... " $N
+$CMD1 2>"${te}0" &
+pid0=$!
+waittcp4port $PORT
+echo "$da 1" |$CMD2 >"${tf}1" 2>"${te}1"
+echo "$da 2" |$CMD2 >"${tf}2" 2>"${te}2"
+# a new mtime and size must drop the cached permission
+$ECHO "test : 255.255.255.255 : allow" >"$ha"
+echo "$da 3" |$CMD2 >"${tf}3" 2>"${te}3"
+kill $pid0 2>/dev/null; wait
+if ! echo "$da 1" |diff - "${tf}1" >/dev/null ||
+   ! echo "$da 2" |diff - "${tf}2" >/dev/null; then
+   $PRINTF "$FAILED: $TRACE $SOCAT:\n"
+   echo "$CMD1 &"
+   echo "$CMD2"
+   cat "${te}0" "${te}1" "${te}2"
+   numFAIL=$((numFAIL+1))
+   listFAIL="$listFAIL $N"
+elif ! grep -q "using cached decision" "${te}0"; then
+   $PRINTF "$FAILED (decision was not cached)\n"
+   echo "$CMD1 &"
+   cat "${te}0"
+   numFAIL=$((numFAIL+1))
+   listFAIL="$listFAIL $N"
+elif [ -s "${tf}3" ]; then
+   $PRINTF "$FAILED (cache not dropped after table change)\n"
+   echo "$CMD1 &"
+   cat "${te}0"
+   numFAIL=$((numFAIL+1))
+   listFAIL="$listFAIL $N"
+else
+   $PRINTF "$OK\n"
+   if [ -n "$debug" ]; then cat "${te}0"; fi
+   numOK=$((numOK+1))
+fi
+fi ;; # NUMCOND, feats
+esac
+PORT=$((PORT+1))
+N=$((N+1))
+
+
+NAME=OPENSSL_SESSION_CACHE
+case "$TESTS" in
+*%$N%*|*%functions%*|*%openssl%*|*%tcp%*|*%tcp4%*|*%ip4%*|*%fork%*|*%$NAME%*)
+TEST="$NAME: forked OpenSSL servers share session cache"
+if ! eval $NUMCOND; then :;
+elif ! testaddrs openssl >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}OPENSSL not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+elif ! type openssl >/dev/null 2>&1; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}openssl executable not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+elif ! testaddrs listen tcp ip4 >/dev/null || ! runsip4 >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}TCP/IPv4 not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+elif ! testoptions openssl-session-cache >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}option session-cache not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+else
+gentestcert testsrv
+tf="$td/test$N.stdout"
+te="$td/test$N.stderr"
+ts="$td/test$N.session"
+# without tickets the second child can only find the session in the cache
+CMD1="$TRACE $SOCAT $opts -d -d OPENSSL-LISTEN:$PORT,pf=ip4,reuseaddr,fork,$SOCAT_EGD,cert=testsrv.crt,key=testsrv.key,verify=0,session-cache=16 pipe"
+CMD2="openssl s_client -connect $LOCALHOST:$PORT -tls1_2 -no_ticket"
+printf "test $F_n $TEST... " $N
+$CMD1 2>"${te}1" &
+pid1=$!
+waittcp4port $PORT
+$CMD2 -sess_out "$ts" </dev/null >"${tf}2" 2>"${te}2"
+$CMD2 -sess_in "$ts" </dev/null >"${tf}3" 2>"${te}3"
+kill $pid1 2>/dev/null; wait
+if ! grep -q "^New," "${tf}2"; then
+    $PRINTF "$NO_RESULT\n"
+    echo "$CMD1 &"
+    echo "$CMD2 -sess_out $ts"
+    cat "${te}1" "${te}2"
+    numCANT=$((numCANT+1))
+elif ! grep -q "^Reused," "${tf}3" ||
+     ! grep -q "resumed a previous session" "${te}1"; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD1 &"
+    echo "$CMD2 -sess_in $ts"
+    cat "${te}1" "${tf}3"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+else
+    $PRINTF "$OK\n"
+    if [ -n "$debug" ]; then cat "${te}1"; fi
+    numOK=$((numOK+1))
+fi
+fi ;; # NUMCOND, feats
+esac
+PORT=$((PORT+1))
+N=$((N+1))
+
+
+NAME=OPENSSL_SESSION_STORE
+case "$TESTS" in
+*%$N%*|*%functions%*|*%openssl%*|*%tcp%*|*%tcp4%*|*%ip4%*|*%$NAME%*)
+TEST="$NAME: OpenSSL client resumes stored session"
+if ! eval $NUMCOND; then :;
+elif ! testaddrs openssl >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}OPENSSL not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+elif ! testaddrs listen tcp ip4 >/dev/null || ! runsip4 >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}TCP/IPv4 not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+elif ! testoptions openssl-session-store >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}option session-store not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+else
+gentestcert testsrv
+tf="$td/test$N.stdout"
+te="$td/test$N.stderr"
+ts="$td/test$N.session"
+da="test$N $(date) $RANDOM"
+CMD1="$TRACE $SOCAT $opts OPENSSL-LISTEN:$PORT,pf=ip4,reuseaddr,fork,$SOCAT_EGD,cert=testsrv.crt,key=testsrv.key,verify=0 pipe"
+# each client is a new process, only the file carries the session
+CMD2="$TRACE $SOCAT $opts -d -d -d - OPENSSL:$LOCALHOST:$PORT,pf=ip4,verify=0,$SOCAT_EGD,session-store=$ts"
+printf "test $F_n $TEST... " $N
+$CMD1 2>"${te}1" &
+pid1=$!
+waittcp4port $PORT
+echo "$da 2" |$CMD2 >"${tf}2" 2>"${te}2"
+echo "$da 3" |$CMD2 >"${tf}3" 2>"${te}3"
+kill $pid1 2>/dev/null; wait
+if ! echo "$da 2" |diff - "${tf}2" >/dev/null ||
+   ! echo "$da 3" |diff - "${tf}3" >/dev/null; then
+    $PRINTF "$FAILED: $TRACE $SOCAT:\n"
+    echo "$CMD1 &"
+    echo "$CMD2"
+    cat "${te}1" "${te}2" "${te}3"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif ! grep -q "server resumed the TLS session" "${te}3"; then
+    $PRINTF "$FAILED (session not resumed)\n"
+    echo "$CMD2"
+    cat "${te}2" "${te}3"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+else
+    $PRINTF "$OK\n"
+    if [ -n "$debug" ]; then cat "${te}3"; fi
+    numOK=$((numOK+1))
+fi
+fi ;; # NUMCOND, feats
+esac
+PORT=$((PORT+1))
+N=$((N+1))
+
+
+NAME=OPENSSL_KTLS
+case "$TESTS" in
+*%$N%*|*%functions%*|*%openssl%*|*%tcp%*|*%tcp4%*|*%ip4%*|*%$NAME%*)
+TEST="$NAME: OpenSSL with kernel TLS or fallback"
+if ! eval $NUMCOND; then :;
+elif ! testaddrs openssl >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}OPENSSL not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+elif ! testaddrs listen tcp ip4 >/dev/null || ! runsip4 >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}TCP/IPv4 not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+elif ! testoptions openssl-ktls >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}option ktls not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+else
+gentestcert testsrv
+tf="$td/test$N.stdout"
+te="$td/test$N.stderr"
+tdiff="$td/test$N.diff"
+da="test$N $(date) $RANDOM"
+CMD1="$TRACE $SOCAT $opts -d -d OPENSSL-LISTEN:$PORT,pf=ip4,reuseaddr,$SOCAT_EGD,cert=testsrv.crt,key=testsrv.key,verify=0,ktls pipe"
+CMD2="$TRACE $SOCAT $opts -d -d - OPENSSL:$LOCALHOST:$PORT,pf=ip4,verify=0,$SOCAT_EGD,ktls"
+printf "test $F_n $TEST... " $N
+$CMD1 2>"${te}1" &
+pid1=$!
+waittcp4port $PORT
+echo "$da" |$CMD2 >"$tf" 2>"${te}2"
+kill $pid1 2>/dev/null; wait
+# whether the kernel takes the keys depends on the system; data must pass
+if ! echo "$da" |diff - "$tf" >"$tdiff"; then
+    $PRINTF "$FAILED: $TRACE $SOCAT:\n"
+    echo "$CMD1 &"
+    echo "$CMD2"
+    cat "${te}1" "${te}2" "$tdiff"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif grep -q "OpenSSL version does not support kernel TLS" "${te}2"; then
+    $PRINTF "${YELLOW}kernel TLS not supported by OpenSSL${NORMAL}\n"
+    numCANT=$((numCANT+1))
+else
+    $PRINTF "$OK\n"
+    if [ -n "$debug" ]; then cat "${te}1" "${te}2"; fi
+    numOK=$((numOK+1))
+fi
+fi ;; # NUMCOND, feats
+esac
+PORT=$((PORT+1))
+N=$((N+1))
+
+
+NAME=OPENSSL_NONBLOCK
+case "$TESTS" in
+*%$N%*|*%functions%*|*%openssl%*|*%tcp%*|*%tcp4%*|*%ip4%*|*%$NAME%*)
+TEST="$NAME: OpenSSL client with option nonblock"
+# the server starts reading late, so the client's SSL_write() on the full
+# nonblocking socket cannot complete and must be repeated
+if ! eval $NUMCOND; then :;
+elif ! testaddrs openssl >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}OPENSSL not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+elif ! testaddrs listen tcp ip4 >/dev/null || ! runsip4 >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}TCP/IPv4 not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+else
+gentestcert testsrv
+tf="$td/test$N.stdout"
+te="$td/test$N.stderr"
+ti="$td/test$N.input"
+dd if=/dev/urandom of="$ti" bs=1024 count=32768 2>/dev/null
+CMD1="$TRACE $SOCAT $opts -u OPENSSL-LISTEN:$PORT,pf=ip4,reuseaddr,$SOCAT_EGD,cert=testsrv.crt,key=testsrv.key,verify=0 SYSTEM:\"sleep 1; cat >$tf\""
+CMD2="$TRACE $SOCAT $opts -u - OPENSSL:$LOCALHOST:$PORT,pf=ip4,verify=0,$SOCAT_EGD,nonblock"
+printf "test $F_n $TEST... " $N
+eval "$CMD1 2>\"${te}1\" &"
+pid1=$!
+waittcp4port $PORT
+$CMD2 <"$ti" 2>"${te}2"
+rc2=$?
+wait $pid1
+if [ "$rc2" -ne 0 ] || ! cmp -s "$ti" "$tf"; then
+    $PRINTF "$FAILED: $TRACE $SOCAT:\n"
+    echo "$CMD1 &"
+    echo "$CMD2"
+    cat "${te}1" "${te}2"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+else
+    $PRINTF "$OK\n"
+    if [ -n "$debug" ]; then cat "${te}1" "${te}2"; fi
+    numOK=$((numOK+1))
+fi
+rm -f "$ti" "$tf"
+fi ;; # NUMCOND, feats
+esac
+PORT=$((PORT+1))
+N=$((N+1))
+
+
+NAME=OPENSSL_NONBLOCK_CLOSE
+case "$TESTS" in
+*%$N%*|*%functions%*|*%openssl%*|*%tcp%*|*%tcp4%*|*%ip4%*|*%timeout%*|*%$NAME%*)
+TEST="$NAME: OpenSSL write queue is given up after the closing timeout"
+# the server never reads, so the client's queued SSL_write() cannot complete
+# with the small socket buffers; after the inactivity timeout the client must
+# not wait longer than -t
+if ! eval $NUMCOND; then :;
+elif ! testaddrs openssl >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}OPENSSL not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+elif ! testaddrs listen tcp ip4 >/dev/null || ! runsip4 >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}TCP/IPv4 not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+else
+gentestcert testsrv
+te="$td/test$N.stderr"
+CMD1="$TRACE $SOCAT $opts -u OPENSSL-LISTEN:$PORT,pf=ip4,reuseaddr,rcvbuf=8192,$SOCAT_EGD,cert=testsrv.crt,key=testsrv.key,verify=0 SYSTEM:\"sleep 10\""
+CMD2="$TRACE $SOCAT $opts -b 1048576 -T 1 -t 1 -u OPEN:/dev/zero OPENSSL:$LOCALHOST:$PORT,pf=ip4,verify=0,$SOCAT_EGD,nonblock,sndbuf=8192"
+printf "test $F_n $TEST... " $N
+eval "$CMD1 2>\"${te}1\" &"
+pid1=$!
+waittcp4port $PORT
+$CMD2 2>"${te}2" &
+pid2=$!
+sleep 6
+if kill -0 $pid2 2>/dev/null; then
+    kill $pid2 2>/dev/null
+    $PRINTF "$FAILED: $TRACE $SOCAT:\n"
+    echo "$CMD1 &"
+    echo "$CMD2"
+    cat "${te}1" "${te}2"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+else
+    $PRINTF "$OK\n"
+    if [ -n "$debug" ]; then cat "${te}1" "${te}2"; fi
+    numOK=$((numOK+1))
+fi
+kill $pid1 2>/dev/null
+wait
+fi ;; # NUMCOND, feats
+esac
+PORT=$((PORT+1))
+N=$((N+1))
+
+
+NAME=OPENSSL_COALESCE
+case "$TESTS" in
+*%$N%*|*%functions%*|*%openssl%*|*%tcp%*|*%tcp4%*|*%ip4%*|*%$NAME%*)
+TEST="$NAME: OpenSSL collects small writes into few records"
+# the client reads its input in blocks of 16 bytes; with coalesce these must
+# become a few SSL_write() calls, and the server reads them with read-ahead
+if ! eval $NUMCOND; then :;
+elif ! testaddrs openssl >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}OPENSSL not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+elif ! testaddrs listen tcp ip4 >/dev/null || ! runsip4 >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}TCP/IPv4 not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+elif ! testoptions openssl-coalesce >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}option coalesce not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+else
+gentestcert testsrv
+tf="$td/test$N.stdout"
+te="$td/test$N.stderr"
+ti="$td/test$N.input"
+i=0; while [ $i -lt 200 ]; do echo "test$N line $i"; i=$((i+1)); done >"$ti"
+CMD1="$TRACE $SOCAT $opts -u OPENSSL-LISTEN:$PORT,pf=ip4,reuseaddr,$SOCAT_EGD,cert=testsrv.crt,key=testsrv.key,verify=0,read-ahead CREAT:$tf"
+CMD2="$TRACE $SOCAT $opts -d -d -d -d -b 16 -u - OPENSSL:$LOCALHOST:$PORT,pf=ip4,verify=0,$SOCAT_EGD,coalesce=1"
+printf "test $F_n $TEST... " $N
+$CMD1 2>"${te}1" &
+pid1=$!
+waittcp4port $PORT
+$CMD2 <"$ti" 2>"${te}2"
+wait $pid1
+records=$(grep -c "collected with coalesce" "${te}2")
+if ! cmp -s "$ti" "$tf"; then
+    $PRINTF "$FAILED: $TRACE $SOCAT:\n"
+    echo "$CMD1 &"
+    echo "$CMD2"
+    cat "${te}1" "${te}2"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif [ "$records" -eq 0 -o "$records" -gt 10 ]; then
+    $PRINTF "$FAILED ($records records)\n"
+    echo "$CMD2"
+    grep "SSL_write" "${te}2"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+else
+    $PRINTF "$OK\n"
+    if [ -n "$debug" ]; then grep "collected with coalesce" "${te}2"; fi
+    numOK=$((numOK+1))
+fi
+fi ;; # NUMCOND, feats
+esac
+PORT=$((PORT+1))
+N=$((N+1))
+
+
+NAME=OPENSSL_MULTIPLEX
+case "$TESTS" in
+*%$N%*|*%functions%*|*%openssl%*|*%tcp%*|*%tcp4%*|*%ip4%*|*%listen%*|*%$NAME%*)
+TEST="$NAME: multiplexed OpenSSL server with a stalled handshake"
+if ! eval $NUMCOND; then :;
+elif [ "$UNAME" != Linux ]; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}only on Linux$NORMAL\n" $N
+    numCANT=$((numCANT+1))
+elif ! testaddrs openssl >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}OPENSSL not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+elif ! testaddrs listen tcp ip4 >/dev/null || ! runsip4 >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}TCP/IPv4 not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+elif ! testoptions multiplex >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}multiplex not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+else
+gentestcert testsrv
+tf="$td/test$N.stdout"
+te="$td/test$N.stderr"
+tdiff="$td/test$N.diff"
+da="test$N $(date) $RANDOM"
+CMD1="$TRACE $SOCAT $opts -d -d OPENSSL-LISTEN:$PORT,pf=ip4,reuseaddr,$SOCAT_EGD,cert=testsrv.crt,key=testsrv.key,verify=0,multiplex PIPE"
+CMD0="$TRACE $SOCAT $opts - TCP4:$LOCALHOST:$PORT"
+CMD2="$TRACE $SOCAT $opts - OPENSSL:$LOCALHOST:$PORT,pf=ip4,verify=0,$SOCAT_EGD"
+printf "test $F_n $TEST... " $N
+$CMD1 2>"${te}1" &
+pid1=$!
+waittcp4port $PORT 1
+# a client that never sends its hello must not hold up the others
+sleep 5 |$CMD0 >/dev/null 2>"${te}0" &
+pid0=$!
+usleep 200000
+(echo "$da 1"; sleep 1) |$CMD2 >"${tf}1" 2>"${te}2" &
+pid2=$!
+echo "$da 2" |$CMD2 >"${tf}2" 2>"${te}3"
+rc3=$?
+echo "$da 3" |$CMD2 >"${tf}3" 2>"${te}4"
+rc4=$?
+wait $pid2
+rc2=$?
+kill -0 $pid0 2>/dev/null; stalled=$?
+kill $pid0 $pid1 2>/dev/null; wait
+if [ $rc2 -ne 0 -o $rc3 -ne 0 -o $rc4 -ne 0 ]; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD1 &"
+    echo "$CMD0 &"
+    echo "$CMD2"
+    cat "${te}1" "${te}2" "${te}3" "${te}4"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif ! (echo "$da 1"; echo "$da 2"; echo "$da 3") |diff - <(cat "${tf}1" "${tf}2" "${tf}3") >"$tdiff"; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD1 &"
+    echo "$CMD2"
+    cat "$tdiff"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+elif [ $stalled -ne 0 ]; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD1 &"
+    echo "the clients had to wait for the stalled handshake" >&2
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+else
+    $PRINTF "$OK\n"
+    if [ -n "$debug" ]; then cat "${te}1"; fi
+    numOK=$((numOK+1))
+fi
+fi ;; # NUMCOND, feats
+esac
+PORT=$((PORT+1))
+N=$((N+1))
+
+
+# the optimistic write after a complete write must not apply to blocking
+# output fds: socat would block in write() and the inactivity timeout -T could
+# not trigger
+NAME=BLOCKING_WRITE_TIMEOUT
+case "$TESTS" in
+*%$N%*|*%functions%*|*%engine%*|*%timeout%*|*%$NAME%*)
+TEST="$NAME: inactivity timeout with full blocking output"
+# socat writes to a pipe whose reader never reads; check that socat
+# terminates after the -T timeout, not only when the reader exits
+if ! eval $NUMCOND; then :; else
+te="$td/test$N.stderr"
+tt="$td/test$N.time"
+CMD0="$TRACE $SOCAT $opts -T 1 -u /dev/zero STDOUT"
+printf "test $F_n $TEST... " $N
+t0=$(date +%s)
+{ $CMD0 2>"${te}0"; date +%s >"$tt"; } |(sleep 4)
+t1=$(cat "$tt")
+if [ $((t1-t0)) -ge 3 ]; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0 |(sleep 4)"
+    echo "socat terminated after $((t1-t0)) seconds" >&2
+    cat "${te}0"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+else
+    $PRINTF "$OK\n"
+    numOK=$((numOK+1))
+fi
+fi # NUMCOND
+ ;;
+esac
+N=$((N+1))
+
+# with option multiplex, a connection whose second address does not read must
+# not block the transfer of the other connections
+NAME=MULTIPLEX_STALL
+case "$TESTS" in
+*%$N%*|*%functions%*|*%tcp%*|*%tcp4%*|*%listen%*|*%$NAME%*)
+TEST="$NAME: multiplex serves others while one connection stalls"
+# the first client sends data that the program of its connection never
+# reads; a second client must still get the greeting of its program
+if ! eval $NUMCOND; then :;
+elif [ "$UNAME" != Linux ]; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}only on Linux$NORMAL\n" $N
+    numCANT=$((numCANT+1))
+elif ! testoptions multiplex >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}multiplex not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+else
+tf="$td/test$N.stdout"
+te="$td/test$N.stderr"
+da="test$N $(date) $RANDOM"
+CMD0="$TRACE $SOCAT $opts -b 12288 TCP4-LISTEN:$PORT,reuseaddr,multiplex,escape=0x1d SYSTEM:\"echo '$da'; sleep 6\",pipes"
+CMD1="$TRACE $SOCAT $opts -u /dev/zero TCP4:$LOCALHOST:$PORT"
+CMD2="$TRACE $SOCAT $opts -u TCP4:$LOCALHOST:$PORT STDOUT"
+printf "test $F_n $TEST... " $N
+eval "$CMD0 2>\"${te}0\" &"
+pid0=$!
+waittcp4port $PORT 1
+$CMD1 2>"${te}1" &
+pid1=$!
+sleep 1
+$CMD2 >"$tf" 2>"${te}2" &
+pid2=$!
+sleep 2
+kill $pid2 $pid1 $pid0 2>/dev/null; wait
+if ! echo "$da" |diff - "$tf" >/dev/null; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0 &"
+    echo "$CMD1 &"
+    echo "$CMD2"
+    cat "${te}0" "${te}1" "${te}2"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+else
+    $PRINTF "$OK\n"
+    numOK=$((numOK+1))
+fi
+fi # NUMCOND
+ ;;
+esac
+PORT=$((PORT+1))
+N=$((N+1))
+
+# data that a nonblocking output did not take is written on close, but socat
+# must not wait longer than the closing timeout for a reader that never reads
+NAME=DRAIN_CLOSE_TIMEOUT
+case "$TESTS" in
+*%$N%*|*%functions%*|*%engine%*|*%timeout%*|*%$NAME%*)
+TEST="$NAME: closing timeout limits the drain of pending output"
+if ! eval $NUMCOND; then :; else
+te="$td/test$N.stderr"
+tt="$td/test$N.time"
+CMD0="$TRACE $SOCAT $opts -t 0.5 -T 1 -u /dev/zero STDOUT,nonblock"
+printf "test $F_n $TEST... " $N
+t0=$(date +%s)
+{ $CMD0 2>"${te}0"; date +%s >"$tt"; } |(sleep 5)
+t1=$(cat "$tt")
+if [ $((t1-t0)) -ge 4 ]; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0 |(sleep 5)"
+    echo "socat terminated after $((t1-t0)) seconds" >&2
+    cat "${te}0"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+else
+    $PRINTF "$OK\n"
+    numOK=$((numOK+1))
+fi
+fi # NUMCOND
+ ;;
+esac
+N=$((N+1))
+
+# with option multiplex on UDP-LISTEN, a session whose second address does
+# not read must not block the transfer of the other sessions
+NAME=UDP4_MULTIPLEX_STALL
+case "$TESTS" in
+*%$N%*|*%functions%*|*%ip4%*|*%ipapp%*|*%udp%*|*%listen%*|*%$NAME%*)
+TEST="$NAME: UDP multiplex serves others while one session stalls"
+# the first peer floods its program that never reads; a second peer must
+# still get the greeting of its program
+if ! eval $NUMCOND; then :;
+elif [ "$UNAME" != Linux ]; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}only on Linux$NORMAL\n" $N
+    numCANT=$((numCANT+1))
+elif ! testoptions multiplex >/dev/null; then
+    $PRINTF "test $F_n $TEST... ${YELLOW}multiplex not available${NORMAL}\n" $N
+    numCANT=$((numCANT+1))
+else
+tf="$td/test$N.stdout"
+te="$td/test$N.stderr"
+tsl=$PORT
+da="test$N $(date) $RANDOM"
+CMD0="$TRACE $SOCAT $opts UDP4-LISTEN:$tsl,reuseaddr,multiplex SYSTEM:\"echo '$da'; sleep 6\",pipes"
+CMD1="$TRACE $SOCAT $opts -u /dev/zero UDP4-SENDTO:$LOCALHOST:$tsl"
+CMD2="$TRACE $SOCAT $opts -t 2 - UDP4:$LOCALHOST:$tsl"
+printf "test $F_n $TEST... " $N
+eval "$CMD0 2>\"${te}0\" &"
+pid0=$!
+waitudp4port $tsl 1
+$CMD1 2>"${te}1" &
+pid1=$!
+sleep 1
+echo |$CMD2 >"$tf" 2>"${te}2"
+kill $pid1 $pid0 2>/dev/null; wait
+if ! echo "$da" |diff - "$tf" >/dev/null; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0 &"
+    echo "$CMD1 &"
+    echo "echo |$CMD2"
+    cat "${te}0" "${te}1" "${te}2"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+else
+    $PRINTF "$OK\n"
+    numOK=$((numOK+1))
+fi
+fi # NUMCOND
+ ;;
+esac
+PORT=$((PORT+1))
+N=$((N+1))
+
+# with option -cr, a full ring must not block the transfer engine that writes
+# it: the other direction still has to pass
+NAME=CHAIN_SHMRINGS_FULL
+case "$TESTS" in
+*%$N%*|*%functions%*|*%chain%*|*%$NAME%*)
+TEST="$NAME: full shared memory ring does not block the other direction"
+# the program never reads the data from /dev/zero, so the ring towards it
+# fills up; its greeting must still arrive
+if ! eval $NUMCOND; then :; else
+tf="$td/test$N.stdout"
+te="$td/test$N.stderr"
+da="test$N $(date) $RANDOM"
+CMD0="$TRACE $SOCAT $opts -cr STDOUT%OPEN:/dev/zero \"^NOP|SYSTEM:sleep 0.5; echo '$da'; sleep 4\""
+printf "test $F_n $TEST... " $N
+eval "$CMD0 >\"$tf\" 2>\"${te}0\" &"
+pid0=$!
+sleep 2
+kill $pid0 2>/dev/null; wait
+if ! echo "$da" |diff - "$tf" >/dev/null; then
+    $PRINTF "$FAILED\n"
+    echo "$CMD0 &"
+    cat "${te}0"
+    numFAIL=$((numFAIL+1))
+    listFAIL="$listFAIL $N"
+else
+    $PRINTF "$OK\n"
+    numOK=$((numOK+1))
+fi
+fi # NUMCOND
+ ;;
+esac
+N=$((N+1))
+
+
 echo "summary: $((N-1)) tests, $((numOK+numFAIL+numCANT)) selected; $numOK ok, $numFAIL failed, $numCANT could not be performed"
 
 if [ "$numFAIL" -gt 0 ]; then
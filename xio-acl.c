@@ -0,0 +1,388 @@
+/* source: xio-acl.c */
+/* Copyright Gerhard Rieger */
+/* Published under the GNU General Public License V.2, see file COPYING */
+
+/* this file contains the source for the peer address lists (option acl) */
+
+/* The file given with option acl contains lines of the form
+      allow|deny <address>[/<prefixlen>]
+   with IPv4 or IPv6 addresses; empty lines and text after '#' are ignored.
+   The entries are compiled into one binary radix trie per address family
+   whose nodes hold a prefix and, when they came from an entry, its decision.
+   Chains of nodes without a branch are compressed into one node, so a lookup
+   visits at most one node per branch and compares every bit of the peer
+   address only once: the most specific matching entry decides, a peer
+   without a matching entry is refused. On SIGHUP the file is read again
+   before the next peer check; when that fails the old list stays active. */
+
+#include "xiosysincludes.h"
+#include "xioopen.h"
+
+#include "xio-acl.h"
+
+
+#if WITH_IP4 || WITH_IP6
+
+#define XIOACL_ALLOW	1
+#define XIOACL_DENY	(-1)
+
+const struct optdesc opt_acl = { "acl", NULL, OPT_ACL, GROUP_RANGE, PH_ACCEPT, TYPE_FILENAME, OFUNC_SPEC };
+
+struct xioacl_node {
+   unsigned char key[16];	/* the prefix in network byte order, the bits
+				   past it are 0 */
+   unsigned char bits;		/* prefix length */
+   signed char action;		/* XIOACL_ALLOW or XIOACL_DENY, 0 when the
+				   node only branches */
+   unsigned int child[2];	/* index of the node for the next bit, 0 for
+				   none */
+} ;
+
+struct xioacl_trie {
+   struct xioacl_node *nodes;	/* [0] is unused */
+   unsigned int numnodes;
+   unsigned int maxnodes;
+   unsigned int root[2];	/* IPv4, IPv6; 0 when empty */
+   unsigned int entries;
+} ;
+
+struct xioacl {
+   char *filename;
+   struct xioacl_trie trie;
+   unsigned int generation;	/* of SIGHUP when it was loaded */
+   pid_t pid;			/* the process that loaded it */
+   unsigned long lookups;	/* peer checks */
+   unsigned long visits;	/* nodes visited by them */
+   unsigned long allowed;
+   unsigned long denied;
+   struct xioacl *next;		/* list of all of them, for the report */
+} ;
+
+static volatile sig_atomic_t xioacl_generation;
+static struct xioacl *xioacl_list;
+
+
+static void xioacl_sighup(int signum) {
+   ++xioacl_generation;
+}
+
+static void xioacl_report(struct xioacl *acl, int level) {
+   Msg6(level, "acl %s: %lu lookups, %lu nodes visited, %lu allowed, %lu denied, %u entries",
+	acl->filename, acl->lookups, acl->visits, acl->allowed, acl->denied,
+	acl->trie.entries);
+}
+
+static void xioacl_exit(void) {
+   struct xioacl *acl;
+
+   for (acl = xioacl_list; acl != NULL; acl = acl->next) {
+      if (acl->pid == Getpid()) {
+	 xioacl_report(acl, E_INFO);
+      }
+   }
+}
+
+static int xioacl_bit(const unsigned char *key, unsigned int i) {
+   return (key[i>>3] >> (7-(i&7))) & 1;
+}
+
+/* returns true when the bits from..to-1 of both keys are equal */
+static bool xioacl_samebits(const unsigned char *a, const unsigned char *b,
+			    unsigned int from, unsigned int to) {
+   unsigned char mask;
+   unsigned int i;
+
+   for (i = from>>3; i < (to+7)>>3; ++i) {
+      mask = 0xff;
+      if (i == from>>3)         mask &= 0xff >> (from&7);
+      if (i == (to-1)>>3 && (to&7))  mask &= 0xff << (8-(to&7));
+      if ((a[i] ^ b[i]) & mask)  return false;
+   }
+   return true;
+}
+
+/* returns a new node with the first bits of key, or 0 when out of memory */
+static unsigned int xioacl_newnode(struct xioacl_trie *trie,
+				   const unsigned char *key, unsigned int bits,
+				   int action) {
+   struct xioacl_node *node;
+   unsigned int i;
+
+   if (trie->numnodes == trie->maxnodes) {
+      unsigned int maxnodes = trie->maxnodes ? 2*trie->maxnodes : 256;
+      if ((node = Realloc(trie->nodes, maxnodes*sizeof(struct xioacl_node)))
+	  == NULL) {
+	 return 0;
+      }
+      trie->nodes = node;
+      trie->maxnodes = maxnodes;
+      if (trie->numnodes == 0)  trie->numnodes = 1;	/* 0 means none */
+   }
+   node = &trie->nodes[trie->numnodes];
+   memset(node, 0, sizeof(*node));
+   for (i = 0; i < bits>>3; ++i) {
+      node->key[i] = key[i];
+   }
+   if (bits&7) {
+      node->key[i] = key[i] & (0xff << (8-(bits&7)));
+   }
+   node->bits = bits;
+   node->action = action;
+   return trie->numnodes++;
+}
+
+/* adds an entry; a later entry for the same prefix replaces the former.
+   returns 0 on success, or -1 when out of memory */
+static int xioacl_insert(struct xioacl_trie *trie, int family,
+			 const unsigned char *key, unsigned int bits,
+			 int action) {
+   unsigned int parent = 0, side = 0;	/* where the link to idx is */
+   unsigned int idx, common, newidx, branch;
+   struct xioacl_node *node;
+
+   idx = trie->root[family];
+   while (true) {
+      if (idx == 0) {
+	 if ((newidx = xioacl_newnode(trie, key, bits, action)) == 0) {
+	    return -1;
+	 }
+	 break;
+      }
+      node = &trie->nodes[idx];
+      for (common = 0;
+	   common < node->bits && common < bits &&
+	      xioacl_bit(node->key, common) == xioacl_bit(key, common);
+	   ++common) ;
+      if (common == node->bits) {
+	 if (bits == node->bits) {
+	    if (node->action == 0)  ++trie->entries;
+	    node->action = action;
+	    return 0;
+	 }
+	 parent = idx;  side = xioacl_bit(key, node->bits);
+	 idx = node->child[side];
+	 continue;
+      }
+      /* the prefix of idx is longer and differs within it, or the new one
+	 is shorter: the new one, or a branch node, goes between */
+      if ((newidx = xioacl_newnode(trie, key, bits, action)) == 0) {
+	 return -1;
+      }
+      if (common == bits) {
+	 trie->nodes[newidx].child[xioacl_bit(trie->nodes[idx].key, bits)] =
+	    idx;
+      } else {
+	 if ((branch = xioacl_newnode(trie, key, common, 0)) == 0) {
+	    return -1;
+	 }
+	 trie->nodes[branch].child[xioacl_bit(key, common)] = newidx;
+	 trie->nodes[branch].child[xioacl_bit(trie->nodes[idx].key, common)] =
+	    idx;
+	 newidx = branch;
+      }
+      break;
+   }
+   if (parent == 0) {
+      trie->root[family] = newidx;
+   } else {
+      trie->nodes[parent].child[side] = newidx;
+   }
+   ++trie->entries;
+   return 0;
+}
+
+/* reads the entries of the file into trie; messages about the file are
+   printed with level.
+   returns 0 on success, or -1 when the file could not be used */
+static int xioacl_load(const char *filename, struct xioacl_trie *trie,
+		       int level) {
+   FILE *fp;
+   char line[512], act[16], net[80], extra[2];
+   unsigned char key[16];
+   unsigned int lineno = 0;
+   unsigned long bits;
+   char *slash, *end;
+   int family, action, n;
+   size_t i;
+
+   memset(trie, 0, sizeof(*trie));
+   if ((fp = fopen(filename, "r")) == NULL) {
+      Msg2(level, "fopen(\"%s\", \"r\"): %s", filename, strerror(errno));
+      return -1;
+   }
+   while (fgets(line, sizeof(line), fp) != NULL) {
+      ++lineno;
+      for (i = 0; line[i] != '\0'; ++i) {
+	 if (line[i] == '#')  { line[i] = '\0';  break; }
+      }
+      n = sscanf(line, "%15s %79s %1s", act, net, extra);
+      if (n <= 0)  continue;	/* empty or comment */
+      if (n != 2) {
+	 Msg2(level, "%s:%u: expected \"allow|deny <address>[/<bits>]\"",
+	      filename, lineno);
+	 goto failed;
+      }
+      if (!strcasecmp(act, "allow")) {
+	 action = XIOACL_ALLOW;
+      } else if (!strcasecmp(act, "deny")) {
+	 action = XIOACL_DENY;
+      } else {
+	 Msg3(level, "%s:%u: unknown action \"%s\"", filename, lineno, act);
+	 goto failed;
+      }
+      if ((slash = strchr(net, '/')) != NULL) {
+	 *slash++ = '\0';
+      }
+      memset(key, 0, sizeof(key));
+      if (inet_pton(AF_INET, net, key) == 1) {
+	 family = 0;  bits = 32;
+#if WITH_IP6
+      } else if (inet_pton(AF_INET6, net, key) == 1) {
+	 family = 1;  bits = 128;
+#endif
+      } else {
+	 Msg3(level, "%s:%u: invalid address \"%s\"", filename, lineno, net);
+	 goto failed;
+      }
+      if (slash != NULL) {
+	 unsigned long maxbits = bits;
+	 bits = strtoul(slash, &end, 10);
+	 if (*slash == '\0' || *end != '\0' || bits > maxbits) {
+	    Msg3(level, "%s:%u: invalid prefix length \"%s\"",
+		 filename, lineno, slash);
+	    goto failed;
+	 }
+      }
+      if (xioacl_insert(trie, family, key, bits, action) < 0) {
+	 goto failed;
+      }
+   }
+   fclose(fp);
+   Info3("acl %s: %u entries in %u trie nodes",
+	 filename, trie->entries, trie->numnodes ? trie->numnodes-1 : 0);
+   return 0;
+
+ failed:
+   fclose(fp);
+   free(trie->nodes);
+   memset(trie, 0, sizeof(*trie));
+   return -1;
+}
+
+/* returns 0 if option was found and could be applied
+   returns 1 if option was not found
+   returns -1 if option was found but failed */
+int xio_retropt_acl(xiosingle_t *xfd, struct opt *opts) {
+   struct xioacl *acl;
+   char *filename;
+
+   if (retropt_string(opts, OPT_ACL, &filename) < 0) {
+      return 1;
+   }
+   if ((acl = Calloc(1, sizeof(struct xioacl))) == NULL) {
+      free(filename);
+      return -1;
+   }
+   acl->filename = filename;
+   acl->generation = xioacl_generation;
+   acl->pid = Getpid();
+   if (xioacl_load(filename, &acl->trie, E_ERROR) < 0) {
+      free(filename);
+      free(acl);
+      return -1;
+   }
+
+   if (xioacl_list == NULL) {
+      /* SIGHUP reloads the lists instead of terminating socat */
+      struct sigaction act;
+      memset(&act, 0, sizeof(act));
+      act.sa_flags = SA_RESTART;
+      act.sa_handler = xioacl_sighup;
+      sigfillset(&act.sa_mask);
+      if (Sigaction(SIGHUP, &act, NULL) < 0) {
+	 Warn3("sigaction(%d, %p, NULL): %s", SIGHUP, &act, strerror(errno));
+      }
+      atexit(xioacl_exit);
+   }
+   acl->next = xioacl_list;
+   xioacl_list = acl;
+   xfd->para.socket.acl = acl;
+   return 0;
+}
+
+/* reads the file again after SIGHUP; keeps the old list when that fails */
+static void xioacl_reload(struct xioacl *acl) {
+   struct xioacl_trie trie;
+
+   acl->generation = xioacl_generation;
+   xioacl_report(acl, E_NOTICE);
+   if (xioacl_load(acl->filename, &trie, E_WARN) < 0) {
+      Warn1("acl %s: keeping the previous entries", acl->filename);
+      return;
+   }
+   free(acl->trie.nodes);
+   acl->trie = trie;
+   Notice2("acl %s: reloaded %u entries", acl->filename, trie.entries);
+}
+
+/* returns -1 if forbidden, 0 if no acl check, or 1 if explicitely allowed */
+int xioacl_check(xiosingle_t *xfd, union sockaddr_union *pa) {
+   struct xioacl *acl = xfd->para.socket.acl;
+   const unsigned char *key;
+   struct xioacl_node *node;
+   unsigned int idx, from = 0, maxbits;
+   int action = 0;
+
+   if (acl == NULL) {
+      return 0;
+   }
+   if (acl->generation != xioacl_generation) {
+      xioacl_reload(acl);
+   }
+   if (pa == NULL)  { ++acl->denied;  return -1; }
+
+   switch (pa->soa.sa_family) {
+#if WITH_IP4
+   case AF_INET:
+      key = (const unsigned char *)&pa->ip4.sin_addr;
+      idx = acl->trie.root[0];  maxbits = 32;
+      break;
+#endif
+#if WITH_IP6
+   case AF_INET6:
+      key = (const unsigned char *)&pa->ip6.sin6_addr;
+      if (IN6_IS_ADDR_V4MAPPED(&pa->ip6.sin6_addr)) {
+	 /* an IPv4 peer on an IPv6 socket */
+	 key += 12;
+	 idx = acl->trie.root[0];  maxbits = 32;
+      } else {
+	 idx = acl->trie.root[1];  maxbits = 128;
+      }
+      break;
+#endif
+   default:
+      ++acl->denied;
+      return -1;
+   }
+
+   ++acl->lookups;
+   while (idx != 0) {
+      node = &acl->trie.nodes[idx];
+      ++acl->visits;
+      if (!xioacl_samebits(node->key, key, from, node->bits)) {
+	 break;
+      }
+      if (node->action != 0)  action = node->action;
+      if (node->bits == maxbits)  break;
+      from = node->bits;
+      idx = node->child[xioacl_bit(key, from)];
+   }
+   if (action == XIOACL_ALLOW) {
+      ++acl->allowed;
+      return 1;
+   }
+   ++acl->denied;
+   return -1;
+}
+
+#endif /* WITH_IP4 || WITH_IP6 */
@@ -0,0 +1,17 @@
+/* source: xio-acl.h */
+/* Copyright Gerhard Rieger */
+/* Published under the GNU General Public License V.2, see file COPYING */
+
+#ifndef __xio_acl_h_included
+#define __xio_acl_h_included 1
+
+#if WITH_IP4 || WITH_IP6
+
+extern const struct optdesc opt_acl;
+
+extern int xio_retropt_acl(xiosingle_t *xfd, struct opt *opts);
+extern int xioacl_check(xiosingle_t *xfd, union sockaddr_union *pa);
+
+#endif /* WITH_IP4 || WITH_IP6 */
+
+#endif /* !defined(__xio_acl_h_included) */
@@ -105,6 +105,7 @@ int xioopen_fd(struct opt *opts, int rw, xiofile_t *xfd, int numrfd, int numwfd,
    
    xfd->stream.rfd = numrfd;
    xfd->stream.wfd = numwfd;
+   xfd->stream.inherited = true;
    if (numrfd >= 0) {
       fd = numrfd;
    } else {
@@ -15,11 +15,15 @@
 #include "xio-ip4.h"
 #include "xio-listen.h"
 #include "xio-tcpwrap.h"
+#include "xio-acl.h"
 
 /***** LISTEN options *****/
 const struct optdesc opt_backlog = { "backlog",   NULL, OPT_BACKLOG,     GROUP_LISTEN, PH_LISTEN, TYPE_INT,    OFUNC_SPEC };
 const struct optdesc opt_fork    = { "fork",      NULL, OPT_FORK,        GROUP_CHILD,   PH_PASTACCEPT, TYPE_BOOL,  OFUNC_SPEC };
 const struct optdesc opt_max_children = { "max-children",      NULL, OPT_MAX_CHILDREN,        GROUP_CHILD,   PH_PASTACCEPT, TYPE_INT,  OFUNC_SPEC };
+const struct optdesc opt_multiplex = { "multiplex", NULL, OPT_MULTIPLEX,   GROUP_LISTEN, PH_PASTACCEPT, TYPE_BOOL,  OFUNC_SPEC };
+const struct optdesc opt_prefork = { "prefork",     NULL, OPT_PREFORK,     GROUP_LISTEN, PH_PASTACCEPT, TYPE_INT,    OFUNC_SPEC };
+const struct optdesc opt_thread  = { "thread",      NULL, OPT_THREAD,      GROUP_LISTEN, PH_PASTACCEPT, TYPE_BOOL,   OFUNC_SPEC };
 /**/
 #if (WITH_UDP || WITH_TCP)
 const struct optdesc opt_range   = { "range",     NULL, OPT_RANGE,       GROUP_RANGE,  PH_ACCEPT, TYPE_STRING, OFUNC_SPEC };
@@ -83,6 +87,65 @@ int
 }
 
 
+#if HAVE_EPOLL_CREATE1
+/* with option prefork: forks the worker processes and keeps their number up,
+   respawning workers that terminate. The master process stays in here.
+   Returns 0 in a worker process, or STAT_RETRYLATER when fork() failed */
+static int xioprefork(int workers, int level) {
+   sigset_t mask_sigchld, oldmask;
+   pid_t master = Getpid();
+   bool respawn = false;	/* all workers have been started once */
+   time_t second = 0;	/* workers respawned within this second... */
+   int respawned = 0;	/* ...are counted here */
+   pid_t pid;
+
+   xiosetchilddied();	/* set SIGCHLD handler */
+   /* a worker that terminates between the check of num_child and
+      sigsuspend() must still wake us up */
+   sigemptyset(&mask_sigchld);
+   sigaddset(&mask_sigchld, SIGCHLD);
+   Sigprocmask(SIG_BLOCK, &mask_sigchld, &oldmask);
+
+   Notice1("starting %d worker processes", workers);
+   while (true) {
+      while (num_child < workers) {
+	 if (respawn) {
+	    if (time(NULL) != second) {
+	       second = time(NULL);
+	       respawned = 0;
+	    } else if (respawned >= workers) {
+	       /* do not spin when the workers fail immediately */
+	       Warn("worker processes terminate immediately, waiting");
+	       Sleep(1);
+	       continue;
+	    }
+	    ++respawned;
+	 }
+	 if ((pid = xio_fork(false, level==E_ERROR?level:E_WARN)) < 0) {
+	    Sigprocmask(SIG_SETMASK, &oldmask, NULL);
+	    return STAT_RETRYLATER;
+	 }
+	 if (pid == 0) {	/* worker */
+	    Sigprocmask(SIG_SETMASK, &oldmask, NULL);
+#if HAVE_SYS_PRCTL_H && defined(PR_SET_PDEATHSIG)
+	    /* terminate together with the master process */
+	    if (prctl(PR_SET_PDEATHSIG, SIGTERM) < 0) {
+	       Warn1("prctl(PR_SET_PDEATHSIG, SIGTERM): %s", strerror(errno));
+	    }
+	    if (Getppid() != master) {
+	       Exit(0);
+	    }
+#endif
+	    return 0;
+	 }
+      }
+      respawn = true;
+      Sigsuspend(&oldmask);	/* until a worker terminates */
+   }
+}
+#endif /* HAVE_EPOLL_CREATE1 */
+
+
 /* creates the listening socket, bind, applies options; waits for incoming
    connection, checks its source address and port. Depending on fork option, it
    may fork a subprocess.
@@ -90,7 +153,10 @@ int
    socket it is 0 (expecting raw binary data), and the real pf can be obtained
    from us->af_family; for other socket types pf == us->af_family
    Returns 0 if a connection was accepted; with fork option, this is always in
-   a subprocess!
+   a subprocess! With multiplex option, returns 0 with the listening socket
+   still in xfd->rfd; the connections are accepted by xiomux_socat(), also
+   with thread option. With prefork option, the same happens in each worker process, while the master
+   process never returns
    Other return values indicate a problem; this can happen in the master
    process or in a subprocess.
    This function does not retry. If you need retries, handle this in a
@@ -99,8 +165,8 @@ int
    applies and consumes the following option:
    PH_INIT, PH_PASTSOCKET, PH_PREBIND, PH_BIND, PH_PASTBIND, PH_EARLY,
    PH_PREOPEN, PH_FD, PH_CONNECTED, PH_LATE, PH_LATE2
-   OPT_FORK, OPT_SO_TYPE, OPT_SO_PROTOTYPE, OPT_BACKLOG, OPT_RANGE, tcpwrap,
-   OPT_SOURCEPORT, OPT_LOWPORT, cloexec
+   OPT_FORK, OPT_MULTIPLEX, OPT_THREAD, OPT_PREFORK, OPT_SO_TYPE, OPT_SO_PROTOTYPE, OPT_BACKLOG,
+   OPT_RANGE, tcpwrap, OPT_SOURCEPORT, OPT_LOWPORT, cloexec
  */
 int _xioopen_listen(struct single *xfd, int xioflags, struct sockaddr *us, socklen_t uslen,
 		 struct opt *opts, int pf, int socktype, int proto, int level) {
@@ -110,6 +176,10 @@ int _xioopen_listen(struct single *xfd, int xioflags, struct sockaddr *us, sockl
    int backlog = 5;	/* why? 1 seems to cause problems under some load */
    char *rangename;
    bool dofork = false;
+   bool domux = false;
+   bool dothread = false;
+   int prefork = 0;	/* number of worker processes */
+   bool sharedfd = true;	/* prefork: workers share the listening socket */
    int maxchildren = 0;
    char infobuff[256];
    char lisname[256];
@@ -131,10 +201,71 @@ int _xioopen_listen(struct single *xfd, int xioflags, struct sockaddr *us, sockl
       xfd->flags |= XIO_DOESFORK;
    }
 
+   retropt_bool(opts, OPT_MULTIPLEX, &domux);
+
+   if (domux) {
+      if (!(xioflags & XIO_MAYMUX)) {
+	 Error("option multiplex not allowed here");
+	 return STAT_NORETRY;
+      }
+      if (dofork) {
+	 Error("options fork and multiplex are mutually exclusive");
+	 return STAT_NORETRY;
+      }
+#if !HAVE_EPOLL_CREATE1
+      Error("option multiplex requires epoll");
+      return STAT_NORETRY;
+#endif
+      xfd->flags |= XIO_DOESMUX;
+   }
+
+   retropt_bool(opts, OPT_THREAD, &dothread);
+
+   if (dothread) {
+      if (!(xioflags & XIO_MAYMUX)) {
+	 Error("option thread not allowed here");
+	 return STAT_NORETRY;
+      }
+      if (dofork || domux) {
+	 Error("option thread cannot be combined with fork or multiplex");
+	 return STAT_NORETRY;
+      }
+      xfd->flags |= XIO_DOESMUX;
+   }
+
+   retropt_int(opts, OPT_PREFORK, &prefork);
+
+   if (prefork) {
+      if (!(xioflags & XIO_MAYMUX)) {
+	 Error("option prefork not allowed here");
+	 return STAT_NORETRY;
+      }
+      if (dofork) {
+	 Error("options fork and prefork are mutually exclusive");
+	 return STAT_NORETRY;
+      }
+#if !HAVE_EPOLL_CREATE1
+      Error("option prefork requires epoll");
+      return STAT_NORETRY;
+#endif
+#ifdef SO_REUSEPORT
+      {
+	 /* with reuseport each worker binds its own socket and the kernel
+	    distributes the connections; the option is set before bind()
+	    below, not in its regular phase */
+	 int reuseport = 0;
+	 retropt_int(opts, OPT_SO_REUSEPORT, &reuseport);
+	 sharedfd = !reuseport;
+      }
+#endif
+      /* the workers loop over the connections like with multiplex */
+      xfd->flags |= XIO_DOESMUX;
+   }
+
    retropt_int(opts, OPT_MAX_CHILDREN, &maxchildren);
 
-   if (! dofork && maxchildren) {
-      Error("option max-children not allowed without option fork");
+   if (! dofork && ! domux && ! dothread && maxchildren) {
+      Error("option max-children not allowed without option fork, multiplex, or thread");
       return STAT_NORETRY;
    }
 
@@ -143,6 +274,13 @@ int _xioopen_listen(struct single *xfd, int xioflags, struct sockaddr *us, sockl
    if (dofork) {
       xiosetchilddied();	/* set SIGCHLD handler */
    }
+#if HAVE_EPOLL_CREATE1
+   if (prefork && !sharedfd) {
+      if ((result = xioprefork(prefork, level)) != 0) {
+	 return result;
+      }
+   }
+#endif
 
    if ((xfd->rfd = xiosocket(opts, us->sa_family, socktype, proto, level)) < 0) {
       return STAT_RETRYLATER;
@@ -150,6 +288,19 @@ int _xioopen_listen(struct single *xfd, int xioflags, struct sockaddr *us, sockl
 
    applyopts_cloexec(xfd->rfd, opts);
 
+#ifdef SO_REUSEPORT
+   if (prefork && !sharedfd) {
+      int one = 1;
+      if (Setsockopt(xfd->rfd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one))
+	  < 0) {
+	 Msg2(level, "setsockopt(%d, SOL_SOCKET, SO_REUSEPORT, {1}, ...): %s",
+	      xfd->rfd, strerror(errno));
+	 Close(xfd->rfd);
+	 return STAT_RETRYLATER;
+      }
+   }
+#endif /* defined(SO_REUSEPORT) */
+
    applyopts(xfd->rfd, opts, PH_PREBIND);
    applyopts(xfd->rfd, opts, PH_BIND);
    if (Bind(xfd->rfd, (struct sockaddr *)us, uslen) < 0) {
@@ -204,6 +355,11 @@ int _xioopen_listen(struct single *xfd, int xioflags, struct sockaddr *us, sockl
 #if (WITH_TCP || WITH_UDP) && WITH_LIBWRAP
    xio_retropt_tcpwrap(xfd, opts);
 #endif /* && (WITH_TCP || WITH_UDP) && WITH_LIBWRAP */
+#if WITH_IP4 || WITH_IP6
+   if (xio_retropt_acl(xfd, opts) < 0) {
+      return STAT_NORETRY;
+   }
+#endif /* WITH_IP4 || WITH_IP6 */
 
 #if WITH_TCP || WITH_UDP
    if (retropt_ushort(opts, OPT_SOURCEPORT, &xfd->para.socket.ip.sourceport) >= 0) {
@@ -224,6 +380,27 @@ int _xioopen_listen(struct single *xfd, int xioflags, struct sockaddr *us, sockl
    } else {
       Info("starting accept loop");
    }
+#if HAVE_EPOLL_CREATE1
+   if (prefork && sharedfd) {
+      if ((result = xioprefork(prefork, level)) != 0) {
+	 Close(xfd->rfd);
+	 return result;
+      }
+   }
+#endif
+   if (domux || dothread || prefork) {
+      /* the accepted connections get the remaining options applied, see
+	 xioaccept_mux() */
+      xfd->para.socket.muxopts = copyopts(opts, GROUP_ALL);
+      /* a worker without multiplex or thread serves one connection at a
+	 time */
+      xfd->para.socket.maxconns = domux||dothread ? maxchildren : 1;
+      xfd->para.socket.muxshared = prefork && sharedfd;
+      xfd->para.socket.muxthreads = dothread;
+      xfd->para.socket.proto = proto;
+      dropopts(opts, PH_ALL);
+      return 0;
+   }
    while (true) {	/* but we only loop if fork option is set */
       char peername[256];
       char sockname[256];
@@ -364,4 +541,136 @@ int _xioopen_listen(struct single *xfd, int xioflags, struct sockaddr *us, sockl
    return 0;
 }
 
+
+/* with option multiplex: accepts one connection on the listening socket of
+   lfd, checks the peer, and applies the options of the listen address.
+   Returns a new xio file for the connection that inherits the settings of the
+   listening address, or NULL when no connection was accepted */
+xiofile_t *xioaccept_mux(xiofile_t *lfd) {
+   struct single *lsfd = &lfd->stream;
+   struct single *sfd;
+   xiofile_t *xfd;
+   struct opt *opts;
+   int rw = (lsfd->flags&XIO_ACCMODE);
+   char infobuff[256];
+   char peername[256];
+   char sockname[256];
+   union sockaddr_union _peername;
+   union sockaddr_union _sockname;
+   union sockaddr_union *pa = &_peername;	/* peer address */
+   union sockaddr_union *la = &_sockname;	/* local address */
+   socklen_t pas = sizeof(_peername);	/* peer address size */
+   socklen_t las = sizeof(_sockname);	/* local address size */
+   int ps;		/* peer socket */
+
+   do {
+      ps = Accept(lsfd->rfd, &pa->soa, &pas);
+   } while (ps < 0 && errno == EINTR);
+   if (ps < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+	 return NULL;	/* the connection attempt has gone */
+      }
+      if (errno == ECONNABORTED) {
+	 Notice4("accept(%d, %p, {"F_socklen"}): %s",
+		 lsfd->rfd, pa, pas, strerror(errno));
+	 return NULL;
+      }
+      Error4("accept(%d, %p, {"F_socklen"}): %s",
+	     lsfd->rfd, pa, pas, strerror(errno));
+      return NULL;
+   }
+   if ((opts = copyopts(lsfd->para.socket.muxopts, GROUP_ALL)) == NULL) {
+      Close(ps);
+      return NULL;
+   }
+   applyopts_cloexec(ps, opts);
+   if (Getsockname(ps, &la->soa, &las) < 0) {
+      Warn4("getsockname(%d, %p, {"F_socklen"}): %s",
+	    ps, la, las, strerror(errno));
+      la = NULL;
+   }
+   Notice2("accepting connection from %s on %s",
+	   sockaddr_info(&pa->soa, pas, peername, sizeof(peername)),
+	   la?
+	   sockaddr_info(&la->soa, las, sockname, sizeof(sockname)):"NULL");
+
+   if (la != NULL && xiocheckpeer(lsfd, pa, la) < 0) {
+      if (Shutdown(ps, 2) < 0) {
+	 Info2("shutdown(%d, 2): %s", ps, strerror(errno));
+      }
+      Close(ps);
+      free(opts);
+      return NULL;
+   }
+   Info1("permitting connection from %s",
+	 sockaddr_info((struct sockaddr *)pa, pas,
+		       infobuff, sizeof(infobuff)));
+
+   /* the connection gets a private copy of the listening address; the
+      pointers it shares with the listener are never freed by xioclose() */
+   if ((xfd = Malloc(sizeof(xiofile_t))) == NULL) {
+      Close(ps);
+      free(opts);
+      return NULL;
+   }
+   memcpy(xfd, lfd, sizeof(xiofile_t));
+   sfd = &xfd->stream;
+   sfd->flags &= ~XIO_DOESMUX;
+   sfd->opts = NULL;
+   sfd->para.socket.muxopts = NULL;
+   sfd->opt_unlink_close = false;	/* the listener keeps the name */
+   sfd->unlink_close = NULL;
+   sfd->havelock = false;
+   sfd->rfd = -1;
+   sfd->wfd = -1;
+   if (XIOWITHRD(rw))  sfd->rfd = ps;
+   if (XIOWITHWR(rw))  sfd->wfd = ps;
+
+   applyopts(ps, opts, PH_FD);
+   applyopts(ps, opts, PH_PASTSOCKET);
+   applyopts(ps, opts, PH_CONNECTED);
+   if (_xio_openlate(sfd, opts) < 0) {
+      Close(ps);
+      free(opts);
+      free(xfd);
+      return NULL;
+   }
+   free(opts);
+
+   /* set the env vars describing the local and remote sockets; the second
+      address of this connection is opened next and might exec a program.
+      With OPENSSL-LISTEN, xioaccept_setenv() does this after the handshake,
+      which other threads might perform at the same time */
+   if ((lsfd->dtype & XIODATA_MASK) != XIODATA_OPENSSL) {
+      if (la != NULL) {
+	 xiosetsockaddrenv("SOCK", la, las, lsfd->para.socket.proto);
+      }
+      xiosetsockaddrenv("PEER", pa, pas, lsfd->para.socket.proto);
+   }
+
+   return xfd;
+}
+
+/* sets the env vars describing the sockets of a connection from
+   xioaccept_mux() after its TLS handshake.
+   returns 0 on success, or -1 when the peer is gone */
+int xioaccept_setenv(struct single *sfd) {
+   union sockaddr_union _peername;
+   union sockaddr_union _sockname;
+   socklen_t pas = sizeof(_peername);
+   socklen_t las = sizeof(_sockname);
+   int fd = (sfd->rfd >= 0 ? sfd->rfd : sfd->wfd);
+
+   if (Getpeername(fd, &_peername.soa, &pas) < 0) {
+      Warn4("getpeername(%d, %p, {"F_socklen"}): %s",
+	    fd, &_peername, pas, strerror(errno));
+      return -1;
+   }
+   if (Getsockname(fd, &_sockname.soa, &las) == 0) {
+      xiosetsockaddrenv("SOCK", &_sockname, las, sfd->para.socket.proto);
+   }
+   xiosetsockaddrenv("PEER", &_peername, pas, sfd->para.socket.proto);
+   return 0;
+}
+
 #endif /* WITH_LISTEN */
@@ -8,7 +8,10 @@
 extern const struct optdesc opt_backlog;
 extern const struct optdesc opt_fork;
 extern const struct optdesc opt_max_children;
+extern const struct optdesc opt_multiplex;
+extern const struct optdesc opt_prefork;
 extern const struct optdesc opt_range;
+extern const struct optdesc opt_thread;
 
 int
    xioopen_listen(struct single *xfd, int xioflags,
@@ -18,5 +21,7 @@ int
 int _xioopen_listen(struct single *fd, int xioflags,
 		    struct sockaddr *us, socklen_t uslen,
 		 struct opt *opts, int pf, int socktype, int proto, int level);
+extern xiofile_t *xioaccept_mux(xiofile_t *lfd);
+extern int xioaccept_setenv(struct single *sfd);
 
 #endif /* !defined(__xio_listen_h_included) */
@@ -48,13 +48,16 @@ static int xioopen_openssl_listen(int argc, const char *argv[], struct opt *opts
 				  int xioflags, xiofile_t *fd, unsigned groups,
 			   int dummy1, int dummy2, int dummy3);
 static int openssl_SSL_ERROR_SSL(int level, const char *funcname);
+static void openssl_accept_error(SSL *ssl, int ret, int level);
 static int openssl_handle_peer_certificate(struct single *xfd,
 					   const char *peername,
 					   bool opt_ver,
 					   int level);
 static int xioSSL_set_fd(struct single *xfd, int level);
+static int xioSSL_wait(struct single *xfd, int ret, int level);
 static int xioSSL_connect(struct single *xfd, const char *opt_commonname, bool opt_ver, int level);
 static int openssl_delete_cert_info(void);
+static void openssl_ktls_setup(struct single *xfd);
  
 
 /* description record for inter-address ssl connect with 0 parameters */
@@ -178,6 +181,10 @@ const struct optdesc opt_openssl_method     = { "openssl-method",     "method",
 const struct optdesc opt_openssl_verify     = { "openssl-verify",     "verify",  OPT_OPENSSL_VERIFY,     GROUP_OPENSSL, PH_SPEC, TYPE_BOOL,   OFUNC_SPEC };
 const struct optdesc opt_openssl_certificate = { "openssl-certificate", "cert",  OPT_OPENSSL_CERTIFICATE, GROUP_OPENSSL, PH_SPEC, TYPE_FILENAME, OFUNC_SPEC };
 const struct optdesc opt_openssl_key         = { "openssl-key",         "key",   OPT_OPENSSL_KEY,         GROUP_OPENSSL, PH_SPEC, TYPE_FILENAME, OFUNC_SPEC };
+const struct optdesc opt_openssl_ktls        = { "openssl-ktls",       "ktls",   OPT_OPENSSL_KTLS,        GROUP_OPENSSL, PH_SPEC, TYPE_BOOL,     OFUNC_SPEC };
+const struct optdesc opt_openssl_read_ahead  = { "openssl-read-ahead", "read-ahead", OPT_OPENSSL_READ_AHEAD, GROUP_OPENSSL, PH_SPEC, TYPE_BOOL,   OFUNC_SPEC };
+const struct optdesc opt_openssl_record_buffer = { "openssl-record-buffer", "record-buffer", OPT_OPENSSL_RECORD_BUFFER, GROUP_OPENSSL, PH_SPEC, TYPE_UINT, OFUNC_SPEC };
+const struct optdesc opt_openssl_coalesce    = { "openssl-coalesce",   "coalesce", OPT_OPENSSL_COALESCE,  GROUP_OPENSSL, PH_SPEC, TYPE_TIMESPEC, OFUNC_SPEC };
 const struct optdesc opt_openssl_dhparam     = { "openssl-dhparam",     "dh",    OPT_OPENSSL_DHPARAM,     GROUP_OPENSSL, PH_SPEC, TYPE_FILENAME, OFUNC_SPEC };
 const struct optdesc opt_openssl_cafile      = { "openssl-cafile",     "cafile", OPT_OPENSSL_CAFILE,      GROUP_OPENSSL, PH_SPEC, TYPE_FILENAME, OFUNC_SPEC };
 const struct optdesc opt_openssl_capath      = { "openssl-capath",     "capath", OPT_OPENSSL_CAPATH,      GROUP_OPENSSL, PH_SPEC, TYPE_FILENAME, OFUNC_SPEC };
@@ -190,6 +197,9 @@ const struct optdesc opt_openssl_compress    = { "openssl-compress",   "compress
 const struct optdesc opt_openssl_fips        = { "openssl-fips",       "fips",   OPT_OPENSSL_FIPS,        GROUP_OPENSSL, PH_SPEC, TYPE_BOOL,     OFUNC_SPEC };
 #endif
 const struct optdesc opt_openssl_commonname  = { "openssl-commonname", "cn",     OPT_OPENSSL_COMMONNAME,  GROUP_OPENSSL, PH_SPEC, TYPE_STRING,   OFUNC_SPEC };
+const struct optdesc opt_openssl_session_cache = { "openssl-session-cache", "session-cache", OPT_OPENSSL_SESSION_CACHE, GROUP_OPENSSL, PH_SPEC, TYPE_UINT, OFUNC_SPEC };
+const struct optdesc opt_openssl_session_store = { "openssl-session-store", "session-store", OPT_OPENSSL_SESSION_STORE, GROUP_OPENSSL, PH_SPEC, TYPE_FILENAME, OFUNC_SPEC };
+const struct optdesc opt_openssl_ticket_key_rotate = { "openssl-ticket-key-rotate", "ticket-key-rotate", OPT_OPENSSL_TICKET_KEY_ROTATE, GROUP_OPENSSL, PH_SPEC, TYPE_TIMESPEC, OFUNC_SPEC };
 
 
 /* If FIPS is compiled in, we need to track if the user asked for FIPS mode.
@@ -219,6 +229,8 @@ int xio_reset_fips_mode(void) {
 
 static void openssl_conn_loginfo(SSL *ssl) {
    Notice1("SSL connection using %s", SSL_get_cipher(ssl));
+   Notice1("SSL connection %s", SSL_session_reused(ssl) ?
+	   "resumed a previous session" : "with a new session");
 
 #if OPENSSL_VERSION_NUMBER >= 0x00908000L
    {
@@ -235,6 +247,69 @@ static void openssl_conn_loginfo(SSL *ssl) {
 #endif
 }
 
+/* with option ktls and a cipher that the kernel supports, OpenSSL has passed
+   the record keys to the kernel during the handshake. Data written to the
+   socket is then encrypted by the kernel, so the write direction becomes a
+   plain stream that write(), sendfile(), and splice() can use. The read
+   direction stays with SSL_read(): the kernel decrypts the records, but
+   alerts and post handshake messages arrive as control records that read()
+   would fail on. When the kernel refused the keys, or the cipher is not
+   supported, both directions remain with OpenSSL */
+static void openssl_ktls_setup(struct single *xfd) {
+#ifdef SSL_OP_ENABLE_KTLS
+   SSL *ssl = xfd->para.openssl.ssl;
+   int tx, rx;
+
+   if (!(SSL_get_options(ssl) & SSL_OP_ENABLE_KTLS)) {
+      return;
+   }
+   tx = BIO_get_ktls_send(SSL_get_wbio(ssl));
+   rx = BIO_get_ktls_recv(SSL_get_rbio(ssl));
+   if (tx) {
+      xfd->dtype = (xfd->dtype & ~XIODATA_WRITEMASK) | XIOWRITE_STREAM;
+   }
+   if (tx || rx) {
+      Info3("kernel TLS with %s: send %s, receive %s", SSL_get_cipher(ssl),
+	    tx?"offloaded":"by OpenSSL", rx?"offloaded":"by OpenSSL");
+   } else {
+      Notice1("kernel TLS not available with %s, using OpenSSL",
+	      SSL_get_cipher(ssl));
+   }
+#endif /* defined(SSL_OP_ENABLE_KTLS) */
+}
+
+/* returns the file that keeps the client session for option
+   openssl-session-store: store itself, or when it is a directory a file
+   named after the peer (and port) in it. returns NULL on error */
+static char *openssl_session_file(const char *store, const char *peername,
+				  const char *portname) {
+   struct stat buf;
+   char *path, *p;
+   size_t len;
+
+   if (Stat(store, &buf) < 0 || !S_ISDIR(buf.st_mode)) {
+      if ((path = strdup(store)) == NULL) {
+	 Error1("strdup(\"%s\"): out of memory", store);
+      }
+      return path;
+   }
+   if (peername == NULL) {
+      Error1("session-store=\"%s\" is a directory but no commonname given",
+	     store);
+      return NULL;
+   }
+   len = strlen(store) + strlen(peername) + (portname?strlen(portname):0) + 3;
+   if ((path = Malloc(len)) == NULL) {
+      return NULL;
+   }
+   snprintf(path, len, "%s/%s%s%s", store, peername,
+	    portname?":":"", portname?portname:"");
+   for (p = path + strlen(store) + 1; *p; ++p) {
+      if (*p == '/')  *p = '_';
+   }
+   return path;
+}
+
 /* the open function for OpenSSL client */
 static int
    xioopen_openssl_connect(int argc,
@@ -271,6 +346,7 @@ static int
    bool opt_ver = true;	/* verify peer certificate */
    char *opt_cert = NULL;	/* file name of client certificate */
    const char *opt_commonname = NULL;	/* for checking peer certificate */
+   char *opt_sessstore = NULL;	/* file or directory of client sessions */
    int result;
 
    if (!(xioflags & XIO_MAYCONVERT)) {
@@ -347,6 +423,16 @@ static int
       return STAT_NORETRY;
    }
 
+   retropt_string(opts, OPT_OPENSSL_SESSION_STORE, &opt_sessstore);
+   if (opt_sessstore != NULL) {
+      xfd->para.openssl.sessfile =
+	 openssl_session_file(opt_sessstore, opt_commonname, portname);
+      if (xfd->para.openssl.sessfile == NULL ||
+	  xiosslcache_client(xfd->para.openssl.ctx) < 0) {
+	 return STAT_NORETRY;
+      }
+   }
+
    if (xioopts.logopt == 'm') {
       Info("starting connect loop, switching to syslog");
       diag_set('y', xioopts.syslogfac);  xioopts.logopt = 'y';
@@ -509,6 +595,7 @@ static int
       return result;
    }
 
+   openssl_ktls_setup(xfd);
    return STAT_OK;
 }
 
@@ -658,6 +745,17 @@ static int
       default:
 	 return result;
       }
+      if (xfd->flags & XIO_DOESMUX) {
+	 /* the accepted connections perform their handshakes in the
+	    multiplexing loop, see xiomux.c */
+	 xfd->para.openssl.ssl = NULL;
+	 xfd->para.openssl.verify = opt_ver;
+	 xfd->para.openssl.commonname = opt_commonname;
+	 /* left over from loading the certificates; this thread would report
+	    them with the first failing SSL_read() */
+	 ERR_clear_error();
+	 return STAT_OK;
+      }
       xfd->wfd = xfd->rfd;
       }
       result =
@@ -698,9 +796,8 @@ int _xioopen_openssl_listen(struct single *xfd,
 			    const char *opt_commonname,
 			     SSL_CTX *ctx,
 			     int level) {
-   char error_string[120];
    unsigned long err;
-   int errint, ret;
+   int ret;
 
    /* create an SSL object */
    if ((xfd->para.openssl.ssl = sycSSL_new(ctx)) == NULL) {
@@ -735,44 +832,11 @@ int _xioopen_openssl_listen(struct single *xfd,
 #endif /* WITH_DEBUG */
 
    /* connect via SSL by performing handshake */
-   if ((ret = sycSSL_accept(xfd->para.openssl.ssl)) <= 0) {
-      /*if (ERR_peek_error() == 0) Msg(level, "SSL_accept() failed");*/
-      errint = SSL_get_error(xfd->para.openssl.ssl, ret);
-      switch (errint) {
-      case SSL_ERROR_NONE:
-	 Msg(level, "ok"); break;
-      case SSL_ERROR_ZERO_RETURN:
-	 Msg(level, "connection closed (wrong version number?)"); break;
-      case SSL_ERROR_WANT_READ: case SSL_ERROR_WANT_WRITE:
-      case SSL_ERROR_WANT_CONNECT:
-      case SSL_ERROR_WANT_X509_LOOKUP:
-	 Msg(level, "nonblocking operation did not complete"); break;	/*!*/
-      case SSL_ERROR_SYSCALL:
-	 if (ERR_peek_error() == 0) {
-	    if (ret == 0) {
-	       Msg(level, "SSL_accept(): socket closed by peer");
-	    } else if (ret == -1) {
-	       Msg1(level, "SSL_accept(): %s", strerror(errno));
-	    }
-	 } else {
-	    Msg(level, "I/O error");	/*!*/
-	    while (err = ERR_get_error()) {
-	       ERR_error_string_n(err, error_string, sizeof(error_string));
-	       Msg4(level, "SSL_accept(): %s / %s / %s / %s", error_string,
-		    ERR_lib_error_string(err), ERR_func_error_string(err),
-		    ERR_reason_error_string(err));
-	    }
-	    /* Msg1(level, "SSL_accept(): %s", ERR_error_string(e, buf));*/
-	 }
-	 break;
-      case SSL_ERROR_SSL:
-	 /*ERR_print_errors_fp(stderr);*/
-	 openssl_SSL_ERROR_SSL(level, "SSL_accept");
-	 break;
-      default:
-	 Msg(level, "unknown error");
-      }
-
+   while ((ret = sycSSL_accept(xfd->para.openssl.ssl)) <= 0 &&
+	  xioSSL_wait(xfd, ret, level) == 0)
+      ;
+   if (ret <= 0) {
+      openssl_accept_error(xfd->para.openssl.ssl, ret, level);
       return STAT_RETRYLATER;
    }
 
@@ -780,9 +844,118 @@ int _xioopen_openssl_listen(struct single *xfd,
       return STAT_NORETRY;
    }
 
+   openssl_ktls_setup(xfd);
    return STAT_OK;
 }
 
+/* prints the messages for a failed SSL_accept() that returned ret */
+static void openssl_accept_error(SSL *ssl, int ret, int level) {
+   char error_string[120];
+   unsigned long err;
+   int errint;
+
+   /*if (ERR_peek_error() == 0) Msg(level, "SSL_accept() failed");*/
+   errint = SSL_get_error(ssl, ret);
+   switch (errint) {
+   case SSL_ERROR_NONE:
+      Msg(level, "ok"); break;
+   case SSL_ERROR_ZERO_RETURN:
+      Msg(level, "connection closed (wrong version number?)"); break;
+   case SSL_ERROR_WANT_READ: case SSL_ERROR_WANT_WRITE:
+   case SSL_ERROR_WANT_CONNECT:
+   case SSL_ERROR_WANT_X509_LOOKUP:
+      Msg(level, "nonblocking operation did not complete"); break;	/*!*/
+   case SSL_ERROR_SYSCALL:
+      if (ERR_peek_error() == 0) {
+	 if (ret == 0) {
+	    Msg(level, "SSL_accept(): socket closed by peer");
+	 } else if (ret == -1) {
+	    Msg1(level, "SSL_accept(): %s", strerror(errno));
+	 }
+      } else {
+	 Msg(level, "I/O error");	/*!*/
+	 while (err = ERR_get_error()) {
+	    ERR_error_string_n(err, error_string, sizeof(error_string));
+	    Msg4(level, "SSL_accept(): %s / %s / %s / %s", error_string,
+		 ERR_lib_error_string(err), ERR_func_error_string(err),
+		 ERR_reason_error_string(err));
+	 }
+	 /* Msg1(level, "SSL_accept(): %s", ERR_error_string(e, buf));*/
+      }
+      break;
+   case SSL_ERROR_SSL:
+      /*ERR_print_errors_fp(stderr);*/
+      openssl_SSL_ERROR_SSL(level, "SSL_accept");
+      break;
+   default:
+      Msg(level, "unknown error");
+   }
+}
+
+
+/* the server handshake of a connection accepted by OPENSSL-LISTEN with
+   option multiplex, thread, or prefork. xiomux.c drives it step by step on
+   the nonblocking fd, so the handshakes can be computed by worker threads */
+
+/* creates the SSL object of the accepted connection.
+   returns STAT_OK, or another STAT_* value on error */
+int xioopenssl_accept_init(struct single *xfd) {
+   SSL_CTX *ctx = xfd->para.openssl.ctx;
+   unsigned long err;
+   int ret;
+
+   /* the listener owns the context; the SSL object holds its own reference,
+      and xioclose() must not free it with this connection */
+   xfd->para.openssl.ctx = NULL;
+   if ((xfd->para.openssl.ssl = sycSSL_new(ctx)) == NULL) {
+      if (ERR_peek_error() == 0)  Error("SSL_new() failed");
+      while (err = ERR_get_error()) {
+	 Error1("SSL_new(): %s", ERR_error_string(err, NULL));
+      }
+      return STAT_NORETRY;
+   }
+   /* the handshake needs both directions of the socket */
+   if (xfd->rfd < 0)  xfd->rfd = xfd->wfd;
+   if (xfd->wfd < 0)  xfd->wfd = xfd->rfd;
+   ret = xioSSL_set_fd(xfd, E_ERROR);
+   if (ret != STAT_OK) {
+      sycSSL_free(xfd->para.openssl.ssl);
+      xfd->para.openssl.ssl = NULL;
+   }
+   return ret;
+}
+
+/* performs the handshake until it has to wait for the fd. May be called by
+   any thread, but by one at a time for a connection.
+   returns 0 when the handshake is complete, POLLIN or POLLOUT when it has to
+   wait, or -1 on error */
+int xioopenssl_accept_step(struct single *xfd) {
+   int ret;
+
+   if ((ret = sycSSL_accept(xfd->para.openssl.ssl)) > 0) {
+      return 0;
+   }
+   switch (SSL_get_error(xfd->para.openssl.ssl, ret)) {
+   case SSL_ERROR_WANT_READ:  return POLLIN;
+   case SSL_ERROR_WANT_WRITE: return POLLOUT;
+   }
+   openssl_accept_error(xfd->para.openssl.ssl, ret, E_ERROR);
+   return -1;
+}
+
+/* checks the peer certificate after the handshake and prepares the transfer.
+   Sets env vars, so call it from the thread that opens the second address.
+   returns 0 on success, or -1 when the peer is not accepted */
+int xioopenssl_accept_done(struct single *xfd) {
+   if (openssl_handle_peer_certificate(xfd, xfd->para.openssl.commonname,
+				       xfd->para.openssl.verify, E_ERROR) < 0) {
+      return -1;
+   }
+   openssl_ktls_setup(xfd);
+   openssl_conn_loginfo(xfd->para.openssl.ssl);
+   return 0;
+}
+
 #endif /* WITH_LISTEN */
 
 
@@ -862,6 +1035,12 @@ int
    char *opt_compress = NULL;  /* compression method */
 #endif
    bool opt_pseudo = false;	/* use pseudo entropy if nothing else */
+   bool opt_ktls = false;	/* pass the record keys to the kernel */
+   bool opt_readahead = false;	/* read more than the next record */
+   unsigned int opt_recbuf = 0;	/* size of the read buffer, implies read-ahead */
+   struct timespec opt_coalesce;	/* how long small writes may be collected */
+   unsigned int opt_sesscache = 0;	/* entries of shared session cache */
+   struct timespec opt_keyrotate = { 0, 0 };	/* session ticket keys */
    unsigned long err;
    int result;
 
@@ -877,6 +1056,21 @@ int
    retropt_string(opts, OPT_OPENSSL_DHPARAM, &opt_dhparam);
    retropt_string(opts, OPT_OPENSSL_EGD, &opt_egd);
    retropt_bool(opts,OPT_OPENSSL_PSEUDO, &opt_pseudo);
+   retropt_bool(opts, OPT_OPENSSL_KTLS, &opt_ktls);
+   retropt_bool(opts, OPT_OPENSSL_READ_AHEAD, &opt_readahead);
+   retropt_uint(opts, OPT_OPENSSL_RECORD_BUFFER, &opt_recbuf);
+   xfd->para.openssl.coalescing = false;
+   xfd->para.openssl.cbuff = NULL;
+   xfd->para.openssl.clen = 0;
+   if (retropt_timespec(opts, OPT_OPENSSL_COALESCE, &opt_coalesce) >= 0) {
+      xfd->para.openssl.coalescing = true;
+      xfd->para.openssl.coalesce.tv_sec  = opt_coalesce.tv_sec;
+      xfd->para.openssl.coalesce.tv_usec = opt_coalesce.tv_nsec/1000;
+   }
+   if (server) {
+      retropt_uint(opts, OPT_OPENSSL_SESSION_CACHE, &opt_sesscache);
+      retropt_timespec(opts, OPT_OPENSSL_TICKET_KEY_ROTATE, &opt_keyrotate);
+   }
 #if OPENSSL_VERSION_NUMBER >= 0x00908000L
    retropt_string(opts, OPT_OPENSSL_COMPRESS, &opt_compress);
 #endif
@@ -1211,6 +1405,38 @@ int
       }
    }
 
+   /* a write that did not complete on a nonblocking fd is repeated from the
+      write queue, not from the caller's buffer */
+   SSL_CTX_set_mode(*ctx, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+   if (opt_readahead || opt_recbuf != 0) {
+      /* fill the read buffer with as many records as the socket has, instead
+	 of reading header and body of each record separately */
+      SSL_CTX_set_read_ahead(*ctx, 1);
+   }
+   if (opt_recbuf != 0) {
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+      SSL_CTX_set_default_read_buffer_len(*ctx, opt_recbuf);
+#else
+      Warn("option record-buffer: not supported by this OpenSSL version");
+#endif
+   }
+
+   if (opt_ktls) {
+#ifdef SSL_OP_ENABLE_KTLS
+      SSL_CTX_set_options(*ctx, SSL_OP_ENABLE_KTLS);
+#else
+      Warn("option ktls: OpenSSL version does not support kernel TLS");
+#endif
+   }
+
+   if (opt_sesscache > 0) {
+      /* before the listener forks, so that all children share it */
+      if (xiosslcache_install(*ctx, opt_sesscache, &opt_keyrotate) < 0) {
+	 return STAT_NORETRY;
+      }
+   }
+
    if (*opt_ver) {
       sycSSL_CTX_set_verify(*ctx,
 			    SSL_VERIFY_PEER| SSL_VERIFY_FAIL_IF_NO_PEER_CERT,
@@ -1589,6 +1815,12 @@ static int openssl_handle_peer_certificate(struct single *xfd,
 static int xioSSL_set_fd(struct single *xfd, int level) {
    unsigned long err;
 
+   /* these share memory with para.socket that the connection has used */
+   xfd->para.openssl.rdwant = xfd->para.openssl.wrwant = 0;
+   xfd->para.openssl.wretry = 0;
+   xfd->para.openssl.cbuff = NULL;
+   xfd->para.openssl.clen = 0;
+
    /* assign a network connection to the SSL object */
   if (xfd->rfd == xfd->wfd) {
    if (sycSSL_set_fd(xfd->para.openssl.ssl, xfd->rfd) <= 0) {
@@ -1625,6 +1857,43 @@ static int xioSSL_set_fd(struct single *xfd, int level) {
 }
 
 
+/* after a handshake function returned ret on a nonblocking fd (option
+   nonblock): waits until the fd is ready for the direction that SSL wants,
+   at most for connect-timeout.
+   returns 0 when the handshake function should be called again, or -1 when
+   ret is another error, or on timeout */
+static int xioSSL_wait(struct single *xfd, int ret, int level) {
+   struct timeval *to = NULL;
+   struct pollfd pfd;
+   int errint, result;
+
+   errint = SSL_get_error(xfd->para.openssl.ssl, ret);
+   if (errint == SSL_ERROR_WANT_READ) {
+      pfd.fd = xfd->rfd;  pfd.events = POLLIN;
+   } else if (errint == SSL_ERROR_WANT_WRITE) {
+      pfd.fd = xfd->wfd;  pfd.events = POLLOUT;
+   } else {
+      return -1;
+   }
+   if (xfd->para.openssl.connect_timeout.tv_sec  != 0 ||
+       xfd->para.openssl.connect_timeout.tv_usec != 0) {
+      to = &xfd->para.openssl.connect_timeout;
+   }
+   do {
+      result = xiopoll(&pfd, 1, to);
+   } while (result < 0 && errno == EINTR);
+   if (result < 0) {
+      Msg3(level, "poll({%d,0x%02x}, 1, ...): %s",
+	   pfd.fd, pfd.events, strerror(errno));
+      return -1;
+   }
+   if (result == 0) {
+      Msg(level, "SSL handshake timed out");
+      return -1;
+   }
+   return 0;
+}
+
 /* ...
    in case of an error condition, this function check forever and retry
    options and ev. sleeps an interval. It returns NORETRY when the caller
@@ -1634,9 +1903,18 @@ static int xioSSL_connect(struct single *xfd, const char *opt_commonname,
    char error_string[120];
    int errint, status, ret;
    unsigned long err;
+   int offered = 0;	/* a stored session */
+
+   if (xfd->para.openssl.sessfile != NULL) {
+      offered = xiosslcache_load(xfd->para.openssl.ssl,
+				 xfd->para.openssl.sessfile);
+   }
 
    /* connect via SSL by performing handshake */
-   if ((ret = sycSSL_connect(xfd->para.openssl.ssl)) <= 0) {
+   while ((ret = sycSSL_connect(xfd->para.openssl.ssl)) <= 0 &&
+	  xioSSL_wait(xfd, ret, level) == 0)
+      ;
+   if (ret <= 0) {
       /*if (ERR_peek_error() == 0) Msg(level, "SSL_connect() failed");*/
       errint = SSL_get_error(xfd->para.openssl.ssl, ret);
       switch (errint) {
@@ -1686,6 +1964,15 @@ static int xioSSL_connect(struct single *xfd, const char *opt_commonname,
       }
       return status;
    }
+   if (offered) {
+      if (SSL_session_reused(xfd->para.openssl.ssl)) {
+	 Info1("server resumed the TLS session from \"%s\"",
+	       xfd->para.openssl.sessfile);
+      } else {
+	 Info1("server did not resume the TLS session from \"%s\"",
+	       xfd->para.openssl.sessfile);
+      }
+   }
    return STAT_OK;
 }
 
@@ -1709,6 +1996,11 @@ ssize_t xioread_openssl(struct single *pipe, void *buff, size_t bufsiz) {
 	 break;
       case SSL_ERROR_WANT_READ:
       case SSL_ERROR_WANT_WRITE:
+	 /* the engine waits for this direction before the next read */
+	 pipe->para.openssl.rdwant = errint;
+	 Info("nonblocking operation did not complete");
+	 errno = EAGAIN;
+	 return -1;
       case SSL_ERROR_WANT_CONNECT:
       case SSL_ERROR_WANT_X509_LOOKUP:
 	 Info("nonblocking operation did not complete");
@@ -1742,11 +2034,19 @@ ssize_t xioread_openssl(struct single *pipe, void *buff, size_t bufsiz) {
       errno = _errno;
       return -1;
    }
+   pipe->para.openssl.rdwant = 0;
    return ret;
 }
 
 ssize_t xiopending_openssl(struct single *pipe) {
    int bytes = sycSSL_pending(pipe->para.openssl.ssl);
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+   /* with read-ahead further records may wait in the read buffer, the socket
+      will not report them */
+   if (bytes == 0 && SSL_has_pending(pipe->para.openssl.ssl)) {
+      bytes = 1;
+   }
+#endif
    return bytes;
 }
 
@@ -1769,6 +2069,12 @@ ssize_t xiowrite_openssl(struct single *pipe, const void *buff, size_t bufsiz) {
 	 break;
       case SSL_ERROR_WANT_READ:
       case SSL_ERROR_WANT_WRITE:
+	 /* SSL_write() must later be repeated with the same data, see
+	    xioflush_openssl() */
+	 pipe->para.openssl.wrwant = errint;
+	 Info("nonblocking operation did not complete");
+	 errno = EAGAIN;
+	 return -1;
       case SSL_ERROR_WANT_CONNECT:
       case SSL_ERROR_WANT_X509_LOOKUP:
 	 Error("nonblocking operation did not complete");
@@ -1801,8 +2107,86 @@ ssize_t xiowrite_openssl(struct single *pipe, const void *buff, size_t bufsiz) {
       errno = _errno;
       return -1;
    }
+   pipe->para.openssl.wrwant = 0;
    return ret;
 }
 
+/* writes the data from the write queue. an unfinished SSL_write() is
+   repeated first with its original length (wretry); the queue holds a copy,
+   thus SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER.
+   returns the number of bytes still queued, or -1 on error */
+ssize_t xioflush_openssl(struct single *pipe) {
+   size_t len;
+   ssize_t writt;
+
+   while (pipe->wqlen > 0) {
+      len = pipe->para.openssl.wretry;
+      if (len == 0)  len = pipe->wqlen;
+      writt = xiowrite_openssl(pipe, pipe->wqbuff, len);
+      if (writt < 0) {
+	 if (errno == EAGAIN) {
+	    pipe->para.openssl.wretry = len;
+	    return pipe->wqlen;
+	 }
+	 /* xiowrite_openssl() printed the error message */
+	 pipe->wqlen = 0;	/* cannot be delivered anymore */
+	 pipe->para.openssl.wretry = 0;
+	 return -1;
+      }
+      pipe->wqlen -= writt;
+      memmove(pipe->wqbuff, pipe->wqbuff + writt, pipe->wqlen);
+      pipe->para.openssl.wretry = 0;
+   }
+   return 0;
+}
+
+/* the poll events the engine should wait for before it reads from (POLLIN)
+   or writes to (POLLOUT) the SSL connection: a renegotiation or key update
+   can require the opposite direction of the socket */
+short xiopoll_openssl(struct single *pipe, short events) {
+   int want;
+
+   want = (events & POLLIN) ?
+      pipe->para.openssl.rdwant : pipe->para.openssl.wrwant;
+   switch (want) {
+   case SSL_ERROR_WANT_READ:  return POLLIN;
+   case SSL_ERROR_WANT_WRITE: return POLLOUT;
+   default:                   return events;
+   }
+}
+
+/* blocks until the write queue has been written completely, but not longer
+   than tmo (NULL: no limit); called by xiodrain().
+   returns 0 on success, or -1 on error; errno is ETIMEDOUT when tmo expired
+   with data still queued */
+int xiodrain_openssl(struct single *pipe, const struct timeval *tmo) {
+   struct timeval now, deadline, rest;
+   struct pollfd pfd;
+
+   if (tmo != NULL) {
+      gettimeofday(&now, NULL);
+      timeradd(&now, tmo, &deadline);
+   }
+   while (xioflush_openssl(pipe) > 0) {
+      if (tmo != NULL) {
+	 gettimeofday(&now, NULL);
+	 if (!timercmp(&now, &deadline, <)) {
+	    /* the caller drops the queue; no SSL_write() is repeated */
+	    pipe->para.openssl.wretry = 0;
+	    errno = ETIMEDOUT;
+	    return -1;
+	 }
+	 timersub(&deadline, &now, &rest);
+      }
+      pfd.fd = pipe->wfd;
+      pfd.events = xiopoll_openssl(pipe, POLLOUT);
+      if (xiopoll(&pfd, 1, tmo != NULL ? &rest : NULL) < 0 && errno != EINTR) {
+	 Warn2("poll({%d,...}, 1, ...): %s", pfd.fd, strerror(errno));
+	 return -1;
+      }
+   }
+   return pipe->wqlen > 0 ? -1 : 0;
+}
+
 
 #endif /* WITH_OPENSSL */
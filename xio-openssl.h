@@ -18,6 +18,10 @@ extern const struct optdesc opt_openssl_method;
 extern const struct optdesc opt_openssl_verify;
 extern const struct optdesc opt_openssl_certificate;
 extern const struct optdesc opt_openssl_key;
+extern const struct optdesc opt_openssl_ktls;
+extern const struct optdesc opt_openssl_read_ahead;
+extern const struct optdesc opt_openssl_record_buffer;
+extern const struct optdesc opt_openssl_coalesce;
 extern const struct optdesc opt_openssl_dhparam;
 extern const struct optdesc opt_openssl_cafile;
 extern const struct optdesc opt_openssl_capath;
@@ -30,6 +34,9 @@ extern const struct optdesc opt_openssl_compress;
 extern const struct optdesc opt_openssl_fips;
 #endif
 extern const struct optdesc opt_openssl_commonname;
+extern const struct optdesc opt_openssl_session_cache;
+extern const struct optdesc opt_openssl_session_store;
+extern const struct optdesc opt_openssl_ticket_key_rotate;
 
 extern int
    _xioopen_openssl_prepare(struct opt *opts, struct single *xfd,
@@ -43,11 +50,22 @@ extern int
    _xioopen_openssl_listen(struct single *xfd, bool opt_ver,
 			   const char *opt_commonname,
 			   SSL_CTX *ctx, int level);
+extern int xioopenssl_accept_init(struct single *xfd);
+extern int xioopenssl_accept_step(struct single *xfd);
+extern int xioopenssl_accept_done(struct single *xfd);
 extern int xioclose_openssl(xiofile_t *xfd);
 extern int xioshutdown_openssl(xiofile_t *xfd, int how);
 extern ssize_t xioread_openssl(struct single *file, void *buff, size_t bufsiz);
 extern ssize_t xiopending_openssl(struct single *pipe);
 extern ssize_t xiowrite_openssl(struct single *file, const void *buff, size_t bufsiz);
+extern ssize_t xioflush_openssl(struct single *pipe);
+extern short xiopoll_openssl(struct single *pipe, short events);
+extern int xiodrain_openssl(struct single *pipe, const struct timeval *tmo);
+
+extern int xiosslcache_install(SSL_CTX *ctx, unsigned int entries,
+			       const struct timespec *rotate);
+extern int xiosslcache_client(SSL_CTX *ctx);
+extern int xiosslcache_load(SSL *ssl, const char *path);
 
 #if WITH_FIPS
 extern int xio_reset_fips_mode(void);
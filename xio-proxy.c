@@ -10,6 +10,7 @@
 #if WITH_PROXY
 
 #include "xioopen.h"
+#include "xiolayer.h"
 #include "xio-socket.h"
 #include "xio-ipapp.h"
 #include "xio-ascii.h"	/* for base64 encoding of authentication */
@@ -33,7 +34,7 @@ const struct optdesc opt_ignorecr  = { "ignorecr",  NULL, OPT_IGNORECR,  GROUP_H
 const struct optdesc opt_proxy_resolve   = { "proxy-resolve",   "resolve", OPT_PROXY_RESOLVE,   GROUP_HTTP, PH_LATE, TYPE_BOOL,  OFUNC_SPEC };
 const struct optdesc opt_proxy_authorization  = { "proxy-authorization",  "proxyauth", OPT_PROXY_AUTHORIZATION,  GROUP_HTTP, PH_LATE, TYPE_STRING,  OFUNC_SPEC };
 
-static const struct xioaddr_inter_desc    xioaddr_proxy_connect2 = { XIOADDR_INTER,    "proxy", 2, XIOBIT_ALL, GROUP_HTTP|GROUP_CHILD|GROUP_RETRY, XIOSHUT_DOWN, XIOCLOSE_CLOSE, xioopen_proxy_connect2, 0, 0, 0, XIOBIT_RDWR HELP(":<host>:<port>") };
+static const struct xioaddr_inter_desc    xioaddr_proxy_connect2 = { XIOADDR_INTER,    "proxy", 2, XIOBIT_ALL, GROUP_HTTP|GROUP_CHILD|GROUP_RETRY, XIOSHUT_DOWN, XIOCLOSE_CLOSE, xioopen_proxy_connect2, 0, 0, 0, XIOBIT_RDWR HELP(":<host>:<port>"), &xiolayer_stream };
 
 static const struct xioaddr_endpoint_desc xioaddr_proxy_connect3 = { XIOADDR_ENDPOINT, "proxy", 3, XIOBIT_ALL, GROUP_FD|GROUP_SOCKET|GROUP_SOCK_IP4|GROUP_SOCK_IP6|GROUP_IP_TCP|GROUP_HTTP|GROUP_CHILD|GROUP_RETRY, XIOSHUT_DOWN, XIOCLOSE_CLOSE, xioopen_proxy_connect3, 0, 0, 0 HELP(":<proxy-server>:<host>:<port>") };
 
@@ -371,7 +372,7 @@ int _xioopen_proxy_connect(struct single *xfd,
    * xiosanitize(request, strlen(request), textbuff) = '\0';
    Info1("sending \"%s\"", textbuff);
    /* write errors are assumed to always be hard errors, no retry */
-   if (writefull(xfd->wfd, request, strlen(request)) < 0) {
+   if (writefull(xfd->wfd, request, strlen(request), NULL) < 0) {
       Msg4(level, "write(%d, %p, "F_Zu"): %s",
 	   xfd->wfd, request, strlen(request), strerror(errno));
       if (Close(xfd->wfd) < 0) {
@@ -401,7 +402,7 @@ int _xioopen_proxy_connect(struct single *xfd,
       *next = '\0';
       Info1("sending \"%s\\r\\n\"", header);
       *next++ = '\r';  *next++ = '\n'; *next++ = '\0';
-      if (writefull(xfd->wfd, header, strlen(header)) < 0) {
+      if (writefull(xfd->wfd, header, strlen(header), NULL) < 0) {
 	 Msg4(level, "write(%d, %p, "F_Zu"): %s",
 	      xfd->wfd, header, strlen(header), strerror(errno));
 	 if (Close(xfd->wfd/*!*/) < 0) {
@@ -414,7 +415,7 @@ int _xioopen_proxy_connect(struct single *xfd,
    }
 
    Info("sending \"\\r\\n\"");
-   if (writefull(xfd->wfd, "\r\n", 2) < 0) {
+   if (writefull(xfd->wfd, "\r\n", 2, NULL) < 0) {
       Msg2(level, "write(%d, \"\\r\\n\", 2): %s",
 	   xfd->wfd, strerror(errno));
       if (Close(xfd->wfd) < 0) {
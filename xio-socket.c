@@ -25,6 +25,7 @@
 #include "xio-listen.h"
 #include "xio-ipapp.h"	/*! not clean */
 #include "xio-tcpwrap.h"
+#include "xio-acl.h"
 
 
 static
@@ -227,6 +228,7 @@ const struct optdesc opt_setsockopt_bin    = { "setsockopt-bin",    "sockopt-bin
 const struct optdesc opt_setsockopt_string = { "setsockopt-string", "sockopt-string", OPT_SETSOCKOPT_STRING,     GROUP_SOCKET,PH_PASTSOCKET,TYPE_INT_INT_STRING,  OFUNC_SOCKOPT_GENERIC, 0, 0 };
 
 const struct optdesc opt_null_eof = { "null-eof", NULL, OPT_NULL_EOF, GROUP_SOCKET, PH_INIT, TYPE_BOOL, OFUNC_OFFSET, XIO_OFFSETOF(para.socket.null_eof) };
+const struct optdesc opt_batch = { "batch", NULL, OPT_BATCH, GROUP_SOCKET, PH_INIT, TYPE_INT, OFUNC_OFFSET, XIO_OFFSETOF(para.socket.batch) };
 
 
 #if WITH_GENERICSOCKET
@@ -1115,6 +1117,10 @@ int _xioopen_dgram_sendto(/* them is already in xfd->peersa */
    if (Getsockname(xfd->rfd, &la.soa, &lalen) < 0) {
       Warn4("getsockname(%d, %p, {%d}): %s",
 	    xfd->rfd, &la.soa, lalen, strerror(errno));
+   } else if (us) {
+      /* bound, so xiowrite() need not ask for it per packet */
+      xfd->locsa = la;
+      xfd->loclen = lalen;
    }
 
    applyopts_fchown(xfd->rfd, opts);
@@ -1340,6 +1346,11 @@ int _xioopen_dgram_recvfrom(struct single *xfd, int xioflags,
 #if (WITH_TCP || WITH_UDP) && WITH_LIBWRAP
    xio_retropt_tcpwrap(xfd, opts);
 #endif /* && (WITH_TCP || WITH_UDP) && WITH_LIBWRAP */
+#if WITH_IP4 || WITH_IP6
+   if (xio_retropt_acl(xfd, opts) < 0) {
+      return STAT_NORETRY;
+   }
+#endif /* WITH_IP4 || WITH_IP6 */
 
    if (xioopts.logopt == 'm') {
       Info("starting recvfrom loop, switching to syslog");
@@ -1597,6 +1608,11 @@ int _xioopen_dgram_recv(struct single *xfd, int xioflags,
 #if (WITH_TCP || WITH_UDP) && WITH_LIBWRAP
    xio_retropt_tcpwrap(xfd, opts);
 #endif /* && (WITH_TCP || WITH_UDP) && WITH_LIBWRAP */
+#if WITH_IP4 || WITH_IP6
+   if (xio_retropt_acl(xfd, opts) < 0) {
+      return STAT_NORETRY;
+   }
+#endif /* WITH_IP4 || WITH_IP6 */
 
    if (xioopts.logopt == 'm') {
       Info("starting recvfrom loop, switching to syslog");
@@ -1671,6 +1687,34 @@ int xiogetpacketsrc(int fd, struct msghdr *msgh) {
 }
 
 
+/* this function calls recvmsg() to receive the next packet into buff, together
+   with its source address and ancillary messages in msgh, so that they need
+   no extra MSG_PEEK call. In msgh the msg_name and msg_control pointers must
+   refer to storage with their lengths set; they are updated.
+   returns the number of bytes like recvfrom(), or -1 with errno set; does not
+   print error messages */
+ssize_t xiogetpacket(int fd, void *buff, size_t bufsiz, struct msghdr *msgh) {
+   ssize_t bytes;
+#if HAVE_STRUCT_IOVEC
+   struct iovec iovec;
+
+   iovec.iov_base = buff;
+   iovec.iov_len  = bufsiz;
+   msgh->msg_iov = &iovec;
+   msgh->msg_iovlen = 1;
+#endif
+#if HAVE_STRUCT_MSGHDR_MSGFLAGS
+   msgh->msg_flags = 0;
+#endif
+   do {
+      bytes = Recvmsg(fd, msgh, 0);
+   } while (bytes < 0 && errno == EINTR);
+   msgh->msg_iov = NULL;	/* iovec is gone now */
+   msgh->msg_iovlen = 0;
+   return bytes;
+}
+
+
 /* works through the ancillary messages found in the given socket header record
    and logs the relevant information (E_DEBUG, E_INFO).
    calls protocol/layer specific functions for handling the messages
@@ -1797,6 +1841,20 @@ int xiocheckpeer(xiosingle_t *xfd,
    char infobuff[256];
    int result;
 
+#if WITH_IP4 || WITH_IP6
+   if (xfd->para.socket.acl != NULL) {
+      if (xioacl_check(xfd, pa) < 0) {
+	 Warn1("refusing connection from %s due to acl option",
+	       pa ? sockaddr_info((struct sockaddr *)pa, 0,
+				  infobuff, sizeof(infobuff)) : "NULL");
+	 return -1;
+      }
+      Info1("permitting connection from %s due to acl option",
+	    sockaddr_info((struct sockaddr *)pa, 0,
+			  infobuff, sizeof(infobuff)));
+   }
+#endif /* WITH_IP4 || WITH_IP6 */
+
 #if WITH_IP4
    if (xfd->para.socket.dorange) {
       if (pa == NULL)  { return -1; }
@@ -68,6 +68,7 @@ extern const struct optdesc opt_setsockopt_int;
 extern const struct optdesc opt_setsockopt_bin;
 extern const struct optdesc opt_setsockopt_string;
 extern const struct optdesc opt_null_eof;
+extern const struct optdesc opt_batch;
 
 
 extern
@@ -110,6 +111,8 @@ int xiodopacketinfo(struct msghdr *msgh, bool withlog, bool withenv);
 extern 
 int xiogetpacketsrc(int fd, struct msghdr *msgh);
 extern
+ssize_t xiogetpacket(int fd, void *buff, size_t bufsiz, struct msghdr *msgh);
+extern
 int xiocheckpeer(xiosingle_t *xfd,
 		 union sockaddr_union *pa, union sockaddr_union *la);
 extern
@@ -9,6 +9,7 @@
 #if WITH_SOCKS4 || WITH_SOCKS4A
 
 #include "xioopen.h"
+#include "xiolayer.h"
 #include "xio-ascii.h"
 #include "xio-socket.h"
 #include "xio-ip.h"
@@ -35,7 +36,7 @@ static int xioopen_socks4_connect(int argc, const char *argv[], struct opt *opts
 const struct optdesc opt_socksport = { "socksport", NULL, OPT_SOCKSPORT, GROUP_IP_SOCKS4, PH_LATE, TYPE_STRING, OFUNC_SPEC };
 const struct optdesc opt_socksuser = { "socksuser", NULL, OPT_SOCKSUSER, GROUP_IP_SOCKS4, PH_LATE, TYPE_NAME, OFUNC_SPEC };
 
-static const struct xioaddr_inter_desc    xiointer_socks4_connect2    = { XIOADDR_INTER,    "socks4", 2, XIOBIT_ALL, GROUP_IP_SOCKS4|GROUP_CHILD|GROUP_RETRY, XIOSHUT_DOWN, XIOCLOSE_CLOSE, xioopen_socks4_connect, 0, 0, 0, XIOBIT_RDWR HELP(":<host>:<port>") };
+static const struct xioaddr_inter_desc    xiointer_socks4_connect2    = { XIOADDR_INTER,    "socks4", 2, XIOBIT_ALL, GROUP_IP_SOCKS4|GROUP_CHILD|GROUP_RETRY, XIOSHUT_DOWN, XIOCLOSE_CLOSE, xioopen_socks4_connect, 0, 0, 0, XIOBIT_RDWR HELP(":<host>:<port>"), &xiolayer_stream };
 static const struct xioaddr_endpoint_desc xioendpoint_socks4_connect3 = { XIOADDR_ENDPOINT, "socks4", 3, XIOBIT_ALL, GROUP_FD|GROUP_SOCKET|GROUP_SOCK_IP4|GROUP_SOCK_IP6|GROUP_IP_TCP|GROUP_IP_SOCKS4|GROUP_CHILD|GROUP_RETRY, XIOSHUT_DOWN, XIOCLOSE_CLOSE, xioopen_socks4_connect, 0, 0, 0 HELP(":<socks-server>:<host>:<port>") };
 
 const union xioaddr_desc *xioaddrs_socks4_connect[] = {
@@ -44,7 +45,7 @@ const union xioaddr_desc *xioaddrs_socks4_connect[] = {
    NULL
 };
 
-static const struct xioaddr_inter_desc    xiointer_socks4a_connect2    = { XIOADDR_INTER,    "socks4a", 2, XIOBIT_ALL, GROUP_IP_SOCKS4|GROUP_CHILD|GROUP_RETRY, XIOSHUT_DOWN, XIOCLOSE_CLOSE, xioopen_socks4_connect, 1, 0, 0, XIOBIT_RDWR HELP(":<host>:<port>") };
+static const struct xioaddr_inter_desc    xiointer_socks4a_connect2    = { XIOADDR_INTER,    "socks4a", 2, XIOBIT_ALL, GROUP_IP_SOCKS4|GROUP_CHILD|GROUP_RETRY, XIOSHUT_DOWN, XIOCLOSE_CLOSE, xioopen_socks4_connect, 1, 0, 0, XIOBIT_RDWR HELP(":<host>:<port>"), &xiolayer_stream };
 static const struct xioaddr_endpoint_desc xioendpoint_socks4a_connect3 = { XIOADDR_ENDPOINT, "socks4a", 3, XIOBIT_ALL, GROUP_FD|GROUP_SOCKET|GROUP_SOCK_IP4|GROUP_SOCK_IP6|GROUP_IP_TCP|GROUP_IP_SOCKS4|GROUP_CHILD|GROUP_RETRY, XIOSHUT_DOWN, XIOCLOSE_CLOSE, xioopen_socks4_connect, 1, 0, 0 HELP(":<socks-server>:<host>:<port>") };
 
 const union xioaddr_desc *xioaddrs_socks4a_connect[] = {
@@ -377,7 +378,7 @@ int _xioopen_socks4_connect(struct single *xfd,
       }
    }
 #endif /* WITH_MSGLEVEL <= E_DEBUG */
-   if (writefull(wfd, sockhead, headlen) < 0) {
+   if (writefull(wfd, sockhead, headlen, NULL) < 0) {
       Msg4(level, "write(%d, %p, "F_Zu"): %s",
 	   wfd, sockhead, headlen, strerror(errno));
       if (Close(wfd) < 0) {
@@ -23,17 +23,247 @@ const struct optdesc opt_tcpwrap_hosts_allow_table = { "tcpwrap-hosts-allow-tabl
 #if defined(HAVE_HOSTS_DENY_TABLE)
 const struct optdesc opt_tcpwrap_hosts_deny_table  = { "tcpwrap-hosts-deny-table",  "deny-table",  OPT_TCPWRAP_HOSTS_DENY_TABLE,  GROUP_RANGE, PH_ACCEPT, TYPE_FILENAME, OFUNC_SPEC };
 #endif
+const struct optdesc opt_tcpwrap_cache     = { "tcpwrap-cache",     NULL, OPT_TCPWRAP_CACHE,     GROUP_RANGE, PH_ACCEPT, TYPE_UINT,     OFUNC_SPEC };
+const struct optdesc opt_tcpwrap_cache_ttl = { "tcpwrap-cache-ttl", NULL, OPT_TCPWRAP_CACHE_TTL, GROUP_RANGE, PH_ACCEPT, TYPE_TIMESPEC, OFUNC_SPEC };
 
 
 /* they are declared only externally with libwrap and would be unresolved
    without these definitions */
 int allow_severity=10, deny_severity=10;
 
+/* With option tcpwrap-cache the decisions of hosts_access() are kept per
+   address in a bounded cache, so that a returning peer does not cost a new
+   parse of hosts.allow and hosts.deny. An entry is used until its TTL
+   expires; all entries are dropped when the mtime, inode, or size of one of
+   the tables changes, which is checked with stat() per lookup. When the
+   cache is full the least recently used entry is replaced.
+   The key is the address of the peer and the local address, without ports;
+   the daemon name and the tables are those of the xfd that owns the
+   cache. */
+
+#define XIOTCPWRAP_CACHETTL	60	/* seconds, without tcpwrap-cache-ttl */
+#define XIOTCPWRAP_KEYLEN	34	/* family and address of peer and us */
+
+/* the tables hosts_access() reads when the xfd does not name its own: those
+   libwrap was configured with, or its compiled in paths when it does not
+   export them */
+#if defined(HAVE_HOSTS_ALLOW_TABLE)
+#  define XIOTCPWRAP_ALLOW hosts_allow_table
+#else
+#  ifndef HOSTS_ALLOW
+#    define HOSTS_ALLOW "/etc/hosts.allow"
+#  endif
+#  define XIOTCPWRAP_ALLOW HOSTS_ALLOW
+#endif
+#if defined(HAVE_HOSTS_DENY_TABLE)
+#  define XIOTCPWRAP_DENY hosts_deny_table
+#else
+#  ifndef HOSTS_DENY
+#    define HOSTS_DENY  "/etc/hosts.deny"
+#  endif
+#  define XIOTCPWRAP_DENY HOSTS_DENY
+#endif
+
+struct xiotcpwrap_entry {
+   unsigned char key[XIOTCPWRAP_KEYLEN];
+   unsigned int keylen;
+   int allow;				/* result of xio_tcpwrap_check() */
+   struct timeval expires;
+   struct xiotcpwrap_entry *hnext;	/* hash chain */
+   struct xiotcpwrap_entry *prev, *next;	/* most recently used first */
+} ;
+
+/* what tells us that a table file has been changed */
+struct xiotcpwrap_stamp {
+   ino_t ino;				/* 0 when the file does not exist */
+   off_t size;
+   time_t mtime;
+} ;
+
+struct xiotcpwrap_cache {
+   const char *daemon;
+   unsigned int size;			/* number of entries */
+   unsigned int count;			/* entries in use */
+   unsigned int mask;			/* number of buckets - 1 */
+   struct xiotcpwrap_entry **buckets;
+   struct xiotcpwrap_entry *entries;
+   struct xiotcpwrap_entry *first, *last;
+   struct timeval ttl;
+   struct xiotcpwrap_stamp allowstamp, denystamp;
+   unsigned long hits, misses, expired, evicted, flushes;
+   pid_t pid;				/* the process that reports */
+   struct xiotcpwrap_cache *next;
+} ;
+
+static struct xiotcpwrap_cache *xiotcpwrap_caches;
+
+static void xiotcpwrap_exit(void) {
+   struct xiotcpwrap_cache *cache;
+
+   for (cache = xiotcpwrap_caches; cache != NULL; cache = cache->next) {
+      if (cache->pid != Getpid())  continue;
+      Info7("tcpwrap cache \"%s\": %lu hits, %lu misses (%lu expired), %lu evicted, %lu flushes, %u entries",
+	    cache->daemon, cache->hits, cache->misses, cache->expired,
+	    cache->evicted, cache->flushes, cache->count);
+   }
+}
+
+static struct xiotcpwrap_cache *xiotcpwrap_newcache(const char *daemon,
+						    unsigned int size,
+						    struct timespec *ttl) {
+   struct xiotcpwrap_cache *cache;
+   unsigned int buckets = 1;
+
+   while (buckets < size)  buckets <<= 1;
+   if ((cache = Calloc(1, sizeof(struct xiotcpwrap_cache))) == NULL) {
+      return NULL;
+   }
+   if ((cache->buckets =
+	Calloc(buckets, sizeof(struct xiotcpwrap_entry *))) == NULL ||
+       (cache->entries =
+	Calloc(size, sizeof(struct xiotcpwrap_entry))) == NULL) {
+      free(cache->buckets);
+      free(cache);
+      return NULL;
+   }
+   cache->daemon = daemon;
+   cache->size = size;
+   cache->mask = buckets - 1;
+   cache->ttl.tv_sec  = ttl->tv_sec;
+   cache->ttl.tv_usec = ttl->tv_nsec/1000;
+   cache->pid = Getpid();
+   if (xiotcpwrap_caches == NULL) {
+      atexit(xiotcpwrap_exit);
+   }
+   cache->next = xiotcpwrap_caches;
+   xiotcpwrap_caches = cache;
+   Info3("tcpwrap cache \"%s\": %u entries, TTL "F_tv_sec"s",
+	 daemon, size, cache->ttl.tv_sec);
+   return cache;
+}
+
+/* appends family and address of sa to key, returns the new length */
+static unsigned int xiotcpwrap_addkey(unsigned char *key, unsigned int len,
+				      const union sockaddr_union *sa) {
+   key[len++] = sa->soa.sa_family;
+   switch (sa->soa.sa_family) {
+#if WITH_IP6
+   case AF_INET6:
+      memcpy(key+len, &sa->ip6.sin6_addr, 16);
+      return len+16;
+#endif
+   default:
+      memcpy(key+len, &sa->ip4.sin_addr, 4);
+      return len+4;
+   }
+}
+
+static unsigned int xiotcpwrap_hash(const unsigned char *key,
+				    unsigned int keylen) {
+   unsigned int hash = 2166136261U, i;
+
+   for (i = 0; i < keylen; ++i) {
+      hash = (hash ^ key[i]) * 16777619U;
+   }
+   return hash;
+}
+
+static void xiotcpwrap_stamp(const char *filename,
+			     struct xiotcpwrap_stamp *stamp) {
+   struct stat buf;
+
+   memset(stamp, 0, sizeof(*stamp));
+   if (Stat(filename, &buf) < 0) {
+      return;	/* a missing table is a valid state too */
+   }
+   stamp->ino = buf.st_ino;
+   stamp->size = buf.st_size;
+   stamp->mtime = buf.st_mtime;
+}
+
+/* drops all entries when one of the tables has changed since the last call */
+static void xiotcpwrap_validate(struct xiotcpwrap_cache *cache,
+				const char *allowtable, const char *denytable) {
+   struct xiotcpwrap_stamp allowstamp, denystamp;
+
+   xiotcpwrap_stamp(allowtable, &allowstamp);
+   xiotcpwrap_stamp(denytable,  &denystamp);
+   if (!memcmp(&allowstamp, &cache->allowstamp, sizeof(allowstamp)) &&
+       !memcmp(&denystamp,  &cache->denystamp,  sizeof(denystamp))) {
+      return;
+   }
+   if (cache->count > 0) {
+      Info3("tcpwrap cache \"%s\": %s or %s changed, dropping cached decisions",
+	    cache->daemon, allowtable, denytable);
+      ++cache->flushes;
+   }
+   cache->allowstamp = allowstamp;
+   cache->denystamp  = denystamp;
+   memset(cache->buckets, 0,
+	  (cache->mask+1)*sizeof(struct xiotcpwrap_entry *));
+   cache->count = 0;
+   cache->first = cache->last = NULL;
+}
+
+static void xiotcpwrap_unlink(struct xiotcpwrap_cache *cache,
+			      struct xiotcpwrap_entry *entry) {
+   if (entry->prev)  entry->prev->next = entry->next;
+   else              cache->first = entry->next;
+   if (entry->next)  entry->next->prev = entry->prev;
+   else              cache->last = entry->prev;
+   entry->prev = entry->next = NULL;
+}
+
+static void xiotcpwrap_pushfront(struct xiotcpwrap_cache *cache,
+				 struct xiotcpwrap_entry *entry) {
+   entry->next = cache->first;
+   entry->prev = NULL;
+   if (cache->first)  cache->first->prev = entry;
+   else               cache->last = entry;
+   cache->first = entry;
+}
+
+static struct xiotcpwrap_entry *
+   xiotcpwrap_find(struct xiotcpwrap_cache *cache,
+		   const unsigned char *key, unsigned int keylen,
+		   unsigned int hash) {
+   struct xiotcpwrap_entry *entry;
+
+   for (entry = cache->buckets[hash & cache->mask]; entry != NULL;
+	entry = entry->hnext) {
+      if (entry->keylen == keylen && !memcmp(entry->key, key, keylen)) {
+	 return entry;
+      }
+   }
+   return NULL;
+}
+
+/* returns a free entry, taking the least recently used one when the cache is
+   full */
+static struct xiotcpwrap_entry *
+   xiotcpwrap_take(struct xiotcpwrap_cache *cache) {
+   struct xiotcpwrap_entry *entry, **pp;
+
+   if (cache->count < cache->size) {
+      return &cache->entries[cache->count++];
+   }
+   entry = cache->last;
+   xiotcpwrap_unlink(cache, entry);
+   pp = &cache->buckets[xiotcpwrap_hash(entry->key, entry->keylen) &
+			cache->mask];
+   while (*pp != entry)  pp = &(*pp)->hnext;
+   *pp = entry->hnext;
+   ++cache->evicted;
+   return entry;
+}
+
 /* returns 0 if option was found and could be applied
    returns 1 if option was not found
    returns -1 if option was found but failed */
 int xio_retropt_tcpwrap(xiosingle_t *xfd, struct opt *opts) {
    bool dolibwrap = false;
+   unsigned int cachesize = 0;
+   struct timespec cachettl = { XIOTCPWRAP_CACHETTL, 0 };
    dolibwrap =
       retropt_string(opts, OPT_TCPWRAPPERS,
 		     &xfd->para.socket.ip.libwrapname) >= 0 || dolibwrap;
@@ -50,6 +280,11 @@ int xio_retropt_tcpwrap(xiosingle_t *xfd, struct opt *opts) {
       retropt_string(opts, OPT_TCPWRAP_HOSTS_DENY_TABLE,
 		     &xfd->para.socket.ip.hosts_deny_table) >= 0 || dolibwrap;
 #endif
+   dolibwrap =
+      retropt_uint(opts, OPT_TCPWRAP_CACHE, &cachesize) >= 0 || dolibwrap;
+   dolibwrap =
+      retropt_timespec(opts, OPT_TCPWRAP_CACHE_TTL, &cachettl) >= 0 ||
+      dolibwrap;
    if (dolibwrap) {
       xfd->para.socket.ip.dolibwrap = true;
       if (xfd->para.socket.ip.libwrapname == NULL) {
@@ -71,6 +306,14 @@ int xio_retropt_tcpwrap(xiosingle_t *xfd, struct opt *opts) {
 	 }
       }
 #endif /* defined(HAVE_HOSTS_ALLOW_TABLE) || defined(HAVE_HOSTS_DENY_TABLE) */
+      if (cachesize > 0) {
+	 xfd->para.socket.ip.tcpwrap_cache =
+	    xiotcpwrap_newcache(xfd->para.socket.ip.libwrapname, cachesize,
+				&cachettl);
+	 if (xfd->para.socket.ip.tcpwrap_cache == NULL) {
+	    return -1;
+	 }
+      }
       return 0;
    }
    return 1;
@@ -82,6 +325,11 @@ int xio_retropt_tcpwrap(xiosingle_t *xfd, struct opt *opts) {
 int xio_tcpwrap_check(xiosingle_t *xfd, union sockaddr_union *us,
 		      union sockaddr_union *them) {
    char *save_hosts_allow_table, *save_hosts_deny_table;
+   struct xiotcpwrap_cache *cache = xfd->para.socket.ip.tcpwrap_cache;
+   struct xiotcpwrap_entry *entry = NULL;
+   unsigned char key[XIOTCPWRAP_KEYLEN];
+   unsigned int keylen = 0, hash = 0;
+   struct timeval now;
    struct request_info ri;
 #if WITH_IP6
    char clientaddr[INET6_ADDRSTRLEN] = "", serveraddr[INET6_ADDRSTRLEN] = "";
@@ -95,6 +343,31 @@ int xio_tcpwrap_check(xiosingle_t *xfd, union sockaddr_union *us,
    }
    if (us == NULL || them == NULL)  { return -1; }
 
+   if (cache != NULL) {
+      xiotcpwrap_validate(cache,
+			  xfd->para.socket.ip.hosts_allow_table ?
+			  xfd->para.socket.ip.hosts_allow_table :
+			  XIOTCPWRAP_ALLOW,
+			  xfd->para.socket.ip.hosts_deny_table ?
+			  xfd->para.socket.ip.hosts_deny_table :
+			  XIOTCPWRAP_DENY);
+      keylen = xiotcpwrap_addkey(key, 0, them);
+      keylen = xiotcpwrap_addkey(key, keylen, us);
+      hash = xiotcpwrap_hash(key, keylen);
+      gettimeofday(&now, NULL);
+      if ((entry = xiotcpwrap_find(cache, key, keylen, hash)) != NULL) {
+	 if (timercmp(&entry->expires, &now, >)) {
+	    ++cache->hits;
+	    xiotcpwrap_unlink(cache, entry);
+	    xiotcpwrap_pushfront(cache, entry);
+	    Debug1("tcpwrap cache: using cached decision %d", entry->allow);
+	    return entry->allow;
+	 }
+	 ++cache->expired;
+      }
+      ++cache->misses;
+   }
+
 #if defined(HAVE_HOSTS_ALLOW_TABLE)
    save_hosts_allow_table = hosts_allow_table;
    if (xfd->para.socket.ip.hosts_allow_table) {
@@ -156,10 +429,24 @@ int xio_tcpwrap_check(xiosingle_t *xfd, union sockaddr_union *us,
 #if defined(HAVE_HOSTS_DENY_TABLE)
    hosts_deny_table  = save_hosts_deny_table;
 #endif
-   if (allow == 0) {
-      return -1;
+   allow = (allow == 0 ? -1 : 1);
+
+   if (cache != NULL) {
+      if (entry != NULL) {
+	 /* expired, renew it in place */
+	 xiotcpwrap_unlink(cache, entry);
+      } else {
+	 entry = xiotcpwrap_take(cache);
+	 memcpy(entry->key, key, keylen);
+	 entry->keylen = keylen;
+	 entry->hnext = cache->buckets[hash & cache->mask];
+	 cache->buckets[hash & cache->mask] = entry;
+      }
+      entry->allow = allow;
+      timeradd(&now, &cache->ttl, &entry->expires);
+      xiotcpwrap_pushfront(cache, entry);
    }
-   return 1;
+   return allow;
 }
 
 #endif /* (WITH_TCP || WITH_UDP) && WITH_LIBWRAP */
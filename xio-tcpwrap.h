@@ -11,6 +11,8 @@ extern const struct optdesc opt_tcpwrappers;
 extern const struct optdesc opt_tcpwrap_etc;
 extern const struct optdesc opt_tcpwrap_hosts_allow_table;
 extern const struct optdesc opt_tcpwrap_hosts_deny_table;
+extern const struct optdesc opt_tcpwrap_cache;
+extern const struct optdesc opt_tcpwrap_cache_ttl;
 
 extern int xio_retropt_tcpwrap(xiosingle_t *xfd, struct opt *opts);
 extern
@@ -8,6 +8,7 @@
 
 #include "xiosysincludes.h"
 #include "xioopen.h"
+#include "xiolayer.h"
 
 #include "xio-test.h"
 
@@ -27,9 +28,16 @@ static int xioopen_testrev(int argc, const char *argv[], struct opt *opts,
 				  unsigned groups, int dummy1, int dummy2,
 				  int dummy3);
 
-static const struct xioaddr_inter_desc xiointer_test0ro = { XIOADDR_PROT, "test", 0, XIOBIT_RDONLY, 0/*groups*/, XIOSHUT_UNSPEC, XIOCLOSE_UNSPEC, xioopen_test, 0, 0, 0, XIOBIT_WRONLY HELP("") };
-static const struct xioaddr_inter_desc xiointer_test0wo = { XIOADDR_PROT, "test", 0, XIOBIT_WRONLY, 0/*groups*/, XIOSHUT_UNSPEC, XIOCLOSE_UNSPEC, xioopen_test, 0, 0, 0, XIOBIT_RDONLY HELP("") };
-static const struct xioaddr_inter_desc xiointer_test0rw = { XIOADDR_PROT, "test", 0, XIOBIT_RDWR,   0/*groups*/, XIOSHUT_UNSPEC, XIOCLOSE_UNSPEC, xioopen_test, 0, 0, 0, XIOBIT_RDWR   HELP("") };
+static ssize_t xiolayer_read_test(struct single *sfd, void *buff, size_t bufsiz);
+static ssize_t xiolayer_write_test(struct single *sfd, const void *buff, size_t bytes);
+static ssize_t xiolayer_write_testrev(struct single *sfd, const void *buff, size_t bytes);
+
+static const struct xiolayer xiolayer_test    = { xiolayer_read_test, xiolayer_write_test,    NULL, false };
+static const struct xiolayer xiolayer_testrev = { xiolayer_read,      xiolayer_write_testrev, NULL, false };
+
+static const struct xioaddr_inter_desc xiointer_test0ro = { XIOADDR_PROT, "test", 0, XIOBIT_RDONLY, 0/*groups*/, XIOSHUT_UNSPEC, XIOCLOSE_UNSPEC, xioopen_test, 0, 0, 0, XIOBIT_WRONLY HELP(""), &xiolayer_test };
+static const struct xioaddr_inter_desc xiointer_test0wo = { XIOADDR_PROT, "test", 0, XIOBIT_WRONLY, 0/*groups*/, XIOSHUT_UNSPEC, XIOCLOSE_UNSPEC, xioopen_test, 0, 0, 0, XIOBIT_RDONLY HELP(""), &xiolayer_test };
+static const struct xioaddr_inter_desc xiointer_test0rw = { XIOADDR_PROT, "test", 0, XIOBIT_RDWR,   0/*groups*/, XIOSHUT_UNSPEC, XIOCLOSE_UNSPEC, xioopen_test, 0, 0, 0, XIOBIT_RDWR   HELP(""), &xiolayer_test };
 
 const union xioaddr_desc *xioaddrs_test[] = {
    (union xioaddr_desc *)&xiointer_test0ro,
@@ -38,14 +46,14 @@ const union xioaddr_desc *xioaddrs_test[] = {
    NULL };
 
 
-static const struct xioaddr_inter_desc xiointer_testuni = { XIOADDR_PROT, "testuni", 0, XIOBIT_WRONLY, 0/*groups*/, XIOSHUT_CLOSE, XIOCLOSE_NONE, xioopen_testuni, 0, 0, 0, XIOBIT_RDONLY HELP("") };
+static const struct xioaddr_inter_desc xiointer_testuni = { XIOADDR_PROT, "testuni", 0, XIOBIT_WRONLY, 0/*groups*/, XIOSHUT_CLOSE, XIOCLOSE_NONE, xioopen_testuni, 0, 0, 0, XIOBIT_RDONLY HELP(""), &xiolayer_test };
 
 const union xioaddr_desc *xioaddrs_testuni[] = {
    (union xioaddr_desc *)&xiointer_testuni,
    NULL };
 
 
-static const struct xioaddr_inter_desc xiointer_testrev = { XIOADDR_PROT, "testrev", 0, XIOBIT_WRONLY, 0/*groups*/, XIOSHUT_CLOSE, XIOCLOSE_NONE, xioopen_testrev, 0, 0, 0, XIOBIT_RDONLY HELP("") };
+static const struct xioaddr_inter_desc xiointer_testrev = { XIOADDR_PROT, "testrev", 0, XIOBIT_WRONLY, 0/*groups*/, XIOSHUT_CLOSE, XIOCLOSE_NONE, xioopen_testrev, 0, 0, 0, XIOBIT_RDONLY HELP(""), &xiolayer_testrev };
 
 const union xioaddr_desc *xioaddrs_testrev[] = {
    (union xioaddr_desc *)&xiointer_testrev,
@@ -224,5 +232,39 @@ size_t xiowrite_testrev(struct single *sfd, const void *buff, size_t bytes) {
    return writt;
 }
 
+/* the data methods for in-process stacking (struct xiolayer) */
+static ssize_t xiolayer_read_test(struct single *sfd, void *buff, size_t bufsiz) {
+   ssize_t bytes;
+
+   if ((bytes = xioread(sfd->lower, buff, bufsiz-1)) <= 0) {
+      return bytes;
+   }
+   ((char *)buff)[bytes] = '<';
+   return bytes+1;
+}
+
+static ssize_t xiolayer_write_mark(struct single *sfd, const void *buff,
+				   size_t bytes, char mark) {
+   void *buff1;
+   ssize_t writt;
+
+   if ((buff1 = Malloc(bytes+1)) == NULL) {
+      return -1;
+   }
+   memcpy(buff1, buff, bytes);
+   ((char *)buff1)[bytes] = mark;
+   writt = xiowrite(sfd->lower, buff1, bytes+1);
+   free(buff1);
+   return writt;
+}
+
+static ssize_t xiolayer_write_test(struct single *sfd, const void *buff, size_t bytes) {
+   return xiolayer_write_mark(sfd, buff, bytes, '>');
+}
+
+static ssize_t xiolayer_write_testrev(struct single *sfd, const void *buff, size_t bytes) {
+   return xiolayer_write_mark(sfd, buff, bytes, '<');
+}
+
 #endif /* WITH_TEST */
 
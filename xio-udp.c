@@ -15,6 +15,7 @@
 #include "xio-ip.h"
 #include "xio-ipapp.h"
 #include "xio-tcpwrap.h"
+#include "xio-acl.h"
 
 #include "xio-udp.h"
 
@@ -90,6 +91,33 @@ static const struct xioaddr_endpoint_desc xioaddr_udp6_recv1    = { XIOADDR_SYS,
 const union xioaddr_desc *xioaddrs_udp6_recv[]     = { (union xioaddr_desc *)&xioaddr_udp6_recv1, NULL };
 #endif /* WITH_IP6 */
 
+#if HAVE_UDP_GSO
+const struct optdesc opt_udp_gro     = { "udp-gro",     NULL, OPT_UDP_GRO,     GROUP_IP_UDP, PH_PASTSOCKET, TYPE_INT, OFUNC_SOCKOPT, SOL_UDP, UDP_GRO };
+const struct optdesc opt_udp_segment = { "udp-segment", NULL, OPT_UDP_SEGMENT, GROUP_IP_UDP, PH_PASTSOCKET, TYPE_INT, OFUNC_SOCKOPT, SOL_UDP, UDP_SEGMENT };
+
+/* looks for the UDP_GRO ancillary message of a received datagram.
+   returns its segment size when the bytes hold more than one segment,
+   else 0 */
+size_t xioudp_grosize(struct msghdr *msgh, size_t bytes) {
+   struct cmsghdr *cmsg;
+   int segsize;
+
+   for (cmsg = CMSG_FIRSTHDR(msgh); cmsg != NULL;
+	cmsg = CMSG_NXTHDR(msgh, cmsg)) {
+      if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+	 memcpy(&segsize, CMSG_DATA(cmsg), sizeof(segsize));
+	 if (segsize > 0 && (size_t)segsize < bytes) {
+	    Info2("received "F_Zu" bytes in segments of %d bytes",
+		  bytes, segsize);
+	    return segsize;
+	 }
+	 break;
+      }
+   }
+   return 0;
+}
+#endif /* HAVE_UDP_GSO */
+
 
 /* we expect the form: port */
 int xioopen_ipdgram_listen(int argc, const char *argv[], struct opt *opts,
@@ -104,6 +132,7 @@ int xioopen_ipdgram_listen(int argc, const char *argv[], struct opt *opts,
    int socktype = SOCK_DGRAM;
    struct pollfd readfd;
    bool dofork = false;
+   bool domux = false;
    pid_t pid;
    char *rangename;
    char infobuff[256];
@@ -160,6 +189,24 @@ int xioopen_ipdgram_listen(int argc, const char *argv[], struct opt *opts,
       }
    }
 
+   retropt_bool(opts, OPT_MULTIPLEX, &domux);
+
+   if (domux) {
+      if (!(xioflags & XIO_MAYMUX)) {
+	 Error("option multiplex not allowed here");
+	 return STAT_NORETRY;
+      }
+      if (dofork) {
+	 Error("options fork and multiplex are mutually exclusive");
+	 return STAT_NORETRY;
+      }
+#if !HAVE_EPOLL_CREATE1
+      Error("option multiplex requires epoll");
+      return STAT_NORETRY;
+#endif
+      retropt_int(opts, OPT_MAX_CHILDREN, &fd->stream.para.socket.maxconns);
+   }
+
 #if WITH_IP4 /*|| WITH_IP6*/
    if (retropt_string(opts, OPT_RANGE, &rangename) >= 0) {
       if (xioparserange(rangename, pf, &fd->stream.para.socket.range) < 0) {
@@ -174,6 +221,11 @@ int xioopen_ipdgram_listen(int argc, const char *argv[], struct opt *opts,
 #if WITH_LIBWRAP
    xio_retropt_tcpwrap(&fd->stream, opts);
 #endif /* WITH_LIBWRAP */
+#if WITH_IP4 || WITH_IP6
+   if (xio_retropt_acl(&fd->stream, opts) < 0) {
+      return STAT_NORETRY;
+   }
+#endif /* WITH_IP4 || WITH_IP6 */
 
    if (retropt_ushort(opts, OPT_SOURCEPORT, &fd->stream.para.socket.ip.sourceport)
        >= 0) {
@@ -228,6 +280,21 @@ int xioopen_ipdgram_listen(int argc, const char *argv[], struct opt *opts,
 
       Notice1("listening on UDP %s",
 	      sockaddr_info(&us.soa, uslen, infobuff, sizeof(infobuff)));
+
+      if (domux) {
+	 /* xiomux_socat() receives the packets of all peers on this socket
+	    and opens the second address once per peer address */
+	 fd->stream.flags |= XIO_DOESMUX;
+	 fd->stream.dtype = XIOREAD_RECV|XIOWRITE_SENDTO;
+	 fd->stream.para.socket.la = us;
+	 fd->stream.para.socket.muxdgram = true;
+	 fd->stream.para.socket.proto = IPPROTO_UDP;
+	 applyopts(fd->stream.rfd, opts, PH_LATE);
+	 fd->stream.wfd = fd->stream.rfd;
+	 dropopts(opts, PH_ALL);
+	 return 0;
+      }
+
       readfd.fd = fd->stream.rfd;
       readfd.events = POLLIN|POLLERR;
       while (xiopoll(&readfd, 1, NULL) < 0) {
@@ -477,6 +544,11 @@ int xioopen_udp_datagram(int argc, const char *argv[], struct opt *opts,
 #if WITH_LIBWRAP
    xio_retropt_tcpwrap(xfd, opts);
 #endif /* WITH_LIBWRAP */
+#if WITH_IP4 || WITH_IP6
+   if (xio_retropt_acl(xfd, opts) < 0) {
+      return STAT_NORETRY;
+   }
+#endif /* WITH_IP4 || WITH_IP6 */
 
    _xio_openlate(xfd, opts);
    return STAT_OK;
@@ -630,6 +702,11 @@ int xioopen_udp_recv(int argc, const char *argv[], struct opt *opts,
 #if WITH_LIBWRAP
    xio_retropt_tcpwrap(&xfd->stream, opts);
 #endif /* WITH_LIBWRAP */
+#if WITH_IP4 || WITH_IP6
+   if (xio_retropt_acl(&xfd->stream, opts) < 0) {
+      return STAT_NORETRY;
+   }
+#endif /* WITH_IP4 || WITH_IP6 */
 
    if (retropt_ushort(opts, OPT_SOURCEPORT,
 		      &xfd->stream.para.socket.ip.sourceport)
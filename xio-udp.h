@@ -24,6 +24,16 @@ extern const union xioaddr_desc *xioaddrs_udp6_datagram[];
 extern const union xioaddr_desc *xioaddrs_udp6_recvfrom[];
 extern const union xioaddr_desc *xioaddrs_udp6_recv[];
 
+#if HAVE_UDP_GSO
+/* a datagram coalesced by UDP GRO may take the maximal IP packet */
+#define XIO_UDP_GROBUFSIZ 65536
+
+extern const struct optdesc opt_udp_gro;
+extern const struct optdesc opt_udp_segment;
+
+extern size_t xioudp_grosize(struct msghdr *msgh, size_t bytes);
+#endif /* HAVE_UDP_GSO */
+
 extern int xioopen_ipdgram_listen(int argc, const char *argv[], struct opt *opts,
 				  int rw, xiofile_t *fd,
 			  unsigned groups, int af, int ipproto,
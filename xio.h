@@ -38,6 +38,8 @@ struct opt;
 #define XIO_MAYCHAIN   64 /* address is allowed to consist of a chain of
 			     subaddresses that are handled by socat
 			     subprocesses */
+#define XIO_MAYMUX    128 /* address may hand its listening socket to the
+			     multiplexing accept loop (option multiplex) */
 #define XIO_EMBEDDED 256	/* address is nonterminal */
 #define XIO_MAYALL INT_MAX	/* all features enabled */
 
@@ -47,6 +49,7 @@ struct opt;
 #define XIO_DOESEXEC    XIO_MAYEXEC
 #define XIO_DOESCONVERT XIO_MAYCONVERT
 #define XIO_DOESCHAIN	XIO_MAYCHAIN
+#define XIO_DOESMUX	XIO_MAYMUX
 
 /* sometimes we use a set of allowed direction(s), a bit pattern */
 #define XIOBIT_RDONLY (1<<XIO_RDONLY)
@@ -70,6 +73,8 @@ struct opt;
 #define XIOREAD_READLINE	0x5000	/* ... */
 #define XIOREAD_OPENSSL		0x6000	/* SSL_read() */
 #define XIOREAD_TEST		0x7000	/* xioread_test() */
+#define XIOREAD_LAYER		0x8000	/* layer->read() on the lower address */
+#define XIOREAD_RING		0x9000	/* xioring_read() */
 #define XIODATA_WRITEMASK	0x0f00	/* mask for basic r/w method */
 #define XIOWRITE_STREAM		0x0100	/* write() (default) */
 #define XIOWRITE_SENDTO		0x0200	/* sendto() */
@@ -79,6 +84,8 @@ struct opt;
 #define XIOWRITE_OPENSSL	0x0600	/* SSL_write() */
 #define XIOWRITE_TEST		0x0700	/* xiowrite_test() */
 #define XIOWRITE_TESTREV	0x0800	/* xiowrite_testrev() */
+#define XIOWRITE_LAYER		0x0900	/* layer->write() to the lower address */
+#define XIOWRITE_RING		0x0a00	/* xioring_write() */
 /* modifiers to XIODATA_READ_RECV */
 #define XIOREAD_RECV_CHECKPORT	0x0001	/* recv, check peer port */
 #define XIOREAD_RECV_CHECKADDR	0x0002	/* recv, check peer address */
@@ -104,6 +111,8 @@ struct opt;
 #define XIODATA_TEST		(XIOREAD_TEST|XIOWRITE_TEST)
 #define XIODATA_TESTUNI		XIOWRITE_TEST
 #define XIODATA_TESTREV		XIOWRITE_TESTREV
+#define XIODATA_LAYER		(XIOREAD_LAYER|XIOWRITE_LAYER)
+#define XIODATA_RING		(XIOREAD_RING|XIOWRITE_RING)
 
 /* XIOSHUT_* define the actions on shutdown of the address */
 /*  */
@@ -132,6 +141,8 @@ struct opt;
 #define XIOSHUT_NULL		(XIOSHUTRD_DOWN|XIOSHUTWR_NULL)
 #define XIOSHUT_PTYEOF		0x0100	/* change pty to icanon and write VEOF */
 #define XIOSHUT_OPENSSL		0x0101	/* specific action on openssl */
+#define XIOSHUT_LAYER		0x0102	/* shut down the lower address */
+#define XIOSHUT_RING		0x0103	/* EOF record to the ring */
 /*!!!*/
 
 #define XIOCLOSE_UNSPEC		0x0000	/* after init, when no end-close... option */
@@ -144,6 +155,8 @@ struct opt;
 #define XIOCLOSE_SLEEP_SIGTERM	0x0007	/* short sleep, then SIGTERM */
 #define XIOCLOSE_OPENSSL	0x0101
 #define XIOCLOSE_READLINE	0x0102
+#define XIOCLOSE_LAYER		0x0103	/* close the lower address */
+#define XIOCLOSE_RING		0x0104	/* release the rings */
 
 /* these are the values allowed for the "enum xiotag  tag" flag of the "struct
    single" and "union bipipe" (xiofile_t) structures. */
@@ -166,9 +179,19 @@ enum xiocomm {
    XIOCOMM_TCP,		/* one TCP socket pair */
    XIOCOMM_TCP4,	/* one TCP/IPv4 socket pair */
    XIOCOMM_TCP4_LISTEN,	/* right side listens for TCP/IPv4, left connects */
+   XIOCOMM_SHMRINGS,	/* two shared memory rings; chain threads only */
 } ;
 
+/* data transfer engines (option -e) */
+enum xioengine {
+   XIOENGINE_POLL,	/* select()/poll(), or epoll where available */
+   XIOENGINE_URING,	/* io_uring, falls back to XIOENGINE_POLL */
+} ;
+
+struct single;
 union bipipe;
+struct xioring;
+struct xiommsg;
 
 
 #define XIOADDR_ENDPOINT 0	/* endpoint address */
@@ -184,8 +207,24 @@ typedef struct fddesc {
    int dtype;		/* specifies methods for reading and writing */
    int howtoshut;	/* specifies method for shutting down wfd */
    int howtoclose;	/* specifies method for closing rfd and wfd */
+   struct xioring *rring;	/* with XIODATA_RING: rfd is its eventfd */
+   struct xioring *wring;	/* with XIODATA_RING: wfd is its eventfd */
 } xiofd_t;
 
+/* in-process data methods of an inter address: instead of a socketpair and
+   a thread with its own transfer engine, the engine of the address on the
+   left calls these directly, and they read and write the lower address (the
+   rest of the chain, sfd->lower) */
+struct xiolayer {
+   ssize_t (*read)(struct single *sfd, void *buff, size_t bufsiz);
+   ssize_t (*write)(struct single *sfd, const void *buff, size_t bytes);
+   ssize_t (*pending)(struct single *sfd);	/* data buffered in the layer
+						   that poll() does not see;
+						   NULL: none */
+   bool handshake;	/* opening talks to the peer over the fds of the lower
+			   address; it must be a plain stream */
+} ;
+
 struct xioaddr_inter_desc {
    int tag;		/* 0: endpoint addr; 1: inter addr */
    const char *defname;	/* main (canonical) name of address */
@@ -204,6 +243,7 @@ struct xioaddr_inter_desc {
 #if WITH_HELP
    const char *syntax;
 #endif
+   const struct xiolayer *layer;	/* NULL: needs socketpair and thread */
 } ;
 
 struct xioaddr_endpoint_desc {
@@ -286,6 +326,7 @@ typedef struct {
    bool righttoleft;	/* first addr wo, second addr ro */
    int pipetype;	/* communication (pipe) type; 0: 2 unidirectional
 			   socketpairs; 1: 2 pipes; 2: 1 socketpair */
+   int engine;		/* data transfer engine, enum xioengine */
 } xioopts_t;
 
 /* pack the description of a lock file */
@@ -352,6 +393,8 @@ typedef struct single {
 #if _WITH_SOCKET
    union sockaddr_union peersa;
    socklen_t salen;
+   union sockaddr_union locsa;	/* local address, for messages */
+   socklen_t loclen;		/* 0 while locsa is unknown */
 #endif /* _WITH_SOCKET */
 #if WITH_TERMIOS
    bool ttyvalid;		/* the following struct is valid */
@@ -365,7 +408,49 @@ typedef struct single {
    pid_t ppid;			/* parent pid, only if we send it signals */
    int escape;			/* escape character; -1 for no escape */
    bool actescape;		/* escape character found in input data */
+#if HAVE_SPLICE
+   int splicefd[2];		/* kernel pipe for splice()'ing data read from
+				   this stream; -1 when not yet created */
+   bool nosplice;		/* splice() not usable, use read()/write() */
+#endif /* HAVE_SPLICE */
+#if HAVE_SENDFILE
+   signed char usesendfile;	/* read side is a regular file that is
+				   sendfile()'d: 0 not yet checked, 1 yes,
+				   -1 no */
+#endif /* HAVE_SENDFILE */
+   unsigned char *wqbuff;	/* output that a nonblocking write() did not
+				   take; see xioflush() */
+   size_t wqsize;		/* allocated size of wqbuff */
+   size_t wqlen;		/* number of pending bytes in wqbuff */
+   bool wqdrop;			/* on shutdown and close, drop what the fd
+				   does not take at once (option multiplex) */
+   bool draining;		/* in xiodrain(): an error exit from there
+				   must not drain again in xioexit() */
+   bool inherited;		/* the fds came from the parent process (FD,
+				   STDIO); their file status flags are shared
+				   with it */
+   unsigned long verbpos;	/* -v, -x: number of bytes read before, for
+				   the block headers */
    pthread_t subthread;		/* thread handling next inter-addr in chain */
+   const struct xiolayer *layer;	/* with XIODATA_LAYER: the data methods */
+   union bipipe *lower;		/* with XIODATA_LAYER: the next address in
+				   the chain */
+   struct xioring *rring;	/* with XIODATA_RING: ring we read from */
+   struct xioring *wring;	/* with XIODATA_RING: ring we write to */
+   struct xiommsg *rbatch;	/* with XIOREAD_RECV: datagrams received by
+				   recvmmsg() and not yet read */
+   struct xiommsg *wbatch;	/* with XIOWRITE_SENDTO: datagrams waiting for
+				   sendmmsg() */
+#if HAVE_UDP_GSO
+   size_t segsize;		/* reading: segment size of the datagram that
+				   UDP GRO coalesced in the last xioread();
+				   writing: set by xiotransfer() for the next
+				   xiowrite(); 0 for a plain datagram */
+   signed char usegso;		/* writing segments: 0 not yet checked, 1 UDP
+				   socket (UDP_SEGMENT), -1 other datagram
+				   socket (one packet per segment), -2 no
+				   datagram socket (write as is) */
+#endif /* HAVE_UDP_GSO */
    union {
 #if 0
       struct {
@@ -377,8 +462,21 @@ typedef struct single {
 	 struct timeval connect_timeout; /* how long to hang in connect() */
 	 union sockaddr_union la;	/* local socket address */
 	 bool null_eof;		/* with dgram: empty packet means EOF */
+	 int batch;		/* with dgram: datagrams per recvmmsg() and
+				   sendmmsg(); 0 for default */
 	 bool dorange;
 	 struct xiorange range;	/* restrictions for peer address */
+	 struct xioacl *acl;	/* option acl: compiled peer address list */
+	 struct opt *muxopts;	/* with option multiplex: the options to be
+				   applied to each accepted connection */
+	 int maxconns;		/* with option multiplex: max-children */
+	 int proto;		/* with option multiplex: for the env vars */
+	 bool muxshared;	/* with option prefork: the listening socket
+				   is shared with the other workers */
+	 bool muxthreads;	/* with option thread: the connections are
+				   handled by threads */
+	 bool muxdgram;		/* with option multiplex on UDP-LISTEN: the
+				   peers are told apart by their addresses */
 #if _WITH_IP4 || _WITH_IP6
 	 struct {
 	    unsigned int res_opts[2];	/* bits to be set in _res.options are
@@ -392,6 +490,8 @@ typedef struct single {
 	    char    *tcpwrap_etc;
 	    char    *hosts_allow_table;
 	    char    *hosts_deny_table;
+	    struct xiotcpwrap_cache *tcpwrap_cache;	/* decisions of
+					   hosts_access(), or NULL */
 #endif
 	 } ip;
 #endif /* _WITH_IP4 || _WITH_IP6 */
@@ -455,6 +555,22 @@ typedef struct single {
 	 struct timeval connect_timeout; /* how long to hang in connect() */
 	 SSL *ssl;
 	 SSL_CTX* ctx;
+	 char *sessfile;	/* client session store, or NULL */
+	 int rdwant;		/* SSL_ERROR_WANT_READ or _WRITE of the last
+				   unfinished SSL_read(), or 0 */
+	 int wrwant;		/* same for SSL_write() */
+	 size_t wretry;		/* length of the unfinished SSL_write() at the
+				   start of wqbuff, see xioflush_openssl() */
+	 bool coalescing;	/* option coalesce */
+	 bool verify;		/* with option multiplex: option verify for the
+				   handshakes of the accepted connections */
+	 struct timeval coalesce;	/* how long collected data may wait */
+	 unsigned char *cbuff;	/* plaintext for the next record, see
+				   xiocoalesce() */
+	 size_t clen;
+	 struct timeval csince;	/* when the first byte came into cbuff */
+	 const char *commonname;	/* with option multiplex: option
+				   commonname for the accepted connections */
       } openssl;
 #endif /* WITH_OPENSSL */
 #if WITH_TUN
@@ -605,6 +721,33 @@ struct threadarg_struct {
    int rw;	/* one of XIO_RDONLY, ... */
    xiofile_t *xfd1;
    xiofile_t *xfd2;
+   xiofile_t *lower;	/* not NULL: xfd1 is opened as layer on it */
+   int exitlevel;	/* of the creating thread, see diag_set_int('E') */
+} ;
+
+/* the state of the data transfer loop between two xio files; see
+   xiorelay_step() */
+struct xiorelay {
+   xiofile_t *sock1;
+   xiofile_t *sock2;
+   unsigned char *buff;
+   int polling;		/* handling ignoreeof */
+   int wasaction;	/* last poll was active, do NOT sleep before next */
+   struct timeval total_timeout;	/* the actual total timeout timer */
+   struct timeval timeout;	/* the poll timeout of this iteration */
+   struct timeval *to;		/* &timeout, or NULL for no timeout */
+   bool mayrd1;		/* sock1 has read data or eof, according to poll() */
+   bool mayrd2;		/* sock2 has read data or eof, according to poll() */
+   bool maywr1;		/* sock1 can be written to, according to poll()
+			   or because the last write to it was complete */
+   bool maywr2;		/* sock2 can be written to, according to poll()
+			   or because the last write to it was complete */
+   bool optwr1;		/* sock1 output is nonblocking: write optimistically */
+   bool optwr2;		/* sock2 output is nonblocking: write optimistically */
+   bool optrd1;		/* sock1 input is nonblocking: after a full block
+			   read again without asking poll() */
+   bool optrd2;		/* sock2 input is nonblocking: read optimistically */
+   int skipped;		/* number of poll() calls skipped in a row */
 } ;
 
 extern const char *PIPESEP;
@@ -637,6 +780,26 @@ extern int xiosocketpair3(xiofile_t **xfd1p, xiofile_t **xfd2p, int how, ...);
 extern int xiopty(int useptmx, int *ttyfdp, int *ptyfdp);
 extern int xiocommpair(int commtype, bool lefttoright, bool righttoleft,
 		       int dual, xiofd_t *left, xiofd_t *right, ...);
+extern struct xioring *xioring_create(size_t size, int *datafd, int *spacefd);
+extern ssize_t xioring_read(struct xioring *ring, void *buff, size_t bufsiz);
+extern ssize_t xioring_pending(struct xioring *ring);
+extern ssize_t xioring_write(struct xioring *ring, const void *buff,
+			     size_t bytes);
+extern ssize_t xioring_writefull(struct xioring *ring, const void *buff,
+				 size_t bytes, const struct timeval *tmo);
+extern short xioring_pollout(struct xioring *ring);
+extern int xioring_shutdown(struct xioring *ring, bool writer);
+extern void xioring_close(struct xioring *ring, bool writer);
+#if HAVE_MMSG
+extern bool xiommsg_usable(struct single *pipe, bool forwrite);
+extern ssize_t xiommsg_recv(struct single *pipe, void *buff, size_t bufsiz,
+			    union sockaddr_union *from, socklen_t *fromlen,
+			    struct msghdr **msgh);
+extern ssize_t xiommsg_pending(struct single *pipe);
+extern int xiommsg_send(struct single *pipe, const void *buff, size_t bytes);
+extern int xiommsg_flush(struct single *pipe);
+extern void xiommsg_free(struct single *pipe);
+#endif /* HAVE_MMSG */
 
 extern int xioopensingle(char *addr, xiosingle_t *fd, int xioflags);
 extern int xioopenhelp(FILE *of, int level);
@@ -651,9 +814,20 @@ extern int xio_opt_signal(pid_t pid, int signum);
 
 extern void *xioengine(void *thread_arg);
 extern int _socat(xiofile_t *xfd1, xiofile_t *xfd2);
+extern int xiorelay_init(struct xiorelay *relay, xiofile_t *sock1, xiofile_t *sock2);
+extern void xiorelay_exit(struct xiorelay *relay);
+extern int xiorelay_timer(struct xiorelay *relay);
+extern void xiorelay_fds(struct xiorelay *relay, struct pollfd fds[4]);
+extern int xiorelay_step(struct xiorelay *relay, struct pollfd fds[4], int retval);
+#define XIOURING_FALLBACK (-2)	/* use the poll engine instead */
+extern int xiouring_socat(xiofile_t *sock1, xiofile_t *sock2);
+extern int xiomux_socat(xiofile_t *lfd, const char *address2);
 extern ssize_t xioread(xiofile_t *sock1, void *buff, size_t bufsiz);
 extern ssize_t xiopending(xiofile_t *sock1);
 extern ssize_t xiowrite(xiofile_t *sock1, const void *buff, size_t bufsiz);
+extern ssize_t xioflush(xiofile_t *sock1);
+extern int xioflushtimer(xiofile_t *sock1, struct timeval *due);
+extern int xiodrain(struct single *pipe);
 extern int xiotransfer(xiofile_t *inpipe, xiofile_t *outpipe,
 		unsigned char **buff, size_t bufsiz, bool righttoleft);
 extern int xioshutdown(xiofile_t *sock, int how);
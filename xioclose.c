@@ -21,6 +21,11 @@ int xioclose1(struct single *pipe) {
       return -1;
    }
 
+   xiodrain(pipe);
+#if HAVE_MMSG
+   xiommsg_free(pipe);
+#endif /* HAVE_MMSG */
+
    switch (pipe->howtoclose) {
 
 #if WITH_READLINE
@@ -47,6 +52,24 @@ int xioclose1(struct single *pipe) {
       break;
 #endif /* WITH_OPENSSL */
 
+   case XIOCLOSE_LAYER:
+      /* the fds are those of the lower address */
+      xioclose(pipe->lower);
+      break;
+
+#if HAVE_SHMRINGS
+   case XIOCLOSE_RING:
+      /* the fds are the eventfds of the rings */
+      if (pipe->rring != NULL) {
+	 xioring_close(pipe->rring, false);  pipe->rring = NULL;
+      }
+      if (pipe->wring != NULL) {
+	 xioring_close(pipe->wring, true);   pipe->wring = NULL;
+      }
+      pipe->rfd = pipe->wfd = -1;
+      break;
+#endif /* HAVE_SHMRINGS */
+
    case XIOCLOSE_SIGTERM:
       if (pipe->child.pid > 0) {
 	 if (Kill(pipe->child.pid, SIGTERM) < 0) {
@@ -107,6 +130,13 @@ int xioclose1(struct single *pipe) {
    }
 #endif /* WITH_TERMIOS */
 
+#if HAVE_SPLICE
+   if (pipe->splicefd[0] >= 0) {
+      Close(pipe->splicefd[0]);  pipe->splicefd[0] = -1;
+      Close(pipe->splicefd[1]);  pipe->splicefd[1] = -1;
+   }
+#endif /* HAVE_SPLICE */
+
    /* unlock */
    if (pipe->havelock) {
       xiounlock(pipe->lock.lockfile);
@@ -126,7 +156,7 @@ int xioclose1(struct single *pipe) {
 
 /* close the xio fd */
 int xioclose(xiofile_t *file) {
-   xiofile_t *xfd = file;
+   pthread_t subthread = file->stream.subthread;
    int result;
 
    if (file->tag == XIO_TAG_INVALID) {
@@ -142,8 +172,27 @@ int xioclose(xiofile_t *file) {
    } else {
       result = xioclose1(&file->stream);
    }
-   if (xfd->tag != XIO_TAG_INVALID && xfd->stream.subthread != 0) {
-      Pthread_join(xfd->stream.subthread, NULL);
+   /* the engine of the rest of the chain must pass on the data in flight;
+      closing our side gives it EOF. Wait for it like for a closing peer, at
+      most the closing timeout (option -t): processes in the chain might keep
+      it alive */
+   if (subthread != 0) {
+#if HAVE_PTHREAD_TIMEDJOIN_NP
+      struct timespec deadline;
+      int _errno;
+
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_sec  += xioparams->closwait.tv_sec;
+      deadline.tv_nsec += xioparams->closwait.tv_usec*1000;
+      if (deadline.tv_nsec >= 1000000000) {
+	 deadline.tv_nsec -= 1000000000;
+	 ++deadline.tv_sec;
+      }
+      if ((_errno = Pthread_timedjoin_np(subthread, NULL, &deadline)) != 0) {
+	 Info2("thread "F_thread" did not terminate: %s",
+	       subthread, strerror(_errno));
+      }
+#endif /* HAVE_PTHREAD_TIMEDJOIN_NP */
    }
    return result;
 }
@@ -119,6 +119,27 @@
 #  undef HAVE_PTY
 #endif
 
+/* chain links over shared memory rings (option -cr) are woken by eventfds */
+#if HAVE_SYS_EVENTFD_H && HAVE_EVENTFD
+#  define HAVE_SHMRINGS 1
+#else
+#  undef HAVE_SHMRINGS
+#endif
+
+/* datagram sockets transfer batches of packets (option batch) */
+#if _WITH_SOCKET && HAVE_RECVMMSG && HAVE_SENDMMSG
+#  define HAVE_MMSG 1
+#else
+#  undef HAVE_MMSG
+#endif
+
+/* UDP sockets pass coalesced datagrams (options udp-gro, udp-segment) */
+#if WITH_UDP && HAVE_UDP_SEGMENT
+#  define HAVE_UDP_GSO 1
+#else
+#  undef HAVE_UDP_GSO
+#endif
+
 #ifndef HAVE_TYPE_SOCKLEN
    typedef int socklen_t;
 #endif /* !defined(HAVE_TYPE_SOCKLEN) */
@@ -8,6 +8,7 @@
 
 #include "xioopen.h"
 #include "xiosigchld.h"
+#include "xio-openssl.h"
 
 
 /* checks if this is a connection to a child process, and if so, sees if the
@@ -49,8 +50,7 @@ int childleftdata(xiofile_t *xfd) {
       if (retval == 0) {
          Info("terminated child did not leave data for us");
          XIO_RDSTREAM(xfd)->eof = 2;
-         xfd->stream.eof = 2;
-         xfd->stream.closing = MAX(xfd->stream.closing, 1);
+         XIO_RDSTREAM(xfd)->closing = MAX(XIO_RDSTREAM(xfd)->closing, 1);
       }
    }
    return 0;
@@ -59,31 +59,636 @@ int childleftdata(xiofile_t *xfd) {
 void *xioengine(void *thread_arg) {
    struct threadarg_struct *engine_arg = thread_arg;
 
+   diag_set_int('E', engine_arg->exitlevel);
    _socat(engine_arg->xfd1, engine_arg->xfd2);
    free(engine_arg);
    return NULL/*!*/;
 }
 
+/* returns true when the output fd of sock is nonblocking. Only then the
+   engine may write to it without waiting for POLLOUT: a blocking write would
+   stall the other direction and the timeouts */
+static bool xiorelay_nonblocking(xiofile_t *sock) {
+   int wfd = XIO_GETWRFD(sock);
+   int flags;
+
+   if (wfd < 0 || (flags = Fcntl(wfd, F_GETFL)) < 0) {
+      return false;
+   }
+   return (flags & O_NONBLOCK) != 0;
+}
+
+/* sockets and pipes that socat opened itself are read and written without
+   blocking, so the engine can write, and read after a full block, without
+   asking poll() first. Only the plain read() and write() methods are prepared
+   for EAGAIN; and inherited fds (FD, STDIO) keep their mode because the
+   parent process shares it.
+   returns true when fd is nonblocking and pipe uses the plain methods */
+static bool xiorelay_nonblock(struct single *pipe, int fd) {
+   int rtype = pipe->dtype & XIODATA_READMASK;
+   int wtype = pipe->dtype & XIODATA_WRITEMASK;
+   struct stat buf;
+   int flags;
+
+   if ((rtype != 0 && rtype != XIOREAD_STREAM) ||
+       (wtype != 0 && wtype != XIOWRITE_STREAM && wtype != XIOWRITE_PIPE &&
+	wtype != XIOWRITE_2PIPE)) {
+      return false;
+   }
+   if (fd < 0 || (flags = Fcntl(fd, F_GETFL)) < 0) {
+      return false;
+   }
+   if (flags & O_NONBLOCK) {
+      return true;
+   }
+   if (pipe->inherited) {
+      return false;
+   }
+   if (Fstat(fd, &buf) < 0 ||
+       !(S_ISSOCK(buf.st_mode) || S_ISFIFO(buf.st_mode))) {
+      return false;
+   }
+   if (Fcntl_l(fd, F_SETFL, flags|O_NONBLOCK) < 0) {
+      Info2("fcntl(%d, F_SETFL, O_NONBLOCK): %s", fd, strerror(errno));
+      return false;
+   }
+   return true;
+}
+
+/* prepares the state of the data transfer between two opened xio files.
+   returns 0 on success, or -1 when memory is exhausted */
+int xiorelay_init(struct xiorelay *relay, xiofile_t *sock1, xiofile_t *sock2) {
+   relay->sock1 = sock1;
+   relay->sock2 = sock2;
+   /* when converting nl to crnl, size might double */
+   relay->buff = Malloc(2*xioparams->bufsiz+1);
+   if (relay->buff == NULL)  return -1;
+   relay->polling = 0;
+   relay->wasaction = 1;
+   relay->total_timeout = xioparams->total_timeout;
+   relay->to = NULL;
+   relay->mayrd1 = relay->mayrd2 = false;
+   relay->maywr1 = relay->maywr2 = false;
+   relay->optrd1 = XIO_READABLE(sock1) &&
+      xiorelay_nonblock(XIO_RDSTREAM(sock1), XIO_GETRDFD(sock1));
+   relay->optrd2 = XIO_READABLE(sock2) &&
+      xiorelay_nonblock(XIO_RDSTREAM(sock2), XIO_GETRDFD(sock2));
+   relay->optwr1 = XIO_WRITABLE(sock1) &&
+      (xiorelay_nonblock(XIO_WRSTREAM(sock1), XIO_GETWRFD(sock1)) ||
+       xiorelay_nonblocking(sock1));
+   relay->optwr2 = XIO_WRITABLE(sock2) &&
+      (xiorelay_nonblock(XIO_WRSTREAM(sock2), XIO_GETWRFD(sock2)) ||
+       xiorelay_nonblocking(sock2));
+   relay->skipped = 0;
+   return 0;
+}
+
+void xiorelay_exit(struct xiorelay *relay) {
+   free(relay->buff);
+   relay->buff = NULL;
+}
+
+/* starts one iteration of the transfer loop: accounts the ignoreeof poll
+   intervall against the total inactivity timeout and selects the poll
+   timeout.
+   returns 1 when the inactivity timeout has triggered and the xio files have
+   been closed, 0 otherwise */
+int xiorelay_timer(struct xiorelay *relay) {
+   xiofile_t *sock1 = relay->sock1, *sock2 = relay->sock2;
+
+   /* for ignoreeof */
+   if (relay->polling) {
+      if (!relay->wasaction) {
+	 /* yes we could do it with select but I like readable trace output */
+	 if (xioparams->total_timeout.tv_sec != 0 ||
+	     xioparams->total_timeout.tv_usec != 0) {
+	    if (relay->total_timeout.tv_usec < xioparams->pollintv.tv_usec) {
+	       relay->total_timeout.tv_usec += 1000000;
+	       relay->total_timeout.tv_sec  -= 1;
+	    }
+	    relay->total_timeout.tv_sec  -= xioparams->pollintv.tv_sec;
+	    relay->total_timeout.tv_usec -= xioparams->pollintv.tv_usec;
+	    if (relay->total_timeout.tv_sec < 0 ||
+		relay->total_timeout.tv_sec == 0 && relay->total_timeout.tv_usec < 0) {
+	       Notice("inactivity timeout triggered");
+	       xioclose(sock1);
+	       xioclose(sock2);
+	       return 1;
+	    }
+	 }
+
+      } else {
+	 relay->wasaction = 0;
+      }
+   }
+
+   if (relay->polling) {
+      /* there is a ignoreeof poll timeout, use it */
+      relay->timeout = xioparams->pollintv;
+      relay->to = &relay->timeout;
+   } else if (xioparams->total_timeout.tv_sec != 0 ||
+	      xioparams->total_timeout.tv_usec != 0) {
+      /* there might occur a total inactivity timeout */
+      relay->timeout = xioparams->total_timeout;
+      relay->to = &relay->timeout;
+   } else {
+      relay->to = NULL;
+   }
+
+#if 1
+   if (XIO_RDSTREAM(sock1)->closing>=1 || XIO_RDSTREAM(sock2)->closing>=1) {
+      /* first eof already occurred, start end timer */
+      relay->timeout = xioparams->closwait;
+      relay->to = &relay->timeout;
+      /*0 closing = 2;*/
+   }
+#endif
+   return 0;
+}
+
+/* the poll events for pipe; SSL may first need the other direction, and a
+   full ring is waited for with POLLIN on its eventfd. A layer uses the fds of
+   its lower address */
+static short xiorelay_events(struct single *pipe, short events) {
+   if ((events & POLLOUT) &&
+       (pipe->dtype & XIODATA_WRITEMASK) == XIOWRITE_LAYER) {
+      return xiorelay_events(XIO_WRSTREAM(pipe->lower), events);
+   }
+   if ((events & POLLIN) &&
+       (pipe->dtype & XIODATA_READMASK) == XIOREAD_LAYER) {
+      return xiorelay_events(XIO_RDSTREAM(pipe->lower), events);
+   }
+#if HAVE_SHMRINGS
+   if ((events & POLLOUT) &&
+       (pipe->dtype & XIODATA_WRITEMASK) == XIOWRITE_RING) {
+      return xioring_pollout(pipe->wring);
+   }
+#endif /* HAVE_SHMRINGS */
+#if WITH_OPENSSL
+   if (((events & POLLIN) &&
+	(pipe->dtype & XIODATA_READMASK) == XIOREAD_OPENSSL) ||
+       ((events & POLLOUT) &&
+	(pipe->dtype & XIODATA_WRITEMASK) == XIOWRITE_OPENSSL)) {
+      return xiopoll_openssl(pipe, events);
+   }
+#endif /* WITH_OPENSSL */
+   return events;
+}
+
+/* with option coalesce: wake up when the output of sock is due */
+static void xiorelay_flushtimer(struct xiorelay *relay, xiofile_t *sock) {
+   struct timeval due;
+
+   if (!xioflushtimer(sock, &due)) {
+      return;
+   }
+   if (relay->to == NULL || timercmp(&due, relay->to, <)) {
+      relay->timeout = due;
+      relay->to = &relay->timeout;
+   }
+}
+
+/* frame 1: sets the poll parameters of the (up to) four file descriptors of
+   the relay: fds[0] sock1 in, fds[1] sock1 out, fds[2] sock2 in, fds[3] sock2
+   out; unused entries get fd -1. Might shorten the poll timeout. */
+void xiorelay_fds(struct xiorelay *relay, struct pollfd fds[4]) {
+   xiofile_t *sock1 = relay->sock1, *sock2 = relay->sock2;
+   struct pollfd
+       *fd1in  = &fds[0],
+       *fd1out = &fds[1],
+       *fd2in  = &fds[2],
+       *fd2out = &fds[3];
+
+   childleftdata(sock1);
+   childleftdata(sock2);
+
+#if 0
+   if (closing>=1) {
+      /* first eof already occurred, start end timer */
+      timeout = xioparams->closwait;
+      to = &timeout;
+      closing = 2;
+   }
+#else
+   if (XIO_RDSTREAM(sock1)->closing>=1 || XIO_RDSTREAM(sock2)->closing>=1) {
+      /* first eof already occurred, start end timer */
+      relay->timeout = xioparams->closwait;
+      relay->to = &relay->timeout;
+      if (XIO_RDSTREAM(sock1)->closing==1) {
+	 XIO_RDSTREAM(sock1)->closing = 2;
+      }
+      if (XIO_RDSTREAM(sock2)->closing==1) {
+	 XIO_RDSTREAM(sock2)->closing = 2;
+      }
+   }
+#endif
+
+   /* use the ignoreeof timeout if appropriate */
+   if (relay->polling) {
+      if ((XIO_RDSTREAM(sock1)->closing == 0 && XIO_RDSTREAM(sock2)->closing == 0) ||
+	  (xioparams->pollintv.tv_sec < relay->timeout.tv_sec) ||
+	  ((xioparams->pollintv.tv_sec == relay->timeout.tv_sec) &&
+	   xioparams->pollintv.tv_usec < relay->timeout.tv_usec)) {
+	 relay->timeout = xioparams->pollintv;
+      }
+   }
+
+   /* now the fds will be assigned */
+   if (XIO_READABLE(sock1) &&
+       !(XIO_RDSTREAM(sock1)->eof > 1 && !XIO_RDSTREAM(sock1)->ignoreeof)
+       /*0 && !xioparams->righttoleft*/) {
+      Debug3("*** sock1: %p [%d,%d]", sock1, XIO_GETRDFD(sock1), XIO_GETWRFD(sock1));
+      /* while output is pending, do not read more data for it */
+      if (!relay->mayrd1 && !(XIO_RDSTREAM(sock1)->eof > 1) &&
+	  XIO_WRSTREAM(sock2)->wqlen == 0) {
+	 fd1in->fd = XIO_GETRDFD(sock1);
+	 fd1in->events = xiorelay_events(XIO_RDSTREAM(sock1), POLLIN);
+      } else {
+	 fd1in->fd = -1;
+      }
+      /* with optimistic write maywr2 may already be set; when input is
+	 pending nevertheless poll the output so poll() returns at once
+	 (but not during ignoreeof polling that needs the interval) */
+      if (!relay->maywr2 || (relay->mayrd1 && !relay->polling)) {
+	 fd2out->fd = XIO_GETWRFD(sock2);
+	 fd2out->events = xiorelay_events(XIO_WRSTREAM(sock2), POLLOUT);
+      } else {
+	 fd2out->fd = -1;
+      }
+   } else {
+      fd1in->fd = -1;
+      fd2out->fd = -1;
+   }
+   if (fd2out->fd < 0 && XIO_WRSTREAM(sock2)->wqlen > 0) {
+      /* after EOF the queued output must still be written */
+      fd2out->fd = XIO_GETWRFD(sock2);
+      fd2out->events = xiorelay_events(XIO_WRSTREAM(sock2), POLLOUT);
+   }
+   if (XIO_READABLE(sock2) &&
+       !(XIO_RDSTREAM(sock2)->eof > 1 && !XIO_RDSTREAM(sock2)->ignoreeof)
+       /*0 && !xioparams->lefttoright*/) {
+      Debug3("*** sock2: %p [%d,%d]", sock2, XIO_GETRDFD(sock2), XIO_GETWRFD(sock2));
+      if (!relay->mayrd2 && !(XIO_RDSTREAM(sock2)->eof > 1) &&
+	  XIO_WRSTREAM(sock1)->wqlen == 0) {
+	 fd2in->fd = XIO_GETRDFD(sock2);
+	 fd2in->events = xiorelay_events(XIO_RDSTREAM(sock2), POLLIN);
+      } else {
+	 fd2in->fd = -1;
+      }
+      if (!relay->maywr1 || (relay->mayrd2 && !relay->polling)) {
+	 fd1out->fd = XIO_GETWRFD(sock1);
+	 fd1out->events = xiorelay_events(XIO_WRSTREAM(sock1), POLLOUT);
+      } else {
+	 fd1out->fd = -1;
+      }
+   } else {
+      fd1out->fd = -1;
+      fd2in->fd = -1;
+   }
+   if (fd1out->fd < 0 && XIO_WRSTREAM(sock1)->wqlen > 0) {
+      fd1out->fd = XIO_GETWRFD(sock1);
+      fd1out->events = xiorelay_events(XIO_WRSTREAM(sock1), POLLOUT);
+   }
+   xiorelay_flushtimer(relay, sock1);
+   xiorelay_flushtimer(relay, sock2);
+}
+
+/* handles the result of polling the fds that xiorelay_fds() set: transfers
+   data and handles EOF and timeouts; retval is the return value of poll(),
+   0 meaning that the timeout elapsed.
+   returns 0 when the relay continues, 1 when it has finished and the xio files
+   have been closed, or -1 on error */
+int xiorelay_step(struct xiorelay *relay, struct pollfd fds[4], int retval) {
+   xiofile_t *sock1 = relay->sock1, *sock2 = relay->sock2;
+   struct pollfd
+       *fd1in  = &fds[0],
+       *fd1out = &fds[1],
+       *fd2in  = &fds[2],
+       *fd2out = &fds[3];
+   ssize_t bytes1, bytes2;
+   struct timeval due;
+
+   /* attention:
+      when an exec'd process sends data and terminates, it is unpredictable
+      whether the data or the sigchild arrives first.
+      */
+
+   /* a timeout for output collected with option coalesce is not one of the
+      timeouts handled here; the output is written below */
+   if (retval == 0 &&
+       !xioflushtimer(sock1, &due) && !xioflushtimer(sock2, &due)) {
+      Info2("poll timed out (no data within %ld.%06ld seconds)",
+	    (XIO_RDSTREAM(sock1)->closing>=1||XIO_RDSTREAM(sock2)->closing>=1)?
+	    xioparams->closwait.tv_sec:xioparams->total_timeout.tv_sec,
+	    (XIO_RDSTREAM(sock1)->closing>=1||XIO_RDSTREAM(sock2)->closing>=1)?
+	    xioparams->closwait.tv_usec:xioparams->total_timeout.tv_usec);
+      if (relay->polling && !relay->wasaction) {
+	 /* there was a ignoreeof poll timeout, use it */
+	 relay->polling = 0;        /*%%%*/
+	 if (XIO_RDSTREAM(sock1)->ignoreeof) {
+	    relay->mayrd1 = 0;
+	 }
+	 if (XIO_RDSTREAM(sock2)->ignoreeof) {
+	    relay->mayrd2 = 0;
+	 }
+      } else if (relay->polling && relay->wasaction) {
+	 relay->wasaction = 0;
+
+      } else if (xioparams->total_timeout.tv_sec != 0 ||
+		 xioparams->total_timeout.tv_usec != 0) {
+	 /* there was a total inactivity timeout */
+	 Notice("inactivity timeout triggered");
+	 goto closeall;
+      }
+
+      if (XIO_RDSTREAM(sock1)->closing || XIO_RDSTREAM(sock2)->closing) {
+	 goto closeall;
+      }
+      /* one possibility to come here is ignoreeof on some fd, but no EOF
+	 and no data on any descriptor - this is no indication for end! */
+      return 0;
+   }
+
+   /*0 Debug1("XIO_READABLE(sock1) = %d", XIO_READABLE(sock1));*/
+   /*0 Debug1("XIO_GETRDFD(sock1) = %d", XIO_GETRDFD(sock1));*/
+   if (XIO_READABLE(sock1) && XIO_GETRDFD(sock1) >= 0 &&
+       (fd1in->revents /*&(POLLIN|POLLHUP|POLLERR)*/)) {
+      if (fd1in->revents & POLLNVAL) {
+	 /* this is what we find on Mac OS X when poll()'ing on a device or
+	    named pipe. a read() might imm. return with 0 bytes, resulting
+	    in a loop? */
+	 Error1("poll(...[%d]: invalid request", fd1in->fd);
+	 return -1;
+      }
+      relay->mayrd1 = true;
+   }
+   /*0 Debug1("XIO_READABLE(sock2) = %d", XIO_READABLE(sock2));*/
+   /*0 Debug1("XIO_GETRDFD(sock2) = %d", XIO_GETRDFD(sock2));*/
+   /*0 Debug1("FD_ISSET(XIO_GETRDFD(sock2), &in) = %d", FD_ISSET(XIO_GETRDFD(sock2), &in));*/
+   if (XIO_READABLE(sock2) && XIO_GETRDFD(sock2) >= 0 &&
+       (fd2in->revents)) {
+      if (fd2in->revents & POLLNVAL) {
+	 Error1("poll(...[%d]: invalid request", fd2in->fd);
+	 return -1;
+      }
+      relay->mayrd2 = true;
+   }
+   /*0 Debug2("mayrd2 = %d, maywr1 = %d", mayrd2, maywr1);*/
+   if (XIO_GETWRFD(sock1) >= 0 && fd1out->fd >= 0 && fd1out->revents) {
+      if (fd1out->revents & POLLNVAL) {
+	 Error1("poll(...[%d]: invalid request", fd1out->fd);
+	 return -1;
+      }
+      relay->maywr1 = true;
+   }
+   if (XIO_GETWRFD(sock2) >= 0 && fd2out->fd >= 0 && fd2out->revents) {
+      if (fd2out->revents & POLLNVAL) {
+	 Error1("poll(...[%d]: invalid request", fd2out->fd);
+	 return -1;
+      }
+      relay->maywr2 = true;
+   }
+
+   /* first write what is pending from previous transfers */
+   if (relay->maywr2 && XIO_WRSTREAM(sock2)->wqlen > 0) {
+      ssize_t pending;
+      if ((pending = xioflush(sock2)) < 0) {
+	 relay->maywr2 = false;
+	 Notice("socket 1 to socket 2 is in error");
+	 if (!XIO_READABLE(sock2)) {
+	    goto closeall;
+	 }
+      } else {
+	 relay->maywr2 = (pending == 0);
+	 relay->total_timeout = xioparams->total_timeout;
+	 relay->wasaction = 1;
+      }
+   }
+   if (relay->maywr1 && XIO_WRSTREAM(sock1)->wqlen > 0) {
+      ssize_t pending;
+      if ((pending = xioflush(sock1)) < 0) {
+	 relay->maywr1 = false;
+	 Notice("socket 2 to socket 1 is in error");
+	 if (!XIO_READABLE(sock1)) {
+	    goto closeall;
+	 }
+      } else {
+	 relay->maywr1 = (pending == 0);
+	 relay->total_timeout = xioparams->total_timeout;
+	 relay->wasaction = 1;
+      }
+   }
+
+   if (relay->mayrd1 && relay->maywr2) {
+      relay->mayrd1 = false;
+      if ((bytes1 = xiotransfer(sock1, sock2, &relay->buff, xioparams->bufsiz, false))
+	  < 0) {
+	 if (errno != EAGAIN) {
+	    /*XIO_RDSTREAM(sock2)->closing = MAX(XIO_RDSTREAM(socks2)->closing, 1);*/
+	    Notice("socket 1 to socket 2 is in error");
+	    if (/*0 xioparams->lefttoright*/ !XIO_READABLE(sock2)) {
+	       goto closeall;
+	    }
+	 } else {
+	    /* e.g. a dropped packet; more may already have been received */
+	    relay->mayrd1 = (xiopending(sock1) > 0);
+	 }
+      } else if (bytes1 > 0) {
+	 /* optimistic write: as long as a nonblocking output took all data we
+	    try the next write without asking poll() first */
+	 relay->maywr2 = relay->optwr2 && XIO_WRSTREAM(sock2)->wqlen == 0;
+	 relay->total_timeout = xioparams->total_timeout;
+	 relay->wasaction = 1;
+	 /* is more data available that has already passed select()? */
+	 relay->mayrd1 = (xiopending(sock1) > 0);
+	 if (relay->optrd1 && bytes1 >= xioparams->bufsiz) {
+	    /* optimistic read: a full block suggests that more data wait */
+	    relay->mayrd1 = true;
+	 }
+	 if (XIO_RDSTREAM(sock1)->readbytes != 0 &&
+	     XIO_RDSTREAM(sock1)->actbytes == 0) {
+	    /* avoid idle when all readbytes already there */
+	    relay->mayrd1 = true;
+	 }
+	 /* escape char occurred? */
+	 if (XIO_RDSTREAM(sock1)->actescape) {
+	    bytes1 = 0;      /* indicate EOF */
+	 }
+      }
+      if (bytes1 == 0) {
+	 if (XIO_RDSTREAM(sock1)->ignoreeof && !XIO_RDSTREAM(sock1)->closing) {
+	    ;
+	 } else {
+	    XIO_RDSTREAM(sock1)->eof = 2;
+	 }
+	 /* (bytes1 == 0)  handled later */
+      }
+   } else {
+      bytes1 = -1;
+   }
+
+   if (relay->mayrd2 && relay->maywr1) {
+      relay->mayrd2 = false;
+      if ((bytes2 = xiotransfer(sock2, sock1, &relay->buff, xioparams->bufsiz, true))
+	  < 0) {
+	 if (errno != EAGAIN) {
+	    /*XIO_RDSTREAM(sock1)->closing = MAX(XIO_RDSTREAM(sock1)->closing, 1);*/
+	    Notice("socket 2 to socket 1 is in error");
+	    if (/*0 xioparams->righttoleft*/ !XIO_READABLE(sock1)) {
+	       goto closeall;
+	    }
+	 } else {
+	    relay->mayrd2 = (xiopending(sock2) > 0);
+	 }
+      } else if (bytes2 > 0) {
+	 relay->maywr1 = relay->optwr1 && XIO_WRSTREAM(sock1)->wqlen == 0;
+	 relay->total_timeout = xioparams->total_timeout;
+	 relay->wasaction = 1;
+	 /* is more data available that has already passed select()? */
+	 relay->mayrd2 = (xiopending(sock2) > 0);
+	 if (relay->optrd2 && bytes2 >= xioparams->bufsiz) {
+	    relay->mayrd2 = true;
+	 }
+	 if (XIO_RDSTREAM(sock2)->readbytes != 0 &&
+	     XIO_RDSTREAM(sock2)->actbytes == 0) {
+	    /* avoid idle when all readbytes already there */
+	    relay->mayrd2 = true;
+	 }
+	 /* escape char occurred? */
+	 if (XIO_RDSTREAM(sock2)->actescape) {
+	    bytes2 = 0;      /* indicate EOF */
+	 }
+      }
+      if (bytes2 == 0) {
+	 if (XIO_RDSTREAM(sock2)->ignoreeof && !XIO_RDSTREAM(sock2)->closing) {
+	    ;
+	 } else {
+	    XIO_RDSTREAM(sock2)->eof = 2;
+	 }
+	 /* (bytes2 == 0)  handled later */
+      }
+   } else {
+      bytes2 = -1;
+   }
+
+#if HAVE_MMSG || WITH_OPENSSL
+   /* packets that xiowrite() batched for sendmmsg(), and data collected for
+      a TLS record (when they are due), go out when no more input is at
+      hand */
+   if (!relay->mayrd1 && XIO_WRSTREAM(sock2)->wqlen == 0 &&
+       xioflush(sock2) < 0) {
+      Notice("socket 1 to socket 2 is in error");
+      if (!XIO_READABLE(sock2)) {
+	 goto closeall;
+      }
+   }
+   if (!relay->mayrd2 && XIO_WRSTREAM(sock1)->wqlen == 0 &&
+       xioflush(sock1) < 0) {
+      Notice("socket 2 to socket 1 is in error");
+      if (!XIO_READABLE(sock1)) {
+	 goto closeall;
+      }
+   }
+#endif /* HAVE_MMSG || WITH_OPENSSL */
+
+   /* NOW handle EOFs */
+
+   if (bytes1 == 0 || XIO_RDSTREAM(sock1)->eof >= 2) {
+      if (XIO_RDSTREAM(sock1)->ignoreeof &&
+	  !XIO_RDSTREAM(sock1)->actescape && !XIO_RDSTREAM(sock1)->closing) {
+	 Debug1("socket 1 (fd %d) is at EOF, ignoring",
+		XIO_RDSTREAM(sock1)->rfd);	/*! */
+	 relay->mayrd1 = true;
+	 relay->polling = 1;       /* do not hook this eof fd to poll for pollintv*/
+      } else if (XIO_WRSTREAM(sock2)->wqlen > 0) {
+	 /* pass on EOF when the queued output has been written */
+	 XIO_RDSTREAM(sock1)->eof = 2;
+	 XIO_RDSTREAM(sock1)->ignoreeof = false;
+      } else {
+	 Notice1("socket 1 (fd %d) is at EOF", XIO_GETRDFD(sock1));
+	 xioshutdown(sock2, SHUT_WR);
+	 XIO_RDSTREAM(sock1)->eof = 2;
+	 XIO_RDSTREAM(sock1)->ignoreeof = false;
+      }
+   } else if (relay->polling && XIO_RDSTREAM(sock1)->ignoreeof) {
+      relay->polling = 0;
+   }
+   if (XIO_RDSTREAM(sock1)->eof >= 2) {
+      XIO_RDSTREAM(sock2)->closing = MAX(XIO_RDSTREAM(sock2)->closing, 1);
+      if (!XIO_READABLE(sock2) && XIO_WRSTREAM(sock2)->wqlen == 0) {
+	 goto closeall;
+      }
+   }
+
+   if (bytes2 == 0 || XIO_RDSTREAM(sock2)->eof >= 2) {
+      if (XIO_RDSTREAM(sock2)->ignoreeof &&
+	  !XIO_RDSTREAM(sock2)->actescape && !XIO_RDSTREAM(sock2)->closing) {
+	 Debug1("socket 2 (fd %d) is at EOF, ignoring",
+		XIO_RDSTREAM(sock2)->rfd);
+	 relay->mayrd2 = true;
+	 relay->polling = 1;       /* do not hook this eof fd to poll for pollintv*/
+      } else if (XIO_WRSTREAM(sock1)->wqlen > 0) {
+	 XIO_RDSTREAM(sock2)->eof = 2;
+	 XIO_RDSTREAM(sock2)->ignoreeof = false;
+      } else {
+	 Notice1("socket 2 (fd %d) is at EOF", XIO_GETRDFD(sock2));
+	 xioshutdown(sock1, SHUT_WR);
+	 XIO_RDSTREAM(sock2)->eof = 2;
+	 XIO_RDSTREAM(sock2)->ignoreeof = false;
+      }
+   } else if (relay->polling && XIO_RDSTREAM(sock2)->ignoreeof) {
+      relay->polling = 0;
+   }
+   if (XIO_RDSTREAM(sock2)->eof >= 2) {
+      XIO_RDSTREAM(sock1)->closing = MAX(XIO_RDSTREAM(sock1)->closing, 1);
+      if (!XIO_READABLE(sock1) && XIO_WRSTREAM(sock1)->wqlen == 0) {
+	 goto closeall;
+      }
+   }
+
+   if (XIO_RDSTREAM(sock1)->eof <= 1 || XIO_RDSTREAM(sock2)->eof <= 1 ||
+       XIO_WRSTREAM(sock1)->wqlen > 0 || XIO_WRSTREAM(sock2)->wqlen > 0) {
+      return 0;
+   }
+
+ closeall:
+   /* close everything that's still open */
+   xioclose(sock1);
+   xioclose(sock2);
+   return 1;
+}
+
+/* the number of poll() calls that the transfer loop skips in a row while
+   data can be transferred without them; then it polls again to learn about
+   the other direction */
+#define XIORELAY_MAXSKIP 8
+
+/* returns true when the next iteration can transfer data without poll():
+   input that is assumed readable and output that is assumed writeable */
+static bool xiorelay_ready(struct xiorelay *relay) {
+   if (relay->polling || relay->skipped >= XIORELAY_MAXSKIP ||
+       !((relay->mayrd1 && relay->maywr2) || (relay->mayrd2 && relay->maywr1))) {
+      relay->skipped = 0;
+      return false;
+   }
+   ++relay->skipped;
+   return true;
+}
+
 /* here we come when the sockets are opened (in the meaning of C language),
    and their options are set/applied
    returns -1 on error or 0 on success */
 int _socat(xiofile_t *xfd1, xiofile_t *xfd2) {
    xiofile_t *sock1, *sock2;
-   struct pollfd fds[4],
-       *fd1in  = &fds[0],
-       *fd1out = &fds[1],
-       *fd2in  = &fds[2],
-       *fd2out = &fds[3];
+   struct xiorelay relay;	/* the state of the transfer loop */
+   struct pollfd fds[4];
    int retval;
-   unsigned char *buff;
-   ssize_t bytes1, bytes2;
-   int polling = 0;	/* handling ignoreeof */
-   int wasaction = 1;	/* last select was active, do NOT sleep before next */
-   struct timeval total_timeout;	/* the actual total timeout timer */
-   bool mayrd1 = false;	/* sock1 has read data or eof, according to select() */
-   bool mayrd2 = false;	/* sock2 has read data or eof, according to select() */
-   bool maywr1 = false;	/* sock1 can be written to, according to select() */
-   bool maywr2 = false;	/* sock2 can be written to, according to select() */
+   int result = 0;
+   int i;
+#if HAVE_EPOLL_CREATE1
+   struct xioepoll epoll;	/* keeps the fds registered across iterations */
+   bool useepoll;
+#endif
 
    sock1 = xfd1;
    sock2 = xfd2;
@@ -117,16 +722,23 @@ int _socat(xiofile_t *xfd1, xiofile_t *xfd2) {
    }
 #endif /* WITH_FILAN */
 
-   /* when converting nl to crnl, size might double */
-   buff = Malloc(2*xioparams->bufsiz+1);
-   if (buff == NULL)  return -1;
-
    if (xioparams->logopt == 'm' && xioinqopt('l', NULL, 0) == 'm') {
       Info("switching to syslog");
       diag_set('y', xioopts.syslogfac);
       xiosetopt('l', "\0");
    }
-   total_timeout = xioparams->total_timeout;
+
+   if (xioparams->engine == XIOENGINE_URING) {
+      if ((retval = xiouring_socat(sock1, sock2)) != XIOURING_FALLBACK) {
+	 return retval;
+      }
+   }
+
+   if (xiorelay_init(&relay, sock1, sock2) < 0)  return -1;
+
+#if HAVE_EPOLL_CREATE1
+   useepoll = (xioepoll_init(&epoll) == 0);
+#endif
 
    Notice4("starting data transfer loop with FDs [%d,%d] and [%d,%d]",
 	   XIO_READABLE(sock1)?XIO_GETRDFD(sock1):-1,
@@ -135,143 +747,48 @@ int _socat(xiofile_t *xfd1, xiofile_t *xfd2) {
 	   XIO_WRITABLE(sock2)?XIO_GETWRFD(sock2):-1);
    while (XIO_RDSTREAM(sock1)->eof <= 1 ||
 	  XIO_RDSTREAM(sock2)->eof <= 1) {
-      struct timeval timeout, *to = NULL;
 
       Debug7("data loop: sock1->eof=%d, sock2->eof=%d, 1->closing=%d, 2->closing=%d, wasaction=%d, total_to={"F_tv_sec"."F_tv_usec"}",
 	     XIO_RDSTREAM(sock1)->eof, XIO_RDSTREAM(sock2)->eof,
 	     XIO_RDSTREAM(sock1)->closing, XIO_RDSTREAM(sock2)->closing,
-	     wasaction, total_timeout.tv_sec, total_timeout.tv_usec);
-
-      /* for ignoreeof */
-      if (polling) {
-	 if (!wasaction) {
-	    /* yes we could do it with select but I like readable trace output */
-	    if (xioparams->total_timeout.tv_sec != 0 ||
-		xioparams->total_timeout.tv_usec != 0) {
-	       if (total_timeout.tv_usec < xioparams->pollintv.tv_usec) {
-		  total_timeout.tv_usec += 1000000;
-		  total_timeout.tv_sec  -= 1;
-	       }
-	       total_timeout.tv_sec  -= xioparams->pollintv.tv_sec;
-	       total_timeout.tv_usec -= xioparams->pollintv.tv_usec;
-	       if (total_timeout.tv_sec < 0 ||
-		   total_timeout.tv_sec == 0 && total_timeout.tv_usec < 0) {
-		  Notice("inactivity timeout triggered");
-		  xioclose(sock1);
-		  xioclose(sock2);
-		  free(buff);
-		  return 0;
-	       }
-	    }
-
-	 } else {
-	    wasaction = 0;
-	 }
-      }
-
-      if (polling) {
-	 /* there is a ignoreeof poll timeout, use it */
-	 timeout = xioparams->pollintv;
-	 to = &timeout;
-     } else if (xioparams->total_timeout.tv_sec != 0 ||
-		 xioparams->total_timeout.tv_usec != 0) {
-	 /* there might occur a total inactivity timeout */
-	 timeout = xioparams->total_timeout;
-	 to = &timeout;
-      } else {
-	 to = NULL;
-      }
+	     relay.wasaction, relay.total_timeout.tv_sec, relay.total_timeout.tv_usec);
 
-#if 1
-      if (XIO_RDSTREAM(sock1)->closing>=1 || XIO_RDSTREAM(sock2)->closing>=1) {
-	 /* first eof already occurred, start end timer */
-	 timeout = xioparams->closwait;
-	 to = &timeout;
-	 /*0 closing = 2;*/
+      if ((result = xiorelay_timer(&relay)) != 0) {
+	 break;
       }
-#endif
 
       /* frame 1: set the poll parameters and loop over poll() EINTR) */
       do {
 	 int _errno;
 
-	 childleftdata(sock1);
-	 childleftdata(sock2);
-
-#if 0
-	 if (closing>=1) {
-	    /* first eof already occurred, start end timer */
-	    timeout = xioparams->closwait;
-	    to = &timeout;
-	    closing = 2;
-	 }
-#else
-	 if (XIO_RDSTREAM(sock1)->closing>=1 || XIO_RDSTREAM(sock2)->closing>=1) {
-	    /* first eof already occurred, start end timer */
-	    timeout = xioparams->closwait;
-	    to = &timeout;
-	    if (XIO_RDSTREAM(sock1)->closing==1) {
-	       XIO_RDSTREAM(sock1)->closing = 2;
-	    }
-	    if (XIO_RDSTREAM(sock2)->closing==1) {
-	       XIO_RDSTREAM(sock2)->closing = 2;
-	    }
-	 }
-#endif
-
-	 /* use the ignoreeof timeout if appropriate */
-	 if (polling) {
-	    if ((XIO_RDSTREAM(sock1)->closing == 0 && XIO_RDSTREAM(sock2)->closing == 0) ||
-		(xioparams->pollintv.tv_sec < timeout.tv_sec) ||
-		((xioparams->pollintv.tv_sec == timeout.tv_sec) &&
-		 xioparams->pollintv.tv_usec < timeout.tv_usec)) {
-	       timeout = xioparams->pollintv;
-	    }
+	 xiorelay_fds(&relay, fds);
+	 if (xiorelay_ready(&relay)) {
+	    /* the last transfers left no reason to wait */
+	    for (i = 0; i < 4; ++i)  fds[i].revents = 0;
+	    retval = 1;
+	    break;
 	 }
-
-	 /* now the fds will be assigned */
-	 if (XIO_READABLE(sock1) &&
-	     !(XIO_RDSTREAM(sock1)->eof > 1 && !XIO_RDSTREAM(sock1)->ignoreeof)
-	     /*0 && !xioparams->righttoleft*/) {
-	    Debug3("*** sock1: %p [%d,%d]", sock1, XIO_GETRDFD(sock1), XIO_GETWRFD(sock1));
-	    if (!mayrd1 && !(XIO_RDSTREAM(sock1)->eof > 1)) {
-	       fd1in->fd = XIO_GETRDFD(sock1);
-	       fd1in->events = POLLIN;
-	    } else {
-	       fd1in->fd = -1;
-	    }
-	    if (!maywr2) {
-	       fd2out->fd = XIO_GETWRFD(sock2);
-	       fd2out->events = POLLOUT;
-	    } else {
-	       fd2out->fd = -1;
-	    }
-	 } else {
-	    fd1in->fd = -1;
-	    fd2out->fd = -1;
-         }
-	 if (XIO_READABLE(sock2) &&
-	     !(XIO_RDSTREAM(sock2)->eof > 1 && !XIO_RDSTREAM(sock2)->ignoreeof)
-	     /*0 && !xioparams->lefttoright*/) {
-	    Debug3("*** sock2: %p [%d,%d]", sock2, XIO_GETRDFD(sock2), XIO_GETWRFD(sock2));
-	    if (!mayrd2 && !(XIO_RDSTREAM(sock2)->eof > 1)) {
-	       fd2in->fd = XIO_GETRDFD(sock2);
-	       fd2in->events = POLLIN;
-	    } else {
-	       fd2in->fd = -1;
+         /* frame 0: innermost part of the transfer loop: check FD status */
+#if HAVE_EPOLL_CREATE1
+	 if (useepoll) {
+	    retval = xioepoll(&epoll, fds, 4, relay.to);
+	    if (retval < 0 && errno == ESTALE) {
+	       /* nobody else knows our epoll instance, just replace it */
+	       if (xioepoll_renew(&epoll) < 0) {
+		  errno = EPERM;	/* use poll() */
+	       } else {
+		  retval = xioepoll(&epoll, fds, 4, relay.to);
+	       }
 	    }
-	    if (!maywr1) {
-	       fd1out->fd = XIO_GETWRFD(sock1);
-	       fd1out->events = POLLOUT;
-	    } else {
-	       fd1out->fd = -1;
+	    if (retval < 0 && errno == EPERM) {
+	       Info("file descriptors do not support epoll, using poll");
+	       xioepoll_exit(&epoll);
+	       useepoll = false;
+	       retval = xiopoll(fds, 4, relay.to);
 	    }
-	 } else {
-	    fd1out->fd = -1;
-	    fd2in->fd = -1;
-	 }
-         /* frame 0: innermost part of the transfer loop: check FD status */
-	 retval = xiopoll(fds, 4, to);
+	 } else
+#endif /* HAVE_EPOLL_CREATE1 */
+	    retval = xiopoll(fds, 4, relay.to);
 	 _errno = errno; diag_flush();	/* just in case it's not debug level and Msg() not been called */
 	 if (retval >= 0 || _errno != EINTR) {
 	    break;
@@ -280,231 +797,31 @@ int _socat(xiofile_t *xfd1, xiofile_t *xfd2) {
 	 errno = _errno;
       } while (true);
 
-      /* attention:
-	 when an exec'd process sends data and terminates, it is unpredictable
-	 whether the data or the sigchild arrives first.
-	 */
-
       if (retval < 0) {
 	 Error11("xiopoll({%d,%0o}{%d,%0o}{%d,%0o}{%d,%0o}, 4, {"F_tv_sec"."F_tv_usec"}): %s",
 		 fds[0].fd, fds[0].events, fds[1].fd, fds[1].events,
 		 fds[2].fd, fds[2].events, fds[3].fd, fds[3].events,
-		 timeout.tv_sec, timeout.tv_usec, strerror(errno));
-	 free(buff);
-	 return -1;
-      } else if (retval == 0) {
-	 Info2("poll timed out (no data within %ld.%06ld seconds)",
-	       (XIO_RDSTREAM(sock1)->closing>=1||XIO_RDSTREAM(sock2)->closing>=1)?
-	       xioparams->closwait.tv_sec:xioparams->total_timeout.tv_sec,
-	       (XIO_RDSTREAM(sock1)->closing>=1||XIO_RDSTREAM(sock2)->closing>=1)?
-	       xioparams->closwait.tv_usec:xioparams->total_timeout.tv_usec);
-	 if (polling && !wasaction) {
-	    /* there was a ignoreeof poll timeout, use it */
-	    polling = 0;        /*%%%*/
-	    if (XIO_RDSTREAM(sock1)->ignoreeof) {
-	       mayrd1 = 0;
-	    }
-	    if (XIO_RDSTREAM(sock2)->ignoreeof) {
-	       mayrd2 = 0;
-	    }
-         } else if (polling && wasaction) {
-            wasaction = 0;
-
-	 } else if (xioparams->total_timeout.tv_sec != 0 ||
-		    xioparams->total_timeout.tv_usec != 0) {
-	    /* there was a total inactivity timeout */
-	    Notice("inactivity timeout triggered");
-	    xioclose(sock1);
-	    xioclose(sock2);
-	    free(buff);
-	    return 0;
-	 }
-
-	 if (XIO_RDSTREAM(sock1)->closing || XIO_RDSTREAM(sock2)->closing) {
-	    break;
-	 }
-	 /* one possibility to come here is ignoreeof on some fd, but no EOF 
-	    and no data on any descriptor - this is no indication for end! */
-	 continue;
-      }
-
-      /*0 Debug1("XIO_READABLE(sock1) = %d", XIO_READABLE(sock1));*/
-      /*0 Debug1("XIO_GETRDFD(sock1) = %d", XIO_GETRDFD(sock1));*/
-      if (XIO_READABLE(sock1) && XIO_GETRDFD(sock1) >= 0 &&
-	  (fd1in->revents /*&(POLLIN|POLLHUP|POLLERR)*/)) {
-         if (fd1in->revents & POLLNVAL) {
-            /* this is what we find on Mac OS X when poll()'ing on a device or
-               named pipe. a read() might imm. return with 0 bytes, resulting
-               in a loop? */ 
-            Error1("poll(...[%d]: invalid request", fd1in->fd);
-	    free(buff);
-            return -1;
-         }
- 	 mayrd1 = true;
-      }
-      /*0 Debug1("XIO_READABLE(sock2) = %d", XIO_READABLE(sock2));*/
-      /*0 Debug1("XIO_GETRDFD(sock2) = %d", XIO_GETRDFD(sock2));*/
-      /*0 Debug1("FD_ISSET(XIO_GETRDFD(sock2), &in) = %d", FD_ISSET(XIO_GETRDFD(sock2), &in));*/
-      if (XIO_READABLE(sock2) && XIO_GETRDFD(sock2) >= 0 &&
-	  (fd2in->revents)) {
-	 if (fd2in->revents & POLLNVAL) {
-	    Error1("poll(...[%d]: invalid request", fd2in->fd);
-	    free(buff);
-	    return -1;
-	 }
-	 mayrd2 = true;
-      }
-      /*0 Debug2("mayrd2 = %d, maywr1 = %d", mayrd2, maywr1);*/
-      if (XIO_GETWRFD(sock1) >= 0 && fd1out->fd >= 0 && fd1out->revents) {
-	 if (fd1out->revents & POLLNVAL) {
-	    Error1("poll(...[%d]: invalid request", fd1out->fd);
-	    free(buff);
-	    return -1;
-	 }
-	 maywr1 = true;
-      }
-      if (XIO_GETWRFD(sock2) >= 0 && fd2out->fd >= 0 && fd2out->revents) {
-	 if (fd2out->revents & POLLNVAL) {
-	    Error1("poll(...[%d]: invalid request", fd2out->fd);
-	    free(buff);
-	    return -1;
-	 }
-	 maywr2 = true;
-      }
-
-      if (mayrd1 && maywr2) {
-	 mayrd1 = false;
-	 if ((bytes1 = xiotransfer(sock1, sock2, &buff, xioparams->bufsiz, false))
-	     < 0) {
-	    if (errno != EAGAIN) {
-	       /*XIO_RDSTREAM(sock2)->closing = MAX(XIO_RDSTREAM(socks2)->closing, 1);*/
-	       Notice("socket 1 to socket 2 is in error");
-	       if (/*0 xioparams->lefttoright*/ !XIO_READABLE(sock2)) {
-		  break;
-	       }
-	    }
-	 } else if (bytes1 > 0) {
-	    maywr2 = false;
-	    total_timeout = xioparams->total_timeout;
-	    wasaction = 1;
-	    /* is more data available that has already passed select()? */
-	    mayrd1 = (xiopending(sock1) > 0);
-	    if (XIO_RDSTREAM(sock1)->readbytes != 0 &&
-		XIO_RDSTREAM(sock1)->actbytes == 0) {
-	       /* avoid idle when all readbytes already there */
-	       mayrd1 = true;
-	    }          
-	    /* escape char occurred? */
-	    if (XIO_RDSTREAM(sock1)->actescape) {
-	       bytes1 = 0;      /* indicate EOF */
-	    }
-	 }
-	 if (bytes1 == 0) {
-	    if (XIO_RDSTREAM(sock1)->ignoreeof && !XIO_RDSTREAM(sock1)->closing) {
-	       ;
-	    } else {
-	       XIO_RDSTREAM(sock1)->eof = 2;
-	    }
-	    /* (bytes1 == 0)  handled later */
-	 }
-      } else {
-	 bytes1 = -1;
-      }
-
-      if (mayrd2 && maywr1) {
-	 mayrd2 = false;
-	 if ((bytes2 = xiotransfer(sock2, sock1, &buff, xioparams->bufsiz, true))
-	     < 0) {
-	    if (errno != EAGAIN) {
-	       /*XIO_RDSTREAM(sock1)->closing = MAX(XIO_RDSTREAM(sock1)->closing, 1);*/
-	       Notice("socket 2 to socket 1 is in error");
-	       if (/*0 xioparams->righttoleft*/ !XIO_READABLE(sock1)) {
-		  break;
-	       }
-	    }
-	 } else if (bytes2 > 0) {
-	    maywr1 = false;
-	    total_timeout = xioparams->total_timeout;
-	    wasaction = 1;
-	    /* is more data available that has already passed select()? */
-	    mayrd2 = (xiopending(sock2) > 0);
-	    if (XIO_RDSTREAM(sock2)->readbytes != 0 &&
-		XIO_RDSTREAM(sock2)->actbytes == 0) {
-	       /* avoid idle when all readbytes already there */
-	       mayrd2 = true;
-	    }          
-	    /* escape char occurred? */
-	    if (XIO_RDSTREAM(sock2)->actescape) {
-	       bytes2 = 0;      /* indicate EOF */
-	    }
-	 }
-	 if (bytes2 == 0) {
-	    if (XIO_RDSTREAM(sock2)->ignoreeof && !XIO_RDSTREAM(sock2)->closing) {
-	       ;
-	    } else {
-	       XIO_RDSTREAM(sock2)->eof = 2;
-	    }
-	    /* (bytes2 == 0)  handled later */
-	 }
-      } else {
-	 bytes2 = -1;
+		 relay.timeout.tv_sec, relay.timeout.tv_usec, strerror(errno));
+	 result = -1;
+	 break;
       }
 
-      /* NOW handle EOFs */
-
-      if (bytes1 == 0 || XIO_RDSTREAM(sock1)->eof >= 2) {
-	 if (XIO_RDSTREAM(sock1)->ignoreeof &&
-	     !XIO_RDSTREAM(sock1)->actescape && !XIO_RDSTREAM(sock1)->closing) {
-	    Debug1("socket 1 (fd %d) is at EOF, ignoring",
-		   XIO_RDSTREAM(sock1)->rfd);	/*! */
-            mayrd1 = true;
-	    polling = 1;       /* do not hook this eof fd to poll for pollintv*/
-	 } else {
-	    Notice1("socket 1 (fd %d) is at EOF", XIO_GETRDFD(sock1));
-	    xioshutdown(sock2, SHUT_WR);
-	    XIO_RDSTREAM(sock1)->eof = 2;
-	    XIO_RDSTREAM(sock1)->ignoreeof = false;
-	 }
-      } else if (polling && XIO_RDSTREAM(sock1)->ignoreeof) {
-         polling = 0;
-      }
-      if (XIO_RDSTREAM(sock1)->eof >= 2) {
-	 XIO_RDSTREAM(sock2)->closing = MAX(XIO_RDSTREAM(sock2)->closing, 1);
-	 if (!XIO_READABLE(sock2)) {
-	    break;
-	 }
-      }
-
-      if (bytes2 == 0 || XIO_RDSTREAM(sock2)->eof >= 2) {
-	 if (XIO_RDSTREAM(sock2)->ignoreeof &&
-	     !XIO_RDSTREAM(sock2)->actescape && !XIO_RDSTREAM(sock2)->closing) {
-	    Debug1("socket 2 (fd %d) is at EOF, ignoring",
-		   XIO_RDSTREAM(sock2)->rfd);
-	    mayrd2 = true;
-	    polling = 1;       /* do not hook this eof fd to poll for pollintv*/
-	 } else {
-	    Notice1("socket 2 (fd %d) is at EOF", XIO_GETRDFD(sock2));
-	    xioshutdown(sock1, SHUT_WR);
-	    XIO_RDSTREAM(sock2)->eof = 2;
-	    XIO_RDSTREAM(sock2)->ignoreeof = false;
-	 }
-      } else if (polling && XIO_RDSTREAM(sock2)->ignoreeof) {
-         polling = 0;
-      }
-      if (XIO_RDSTREAM(sock2)->eof >= 2) {
-	 XIO_RDSTREAM(sock1)->closing = MAX(XIO_RDSTREAM(sock1)->closing, 1);
-	 if (!XIO_READABLE(sock1)) {
-	    break;
-	 }
+      if ((result = xiorelay_step(&relay, fds, retval)) != 0) {
+	 break;
       }
    }
 
-   /* close everything that's still open */
-   xioclose(sock1);
-   xioclose(sock2);
+   if (result == 0) {
+      /* close everything that's still open */
+      xioclose(sock1);
+      xioclose(sock2);
+   }
 
-   free(buff);
-   return 0;
+#if HAVE_EPOLL_CREATE1
+   if (useepoll)  xioepoll_exit(&epoll);
+#endif
+   xiorelay_exit(&relay);
+   return result < 0 ? -1 : 0;
 }
 
 
@@ -24,3 +24,20 @@ const struct optdesc opt_intervall = { "intervall", NULL, OPT_INTERVALL, GROUP_R
 const struct optdesc opt_retry     = { "retry",     NULL, OPT_RETRY,     GROUP_RETRY, PH_INIT, TYPE_UINT, OFUNC_OFFSET, XIO_OFFSETOF(retry),     XIO_SIZEOF(retry) };
 #endif
 
+
+
+/****** in-process layers, see struct xiolayer ******/
+
+/* data methods of layers that pass the data unchanged, e.g. NOP, or SOCKS
+   after the handshake */
+ssize_t xiolayer_read(struct single *sfd, void *buff, size_t bufsiz) {
+   return xioread(sfd->lower, buff, bufsiz);
+}
+
+ssize_t xiolayer_write(struct single *sfd, const void *buff, size_t bytes) {
+   return xiowrite(sfd->lower, buff, bytes);
+}
+
+/* for addresses that just pass the data after a handshake over the fds of the
+   lower address, e.g. SOCKS and PROXY */
+const struct xiolayer xiolayer_stream = { xiolayer_read, xiolayer_write, NULL, true };
@@ -16,4 +16,8 @@ extern const struct optdesc opt_forever;
 extern const struct optdesc opt_intervall;
 extern const struct optdesc opt_retry;
 
+extern ssize_t xiolayer_read(struct single *sfd, void *buff, size_t bufsiz);
+extern ssize_t xiolayer_write(struct single *sfd, const void *buff, size_t bytes);
+extern const struct xiolayer xiolayer_stream;
+
 #endif /* !defined(__xiolayer_h_included) */
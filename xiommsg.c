@@ -0,0 +1,254 @@
+/* source: xiommsg.c */
+/* Copyright Gerhard Rieger */
+/* Published under the GNU General Public License V.2, see file COPYING */
+
+/* this is the source of the packet batches of datagram sockets (option
+   batch) */
+
+/* xioread() on a datagram socket receives up to a batch of packets with one
+   recvmmsg() and returns them one per call; xiopending() tells the transfer
+   engine that more of them are at hand without poll(). xiowrite() queues
+   packets in a batch that goes out with one sendmmsg() when it is full, or
+   when the engine has no more input at hand and calls xioflush(). So the
+   packet boundaries are kept, but a burst of packets costs two system calls
+   per batch instead of two or three per packet. */
+
+#include "xiosysincludes.h"
+#include "xioopen.h"
+
+#if HAVE_MMSG
+
+#define XIOMMSG_DEFAULT	32	/* packets per batch without option batch */
+#define XIOMMSG_MAX	1024	/* UIO_MAXIOV, more are not sent at once */
+#define XIOMMSG_CTRLLEN	1024	/* ancillary messages per received packet */
+
+struct xiommsg {
+   unsigned int size;		/* number of slots */
+   unsigned int count;		/* packets received or queued */
+   unsigned int next;		/* with receive: the next packet to read */
+   size_t slotsize;		/* data bytes per slot */
+   struct mmsghdr *msgs;
+   struct iovec *iovs;
+   union sockaddr_union *addrs;	/* peer addresses */
+   char *ctrl;			/* with receive: ancillary messages */
+   unsigned char *data;
+} ;
+
+
+static void xiommsg_release(struct xiommsg *batch) {
+   free(batch->msgs);
+   free(batch->iovs);
+   free(batch->addrs);
+   free(batch->ctrl);
+   free(batch->data);
+   free(batch);
+}
+
+static struct xiommsg *xiommsg_alloc(struct single *pipe, size_t slotsize,
+				     bool withctrl) {
+   struct xiommsg *batch;
+   unsigned int size, i;
+
+   if (pipe->para.socket.batch == 0) {
+      size = XIOMMSG_DEFAULT;
+   } else if (pipe->para.socket.batch > XIOMMSG_MAX) {
+      Warn2("batch=%d: using maximum of %u packets",
+	    pipe->para.socket.batch, XIOMMSG_MAX);
+      size = pipe->para.socket.batch = XIOMMSG_MAX;
+   } else {
+      size = pipe->para.socket.batch;
+   }
+   if ((batch = Calloc(1, sizeof(struct xiommsg))) == NULL) {
+      return NULL;
+   }
+   batch->size = size;
+   batch->slotsize = slotsize;
+   if ((batch->msgs  = Calloc(size, sizeof(struct mmsghdr))) == NULL ||
+       (batch->iovs  = Calloc(size, sizeof(struct iovec))) == NULL ||
+       (batch->addrs = Calloc(size, sizeof(union sockaddr_union))) == NULL ||
+       (withctrl && (batch->ctrl = Malloc(size*XIOMMSG_CTRLLEN)) == NULL) ||
+       (batch->data  = Malloc(size*slotsize)) == NULL) {
+      xiommsg_release(batch);
+      return NULL;
+   }
+   for (i = 0; i < size; ++i) {
+      batch->iovs[i].iov_base = batch->data + i*slotsize;
+      batch->iovs[i].iov_len  = slotsize;
+      batch->msgs[i].msg_hdr.msg_name = &batch->addrs[i];
+      batch->msgs[i].msg_hdr.msg_iov = &batch->iovs[i];
+      batch->msgs[i].msg_hdr.msg_iovlen = 1;
+   }
+   Info3("fd %d: batches of up to %u packets per %s",
+	 withctrl?pipe->rfd:pipe->wfd, size,
+	 withctrl?"recvmmsg()":"sendmmsg()");
+   return batch;
+}
+
+/* returns true when the packets of pipe in the given direction are
+   transferred in batches */
+bool xiommsg_usable(struct single *pipe, bool forwrite) {
+   if ((forwrite ? pipe->wbatch : pipe->rbatch) != NULL) {
+      return true;
+   }
+   if (pipe->para.socket.batch < 0 || pipe->para.socket.batch == 1) {
+      return false;
+   }
+   /* the child of a forking recvfrom address must take only its own packet
+      from the shared socket */
+   if (!forwrite && (pipe->dtype & XIOREAD_RECV_ONESHOT)) {
+      return false;
+   }
+   return true;
+}
+
+/* returns the next received packet in buff, truncated to bufsiz like with
+   recvfrom(), and its source address in *from. When no received packet is
+   left, a new batch is received without waiting.
+   When msgh is not NULL it gets the header with the ancillary messages of
+   the packet, valid until the next call.
+   returns the number of bytes, or -1 with EAGAIN when no packet is
+   available, or -1 on error */
+ssize_t xiommsg_recv(struct single *pipe, void *buff, size_t bufsiz,
+		     union sockaddr_union *from, socklen_t *fromlen,
+		     struct msghdr **msgh) {
+   struct xiommsg *batch;
+   struct mmsghdr *mh;
+   size_t bytes;
+   unsigned int i;
+   int n, _errno;
+
+   if ((batch = pipe->rbatch) == NULL) {
+      if ((batch = pipe->rbatch =
+	   xiommsg_alloc(pipe, Max(bufsiz, xioparams->bufsiz), true))
+	  == NULL) {
+	 return -1;
+      }
+   }
+
+   if (batch->next == batch->count) {
+      for (i = 0; i < batch->size; ++i) {
+	 mh = &batch->msgs[i];
+	 mh->msg_hdr.msg_namelen = sizeof(union sockaddr_union);
+	 mh->msg_hdr.msg_control = batch->ctrl + i*XIOMMSG_CTRLLEN;
+	 mh->msg_hdr.msg_controllen = XIOMMSG_CTRLLEN;
+	 mh->msg_hdr.msg_flags = 0;
+      }
+      batch->next = batch->count = 0;
+      do {
+	 n = Recvmmsg(pipe->rfd, batch->msgs, batch->size, MSG_DONTWAIT, NULL);
+      } while (n < 0 && errno == EINTR);
+      if (n < 0) {
+	 if (errno != EAGAIN) {
+	    _errno = errno;
+	    Error4("recvmmsg(%d, %p, %u, MSG_DONTWAIT, NULL): %s",
+		   pipe->rfd, batch->msgs, batch->size, strerror(_errno));
+	    errno = _errno;
+	 }
+	 return -1;
+      }
+      batch->count = n;
+      if (n == 0) {
+	 errno = EAGAIN;
+	 return -1;
+      }
+   }
+
+   mh = &batch->msgs[batch->next];
+   bytes = Min(mh->msg_len, bufsiz);
+   memcpy(buff, batch->iovs[batch->next].iov_base, bytes);
+   memcpy(from, mh->msg_hdr.msg_name, mh->msg_hdr.msg_namelen);
+   *fromlen = mh->msg_hdr.msg_namelen;
+   if (msgh != NULL) {
+      *msgh = &mh->msg_hdr;
+   }
+   ++batch->next;
+   return bytes;
+}
+
+/* returns the number of received packets that xioread() has not yet
+   returned */
+ssize_t xiommsg_pending(struct single *pipe) {
+   if (pipe->rbatch == NULL) {
+      return 0;
+   }
+   return pipe->rbatch->count - pipe->rbatch->next;
+}
+
+/* queues a packet to the current peer address of pipe; sends the batch when
+   it is full.
+   returns 1 when the packet has been queued, 0 when it does not fit in a
+   slot and the caller has to send it (the queue has been sent before so
+   that the order is kept), or -1 on error */
+int xiommsg_send(struct single *pipe, const void *buff, size_t bytes) {
+   struct xiommsg *batch;
+   unsigned int i;
+
+   if ((batch = pipe->wbatch) == NULL) {
+      if ((batch = pipe->wbatch =
+	   xiommsg_alloc(pipe, Max(bytes, xioparams->bufsiz), false))
+	  == NULL) {
+	 return -1;
+      }
+   }
+   if (bytes > batch->slotsize) {
+      return xiommsg_flush(pipe) < 0 ? -1 : 0;
+   }
+   i = batch->count++;
+   memcpy(batch->iovs[i].iov_base, buff, bytes);
+   batch->iovs[i].iov_len = bytes;
+   batch->addrs[i] = pipe->peersa;
+   batch->msgs[i].msg_hdr.msg_namelen = pipe->salen;
+   if (batch->count == batch->size) {
+      return xiommsg_flush(pipe) < 0 ? -1 : 1;
+   }
+   return 1;
+}
+
+/* sends the queued packets. A packet that fails is reported and dropped like
+   with sendto(); the following ones are still sent.
+   returns 0 on success, or -1 when a packet failed (errno valid) */
+int xiommsg_flush(struct single *pipe) {
+   struct xiommsg *batch = pipe->wbatch;
+   unsigned int done = 0;
+   int n, result = 0, _errno = 0;
+
+   if (batch == NULL) {
+      return 0;
+   }
+   while (done < batch->count) {
+      do {
+	 n = Sendmmsg(pipe->wfd, batch->msgs+done, batch->count-done, 0);
+      } while (n < 0 && errno == EINTR);
+      if (n < 0) {
+	 char infobuff[256];
+	 _errno = errno;
+	 Error6("sendmmsg(%d, {{%s,,%p,"F_Zu"},...}, %u, 0): %s",
+		pipe->wfd,
+		sockaddr_info(&batch->addrs[done].soa,
+			      batch->msgs[done].msg_hdr.msg_namelen,
+			      infobuff, sizeof(infobuff)),
+		batch->iovs[done].iov_base, batch->iovs[done].iov_len,
+		batch->count-done, strerror(_errno));
+	 result = -1;
+	 n = 1;		/* drop it */
+      }
+      done += n;
+   }
+   batch->count = 0;
+   errno = _errno;
+   return result;
+}
+
+/* releases the batches of pipe; queued packets are not sent */
+void xiommsg_free(struct single *pipe) {
+   if (pipe->rbatch != NULL) {
+      xiommsg_release(pipe->rbatch);
+      pipe->rbatch = NULL;
+   }
+   if (pipe->wbatch != NULL) {
+      xiommsg_release(pipe->wbatch);
+      pipe->wbatch = NULL;
+   }
+}
+
+#endif /* HAVE_MMSG */
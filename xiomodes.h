@@ -42,6 +42,7 @@
 #include "xio-pty.h"
 #include "xio-openssl.h"
 #include "xio-tcpwrap.h"
+#include "xio-acl.h"
 #include "xio-ext2.h"
 #include "xio-tun.h"
 #include "xio-streams.h"
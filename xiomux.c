@@ -0,0 +1,1476 @@
+/* source: xiomux.c */
+/* Copyright Gerhard Rieger */
+/* Published under the GNU General Public License V.2, see file COPYING */
+
+/* this is the source of the multiplexing accept loop (option multiplex): one
+   process accepts the connections of a listen address and drives the data
+   transfer of all of them. With OPENSSL-LISTEN, a pool of worker threads
+   performs the TLS handshakes of the new connections */
+
+#include "xiosysincludes.h"
+
+#include "xioopen.h"
+#include "xiosigchld.h"
+#include "xio-socket.h"
+#include "xio-listen.h"
+#include "xio-openssl.h"
+
+#if WITH_LISTEN
+
+static void xiomux_freefd(xiofile_t *xfd, bool ownargs);
+
+/* frees an xio file that was closed; with ownargs, also the address
+   parameters (they are shared with the listener otherwise). The options are
+   left alone, some address types release them already */
+static void xiomux_free1(struct single *sfd, bool ownargs) {
+   int i;
+
+   if (sfd->lower != NULL) {
+      /* the rest of the chain below an in-process layer */
+      xiomux_freefd(sfd->lower, true);
+   }
+   if (sfd->child.pid > 0) {
+      /* the SIGCHLD handler must not access the freed record */
+      xiosigchld_unregister(sfd->child.pid);
+   }
+   free(sfd->wqbuff);
+#if HAVE_MMSG
+   xiommsg_free(sfd);
+#endif /* HAVE_MMSG */
+#if WITH_OPENSSL
+   if ((sfd->dtype & XIODATA_MASK) == XIODATA_OPENSSL &&
+       sfd->para.openssl.ssl != NULL) {
+      /* a connection of OPENSSL-LISTEN */
+      sycSSL_free(sfd->para.openssl.ssl);
+   }
+#endif /* WITH_OPENSSL */
+   if (ownargs) {
+      for (i = 0; i < sfd->argc; ++i) {
+	 free((void *)sfd->argv[i]);
+      }
+   }
+}
+
+static void xiomux_freefd(xiofile_t *xfd, bool ownargs) {
+   int i;
+
+   for (i = 0; i < XIO_MAXSOCK; ++i) {
+      if (sock[i] == xfd)  sock[i] = NULL;
+   }
+   if (xfd->tag == XIO_TAG_DUAL) {
+      xiomux_free1(xfd->dual.stream[0], ownargs);
+      xiomux_free1(xfd->dual.stream[1], ownargs);
+      for (i = 0; i < XIO_MAXSOCK; ++i) {
+	 if (sock[i] == (xiofile_t *)xfd->dual.stream[0] ||
+	     sock[i] == (xiofile_t *)xfd->dual.stream[1])  sock[i] = NULL;
+      }
+      free(xfd->dual.stream[0]);
+      free(xfd->dual.stream[1]);
+   } else {
+      xiomux_free1(&xfd->stream, ownargs);
+   }
+   free(xfd);
+}
+
+#endif /* WITH_LISTEN */
+
+
+#if WITH_LISTEN && HAVE_EPOLL_CREATE1
+
+#define XIOMUX_MAXEVENTS 64	/* events taken from one epoll_wait() */
+#define XIOMUX_ROUNDS 16	/* transfers per connection before the others
+				   get their turn */
+
+/* one accepted connection with the second address opened for it */
+struct xiomux_conn {
+   struct xiorelay relay;	/* its own transfer loop state */
+   struct xioepoll epoll;	/* its fds; registered itself with the outer
+				   epoll instance */
+   int outer;			/* the outer epoll instance */
+   struct pollfd fds[4];	/* as set by xiorelay_fds() */
+   struct timeval deadline;	/* when relay.to expires */
+   int done;			/* result of the finished transfer loop: 1 ok,
+				   -1 error; 0 while active */
+   struct xiomux_conn *next;
+   /* with OPENSSL-LISTEN, before the transfer loop: */
+   xiofile_t *tls;		/* the accepted connection while its TLS
+				   handshake is in progress, else NULL */
+   bool hsto;			/* deadline is the handshake's connect-timeout */
+   bool busy;			/* a handshake worker has it */
+   int want;			/* result of the last handshake step */
+   struct xiomux_conn *job;	/* in the queues of the handshake workers */
+} ;
+
+static struct timeval xiomux_zero = { 0, 0 };
+
+
+/* checks the fds of the connection without waiting and keeps them
+   registered; sets the deadline of the connection from its poll timeout.
+   returns the number of ready fds, 0 when the connection has to wait, or -1
+   on error */
+static int xiomux_poll(struct xiomux_conn *conn) {
+   struct epoll_event ev;
+   int retval;
+
+   retval = xioepoll(&conn->epoll, conn->fds, 4, &xiomux_zero);
+   if (retval < 0 && errno == ESTALE) {
+      /* the new epoll instance replaces the old one in the outer one */
+      Epoll_ctl(conn->outer, EPOLL_CTL_DEL, conn->epoll.epfd, NULL);
+      if (xioepoll_renew(&conn->epoll) < 0) {
+	 Error1("connection [%d]: cannot recreate its epoll instance",
+		XIO_GETRDFD(conn->relay.sock1));
+	 return -1;
+      }
+      ev.events = EPOLLIN;
+      ev.data.ptr = conn;
+      if (Epoll_ctl(conn->outer, EPOLL_CTL_ADD, conn->epoll.epfd, &ev) < 0) {
+	 Error3("epoll_ctl(%d, EPOLL_CTL_ADD, %d, ...): %s",
+		conn->outer, conn->epoll.epfd, strerror(errno));
+	 return -1;
+      }
+      retval = xioepoll(&conn->epoll, conn->fds, 4, &xiomux_zero);
+   }
+   if (retval < 0) {
+      if (errno == EINTR) {
+	 retval = 0;
+      } else {
+	 Error1("connection [%d]: file descriptors do not support epoll",
+		XIO_GETRDFD(conn->relay.sock1));
+	 return -1;
+      }
+   }
+   if (conn->relay.to != NULL) {
+      gettimeofday(&conn->deadline, NULL);
+      conn->deadline.tv_sec  += conn->relay.to->tv_sec;
+      conn->deadline.tv_usec += conn->relay.to->tv_usec;
+      if (conn->deadline.tv_usec >= 1000000) {
+	 conn->deadline.tv_usec -= 1000000;
+	 ++conn->deadline.tv_sec;
+      }
+   }
+   return retval;
+}
+
+/* runs the transfer loop of the connection until it has to wait; with
+   timedout, starts with handling the expired poll timeout.
+   returns 0 when the connection continues, 1 when it has finished and its
+   xio files have been closed, or -1 on error */
+static int xiomux_run(struct xiomux_conn *conn, bool timedout) {
+   int retval = 0;
+   int rounds;
+   int result;
+
+   for (rounds = 0; ; ++rounds) {
+      if (!timedout) {
+	 if ((retval = xiomux_poll(conn)) <= 0)  return retval;
+	 if (rounds >= XIOMUX_ROUNDS) {
+	    /* the fds are still ready, the outer epoll reports us again */
+	    return 0;
+	 }
+      }
+      timedout = false;
+      if ((result = xiorelay_step(&conn->relay, conn->fds, retval)) != 0) {
+	 return result;
+      }
+      if (xiorelay_timer(&conn->relay) != 0) {
+	 return 1;
+      }
+      xiorelay_fds(&conn->relay, conn->fds);
+   }
+}
+
+#if WITH_OPENSSL
+
+/* the handshakes of OPENSSL-LISTEN: a fixed pool of worker threads, one per
+   CPU, performs the handshake steps, so the key exchange of new connections
+   does not hold up the transfer of the established ones. The loop waits for
+   the fd of a handshake and queues the connection for the workers when the
+   fd is ready; a worker runs the step and returns the connection through a
+   pipe */
+static struct {
+   int numworkers;		/* 0 until started */
+   pthread_mutex_t lock;	/* protects the queues */
+   pthread_cond_t cond;		/* signalled when jobs got an entry */
+   struct xiomux_conn *jobs;	/* connections ready for a step */
+   struct xiomux_conn **jobtail;
+   struct xiomux_conn *results;	/* connections stepped by a worker */
+   int notify[2];		/* pipe; a worker writes a byte to it when
+				   results got an entry */
+} xiotlspool = {
+   0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, NULL,
+   { -1, -1 }
+} ;
+
+/* one handshake worker thread. Never returns */
+static void *xiomux_tlsworker(void *arg) {
+   struct xiomux_conn *conn;
+
+   /* a failed handshake ends only its connection */
+   diag_set_int('E', E_FATAL);
+   while (true) {
+      pthread_mutex_lock(&xiotlspool.lock);
+      while (xiotlspool.jobs == NULL) {
+	 pthread_cond_wait(&xiotlspool.cond, &xiotlspool.lock);
+      }
+      conn = xiotlspool.jobs;
+      if ((xiotlspool.jobs = conn->job) == NULL) {
+	 xiotlspool.jobtail = &xiotlspool.jobs;
+      }
+      pthread_mutex_unlock(&xiotlspool.lock);
+
+      conn->want = xioopenssl_accept_step(&conn->tls->stream);
+
+      pthread_mutex_lock(&xiotlspool.lock);
+      conn->job = xiotlspool.results;
+      xiotlspool.results = conn;
+      pthread_mutex_unlock(&xiotlspool.lock);
+      /* when the pipe is full, the loop has not read it yet anyway */
+      while (Write(xiotlspool.notify[1], "", 1) < 0 && errno == EINTR) ;
+   }
+   return NULL;
+}
+
+/* starts the handshake workers and registers their pipe with the epoll
+   instance epfd.
+   returns 0 on success, or -1 on error */
+static int xiomux_tlsstart(int epfd) {
+   struct epoll_event ev;
+   pthread_attr_t attr;
+   pthread_t thread;
+   sigset_t all, old;
+   long ncpus;
+   int _errno;
+   int i;
+
+   if (Pipe(xiotlspool.notify) < 0) {
+      Error2("pipe(%p): %s", xiotlspool.notify, strerror(errno));
+      return -1;
+   }
+   for (i = 0; i < 2; ++i) {
+      if (Fcntl_l(xiotlspool.notify[i], F_SETFD, FD_CLOEXEC) < 0 ||
+	  Fcntl_l(xiotlspool.notify[i], F_SETFL,
+		  Fcntl(xiotlspool.notify[i], F_GETFL)|O_NONBLOCK) < 0) {
+	 Error2("fcntl(%d, ...): %s", xiotlspool.notify[i], strerror(errno));
+	 return -1;
+      }
+   }
+   ev.events = EPOLLIN;
+   ev.data.ptr = &xiotlspool;
+   if (Epoll_ctl(epfd, EPOLL_CTL_ADD, xiotlspool.notify[0], &ev) < 0) {
+      Error3("epoll_ctl(%d, EPOLL_CTL_ADD, %d, ...): %s",
+	     epfd, xiotlspool.notify[0], strerror(errno));
+      return -1;
+   }
+   xiotlspool.jobtail = &xiotlspool.jobs;
+
+   if ((ncpus = sysconf(_SC_NPROCESSORS_ONLN)) < 1)  ncpus = 1;
+   /* the signals, e.g. SIGCHLD of the second addresses, are for the loop */
+   sigfillset(&all);
+   pthread_sigmask(SIG_SETMASK, &all, &old);
+   pthread_attr_init(&attr);
+   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+   while (xiotlspool.numworkers < ncpus) {
+      if ((_errno = Pthread_create(&thread, &attr, xiomux_tlsworker, NULL))
+	  != 0) {
+	 Warn1("pthread_create(): %s", strerror(_errno));
+	 break;
+      }
+      ++xiotlspool.numworkers;
+   }
+   pthread_attr_destroy(&attr);
+   pthread_sigmask(SIG_SETMASK, &old, NULL);
+   if (xiotlspool.numworkers == 0) {
+      Error("no thread for the TLS handshakes");
+      return -1;
+   }
+   Info1("started %d TLS handshake threads", xiotlspool.numworkers);
+   return 0;
+}
+
+/* passes the connection to the handshake workers for the next step */
+static void xiomux_tlssubmit(struct xiomux_conn *conn) {
+   conn->busy = true;
+   conn->job = NULL;
+   pthread_mutex_lock(&xiotlspool.lock);
+   *xiotlspool.jobtail = conn;
+   xiotlspool.jobtail = &conn->job;
+   pthread_cond_signal(&xiotlspool.cond);
+   pthread_mutex_unlock(&xiotlspool.lock);
+}
+
+/* starts the TLS handshake of the accepted connection xfd1 in conn.
+   returns 0 on success, or -1 on error; xfd1 is left to the caller then */
+static int xiomux_tlsopen(struct xiomux_conn *conn, xiofile_t *xfd1,
+			  int epfd) {
+   struct single *sfd = &xfd1->stream;
+   struct timeval *to = &sfd->para.openssl.connect_timeout;
+   struct epoll_event ev;
+   int flags;
+
+   /* the fd stays nonblocking for the transfer, see xiomux_nonblock() */
+   if ((flags = Fcntl(sfd->rfd, F_GETFL)) < 0 ||
+       Fcntl_l(sfd->rfd, F_SETFL, flags|O_NONBLOCK) < 0) {
+      Error2("fcntl(%d, F_SETFL, O_NONBLOCK): %s", sfd->rfd, strerror(errno));
+      return -1;
+   }
+   ev.events = 0;	/* until a step tells what the handshake waits for */
+   ev.data.ptr = conn;
+   if (Epoll_ctl(epfd, EPOLL_CTL_ADD, sfd->rfd, &ev) < 0) {
+      Error3("epoll_ctl(%d, EPOLL_CTL_ADD, %d, ...): %s",
+	     epfd, sfd->rfd, strerror(errno));
+      return -1;
+   }
+   conn->tls = xfd1;
+   if (conn->hsto = (to->tv_sec != 0 || to->tv_usec != 0)) {
+      gettimeofday(&conn->deadline, NULL);
+      conn->deadline.tv_sec  += to->tv_sec;
+      conn->deadline.tv_usec += to->tv_usec;
+      if (conn->deadline.tv_usec >= 1000000) {
+	 conn->deadline.tv_usec -= 1000000;
+	 ++conn->deadline.tv_sec;
+      }
+   }
+   xiomux_tlssubmit(conn);
+   return 0;
+}
+
+#endif /* WITH_OPENSSL */
+
+/* makes the fds of xfd nonblocking, so that a peer that does not take data
+   cannot block the loop that serves all connections: output that an fd does
+   not take is kept in its write queue. What is still queued on shutdown or
+   close is dropped instead of waited for.
+   returns 0 on success, or -1 on error */
+static int xiomux_nonblock(xiofile_t *xfd) {
+   struct single *sfd;
+   int flags;
+
+   if (xfd->tag == XIO_TAG_DUAL) {
+      if (xiomux_nonblock((xiofile_t *)xfd->dual.stream[0]) < 0) {
+	 return -1;
+      }
+      return xiomux_nonblock((xiofile_t *)xfd->dual.stream[1]);
+   }
+   sfd = &xfd->stream;
+   if ((sfd->dtype & XIODATA_MASK) == XIODATA_LAYER) {
+      return xiomux_nonblock(sfd->lower);
+   }
+   if ((sfd->dtype & XIODATA_MASK) == XIODATA_RING) {
+      return 0;	/* the peer is a thread of ours */
+   }
+   sfd->wqdrop = true;
+   if (sfd->rfd >= 0) {
+      if ((flags = Fcntl(sfd->rfd, F_GETFL)) < 0 ||
+	  Fcntl_l(sfd->rfd, F_SETFL, flags|O_NONBLOCK) < 0) {
+	 Error2("fcntl(%d, F_SETFL, O_NONBLOCK): %s",
+		sfd->rfd, strerror(errno));
+	 return -1;
+      }
+   }
+   if (sfd->wfd >= 0 && sfd->wfd != sfd->rfd) {
+      if ((flags = Fcntl(sfd->wfd, F_GETFL)) < 0 ||
+	  Fcntl_l(sfd->wfd, F_SETFL, flags|O_NONBLOCK) < 0) {
+	 Error2("fcntl(%d, F_SETFL, O_NONBLOCK): %s",
+		sfd->wfd, strerror(errno));
+	 return -1;
+      }
+   }
+   return 0;
+}
+
+/* opens the second address for the accepted connection xfd1 and starts the
+   transfer loop of conn.
+   returns 0 on success, or -1 on error; xfd1 is left to the caller then */
+static int xiomux_start(struct xiomux_conn *conn, xiofile_t *xfd1,
+			const char *address2, int epfd) {
+   xiofile_t *xfd2;
+   struct epoll_event ev;
+   int rw;
+
+   xiosetsigchild(xfd1, socat_sigchild);
+
+   /* the second address must neither fork nor exec the process that handles
+      all the other connections */
+   if (XIO_WRITABLE(xfd1)) {
+      rw = XIO_READABLE(xfd1) ? XIO_RDWR : XIO_RDONLY;
+   } else {
+      rw = XIO_WRONLY;
+   }
+   if ((xfd2 = socat_open(address2, rw, XIO_MAYCHILD|XIO_MAYCONVERT)) == NULL) {
+      return -1;
+   }
+   xiosetsigchild(xfd2, socat_sigchild);
+
+   if (xiomux_nonblock(xfd1) < 0 || xiomux_nonblock(xfd2) < 0) {
+      xioclose(xfd2);
+      xiomux_freefd(xfd2, true);
+      return -1;
+   }
+   if (xiorelay_init(&conn->relay, xfd1, xfd2) < 0) {
+      xioclose(xfd2);
+      xiomux_freefd(xfd2, true);
+      return -1;
+   }
+   if (xioepoll_init(&conn->epoll) < 0) {
+      xiorelay_exit(&conn->relay);
+      xioclose(xfd2);
+      xiomux_freefd(xfd2, true);
+      return -1;
+   }
+   conn->outer = epfd;
+   ev.events = EPOLLIN;
+   ev.data.ptr = conn;
+   if (Epoll_ctl(epfd, EPOLL_CTL_ADD, conn->epoll.epfd, &ev) < 0) {
+      /* the loop would never see the events of this connection */
+      Error3("epoll_ctl(%d, EPOLL_CTL_ADD, %d, ...): %s",
+	     epfd, conn->epoll.epfd, strerror(errno));
+      xioepoll_exit(&conn->epoll);
+      xiorelay_exit(&conn->relay);
+      xioclose(xfd2);
+      xiomux_freefd(xfd2, true);
+      return -1;
+   }
+   conn->tls = NULL;
+
+   Notice4("starting data transfer loop with FDs [%d,%d] and [%d,%d]",
+	   XIO_READABLE(xfd1)?XIO_GETRDFD(xfd1):-1,
+	   XIO_WRITABLE(xfd1)?XIO_GETWRFD(xfd1):-1,
+	   XIO_READABLE(xfd2)?XIO_GETRDFD(xfd2):-1,
+	   XIO_WRITABLE(xfd2)?XIO_GETWRFD(xfd2):-1);
+   return 0;
+}
+
+/* runs the transfer loop of a new connection until it has to wait */
+static void xiomux_begin(struct xiomux_conn *conn) {
+   if ((conn->done = xiorelay_timer(&conn->relay)) == 0) {
+      xiorelay_fds(&conn->relay, conn->fds);
+      conn->done = xiomux_run(conn, false);
+   }
+}
+
+/* accepts a connection, opens the second address for it, and starts its
+   transfer loop; with OPENSSL-LISTEN, starts its handshake instead.
+   returns the new connection, or NULL when none has been established */
+static struct xiomux_conn *xiomux_open(xiofile_t *lfd, const char *address2,
+				       int epfd) {
+   struct xiomux_conn *conn;
+   xiofile_t *xfd1;
+
+   if ((xfd1 = xioaccept_mux(lfd)) == NULL) {
+      return NULL;
+   }
+#if WITH_OPENSSL
+   if ((xfd1->stream.dtype & XIODATA_MASK) == XIODATA_OPENSSL &&
+       xioopenssl_accept_init(&xfd1->stream) != STAT_OK) {
+      xioclose(xfd1);
+      xiomux_freefd(xfd1, false);
+      return NULL;
+   }
+#endif /* WITH_OPENSSL */
+
+   if ((conn = Malloc(sizeof(struct xiomux_conn))) == NULL) {
+      xioclose(xfd1);
+      xiomux_freefd(xfd1, false);
+      return NULL;
+   }
+   conn->done = 0;
+   conn->next = NULL;
+   conn->tls = NULL;
+#if WITH_OPENSSL
+   if ((xfd1->stream.dtype & XIODATA_MASK) == XIODATA_OPENSSL) {
+      /* the transfer starts when the workers have done the handshake */
+      if (xiomux_tlsopen(conn, xfd1, epfd) < 0) {
+	 free(conn);
+	 xioclose(xfd1);
+	 xiomux_freefd(xfd1, false);
+	 return NULL;
+      }
+      return conn;
+   }
+#endif /* WITH_OPENSSL */
+   if (xiomux_start(conn, xfd1, address2, epfd) < 0) {
+      free(conn);
+      xioclose(xfd1);
+      xiomux_freefd(xfd1, false);
+      return NULL;
+   }
+   xiomux_begin(conn);
+   return conn;
+}
+
+#if WITH_OPENSSL
+/* takes the connections that the handshake workers have stepped: starts the
+   transfer of those with a complete handshake, and waits for the fds of the
+   others */
+static void xiomux_tlsresults(const char *address2, int epfd) {
+   struct xiomux_conn *conn, *next;
+   struct epoll_event ev;
+   struct single *sfd;
+   char buff[64];
+
+   while (Read(xiotlspool.notify[0], buff, sizeof(buff)) > 0) ;
+   pthread_mutex_lock(&xiotlspool.lock);
+   conn = xiotlspool.results;
+   xiotlspool.results = NULL;
+   pthread_mutex_unlock(&xiotlspool.lock);
+
+   for (; conn != NULL; conn = next) {
+      next = conn->job;
+      conn->busy = false;
+      sfd = &conn->tls->stream;
+      if (conn->want < 0) {
+	 conn->done = -1;
+	 continue;
+      }
+      if (conn->want > 0) {
+	 ev.events = (conn->want == POLLIN ? EPOLLIN : EPOLLOUT)|EPOLLONESHOT;
+	 ev.data.ptr = conn;
+	 if (Epoll_ctl(epfd, EPOLL_CTL_MOD, sfd->rfd, &ev) < 0) {
+	    Error3("epoll_ctl(%d, EPOLL_CTL_MOD, %d, ...): %s",
+		   epfd, sfd->rfd, strerror(errno));
+	    conn->done = -1;
+	 }
+	 continue;
+      }
+      /* the handshake is complete */
+      Epoll_ctl(epfd, EPOLL_CTL_DEL, sfd->rfd, NULL);
+      if (xioaccept_setenv(sfd) < 0 ||
+	  xioopenssl_accept_done(sfd) < 0 ||
+	  xiomux_start(conn, conn->tls, address2, epfd) < 0) {
+	 conn->done = -1;
+	 continue;
+      }
+      xiomux_begin(conn);
+   }
+}
+#endif /* WITH_OPENSSL */
+
+/* tells if the connection has a deadline: the poll timeout of its transfer
+   loop, or connect-timeout during its handshake unless a worker has it */
+static bool xiomux_timed(struct xiomux_conn *conn) {
+   if (conn->tls != NULL) {
+      return conn->hsto && !conn->busy;
+   }
+   return conn->relay.to != NULL;
+}
+
+/* releases a connection after its transfer loop has finished, or its
+   handshake has failed */
+static void xiomux_close(struct xiomux_conn *conn, int result, int epfd) {
+   if (conn->tls != NULL) {
+      /* a forked child might still have the fd */
+      Epoll_ctl(epfd, EPOLL_CTL_DEL, conn->tls->stream.rfd, NULL);
+      xioclose(conn->tls);
+      xiomux_freefd(conn->tls, false);
+      free(conn);
+      return;
+   }
+   if (result < 0) {
+      xioclose(conn->relay.sock1);
+      xioclose(conn->relay.sock2);
+   }
+   xioepoll_exit(&conn->epoll);	/* removes it from the outer epoll too */
+   xiomux_freefd(conn->relay.sock1, false);
+   xiomux_freefd(conn->relay.sock2, true);
+   xiorelay_exit(&conn->relay);
+   free(conn);
+}
+
+/* the accept and transfer loop for a listen address with option multiplex:
+   each accepted connection gets the second address opened and its own
+   transfer loop state (xiorelay), so timeouts and EOF handling are the same
+   as with fork. Opening the second address blocks the loop, TLS handshakes
+   do not.
+   Returns only on error */
+static int xiomux_epoll(xiofile_t *lfd, const char *address2) {
+   struct xiomux_conn *conns = NULL;	/* list of active connections */
+   struct xiomux_conn *conn;
+   struct epoll_event ev, events[XIOMUX_MAXEVENTS];
+   int lfdnum = lfd->stream.rfd;
+   int maxconns = lfd->stream.para.socket.maxconns;
+   uint32_t lisevents = EPOLLIN;
+   int numconns = 0;
+   bool listening;
+   char lisname[256];
+   union sockaddr_union us;
+   socklen_t uslen = sizeof(us);
+   int epfd;
+   int n, i;
+
+   /* a connection attempt might be gone when we accept() it */
+   if (Fcntl_l(lfdnum, F_SETFL, Fcntl(lfdnum, F_GETFL)|O_NONBLOCK) < 0) {
+      Error2("fcntl(%d, F_SETFL, O_NONBLOCK): %s", lfdnum, strerror(errno));
+      return -1;
+   }
+   if ((epfd = Epoll_create1(EPOLL_CLOEXEC)) < 0) {
+      Error1("epoll_create1(EPOLL_CLOEXEC): %s", strerror(errno));
+      return -1;
+   }
+#ifdef EPOLLEXCLUSIVE
+   if (lfd->stream.para.socket.muxshared) {
+      /* option prefork: wake up only one of the workers per connection */
+      lisevents |= EPOLLEXCLUSIVE;
+   }
+#endif
+   ev.events = lisevents;
+   ev.data.ptr = NULL;	/* the listening socket */
+   if (Epoll_ctl(epfd, EPOLL_CTL_ADD, lfdnum, &ev) < 0) {
+      Error3("epoll_ctl(%d, EPOLL_CTL_ADD, %d, ...): %s",
+	     epfd, lfdnum, strerror(errno));
+      Close(epfd);
+      return -1;
+   }
+   listening = true;
+#if WITH_OPENSSL
+   if ((lfd->stream.dtype & XIODATA_MASK) == XIODATA_OPENSSL &&
+       xiomux_tlsstart(epfd) < 0) {
+      Close(epfd);
+      return -1;
+   }
+#endif /* WITH_OPENSSL */
+   if (Getsockname(lfdnum, &us.soa, &uslen) < 0) {
+      uslen = 0;
+   }
+   Notice1("listening on %s, multiplexing connections",
+	   uslen ? sockaddr_info(&us.soa, uslen, lisname, sizeof(lisname)) :
+	   "?");
+
+   /* an error of one connection, e.g. when its second address cannot be
+      opened, must not terminate the others; only fatals exit the loop */
+   diag_set_int('E', E_FATAL);
+   while (true) {
+      struct xiomux_conn **connp;
+      struct timeval now, *first = NULL;
+      int ms = -1;
+
+      /* the earliest timeout of all connections */
+      for (conn = conns; conn != NULL; conn = conn->next) {
+	 if (conn->done || !xiomux_timed(conn))  continue;
+	 if (first == NULL ||
+	     conn->deadline.tv_sec < first->tv_sec ||
+	     conn->deadline.tv_sec == first->tv_sec &&
+	     conn->deadline.tv_usec < first->tv_usec) {
+	    first = &conn->deadline;
+	 }
+      }
+      if (first != NULL) {
+	 gettimeofday(&now, NULL);
+	 ms = 1000*(first->tv_sec - now.tv_sec) +
+	    (first->tv_usec - now.tv_usec + 999)/1000;
+	 if (ms < 0)  ms = 0;
+      }
+
+      n = Epoll_wait(epfd, events, XIOMUX_MAXEVENTS, ms);
+      if (n < 0) {
+	 if (errno == EINTR)  continue;
+	 Error5("epoll_wait(%d, %p, %d, %d): %s",
+		epfd, events, XIOMUX_MAXEVENTS, ms, strerror(errno));
+	 break;
+      }
+      gettimeofday(&now, NULL);
+
+      for (i = 0; i < n; ++i) {
+	 conn = events[i].data.ptr;
+#if WITH_OPENSSL
+	 if (conn == (void *)&xiotlspool) {
+	    xiomux_tlsresults(address2, epfd);
+	    continue;
+	 }
+	 if (conn != NULL && conn->tls != NULL) {
+	    /* the fd of a handshake is ready */
+	    if (!conn->done && !conn->busy)  xiomux_tlssubmit(conn);
+	    continue;
+	 }
+#endif /* WITH_OPENSSL */
+	 if (conn != NULL) {
+	    if (!conn->done) {
+	       conn->done = xiomux_run(conn, false);
+	    }
+	    continue;
+	 }
+	 /* a new connection on the listening socket; one per event, because
+	    Accept() waits for it. Further ones are reported again */
+	 if (maxconns != 0 && numconns >= maxconns) {
+	    continue;
+	 }
+	 if ((conn = xiomux_open(lfd, address2, epfd)) == NULL) {
+	    continue;
+	 }
+	 conn->next = conns;
+	 conns = conn;
+	 ++numconns;
+      }
+
+      /* the connections whose poll timeout expired */
+      for (conn = conns; conn != NULL; conn = conn->next) {
+	 if (conn->done || !xiomux_timed(conn))  continue;
+	 if (conn->deadline.tv_sec < now.tv_sec ||
+	     conn->deadline.tv_sec == now.tv_sec &&
+	     conn->deadline.tv_usec <= now.tv_usec) {
+	    if (conn->tls != NULL) {
+	       Error1("connection [%d]: SSL handshake timed out",
+		      conn->tls->stream.rfd);
+	       conn->done = -1;
+	    } else {
+	       conn->done = xiomux_run(conn, true);
+	    }
+	 }
+      }
+
+      /* release finished connections only now, events might refer to them */
+      connp = &conns;
+      while ((conn = *connp) != NULL) {
+	 if (!conn->done) {
+	    connp = &conn->next;
+	    continue;
+	 }
+	 *connp = conn->next;
+	 xiomux_close(conn, conn->done, epfd);
+	 --numconns;
+      }
+
+      if (maxconns) {
+	 if (listening && numconns >= maxconns) {
+	    Notice("maxchildren are active, waiting");
+	    Epoll_ctl(epfd, EPOLL_CTL_DEL, lfdnum, NULL);
+	    listening = false;
+	 } else if (!listening && numconns < maxconns) {
+	    Info("still listening");
+	    ev.events = lisevents;
+	    ev.data.ptr = NULL;
+	    Epoll_ctl(epfd, EPOLL_CTL_ADD, lfdnum, &ev);
+	    listening = true;
+	 }
+      }
+   }
+
+   diag_set_int('E', -1);
+   Close(epfd);
+   return -1;
+}
+
+#endif /* WITH_LISTEN && HAVE_EPOLL_CREATE1 */
+
+
+#if WITH_LISTEN && HAVE_EPOLL_CREATE1
+
+#define XIOMUX_BURST	256	/* packets taken from the socket before the
+				   sessions get their turn */
+#define XIOMUX_HASHMIN	1024	/* initial number of hash buckets */
+#define XIOMUX_WQMAX	262144	/* bytes queued for the second address of a
+				   session beyond which its packets are
+				   dropped */
+
+/* with option multiplex on UDP-LISTEN: one peer address and the second
+   address opened for it */
+struct xiomux_peer {
+   union sockaddr_union sa;	/* the peer address */
+   socklen_t salen;
+   xiofile_t *xfd2;
+   struct timeval lastio;	/* last packet in either direction */
+   bool pollout;		/* output is queued, waiting for EPOLLOUT */
+   bool done;			/* finished, released after the event loop */
+   struct xiomux_peer *hnext;	/* next one in the hash bucket */
+   struct xiomux_peer *prev;	/* the sessions ordered by lastio, the */
+   struct xiomux_peer *next;	/* least recently active first */
+} ;
+
+/* the sessions of the UDP listening socket */
+struct xiomux_peers {
+   struct xiomux_peer **buckets;
+   unsigned int size;		/* number of buckets, a power of 2 */
+   unsigned int count;		/* number of sessions */
+   struct xiomux_peer *first, *last;	/* see xiomux_peer.prev */
+   struct xiomux_peer *dead;	/* finished ones, linked by hnext */
+   int epfd;			/* with the fds of the second addresses */
+} ;
+
+
+/* returns the hash value of the IP address and port of sa */
+static unsigned int xiomux_peerhash(const union sockaddr_union *sa) {
+   const unsigned char *addr;
+   size_t len, i;
+   uint16_t port;
+   unsigned int hash = 2166136261u;	/* FNV-1a */
+
+   switch (sa->soa.sa_family) {
+#if WITH_IP4
+   case AF_INET:
+      addr = (const unsigned char *)&sa->ip4.sin_addr;
+      len = sizeof(sa->ip4.sin_addr);
+      port = sa->ip4.sin_port;
+      break;
+#endif
+#if WITH_IP6
+   case AF_INET6:
+      addr = (const unsigned char *)&sa->ip6.sin6_addr;
+      len = sizeof(sa->ip6.sin6_addr);
+      port = sa->ip6.sin6_port;
+      break;
+#endif
+   default:
+      return 0;
+   }
+   for (i = 0; i < len; ++i) {
+      hash = (hash ^ addr[i]) * 16777619u;
+   }
+   hash = (hash ^ (port & 0xff)) * 16777619u;
+   hash = (hash ^ (port >> 8))   * 16777619u;
+   return hash;
+}
+
+static bool xiomux_samepeer(const union sockaddr_union *sa1,
+			    const union sockaddr_union *sa2) {
+   if (sa1->soa.sa_family != sa2->soa.sa_family)  return false;
+   switch (sa1->soa.sa_family) {
+#if WITH_IP4
+   case AF_INET:
+      return sa1->ip4.sin_port == sa2->ip4.sin_port &&
+	 sa1->ip4.sin_addr.s_addr == sa2->ip4.sin_addr.s_addr;
+#endif
+#if WITH_IP6
+   case AF_INET6:
+      return sa1->ip6.sin6_port == sa2->ip6.sin6_port &&
+	 sa1->ip6.sin6_scope_id == sa2->ip6.sin6_scope_id &&
+	 !memcmp(&sa1->ip6.sin6_addr, &sa2->ip6.sin6_addr,
+		 sizeof(sa1->ip6.sin6_addr));
+#endif
+   }
+   return false;
+}
+
+/* returns the active session of the peer address, or NULL */
+static struct xiomux_peer *xiomux_peerfind(struct xiomux_peers *peers,
+					   const union sockaddr_union *sa) {
+   struct xiomux_peer *peer;
+
+   peer = peers->buckets[xiomux_peerhash(sa) & (peers->size-1)];
+   while (peer != NULL && !xiomux_samepeer(&peer->sa, sa)) {
+      peer = peer->hnext;
+   }
+   return peer;
+}
+
+/* doubles the number of hash buckets when they are all in use on average,
+   so a lookup stays short with any number of sessions */
+static void xiomux_peergrow(struct xiomux_peers *peers) {
+   struct xiomux_peer **buckets, *peer;
+   unsigned int size = 2*peers->size;
+   unsigned int i, h;
+
+   if ((buckets = Calloc(size, sizeof(struct xiomux_peer *))) == NULL) {
+      return;	/* go on with longer chains */
+   }
+   for (i = 0; i < peers->size; ++i) {
+      while ((peer = peers->buckets[i]) != NULL) {
+	 peers->buckets[i] = peer->hnext;
+	 h = xiomux_peerhash(&peer->sa) & (size-1);
+	 peer->hnext = buckets[h];
+	 buckets[h] = peer;
+      }
+   }
+   free(peers->buckets);
+   peers->buckets = buckets;
+   peers->size = size;
+   Info1("%u hash buckets for UDP peers", size);
+}
+
+/* makes peer the most recently active session */
+static void xiomux_peertouch(struct xiomux_peers *peers,
+			     struct xiomux_peer *peer,
+			     const struct timeval *now) {
+   peer->lastio = *now;
+   if (peers->last == peer)  return;
+   if (peer->prev != NULL)  peer->prev->next = peer->next;
+   else                     peers->first = peer->next;
+   peer->next->prev = peer->prev;
+   peer->prev = peers->last;
+   peer->next = NULL;
+   peers->last->next = peer;
+   peers->last = peer;
+}
+
+/* waits for the output fd of the second address of the session to become
+   writeable while its write queue holds data, and stops waiting when the
+   queue is empty */
+static void xiomux_peerout(struct xiomux_peers *peers,
+			   struct xiomux_peer *peer) {
+   bool want = XIO_WRSTREAM(peer->xfd2)->wqlen > 0;
+   int rfd = XIO_READABLE(peer->xfd2) ? XIO_GETRDFD(peer->xfd2) : -1;
+   int wfd = XIO_GETWRFD(peer->xfd2);
+   struct epoll_event ev;
+
+   if (want == peer->pollout || wfd < 0)  return;
+   ev.data.ptr = peer;
+   if (wfd == rfd) {
+      ev.events = EPOLLIN | (want ? EPOLLOUT : 0);
+      if (Epoll_ctl(peers->epfd, EPOLL_CTL_MOD, wfd, &ev) < 0) {
+	 Error3("epoll_ctl(%d, EPOLL_CTL_MOD, %d, ...): %s",
+		peers->epfd, wfd, strerror(errno));
+	 return;
+      }
+   } else {
+      ev.events = EPOLLOUT;
+      if (Epoll_ctl(peers->epfd, want ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, wfd,
+		    &ev) < 0) {
+	 Error4("epoll_ctl(%d, %s, %d, ...): %s", peers->epfd,
+		want ? "EPOLL_CTL_ADD" : "EPOLL_CTL_DEL", wfd, strerror(errno));
+	 return;
+      }
+   }
+   peer->pollout = want;
+}
+
+/* removes the session from the table and the activity list, closes its
+   second address, and queues it for release after the event loop */
+static void xiomux_peerend(struct xiomux_peers *peers,
+			   struct xiomux_peer *peer) {
+   struct xiomux_peer **pp;
+
+   pp = &peers->buckets[xiomux_peerhash(&peer->sa) & (peers->size-1)];
+   while (*pp != peer)  pp = &(*pp)->hnext;
+   *pp = peer->hnext;
+   if (peer->prev != NULL)  peer->prev->next = peer->next;
+   else                     peers->first = peer->next;
+   if (peer->next != NULL)  peer->next->prev = peer->prev;
+   else                     peers->last = peer->prev;
+   --peers->count;
+
+   if (XIO_READABLE(peer->xfd2)) {
+      /* a child process might share the fd */
+      Epoll_ctl(peers->epfd, EPOLL_CTL_DEL, XIO_GETRDFD(peer->xfd2), NULL);
+   }
+   if (peer->pollout &&
+       !(XIO_READABLE(peer->xfd2) &&
+	 XIO_GETWRFD(peer->xfd2) == XIO_GETRDFD(peer->xfd2))) {
+      Epoll_ctl(peers->epfd, EPOLL_CTL_DEL, XIO_GETWRFD(peer->xfd2), NULL);
+   }
+   xioclose(peer->xfd2);
+   peer->done = true;
+   peer->hnext = peers->dead;
+   peers->dead = peer;
+}
+
+/* checks a new peer address and opens the second address for it.
+   Returns the new session, or NULL when the packet is to be dropped */
+static struct xiomux_peer *xiomux_peeropen(xiofile_t *lfd,
+					   const char *address2,
+					   struct xiomux_peers *peers,
+					   const union sockaddr_union *from,
+					   socklen_t fromlen,
+					   socklen_t lalen) {
+   struct single *lsfd = &lfd->stream;
+   struct xiomux_peer *peer;
+   union sockaddr_union pa = *from;
+   struct epoll_event ev;
+   char infobuff[256];
+   unsigned int h;
+   int rw;
+
+   Notice1("accepting UDP connection from %s",
+	   sockaddr_info(&pa.soa, fromlen, infobuff, sizeof(infobuff)));
+   if (xiocheckpeer(lsfd, &pa, &lsfd->para.socket.la) < 0) {
+      return NULL;
+   }
+   Info1("permitting UDP connection from %s",
+	 sockaddr_info(&pa.soa, fromlen, infobuff, sizeof(infobuff)));
+
+   if ((peer = Calloc(1, sizeof(struct xiomux_peer))) == NULL) {
+      return NULL;
+   }
+   peer->sa = pa;
+   peer->salen = fromlen;
+
+   /* the second address may refer to the peer in its parameters */
+   xiosetsockaddrenv("SOCK", &lsfd->para.socket.la, lalen,
+		     lsfd->para.socket.proto);
+   xiosetsockaddrenv("PEER", &pa, fromlen, lsfd->para.socket.proto);
+   /* the second address must neither fork nor exec the process that handles
+      all the other peers */
+   rw = XIO_WRITABLE(lfd) ? XIO_RDWR : XIO_WRONLY;
+   if ((peer->xfd2 = socat_open(address2, rw, XIO_MAYCHILD|XIO_MAYCONVERT))
+       == NULL) {
+      free(peer);
+      return NULL;
+   }
+   xiosetsigchild(peer->xfd2, socat_sigchild);
+
+   if (xiomux_nonblock(peer->xfd2) < 0) {
+      xioclose(peer->xfd2);
+      xiomux_freefd(peer->xfd2, true);
+      free(peer);
+      return NULL;
+   }
+   if (XIO_READABLE(peer->xfd2)) {
+      ev.events = EPOLLIN;
+      ev.data.ptr = peer;
+      if (Epoll_ctl(peers->epfd, EPOLL_CTL_ADD, XIO_GETRDFD(peer->xfd2), &ev)
+	  < 0) {
+	 Error3("epoll_ctl(%d, EPOLL_CTL_ADD, %d, ...): %s",
+		peers->epfd, XIO_GETRDFD(peer->xfd2), strerror(errno));
+	 xioclose(peer->xfd2);
+	 xiomux_freefd(peer->xfd2, true);
+	 free(peer);
+	 return NULL;
+      }
+   }
+
+   h = xiomux_peerhash(&peer->sa) & (peers->size-1);
+   peer->hnext = peers->buckets[h];
+   peers->buckets[h] = peer;
+   peer->prev = peers->last;
+   if (peers->last != NULL)  peers->last->next = peer;
+   else                      peers->first = peer;
+   peers->last = peer;
+   if (++peers->count > peers->size) {
+      xiomux_peergrow(peers);
+   }
+   Notice3("starting data transfer loop with FDs [%d,%d] for %s",
+	   XIO_READABLE(peer->xfd2)?XIO_GETRDFD(peer->xfd2):-1,
+	   XIO_GETWRFD(peer->xfd2),
+	   sockaddr_info(&pa.soa, fromlen, infobuff, sizeof(infobuff)));
+   return peer;
+}
+
+/* receives the next packet on the listening socket without waiting.
+   Returns the number of bytes, or -1 with EAGAIN when there is none, or -1 on
+   error */
+static ssize_t xiomux_recvfrom(struct single *lsfd, void *buff, size_t bufsiz,
+			       union sockaddr_union *from,
+			       socklen_t *fromlen) {
+   ssize_t bytes;
+   char infobuff[256];
+   int _errno;
+
+#if HAVE_MMSG
+   if (xiommsg_usable(lsfd, false)) {
+      /* prints its own error messages */
+      return xiommsg_recv(lsfd, buff, bufsiz, from, fromlen, NULL);
+   }
+#endif /* HAVE_MMSG */
+   do {
+      bytes = Recvfrom(lsfd->rfd, buff, bufsiz, 0, &from->soa, fromlen);
+   } while (bytes < 0 && errno == EINTR);
+   if (bytes < 0 && errno != EAGAIN) {
+      _errno = errno;
+      Error6("recvfrom(%d, %p, "F_Zu", 0, %s, {"F_socklen"}): %s",
+	     lsfd->rfd, buff, bufsiz,
+	     sockaddr_info(&from->soa, *fromlen, infobuff, sizeof(infobuff)),
+	     *fromlen, strerror(_errno));
+      errno = _errno;
+   }
+   return bytes;
+}
+
+/* the transfer loop for UDP-LISTEN with option multiplex: all peers send to
+   the one listening socket; their packets are told apart by the source
+   address, and each peer address gets its own instance of the second
+   address, found in a hash table. Replies go back with sendto().
+   A session ends on EOF or error of its second address, and with option -T
+   after that time without packets in either direction; the sessions are kept
+   in order of their last activity, so expiring them does not need to look at
+   the others. Opening the second address blocks the loop.
+   Returns only on error */
+static int xiomux_udp(xiofile_t *lfd, const char *address2) {
+   struct single *lsfd = &lfd->stream;
+   struct xiomux_peers peers = { NULL, XIOMUX_HASHMIN, 0, NULL, NULL, NULL, -1 };
+   struct xiomux_peer *peer, *flush;
+   struct epoll_event ev, events[XIOMUX_MAXEVENTS];
+   struct timeval idle = xioparams->total_timeout;
+   bool doidle = (idle.tv_sec != 0 || idle.tv_usec != 0);
+   int maxconns = lsfd->para.socket.maxconns;
+   size_t bufsiz = xioparams->bufsiz;
+   unsigned char *buff;
+   union sockaddr_union from;
+   socklen_t fromlen;
+   socklen_t lalen = sizeof(lsfd->para.socket.la);
+   char infobuff[256];
+   ssize_t bytes;
+   int epfd;
+   int n, i, count;
+
+   if (Fcntl_l(lsfd->rfd, F_SETFL, Fcntl(lsfd->rfd, F_GETFL)|O_NONBLOCK) < 0) {
+      Error2("fcntl(%d, F_SETFL, O_NONBLOCK): %s", lsfd->rfd, strerror(errno));
+      return -1;
+   }
+   if ((buff = Malloc(bufsiz)) == NULL) {
+      return -1;
+   }
+   if ((peers.buckets = Calloc(peers.size, sizeof(struct xiomux_peer *)))
+       == NULL) {
+      free(buff);
+      return -1;
+   }
+   if ((epfd = Epoll_create1(EPOLL_CLOEXEC)) < 0) {
+      Error1("epoll_create1(EPOLL_CLOEXEC): %s", strerror(errno));
+      free(peers.buckets);  free(buff);
+      return -1;
+   }
+   peers.epfd = epfd;
+   ev.events = EPOLLIN;
+   ev.data.ptr = NULL;	/* the listening socket */
+   if (Epoll_ctl(epfd, EPOLL_CTL_ADD, lsfd->rfd, &ev) < 0) {
+      Error3("epoll_ctl(%d, EPOLL_CTL_ADD, %d, ...): %s",
+	     epfd, lsfd->rfd, strerror(errno));
+      Close(epfd);  free(peers.buckets);  free(buff);
+      return -1;
+   }
+   switch (lsfd->para.socket.la.soa.sa_family) {
+#if WITH_IP4
+   case AF_INET:  lalen = sizeof(struct sockaddr_in);  break;
+#endif
+#if WITH_IP6
+   case AF_INET6: lalen = sizeof(struct sockaddr_in6); break;
+#endif
+   }
+   Notice1("listening on UDP %s, multiplexing peers",
+	   sockaddr_info(&lsfd->para.socket.la.soa, lalen,
+			 infobuff, sizeof(infobuff)));
+
+   /* an error of one session must not terminate the others */
+   diag_set_int('E', E_FATAL);
+   while (true) {
+      struct timeval now;
+      int ms = -1;
+
+      if (doidle && peers.first != NULL) {
+	 gettimeofday(&now, NULL);
+	 ms = 1000*(peers.first->lastio.tv_sec + idle.tv_sec - now.tv_sec) +
+	    (peers.first->lastio.tv_usec + idle.tv_usec - now.tv_usec + 999)/1000;
+	 if (ms < 0)  ms = 0;
+      }
+
+      n = Epoll_wait(epfd, events, XIOMUX_MAXEVENTS, ms);
+      if (n < 0) {
+	 if (errno == EINTR)  continue;
+	 Error5("epoll_wait(%d, %p, %d, %d): %s",
+		epfd, events, XIOMUX_MAXEVENTS, ms, strerror(errno));
+	 break;
+      }
+      gettimeofday(&now, NULL);
+
+      for (i = 0; i < n; ++i) {
+	 peer = events[i].data.ptr;
+	 if (peer != NULL) {
+	    /* a reply from the second address of a session, or room for
+	       the output queued for it */
+	    if (peer->done)  continue;
+	    if (events[i].events & EPOLLOUT) {
+	       if (xioflush(peer->xfd2) < 0) {
+		  xiomux_peerend(&peers, peer);
+		  continue;
+	       }
+	       xiomux_peertouch(&peers, peer, &now);
+	       xiomux_peerout(&peers, peer);
+	       if (!(events[i].events & (EPOLLIN|EPOLLHUP|EPOLLERR)) ||
+		   !XIO_READABLE(peer->xfd2)) {
+		  continue;
+	       }
+	    }
+	    do {
+	       if ((bytes = xioread(peer->xfd2, buff, bufsiz)) < 0) {
+		  if (errno == EAGAIN)  break;
+		  xiomux_peerend(&peers, peer);
+		  break;
+	       }
+	       if (bytes == 0) {
+		  Info1("EOF on second address for %s, ending session",
+			sockaddr_info(&peer->sa.soa, peer->salen,
+				      infobuff, sizeof(infobuff)));
+		  xiomux_peerend(&peers, peer);
+		  break;
+	       }
+	       xiomux_peertouch(&peers, peer, &now);
+	       lsfd->peersa = peer->sa;
+	       lsfd->salen  = peer->salen;
+	       xiowrite(lfd, buff, bytes);	/* prints its own errors */
+	    } while (xiopending(peer->xfd2) > 0);
+	    continue;
+	 }
+
+	 /* packets on the listening socket; writes to the second address of a
+	    session are flushed when the next packet is from another peer */
+	 flush = NULL;
+	 for (count = 0; count < XIOMUX_BURST || xiopending(lfd) > 0; ++count) {
+	    fromlen = sizeof(from);
+	    if ((bytes = xiomux_recvfrom(lsfd, buff, bufsiz, &from, &fromlen))
+		< 0) {
+	       break;
+	    }
+	    if ((peer = xiomux_peerfind(&peers, &from)) == NULL) {
+	       if (maxconns != 0 && peers.count >= (unsigned int)maxconns) {
+		  Info1("maxchildren are active, dropping packet from %s",
+			sockaddr_info(&from.soa, fromlen,
+				      infobuff, sizeof(infobuff)));
+		  continue;
+	       }
+	       if ((peer = xiomux_peeropen(lfd, address2, &peers, &from,
+					   fromlen, lalen))
+		   == NULL) {
+		  continue;	/* drop packet */
+	       }
+	    }
+	    if (flush != NULL && flush != peer && !flush->done) {
+	       xioflush(flush->xfd2);
+	       xiomux_peerout(&peers, flush);
+	    }
+	    flush = peer;
+	    xiomux_peertouch(&peers, peer, &now);
+	    if (XIO_WRSTREAM(peer->xfd2)->wqlen >= XIOMUX_WQMAX) {
+	       /* like a full socket buffer */
+	       Info1("second address for %s does not take data, dropping packet",
+		     sockaddr_info(&peer->sa.soa, peer->salen,
+				   infobuff, sizeof(infobuff)));
+	       continue;
+	    }
+	    if (xiowrite(peer->xfd2, buff, bytes) < 0) {
+	       xiomux_peerend(&peers, peer);
+	       flush = NULL;
+	    }
+	 }
+	 if (flush != NULL && !flush->done) {
+	    xioflush(flush->xfd2);
+	    xiomux_peerout(&peers, flush);
+	 }
+      }
+      xioflush(lfd);	/* the replies */
+
+      /* the sessions without activity for the time of option -T */
+      while (doidle && (peer = peers.first) != NULL) {
+	 struct timeval end = peer->lastio;
+	 end.tv_sec  += idle.tv_sec;
+	 end.tv_usec += idle.tv_usec;
+	 if (end.tv_usec >= 1000000) {
+	    end.tv_usec -= 1000000;
+	    ++end.tv_sec;
+	 }
+	 if (end.tv_sec > now.tv_sec ||
+	     end.tv_sec == now.tv_sec && end.tv_usec > now.tv_usec) {
+	    break;
+	 }
+	 Info1("inactivity timeout of session for %s",
+	       sockaddr_info(&peer->sa.soa, peer->salen,
+			     infobuff, sizeof(infobuff)));
+	 xiomux_peerend(&peers, peer);
+      }
+
+      /* release finished sessions only now, events might refer to them */
+      while ((peer = peers.dead) != NULL) {
+	 peers.dead = peer->hnext;
+	 xiomux_freefd(peer->xfd2, true);
+	 free(peer);
+      }
+   }
+
+   diag_set_int('E', -1);
+   Close(epfd);
+   return -1;
+}
+
+#endif /* WITH_LISTEN && HAVE_EPOLL_CREATE1 */
+
+
+#if WITH_LISTEN
+
+/* with option thread: the state shared by the connection threads */
+static struct {
+   xiofile_t *lfd;
+   const char *address2;
+   int maxthreads;		/* max-children; 0 means no limit */
+   int numthreads;		/* connection threads started */
+   int idle;			/* threads waiting for the next connection */
+   pthread_mutex_t acceptlock;	/* held while accepting a connection and
+				   opening the second address: the latter
+				   depends on the process wide environment
+				   (SOCAT_PEERADDR etc.) */
+   pthread_mutex_t lock;	/* protects the counters and the xio file
+				   registry sock[] */
+} xiothreads = {
+   NULL, NULL, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER
+} ;
+
+static void *xiomux_thread(void *arg);
+
+/* starts another connection thread unless one is waiting for connections
+   already or max-children threads exist */
+static void xiomux_spawn(void) {
+   pthread_attr_t attr;
+   pthread_t thread;
+   bool spawn;
+   int _errno;
+
+   pthread_mutex_lock(&xiothreads.lock);
+   spawn = (xiothreads.idle == 0 &&
+	    (xiothreads.maxthreads == 0 ||
+	     xiothreads.numthreads < xiothreads.maxthreads));
+   if (spawn)  ++xiothreads.numthreads;
+   pthread_mutex_unlock(&xiothreads.lock);
+   if (!spawn)  return;
+
+   pthread_attr_init(&attr);
+   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+   if ((_errno = Pthread_create(&thread, &attr, xiomux_thread, NULL)) != 0) {
+      Warn1("pthread_create(): %s", strerror(_errno));
+      pthread_mutex_lock(&xiothreads.lock);
+      --xiothreads.numthreads;
+      pthread_mutex_unlock(&xiothreads.lock);
+   } else {
+      Info1("started thread "F_thread, thread);
+   }
+   pthread_attr_destroy(&attr);
+}
+
+#if WITH_OPENSSL
+/* with OPENSSL-LISTEN: performs the TLS handshake of the accepted connection
+   in this thread, after xioopenssl_accept_init().
+   returns 0 on success, or -1 on error */
+static int xiomux_tlsaccept(xiofile_t *xfd) {
+   struct single *sfd = &xfd->stream;
+   struct timeval *to = NULL;
+   struct pollfd pfd;
+   int want, result;
+
+   if (sfd->para.openssl.connect_timeout.tv_sec  != 0 ||
+       sfd->para.openssl.connect_timeout.tv_usec != 0) {
+      to = &sfd->para.openssl.connect_timeout;
+   }
+   pfd.fd = sfd->rfd;
+   /* with option nonblock, the steps wait for the fd here */
+   while ((want = xioopenssl_accept_step(sfd)) > 0) {
+      pfd.events = want;
+      do {
+	 result = xiopoll(&pfd, 1, to);
+      } while (result < 0 && errno == EINTR);
+      if (result < 0) {
+	 Error3("poll({%d,0x%02x}, 1, ...): %s",
+		pfd.fd, pfd.events, strerror(errno));
+	 return -1;
+      }
+      if (result == 0) {
+	 Error1("connection [%d]: SSL handshake timed out", pfd.fd);
+	 return -1;
+      }
+   }
+   return want;
+}
+#endif /* WITH_OPENSSL */
+
+/* one connection thread: waits for its turn to accept a connection, opens
+   the second address for it, and runs the transfer loop; then starts over.
+   Never returns */
+static void *xiomux_thread(void *arg) {
+   xiofile_t *lfd = xiothreads.lfd;
+   xiofile_t *xfd1, *xfd2;
+   bool tls;		/* the connection is from OPENSSL-LISTEN */
+   int rw;
+
+   /* an error of this connection must not terminate the others: only
+      fatals exit the process, the other errors end the connection */
+   diag_set_int('E', E_FATAL);
+   while (true) {
+      tls = false;
+      pthread_mutex_lock(&xiothreads.lock);
+      ++xiothreads.idle;
+      pthread_mutex_unlock(&xiothreads.lock);
+      pthread_mutex_lock(&xiothreads.acceptlock);
+      pthread_mutex_lock(&xiothreads.lock);
+      --xiothreads.idle;
+      pthread_mutex_unlock(&xiothreads.lock);
+
+      if ((xfd1 = xioaccept_mux(lfd)) == NULL) {
+	 pthread_mutex_unlock(&xiothreads.acceptlock);
+	 continue;
+      }
+      /* somebody must accept the next connection while we serve this one */
+      xiomux_spawn();
+#if WITH_OPENSSL
+      if ((xfd1->stream.dtype & XIODATA_MASK) == XIODATA_OPENSSL) {
+	 /* the other threads accept connections during the handshake. The
+	    env vars of this one are set afterwards, under the lock that
+	    protects opening the second address */
+	 pthread_mutex_unlock(&xiothreads.acceptlock);
+	 tls = true;
+	 if (xioopenssl_accept_init(&xfd1->stream) != STAT_OK ||
+	     xiomux_tlsaccept(xfd1) < 0) {
+	    xioclose(xfd1);
+	    pthread_mutex_lock(&xiothreads.lock);
+	    xiomux_freefd(xfd1, false);
+	    pthread_mutex_unlock(&xiothreads.lock);
+	    continue;
+	 }
+      }
+#endif /* WITH_OPENSSL */
+
+      /* the second address must neither fork nor exec the process that
+	 handles all the other connections */
+      if (XIO_WRITABLE(xfd1)) {
+	 rw = XIO_READABLE(xfd1) ? XIO_RDWR : XIO_RDONLY;
+      } else {
+	 rw = XIO_WRONLY;
+      }
+      pthread_mutex_lock(&xiothreads.lock);
+      xiosetsigchild(xfd1, socat_sigchild);
+#if WITH_OPENSSL
+      if (tls &&
+	  (xioaccept_setenv(&xfd1->stream) < 0 ||
+	   xioopenssl_accept_done(&xfd1->stream) < 0)) {
+	 xfd2 = NULL;
+      } else
+#endif /* WITH_OPENSSL */
+      if ((xfd2 = socat_open(xiothreads.address2, rw,
+			     XIO_MAYCHILD|XIO_MAYCONVERT)) != NULL) {
+	 xiosetsigchild(xfd2, socat_sigchild);
+      }
+      pthread_mutex_unlock(&xiothreads.lock);
+      if (!tls)  pthread_mutex_unlock(&xiothreads.acceptlock);
+
+      if (xfd2 == NULL) {
+	 xioclose(xfd1);
+	 pthread_mutex_lock(&xiothreads.lock);
+	 xiomux_freefd(xfd1, false);
+	 pthread_mutex_unlock(&xiothreads.lock);
+	 continue;
+      }
+
+      if (_socat(xfd1, xfd2) < 0) {
+	 xioclose(xfd1);
+	 xioclose(xfd2);
+      }
+      pthread_mutex_lock(&xiothreads.lock);
+      xiomux_freefd(xfd1, false);
+      xiomux_freefd(xfd2, true);
+      pthread_mutex_unlock(&xiothreads.lock);
+   }
+   return NULL;
+}
+
+/* the accept loop for a listen address with option multiplex or thread.
+   Returns only on error */
+int xiomux_socat(xiofile_t *lfd, const char *address2) {
+   if (xioparams->logopt == 'm' && xioinqopt('l', NULL, 0) == 'm') {
+      Info("switching to syslog");
+      diag_set('y', xioopts.syslogfac);
+      xiosetopt('l', "\0");
+   }
+
+   if (lfd->stream.para.socket.muxthreads) {
+      xiothreads.lfd = lfd;
+      xiothreads.address2 = address2;
+      xiothreads.maxthreads = lfd->stream.para.socket.maxconns;
+      xiothreads.numthreads = 1;
+      Notice("accepting connections, each handled by a thread");
+      xiomux_thread(NULL);	/* the main thread serves connections too */
+      return -1;
+   }
+#if HAVE_EPOLL_CREATE1
+   if (lfd->stream.para.socket.muxdgram) {
+      return xiomux_udp(lfd, address2);
+   }
+   return xiomux_epoll(lfd, address2);
+#else
+   Error("option multiplex requires epoll");
+   return -1;
+#endif
+}
+
+#endif /* WITH_LISTEN */
@@ -17,6 +17,9 @@ static xiosingle_t *xioparse_single(const char **addr);
 
 static int 
    xioopen_inter_single(xiofile_t *xfd, int xioflags);
+static bool xioopen_maylayer(xiosingle_t *sfd, xiofile_t *lower, int rw);
+static int xioopen_layer(xiofile_t *xfd, xiofile_t *lower, int xioflags);
+static xiofile_t *xioopen_ringend(xiofile_t *xfd, int rw);
 static int 
    xioopen_endpoint_single(xiofile_t *xfd, int xioflags);
 static int
@@ -388,6 +391,10 @@ xiofile_t *xioallocfd(void) {
 /* fd->stream.howtoclose  = XIOCLOSE_UNSPEC;*/
 /* fd->stream.name      = NULL; */
    fd->stream.escape	= -1;
+#if HAVE_SPLICE
+   fd->stream.splicefd[0] = -1;
+   fd->stream.splicefd[1] = -1;
+#endif /* HAVE_SPLICE */
 /* fd->stream.para.exec.pid = 0; */
    fd->stream.lineterm  = LINETERM_RAW;
 
@@ -430,6 +437,8 @@ xiofile_t *socat_open(const char *addrs0, int rw, int flags) {
 				 directions are sepcified as seen by transfer
 				 engine */
    xiofd_t left, right;
+   int commtype;	/* of left and right */
+   xiofile_t *ringend = NULL;	/* with XIOCOMM_SHMRINGS */
    struct threadarg_struct *thread_arg;
    /*0 pthread_t thread = 0;*/
    /*pthread_attr_t attr;*/
@@ -443,6 +452,7 @@ xiofile_t *socat_open(const char *addrs0, int rw, int flags) {
       addrs = addrs0;
       skipsp(&addrs);
       rw0 = rw;
+      ringend = NULL;
 
       /* here we do not know much: will the next sub address be inter or
 	 endpoint, single or dual, reverse? */
@@ -606,7 +616,7 @@ xiofile_t *socat_open(const char *addrs0, int rw, int flags) {
       /* recursively open the following addresses of chain */
       /* loop over retries if appropriate */
       do {
-	 xfd2 = socat_open(addrs, rw2, flags);
+	 xfd2 = socat_open(addrs, rw2, flags&~XIO_MAYMUX);
 	 if (xfd2 != NULL) {
 	    break;	/* succeeded */
 	 }
@@ -620,6 +630,25 @@ xiofile_t *socat_open(const char *addrs0, int rw, int flags) {
 	 if (sfdA->retry)  --sfdA->retry;
       } while (true);
 
+      /* when the current address can work as in-process layer on top of
+	 xfd2, the engine on the left side calls its data methods directly;
+	 no socketpair and no thread with its own engine needed */
+      if (sfdB == NULL && !reverseA && rw2 == rw0 &&
+	  xioopen_maylayer(sfdA, xfd2, rw0)) {
+	 xfd0 = (xiofile_t *)sfdA;
+	 if (xioopen_layer(xfd0, xfd2, rw|flags) < 0) {
+	    xioclose(xfd2);
+	    xiofreefd(xfd2);
+	    if (xfd0->stream.retry == 0 && !xfd0->stream.forever) {
+	       xiofreefd(xfd0); return NULL;
+	    }
+	    Nanosleep(&xfd0->stream.intervall, NULL);
+	    if (xfd0->stream.retry)  --xfd0->stream.retry;
+	    continue;
+	 }
+	 break;
+      }
+
       /* only xfd2 is valid here, contains a handle for the rest of the chain
 	 */
       /* yupp, and the single addresses sfdA and ev.sfdB are valid too, but
@@ -651,10 +680,20 @@ xiofile_t *socat_open(const char *addrs0, int rw, int flags) {
       /* prepare FD based communication of current addr with its right neighbor
 	 (xfd0-xfd1) */
       {
-	 switch (xioopts.pipetype) {
+	 commtype = xioopts.pipetype;
+	 /* the inter address can use the rings only through the data methods
+	    of a layer; they are not fds */
+	 if (commtype == XIOCOMM_SHMRINGS &&
+	     (sfdB != NULL || sfdA->addrdesc->inter_desc.layer == NULL ||
+	      sfdA->addrdesc->inter_desc.layer->handshake)) {
+	    Info1("address \"%s\" cannot use rings, using socketpairs",
+		  sfdA->addrdesc->inter_desc.defname);
+	    commtype = XIOCOMM_SOCKETPAIRS;
+	 }
+	 switch (commtype) {
 	 case XIOCOMM_SOCKETPAIR:
 	 case XIOCOMM_SOCKETPAIRS:
-	    if (xiocommpair(xioopts.pipetype,
+	    if (xiocommpair(commtype,
 			    (rw2+1)&(XIO_WRONLY+1), (rw1+1)&(XIO_WRONLY+1),
 			    sfdB!=0, &left, &right,
 			    PF_UNIX, SOCK_STREAM, 0) != 0) {
@@ -663,7 +702,7 @@ xiofile_t *socat_open(const char *addrs0, int rw, int flags) {
 	    break;
 	 case XIOCOMM_PTY:
 	 case XIOCOMM_PTYS:
-	    if (xiocommpair(xioopts.pipetype,
+	    if (xiocommpair(commtype,
 			    (rw2+1)&(XIO_WRONLY+1), (rw1+1)&(XIO_WRONLY+1),
 			    sfdB!=0, &left, &right,
 			    1 /* useptmx */) != 0) {
@@ -671,7 +710,7 @@ xiofile_t *socat_open(const char *addrs0, int rw, int flags) {
 	    }
 	    break;
 	 default:
-	    if (xiocommpair(xioopts.pipetype,
+	    if (xiocommpair(commtype,
 			    (rw2+1)&(XIO_WRONLY+1), (rw1+1)&(XIO_WRONLY+1),
 			    sfdB!=0, &left, &right) != 0) {
 	       return NULL;
@@ -815,6 +854,8 @@ xiofile_t *socat_open(const char *addrs0, int rw, int flags) {
 	 xfd0->stream.howtoshut = left.howtoshut;
 	 xfd0->stream.howtoclose = left.howtoclose;
 	 xfd0->stream.dtype      = left.dtype;
+	 xfd0->stream.rring      = left.rring;
+	 xfd0->stream.wring      = left.wring;
       }
       if (xfd1->tag == XIO_TAG_DUAL) {
 	 xfd1->dual.stream[0]->howtoshut = left.howtoshut;
@@ -827,6 +868,18 @@ xiofile_t *socat_open(const char *addrs0, int rw, int flags) {
 	 xfd1->stream.howtoshut = right.howtoshut;
 	 xfd1->stream.howtoclose = right.howtoclose;
 	 xfd1->stream.dtype      = right.dtype;
+	 xfd1->stream.rring      = right.rring;
+	 xfd1->stream.wring      = right.wring;
+      }
+
+      if (commtype == XIOCOMM_SHMRINGS) {
+	 /* the inter address (xfd0 forward, xfd1 reverse) will be opened as
+	    layer on top of its ends of the rings */
+	 if ((ringend = xioopen_ringend(reverseA?xfd1:xfd0,
+					reverseA?rw1:rw0)) == NULL) {
+	    xiofreefd(xfd0);  xiofreefd(xfd1);  xiofreefd(xfd2);
+	    return NULL;
+	 }
       }
 
       /* here xfd2 is valid and ready for transfer;
@@ -842,6 +895,8 @@ xiofile_t *socat_open(const char *addrs0, int rw, int flags) {
       thread_arg->rw = (reverseA ? rw1 : rw0);
       thread_arg->xfd1 = xfd1;
       thread_arg->xfd2 = xfd2;
+      thread_arg->lower = reverseA ? ringend : NULL;
+      thread_arg->exitlevel = diag_get_int('E');
       Notice5("starting thread: dir=%d, reverseA=%d, reverseB=%d, xfd1->tag=%d, xfd2->tag=%d",
 	      rw0, reverseA, reverseB, xfd1->tag, xfd2->tag);
       if (xfd1->tag==XIO_TAG_DUAL) {
@@ -886,7 +941,9 @@ xiofile_t *socat_open(const char *addrs0, int rw, int flags) {
       xfd2 = NULL;
 
       /* open protocol part */
-      if (xioopen_inter_dual(xfd0, rw|flags)
+      if ((ringend != NULL && !reverseA ?
+	   xioopen_layer(xfd0, ringend, rw|flags) :
+	   xioopen_inter_dual(xfd0, rw|flags))
 	  < 0) {
 	 /*! close sub chain */
 	 if (xfd0->stream.retry == 0 && !xfd0->stream.forever) {
@@ -905,14 +962,108 @@ xiofile_t *socat_open(const char *addrs0, int rw, int flags) {
    return xfd0;
 }
 
+/* checks if the inter address sfd can be stacked in-process on the already
+   opened rest of the chain (lower) */
+static bool xioopen_maylayer(xiosingle_t *sfd, xiofile_t *lower, int rw) {
+   const struct xiolayer *layer = sfd->addrdesc->inter_desc.layer;
+
+   if (layer == NULL) {
+      return false;
+   }
+   if (layer->handshake) {
+      /* the address talks to its peer with read() and write() on the fds */
+      if (rw != XIO_RDWR || lower->tag == XIO_TAG_DUAL ||
+	  lower->stream.dtype != XIODATA_STREAM ||
+	  lower->stream.rfd < 0 || lower->stream.wfd < 0) {
+	 return false;
+      }
+   }
+   return true;
+}
+
+/* opens the inter address xfd as in-process layer on top of lower: it uses
+   the fds of lower, and its data methods call those of lower.
+   returns 0 on success, or <0 on error; lower remains open then */
+static int xioopen_layer(xiofile_t *xfd, xiofile_t *lower, int xioflags) {
+   const struct xiolayer *layer = xfd->stream.addrdesc->inter_desc.layer;
+   int rfd = -1, wfd = -1;
+   int result;
+
+   if (XIO_READABLE(lower))  rfd = XIO_GETRDFD(lower);
+   if (XIO_WRITABLE(lower))  wfd = XIO_GETWRFD(lower);
+   if (layer->handshake) {
+      /* on failure the address might close its fds, but those of lower are
+	 closed by the caller */
+      if ((xfd->stream.rfd = Dup(rfd)) < 0) {
+	 Error2("dup(%d): %s", rfd, strerror(errno));
+	 return -1;
+      }
+      if (wfd == rfd) {
+	 xfd->stream.wfd = xfd->stream.rfd;
+      } else if ((xfd->stream.wfd = Dup(wfd)) < 0) {
+	 Error2("dup(%d): %s", wfd, strerror(errno));
+	 Close(xfd->stream.rfd);
+	 return -1;
+      }
+   } else {
+      xfd->stream.rfd = rfd;
+      xfd->stream.wfd = wfd;
+   }
+
+   Info3("stacking address \"%s\" in-process on fds [%d,%d]",
+	 xfd->stream.addrdesc->inter_desc.defname, rfd, wfd);
+   if ((result = xioopen_inter_dual(xfd, xioflags)) < 0) {
+      return result;
+   }
+
+   if (layer->handshake) {
+      if (xfd->stream.wfd != xfd->stream.rfd)  Close(xfd->stream.wfd);
+      Close(xfd->stream.rfd);
+      xfd->stream.rfd = rfd;
+      xfd->stream.wfd = wfd;
+   }
+   xfd->stream.dtype      = XIODATA_LAYER;
+   xfd->stream.howtoshut  = XIOSHUT_LAYER;
+   xfd->stream.howtoclose = XIOCLOSE_LAYER;
+   xfd->stream.layer = layer;
+   xfd->stream.lower = lower;
+   return 0;
+}
+
+/* with XIOCOMM_SHMRINGS: moves the ring ends that socat_open() assigned to the
+   inter address xfd to a new xio file, which becomes its lower address */
+static xiofile_t *xioopen_ringend(xiofile_t *xfd, int rw) {
+   xiofile_t *ringend;
+
+   if ((ringend = xioallocfd()) == NULL) {
+      return NULL;
+   }
+   ringend->stream.tag = (rw == XIO_RDONLY) ? XIO_TAG_RDONLY :
+      (rw == XIO_WRONLY) ? XIO_TAG_WRONLY : XIO_TAG_RDWR;
+   ringend->stream.flags      = rw;
+   ringend->stream.addrdesc   = xfd->stream.addrdesc;
+   ringend->stream.rfd        = xfd->stream.rfd;
+   ringend->stream.wfd        = xfd->stream.wfd;
+   ringend->stream.dtype      = xfd->stream.dtype;
+   ringend->stream.howtoshut  = xfd->stream.howtoshut;
+   ringend->stream.howtoclose = xfd->stream.howtoclose;
+   ringend->stream.rring      = xfd->stream.rring;
+   ringend->stream.wring      = xfd->stream.wring;
+   xfd->stream.rring = xfd->stream.wring = NULL;
+   return ringend;
+}
+
 void *xioopenleftthenengine(void *thread_void) {
    struct threadarg_struct *thread_arg = thread_void;
    int rw = thread_arg->rw;
    xiofile_t *xfd1 = thread_arg->xfd1;
    xiofile_t *xfd2 = thread_arg->xfd2;
 
+   diag_set_int('E', thread_arg->exitlevel);
    /*! design a function with better interface */
-   if (xioopen_inter_dual(xfd1, rw|XIO_MAYCONVERT|XIO_MAYCHILD) < 0) {
+   if ((thread_arg->lower != NULL ?
+	xioopen_layer(xfd1, thread_arg->lower, rw|XIO_MAYCONVERT|XIO_MAYCHILD) :
+	xioopen_inter_dual(xfd1, rw|XIO_MAYCONVERT|XIO_MAYCHILD)) < 0) {
       xioclose(xfd2);
       xiofreefd(xfd1);
       xiofreefd(xfd2);
@@ -1005,14 +1156,14 @@ int xioopen_endpoint_dual(xiofile_t *xfd, int xioflags) {
 
       /* a "usual" bidirectional stream specification, one address */
       if (((xioflags&XIO_ACCMODE)+1) & (XIO_WRONLY+1)) {
-	 if (xioopen_endpoint_single((xiofile_t *)xfd->dual.stream[1], XIO_WRONLY|(xioflags&~XIO_ACCMODE&~XIO_MAYEXEC))
+	 if (xioopen_endpoint_single((xiofile_t *)xfd->dual.stream[1], XIO_WRONLY|(xioflags&~XIO_ACCMODE&~XIO_MAYEXEC&~XIO_MAYMUX))
 	     < 0) {
 	    return -1;
 	 }
       }
       /*! should come before xioopensingle? */
       if (((xioflags&XIO_ACCMODE)+1) & (XIO_RDONLY+1)) {
-	 if (xioopen_endpoint_single((xiofile_t *)xfd->dual.stream[0], XIO_RDONLY|(xioflags&~XIO_ACCMODE&~XIO_MAYEXEC))
+	 if (xioopen_endpoint_single((xiofile_t *)xfd->dual.stream[0], XIO_RDONLY|(xioflags&~XIO_ACCMODE&~XIO_MAYEXEC&~XIO_MAYMUX))
 	     < 0) {
 	    xioclose((xiofile_t *)xfd->dual.stream[1]);
 	    return -1;
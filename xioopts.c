@@ -82,6 +82,12 @@ bool xioopts_ignoregroups;
 #  define IF_TCP(a,b) 
 #endif
 
+#if WITH_UDP
+#  define IF_UDP(a,b) {a,b},
+#else
+#  define IF_UDP(a,b) 
+#endif
+
 #if WITH_SCTP
 #  define IF_SCTP(a,b) {a,b},
 #else
@@ -159,6 +165,7 @@ const struct optname optionnames[] = {
 #ifdef SO_ACCEPTCONN /* AIX433 */
 	IF_SOCKET ("acceptconn",	&opt_so_acceptconn)
 #endif /* SO_ACCEPTCONN */
+	IF_RANGE  ("acl",	&opt_acl)
 #ifdef IP_ADD_MEMBERSHIP
 	IF_IP     ("add-membership",	&opt_ip_add_membership)
 #endif
@@ -254,6 +261,7 @@ const struct optname optionnames[] = {
 	IF_TERMIOS("b9600",	&opt_b9600)
 #endif /* defined(CBAUD) */
 	IF_LISTEN ("backlog",	&opt_backlog)
+	IF_SOCKET ("batch",	&opt_batch)
 #ifdef O_BINARY
 	IF_OPEN   ("bin",		&opt_o_binary)
 	IF_OPEN   ("binary",		&opt_o_binary)
@@ -298,6 +306,7 @@ const struct optname optionnames[] = {
 	IF_ANY    ("cloexec",	&opt_cloexec)
 	IF_ANY    ("close",	&opt_end_close)
 	IF_OPENSSL("cn",		&opt_openssl_commonname)
+	IF_OPENSSL("coalesce",	&opt_openssl_coalesce)
 	IF_OPENSSL("commonname",	&opt_openssl_commonname)
 	IF_EXEC   ("commtype",	&opt_commtype)
 #if WITH_EXT2 && defined(EXT2_COMPR_FL)
@@ -831,6 +840,7 @@ const struct optname optionnames[] = {
 #endif /* SO_KERNACCEPT */
 	IF_OPENSSL("key",	&opt_openssl_key)
 	IF_TERMIOS("kill",	&opt_vkill)
+	IF_OPENSSL("ktls",	&opt_openssl_ktls)
 #ifdef O_LARGEFILE
 	IF_OPEN   ("largefile",	&opt_o_largefile)
 #endif
@@ -908,6 +918,7 @@ const struct optname optionnames[] = {
 	IF_IP     ("multicast-ttl",	&opt_ip_multicast_ttl)
 	IF_IP     ("multicastloop",	&opt_ip_multicast_loop)
 	IF_IP     ("multicastttl",	&opt_ip_multicast_ttl)
+	IF_LISTEN ("multiplex",	&opt_multiplex)
 #if defined(O_NDELAY) && (!defined(O_NONBLOCK) || O_NDELAY != O_NONBLOCK)
 	IF_ANY    ("ndelay",	&opt_o_ndelay)
 #else
@@ -1061,6 +1072,7 @@ const struct optname optionnames[] = {
 	IF_OPENSSL("openssl-capath",	&opt_openssl_capath)
 	IF_OPENSSL("openssl-certificate",	&opt_openssl_certificate)
 	IF_OPENSSL("openssl-cipherlist",	&opt_openssl_cipherlist)
+	IF_OPENSSL("openssl-coalesce",	&opt_openssl_coalesce)
 	IF_OPENSSL("openssl-commonname",	&opt_openssl_commonname)
 #if OPENSSL_VERSION_NUMBER >= 0x00908000L
 	IF_OPENSSL("openssl-compress",  &opt_openssl_compress)
@@ -1071,8 +1083,14 @@ const struct optname optionnames[] = {
 	IF_OPENSSL("openssl-fips",	&opt_openssl_fips)
 #endif
 	IF_OPENSSL("openssl-key",	&opt_openssl_key)
+	IF_OPENSSL("openssl-ktls",	&opt_openssl_ktls)
 	IF_OPENSSL("openssl-method",	&opt_openssl_method)
 	IF_OPENSSL("openssl-pseudo",	&opt_openssl_pseudo)
+	IF_OPENSSL("openssl-read-ahead",	&opt_openssl_read_ahead)
+	IF_OPENSSL("openssl-record-buffer",	&opt_openssl_record_buffer)
+	IF_OPENSSL("openssl-session-cache",	&opt_openssl_session_cache)
+	IF_OPENSSL("openssl-session-store",	&opt_openssl_session_store)
+	IF_OPENSSL("openssl-ticket-key-rotate",	&opt_openssl_ticket_key_rotate)
 	IF_OPENSSL("openssl-verify",	&opt_openssl_verify)
 	IF_TERMIOS("opost",	&opt_opost)
 #if defined(HAVE_TERMIOS_ISPEED) && defined(OSPEED_OFFSET) && (OSPEED_OFFSET != -1)
@@ -1114,6 +1132,7 @@ const struct optname optionnames[] = {
 #endif
 	/*IF_IPAPP("port",	&opt_port)*/
 	IF_TUN    ("portsel",	&opt_iff_portsel)
+	IF_LISTEN ("prefork",	&opt_prefork)
 #if HAVE_RESOLV_H
 	IF_IP     ("primary",	&opt_res_primary)
 #endif /* HAVE_RESOLV_H */
@@ -1171,7 +1190,9 @@ const struct optname optionnames[] = {
 #endif
 	IF_OPEN   ("rdonly",	&opt_o_rdonly)
 	IF_OPEN   ("rdwr",	&opt_o_rdwr)
+	IF_OPENSSL("read-ahead",	&opt_openssl_read_ahead)
 	IF_ANY    ("readbytes", &opt_readbytes)
+	IF_OPENSSL("record-buffer",	&opt_openssl_record_buffer)
 #if HAVE_RESOLV_H
 	IF_IP     ("recurse",	&opt_res_recurse)
 #endif /* HAVE_RESOLV_H */
@@ -1304,6 +1325,8 @@ const struct optname optionnames[] = {
 	IF_ANY    ("seek-end",		&opt_lseek32_end)
 	IF_ANY    ("seek-set",		&opt_lseek32_set)
 #endif
+	IF_OPENSSL("session-cache",	&opt_openssl_session_cache)
+	IF_OPENSSL("session-store",	&opt_openssl_session_store)
 	IF_ANY    ("setgid",	&opt_setgid)
 	IF_ANY    ("setgid-early",	&opt_setgid_early)
 	IF_ANY 	  ("setlk",	&opt_f_setlk_wr)
@@ -1585,6 +1608,8 @@ const struct optname optionnames[] = {
 #endif
 #if WITH_LIBWRAP
 	IF_IPAPP  ("tcpwrap",		&opt_tcpwrappers)
+	IF_IPAPP  ("tcpwrap-cache",	&opt_tcpwrap_cache)
+	IF_IPAPP  ("tcpwrap-cache-ttl",	&opt_tcpwrap_cache_ttl)
 	IF_IPAPP  ("tcpwrap-dir",	&opt_tcpwrap_etc)
 	IF_IPAPP  ("tcpwrap-etc",	&opt_tcpwrap_etc)
 #if WITH_LIBWRAP && defined(HAVE_HOSTS_ALLOW_TABLE)
@@ -1601,6 +1626,8 @@ const struct optname optionnames[] = {
 #ifdef O_TEXT
 	IF_ANY    ("text",	&opt_o_text)
 #endif
+	IF_LISTEN ("thread",	&opt_thread)
+	IF_OPENSSL("ticket-key-rotate",	&opt_openssl_ticket_key_rotate)
 	IF_UNIX   ("tightsocklen",	&xioopt_unix_tightsocklen)
 	IF_TERMIOS("time",	&opt_vtime)
 #ifdef SO_TIMESTAMP
@@ -1627,6 +1654,10 @@ const struct optname optionnames[] = {
 	IF_TUN    ("tun-no-pi",	&opt_iff_no_pi)
 	IF_TUN    ("tun-type",	&opt_tun_type)
 	IF_SOCKET ("type",	&opt_so_type)
+#if HAVE_UDP_GSO
+	IF_UDP    ("udp-gro",	&opt_udp_gro)
+	IF_UDP    ("udp-segment",	&opt_udp_segment)
+#endif
 	IF_ANY    ("uid",	&opt_user)
 	IF_NAMED  ("uid-e",	&opt_user_early)
 	IF_ANY    ("uid-l",	&opt_user_late)
@@ -3088,6 +3119,31 @@ int applyopts(int fd, struct opt *opts, enum e_phase phase) {
 	       opt->desc = ODESC_ERROR; ++opt; continue;
 	    }
 #endif /* HAVE_STRUCT_LINGER */
+#if HAVE_UDP_GSO
+	 } else if (opt->desc->optcode == OPT_UDP_GRO ||
+		    opt->desc->optcode == OPT_UDP_SEGMENT) {
+	    /* older kernels do not know them; then datagrams are transferred
+	       one by one as without the option */
+	    if (Setsockopt(fd, opt->desc->major, opt->desc->minor,
+			   &opt->value.u_int, sizeof(int)) < 0) {
+	       if (errno == ENOPROTOOPT) {
+		  Warn2("option %s: %s, ignored",
+			opt->desc->defname, strerror(errno));
+	       } else {
+		  Error6("setsockopt(%d, %d, %d, {%d}, "F_Zu"): %s",
+			 fd, opt->desc->major, opt->desc->minor,
+			 opt->value.u_int, sizeof(int), strerror(errno));
+		  opt->desc = ODESC_ERROR; ++opt; continue;
+	       }
+	    } else if (opt->desc->optcode == OPT_UDP_GRO &&
+		       opt->value.u_int != 0 &&
+		       xioparams->bufsiz < XIO_UDP_GROBUFSIZ) {
+	       /* smaller buffers would truncate the coalesced datagrams */
+	       Info2("option udp-gro: increasing buffer size from "F_Zu" to %d",
+		     xioparams->bufsiz, XIO_UDP_GROBUFSIZ);
+	       xioparams->bufsiz = XIO_UDP_GROBUFSIZ;
+	    }
+#endif /* HAVE_UDP_GSO */
 	 } else {
 	    switch (opt->desc->type) {
 	    case TYPE_BIN:
@@ -184,6 +184,7 @@ enum e_func {
 /* optcode's */
 enum e_optcode {
    OPT_ADDRESS_FAMILY = 1,
+   OPT_ACL,		/* peer address list file */
    /* these are not alphabetically, I know... */
    OPT_B0,		/* termios.c_cflag */
    OPT_B50,		/* termios.c_cflag */
@@ -220,6 +221,7 @@ enum e_optcode {
    OPT_B3500000,	/* termios.c_cflag */
    OPT_B4000000,	/* termios.c_cflag */
    OPT_BACKLOG,
+   OPT_BATCH,		/* dgram sockets: packets per recvmmsg/sendmmsg */
    OPT_BIND,	/* a socket address as character string */
    OPT_BRKINT,		/* termios.c_iflag */
 #ifdef BSDLY
@@ -437,6 +439,7 @@ enum e_optcode {
    OPT_LOCKFILE,
    OPT_LOWPORT,
    OPT_MAX_CHILDREN,
+   OPT_MULTIPLEX,
 #ifdef NLDLY
 #  ifdef NL0
    OPT_NL0,		/* termios.c_oflag */
@@ -477,6 +480,7 @@ enum e_optcode {
    OPT_OPENSSL_CAPATH,
    OPT_OPENSSL_CERTIFICATE,
    OPT_OPENSSL_CIPHERLIST,
+   OPT_OPENSSL_COALESCE,
    OPT_OPENSSL_COMMONNAME,
 #if OPENSSL_VERSION_NUMBER >= 0x00908000L
    OPT_OPENSSL_COMPRESS,
@@ -485,8 +489,14 @@ enum e_optcode {
    OPT_OPENSSL_EGD,
    OPT_OPENSSL_FIPS,
    OPT_OPENSSL_KEY,
+   OPT_OPENSSL_KTLS,
    OPT_OPENSSL_METHOD,
    OPT_OPENSSL_PSEUDO,
+   OPT_OPENSSL_READ_AHEAD,
+   OPT_OPENSSL_RECORD_BUFFER,
+   OPT_OPENSSL_SESSION_CACHE,
+   OPT_OPENSSL_SESSION_STORE,
+   OPT_OPENSSL_TICKET_KEY_ROTATE,
    OPT_OPENSSL_VERIFY,
    OPT_OPOST,		/* termios.c_oflag */
    OPT_OSPEED,		/* termios.c_ospeed */
@@ -557,6 +567,7 @@ enum e_optcode {
    OPT_PERM_LATE,
    OPT_PIPES,
    /*OPT_PORT,*/
+   OPT_PREFORK,
    OPT_PROMPT,		/* readline */
    OPT_PROTOCOL,	/* 6=TCP, 17=UDP */
    OPT_PROTOCOL_FAMILY,	/* 1=PF_UNIX, 2=PF_INET, 10=PF_INET6 */
@@ -740,6 +751,8 @@ enum e_optcode {
    OPT_TCPWRAP_ETC,	/* libwrap */
    OPT_TCPWRAP_HOSTS_ALLOW_TABLE,	/* libwrap */
    OPT_TCPWRAP_HOSTS_DENY_TABLE,	/* libwrap */
+   OPT_TCPWRAP_CACHE,		/* libwrap */
+   OPT_TCPWRAP_CACHE_TTL,	/* libwrap */
    OPT_TCP_ABORT_THRESHOLD,	/* HP-UX */
    OPT_TCP_CONN_ABORT_THRESHOLD,	/* HP-UX */
 #ifdef TCP_CORK
@@ -796,11 +809,14 @@ enum e_optcode {
 #endif
    OPT_TERMIOS_CFMAKERAW,    /* termios.cfmakeraw() */
    OPT_TERMIOS_RAWER,
+   OPT_THREAD,
    OPT_TIOCSCTTY,
    OPT_TOSTOP,		/* termios.c_lflag */
    OPT_TUN_DEVICE,	/* tun: /dev/net/tun ... */
    OPT_TUN_NAME,	/* tun: tun0 */
    OPT_TUN_TYPE,	/* tun: tun|tap */
+   OPT_UDP_GRO,		/* UDP receive offload */
+   OPT_UDP_SEGMENT,	/* UDP segmentation offload (GSO) */
    OPT_UMASK,
    OPT_UNIX_TIGHTSOCKLEN,	/* UNIX domain sockets */
    OPT_UNLINK,
@@ -33,6 +33,7 @@ xioopts_t xioopts = {
    false,	/* lefttoright */
    false,	/* righttoleft */
    0,		/* pipetype: two unidirectional socketpairs */
+   XIOENGINE_POLL,	/* engine */
 } ;
 xioopts_t *xioparams = &xioopts;
 
@@ -9,6 +9,7 @@
 
 #include "xio-termios.h"
 #include "xio-socket.h"
+#include "xio-udp.h"
 #include "xio-test.h"
 #include "xio-readline.h"
 #include "xio-openssl.h"
@@ -62,6 +63,9 @@ ssize_t xioread(xiofile_t *file, void *buff, size_t bufsiz) {
       if (bytes < 0) {
 	 _errno = errno;
 	 switch (_errno) {
+	 case EAGAIN:
+	    /* the engine reads nonblocking fds optimistically */
+	    break;
 #if 1
 	 case EPIPE: case ECONNRESET:
 	    Warn4("read(%d, %p, "F_Zu"): %s",
@@ -72,6 +76,7 @@ ssize_t xioread(xiofile_t *file, void *buff, size_t bufsiz) {
 	    Error4("read(%d, %p, "F_Zu"): %s",
 		   fd, buff, bufsiz, strerror(_errno));
  	 }
+	 errno = _errno;
 	 return -1;
       }
       break;
@@ -140,11 +145,27 @@ ssize_t xioread(xiofile_t *file, void *buff, size_t bufsiz) {
       break;
 #endif /* WITH_OPENSSL */
 
+   case XIOREAD_LAYER:
+      /* the layer and the lower addresses print their error messages */
+      if ((bytes = pipe->layer->read(pipe, buff, bufsiz)) < 0) {
+	 return -1;
+      }
+      break;
+
+#if HAVE_SHMRINGS
+   case XIOREAD_RING:
+      /* fails only with EAGAIN, when the wakeup was for data already read */
+      if ((bytes = xioring_read(pipe->rring, buff, bufsiz)) < 0) {
+	 return -1;
+      }
+      break;
+#endif /* HAVE_SHMRINGS */
+
 #if _WITH_SOCKET
    case XIOREAD_RECV:
      if (pipe->dtype & XIOREAD_RECV_FROM) {
 #if WITH_RAWIP || WITH_UDP || WITH_UNIX
-      struct msghdr msgh = {0};
+      struct msghdr msgh = {0}, *pmsgh = &msgh;
       union sockaddr_union from = {{0}};
       socklen_t fromlen = sizeof(from);
       char infobuff[256];
@@ -158,22 +179,30 @@ ssize_t xioread(xiofile_t *file, void *buff, size_t bufsiz) {
 #if HAVE_STRUCT_MSGHDR_MSGCONTROLLEN
       msgh.msg_controllen = sizeof(ctrlbuff);
 #endif
-      if (xiogetpacketsrc(pipe->rfd, &msgh) < 0) {
-	 return -1;
-      }
-      do {
-	 bytes = Recvfrom(fd, buff, bufsiz, 0, &from.soa, &fromlen);
-      } while (bytes < 0 && errno == EINTR);
-      if (bytes < 0) {
-	 char infobuff[256];
-	 _errno = errno;
-	 Error6("recvfrom(%d, %p, "F_Zu", 0, %s, {"F_socklen"}): %s",
-		fd, buff, bufsiz,
-		sockaddr_info(&from.soa, fromlen, infobuff, sizeof(infobuff)),
-		fromlen, strerror(errno));
-	 errno = _errno;
-	 return -1;
+#if HAVE_MMSG
+      if (xiommsg_usable(pipe, false)) {
+	 /* the next packet of the batch; prints its error messages */
+	 if ((bytes = xiommsg_recv(pipe, buff, bufsiz, &from, &fromlen,
+				   &pmsgh))
+	     < 0) {
+	    return -1;
+	 }
+      } else
+#endif /* HAVE_MMSG */
+      {
+	 /* payload, source address, and ancillary messages with one call */
+	 if ((bytes = xiogetpacket(fd, buff, bufsiz, &msgh)) < 0) {
+	    _errno = errno;
+	    Error4("recvmsg(%d, {,,{%p,"F_Zu"},,}, 0): %s",
+		   fd, buff, bufsiz, strerror(_errno));
+	    errno = _errno;
+	    return -1;
+	 }
+	 fromlen = msgh.msg_namelen;
       }
+#if HAVE_UDP_GSO
+      pipe->segsize = xioudp_grosize(pmsgh, bytes);
+#endif
       /* on packet type we also receive outgoing packets, this is not desired
        */
 #if defined(PF_PACKET) && defined(PACKET_OUTGOING)
@@ -337,7 +366,7 @@ ssize_t xioread(xiofile_t *file, void *buff, size_t bufsiz) {
      } else /* ~XIOREAD_RECV_FROM */ {
       union sockaddr_union from;  socklen_t fromlen = sizeof(from);
       char infobuff[256];
-      struct msghdr msgh = {0};
+      struct msghdr msgh = {0}, *pmsgh = &msgh;
       char ctrlbuff[1024];	/* ancillary messages */
 
       socket_init(pipe->para.socket.la.soa.sa_family, &from);
@@ -350,32 +379,36 @@ ssize_t xioread(xiofile_t *file, void *buff, size_t bufsiz) {
 #if HAVE_STRUCT_MSGHDR_MSGCONTROLLEN
       msgh.msg_controllen = sizeof(ctrlbuff);
 #endif
-      if (xiogetpacketsrc(pipe->rfd, &msgh) < 0) {
-	 return -1;
+#if HAVE_MMSG
+      if (xiommsg_usable(pipe, false)) {
+	 /* the next packet of the batch; prints its error messages */
+	 if ((bytes = xiommsg_recv(pipe, buff, bufsiz, &from, &fromlen, &pmsgh))
+	     < 0) {
+	    return -1;
+	 }
+      } else
+#endif /* HAVE_MMSG */
+      {
+	 /* payload, source address, and ancillary messages with one call */
+	 if ((bytes = xiogetpacket(fd, buff, bufsiz, &msgh)) < 0) {
+	    _errno = errno;
+	    Error4("recvmsg(%d, {,,{%p,"F_Zu"},,}, 0): %s",
+		   fd, buff, bufsiz, strerror(_errno));
+	    errno = _errno;
+	    return -1;
+	 }
+	 fromlen = msgh.msg_namelen;
       }
-      xiodopacketinfo(&msgh, true, false);
+      xiodopacketinfo(pmsgh, true, false);
       if (xiocheckpeer(pipe, &from, &pipe->para.socket.la) < 0) {
-	 Recvfrom(fd, buff, bufsiz, 0, &from.soa, &fromlen);  /* drop */
-	 errno = EAGAIN;  return -1;
+	 errno = EAGAIN;  return -1;	/* the packet has been dropped */
       }
       Info1("permitting packet from %s",
 	    sockaddr_info((struct sockaddr *)&from, fromlen,
 			  infobuff, sizeof(infobuff)));
-
-      do {
-	 bytes =
-	    Recvfrom(fd, buff, bufsiz, 0, &from.soa, &fromlen);
-      } while (bytes < 0 && errno == EINTR);
-      if (bytes < 0) {
-	 char infobuff[256];
-	 _errno = errno;
-	 Error6("recvfrom(%d, %p, "F_Zu", 0, %s, "F_socklen"): %s",
-		fd, buff, bufsiz,
-		sockaddr_info(&from.soa, fromlen, infobuff, sizeof(infobuff)),
-		fromlen, strerror(errno));
-	 errno = _errno;
-	 return -1;
-      }
+#if HAVE_UDP_GSO
+      pipe->segsize = xioudp_grosize(pmsgh, bytes);
+#endif
       Notice2("received packet with "F_Zu" bytes from %s",
 	      bytes,
 	      sockaddr_info(&from.soa, fromlen, infobuff, sizeof(infobuff)));
@@ -432,7 +465,8 @@ ssize_t xioread(xiofile_t *file, void *buff, size_t bufsiz) {
 
 /* this function is intended only for some special address types where the
    select()/poll() calls cannot strictly determine if (more) read data is
-   available. currently this is for the OpenSSL based addresses.
+   available. currently this is for the OpenSSL based addresses, the layers
+   and rings of address chains, and batches of received datagrams.
 */
 ssize_t xiopending(xiofile_t *file) {
    struct single *pipe;
@@ -459,6 +493,24 @@ ssize_t xiopending(xiofile_t *file) {
    case XIOREAD_OPENSSL:
       return xiopending_openssl(pipe);
 #endif /* WITH_OPENSSL */
+   case XIOREAD_LAYER:
+      {
+	 ssize_t pending = 0;
+	 if (pipe->layer->pending != NULL &&
+	     (pending = pipe->layer->pending(pipe)) != 0) {
+	    return pending;
+	 }
+	 return xiopending(pipe->lower);
+      }
+#if HAVE_SHMRINGS
+   case XIOREAD_RING:
+      return xioring_pending(pipe->rring);
+#endif /* HAVE_SHMRINGS */
+#if HAVE_MMSG
+   case XIOREAD_RECV:
+      /* packets of the last recvmmsg() batch */
+      return xiommsg_pending(pipe);
+#endif /* HAVE_MMSG */
    default:
       return 0;
    }
@@ -0,0 +1,421 @@
+/* source: xioring.c */
+/* Copyright Gerhard Rieger */
+/* Published under the GNU General Public License V.2, see file COPYING */
+
+/* this is the source of the shared memory rings between the threads of an
+   address chain (option -cr) */
+
+/* each ring carries the data of one direction from one producer thread to
+   one consumer thread, without locks and without system calls as long as
+   both sides keep up. The data is framed in records; a record header is
+   followed by the data, padded to the header size so that headers never
+   wrap. Besides data records there are EOF records that carry a shutdown of
+   the producer.
+   Each side may sleep in poll(): the consumer on datafd when it found the
+   ring empty, the producer on spacefd when it found it full. Before sleeping
+   a side sets its wait flag, and the other side writes the eventfd only when
+   it finds the flag set, i.e. on the transition from empty to non-empty, or
+   from full to non-full. datafd also serves as rfd of the consumer stream for
+   the engine's poll(), spacefd as wfd of the producer stream; a consumer
+   that leaves the ring empty sets its flag because its engine sleeps in
+   poll() next. An eventfd is always writeable, so the engine polls spacefd
+   for POLLIN when the ring is full, see xioring_pollout(). */
+
+#include "xiosysincludes.h"
+
+#include "mytypes.h"
+#include "compat.h"
+#include "error.h"
+
+#include "sycls.h"
+#include "xio.h"
+
+#if HAVE_SHMRINGS
+
+#define XIORING_DATA 1
+#define XIORING_EOF  2
+
+#define XIORING_MINSIZE 65536
+
+struct xioring_rec {
+   uint32_t type;	/* XIORING_DATA, XIORING_EOF */
+   uint32_t len;	/* bytes of data following the header */
+} ;
+#define XIORING_HDRLEN (sizeof(struct xioring_rec))
+#define XIORING_PAD(n) (((n)+XIORING_HDRLEN-1) & ~(XIORING_HDRLEN-1))
+
+/* producer and consumer fields are in separate cache lines */
+struct xioring {
+   /* written by the producer */
+   size_t head __attribute__((aligned(64)));	/* end of published records */
+   int waitspace;		/* producer sleeps on spacefd */
+   int wstate;			/* 0: open, 1: EOF record sent, 2: closed */
+   /* written by the consumer */
+   size_t tail __attribute__((aligned(64)));	/* begin of unread records */
+   int waitdata;		/* consumer sleeps on datafd */
+   size_t rdoff;		/* data of the record at tail already read */
+   bool eof;			/* EOF record or closed producer seen */
+   int rclosed;			/* consumer does not read any more */
+   /* constant, or protected by refs */
+   size_t size __attribute__((aligned(64)));	/* a power of 2 */
+   size_t mapsize;
+   int datafd;			/* wakes the consumer */
+   int spacefd;			/* wakes the producer */
+   int refs;			/* producer and consumer */
+   unsigned char *data;
+} ;
+
+#define XIORING_OPEN    0
+#define XIORING_EOFSENT 1
+#define XIORING_CLOSED  2
+
+
+/* creates a ring with at least size data bytes and returns it, with its
+   eventfds in *datafd and *spacefd. returns NULL on error */
+struct xioring *xioring_create(size_t size, int *datafd, int *spacefd) {
+   struct xioring *ring;
+   size_t datasize = XIORING_MINSIZE, mapsize;
+   void *map;
+
+   while (datasize < size)  datasize <<= 1;
+   mapsize = XIORING_PAD(sizeof(struct xioring)) + datasize;
+   map = mmap(NULL, mapsize, PROT_READ|PROT_WRITE,
+	      MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+   if (map == MAP_FAILED) {
+      Error2("mmap(NULL, "F_Zu", ...): %s", mapsize, strerror(errno));
+      return NULL;
+   }
+   ring = map;
+   memset(ring, 0, sizeof(*ring));
+   ring->size = datasize;
+   ring->mapsize = mapsize;
+   ring->data = (unsigned char *)map + XIORING_PAD(sizeof(struct xioring));
+   ring->refs = 2;
+   ring->waitdata = 1;	/* the consumer's engine starts with poll() */
+   if ((ring->datafd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC)) < 0) {
+      Error1("eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC): %s", strerror(errno));
+      munmap(map, mapsize);
+      return NULL;
+   }
+   if ((ring->spacefd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC)) < 0) {
+      Error1("eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC): %s", strerror(errno));
+      Close(ring->datafd);
+      munmap(map, mapsize);
+      return NULL;
+   }
+   Info4("created ring of "F_Zu" bytes at %p, eventfds %d, %d",
+	 datasize, ring->data, ring->datafd, ring->spacefd);
+   *datafd  = ring->datafd;
+   *spacefd = ring->spacefd;
+   return ring;
+}
+
+static void xioring_signal(int fd) {
+   uint64_t one = 1;
+
+   if (Write(fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+      Warn2("write(%d, {1}, 8): %s", fd, strerror(errno));
+   }
+}
+
+/* consumes a pending wakeup, if any */
+static void xioring_drain(int fd) {
+   uint64_t count;
+
+   if (Read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+      Warn2("read(%d, {}, 8): %s", fd, strerror(errno));
+   }
+}
+
+static void xioring_get(struct xioring *ring, size_t pos, void *buff,
+			size_t bytes) {
+   size_t off = pos & (ring->size-1), first = ring->size - off;
+
+   if (bytes <= first) {
+      memcpy(buff, ring->data+off, bytes);
+   } else {
+      memcpy(buff, ring->data+off, first);
+      memcpy((char *)buff+first, ring->data, bytes-first);
+   }
+}
+
+static void xioring_put(struct xioring *ring, size_t pos, const void *buff,
+			size_t bytes) {
+   size_t off = pos & (ring->size-1), first = ring->size - off;
+
+   if (bytes <= first) {
+      memcpy(ring->data+off, buff, bytes);
+   } else {
+      memcpy(ring->data+off, buff, first);
+      memcpy(ring->data, (const char *)buff+first, bytes-first);
+   }
+}
+
+/* consumer: releases the record at tail */
+static void xioring_release(struct xioring *ring, size_t reclen) {
+   ring->rdoff = 0;
+   __atomic_store_n(&ring->tail, ring->tail + reclen, __ATOMIC_SEQ_CST);
+   if (__atomic_load_n(&ring->waitspace, __ATOMIC_SEQ_CST) &&
+       __atomic_exchange_n(&ring->waitspace, 0, __ATOMIC_SEQ_CST)) {
+      xioring_signal(ring->spacefd);
+   }
+}
+
+/* reads at most bufsiz bytes of data from the ring. returns the number of
+   bytes, 0 on EOF, or -1 with EAGAIN when the ring is empty */
+ssize_t xioring_read(struct xioring *ring, void *buff, size_t bufsiz) {
+   struct xioring_rec rec;
+   size_t head, n, done = 0;
+
+   if (ring->eof) {
+      return 0;
+   }
+   head = __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);
+   if (head == ring->tail) {
+      /* consume an old wakeup, announce that we sleep, then look again so
+	 that no data published in between is missed */
+      xioring_drain(ring->datafd);
+      __atomic_store_n(&ring->waitdata, 1, __ATOMIC_SEQ_CST);
+      head = __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);
+      if (head == ring->tail) {
+	 if (__atomic_load_n(&ring->wstate, __ATOMIC_SEQ_CST) ==
+	     XIORING_CLOSED &&
+	     __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) == ring->tail) {
+	    ring->eof = true;
+	    return 0;
+	 }
+	 errno = EAGAIN;	/* the engine poll()s datafd */
+	 return -1;
+      }
+      __atomic_store_n(&ring->waitdata, 0, __ATOMIC_SEQ_CST);
+   }
+
+   while (done < bufsiz && ring->tail != head) {
+      xioring_get(ring, ring->tail, &rec, XIORING_HDRLEN);
+      if (rec.type == XIORING_EOF) {
+	 if (done > 0) {
+	    break;	/* return the data first */
+	 }
+	 ring->eof = true;
+	 xioring_release(ring, XIORING_HDRLEN);
+	 return 0;
+      }
+      n = Min(bufsiz-done, (size_t)(rec.len - ring->rdoff));
+      xioring_get(ring, ring->tail+XIORING_HDRLEN+ring->rdoff,
+		  (char *)buff+done, n);
+      done += n;
+      if ((ring->rdoff += n) == rec.len) {
+	 xioring_release(ring, XIORING_HDRLEN+XIORING_PAD(rec.len));
+      }
+   }
+   if (ring->tail == head) {
+      /* the engine will poll() datafd unless xioring_pending() finds data
+	 published meanwhile, so the producer has to wake us */
+      __atomic_store_n(&ring->waitdata, 1, __ATOMIC_SEQ_CST);
+   }
+   return done;
+}
+
+/* returns >0 when the consumer finds something in the ring without poll() */
+ssize_t xioring_pending(struct xioring *ring) {
+   if (ring->eof) {
+      return 0;
+   }
+   return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) != ring->tail;
+}
+
+/* producer: returns the number of free bytes in the ring */
+static size_t xioring_space(struct xioring *ring) {
+   return ring->size -
+      (ring->head - __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST));
+}
+
+/* producer: returns the poll() events on spacefd that tell when a write can
+   make progress: POLLOUT, which the eventfd reports at once, when the ring
+   has free space or the consumer has gone; otherwise POLLIN, after
+   announcing that we sleep, so the next release by the consumer wakes us */
+short xioring_pollout(struct xioring *ring) {
+   if (xioring_space(ring) >= XIORING_HDRLEN+1 ||
+       __atomic_load_n(&ring->rclosed, __ATOMIC_ACQUIRE)) {
+      return POLLOUT;
+   }
+   /* consume an old wakeup, announce that we sleep, then look again so that
+      no release in between is missed */
+   xioring_drain(ring->spacefd);
+   __atomic_store_n(&ring->waitspace, 1, __ATOMIC_SEQ_CST);
+   if (xioring_space(ring) >= XIORING_HDRLEN+1 ||
+       __atomic_load_n(&ring->rclosed, __ATOMIC_SEQ_CST)) {
+      __atomic_store_n(&ring->waitspace, 0, __ATOMIC_SEQ_CST);
+      return POLLOUT;
+   }
+   return POLLIN;
+}
+
+/* producer: waits until at least need bytes are free in the ring, but not
+   after deadline (NULL: no limit).
+   returns 0 on success, or -1 with EPIPE when the consumer has gone, or with
+   ETIMEDOUT */
+static int xioring_waitspace(struct xioring *ring, size_t need,
+			     const struct timeval *deadline) {
+   struct timeval now, rest;
+   struct pollfd pfd;
+
+   while (true) {
+      if (__atomic_load_n(&ring->rclosed, __ATOMIC_ACQUIRE)) {
+	 errno = EPIPE;
+	 return -1;
+      }
+      if (xioring_space(ring) >= need) {
+	 return 0;
+      }
+      /* announce that we sleep, then look again so that no release by the
+	 consumer in between is missed */
+      __atomic_store_n(&ring->waitspace, 1, __ATOMIC_SEQ_CST);
+      if (xioring_space(ring) >= need ||
+	  __atomic_load_n(&ring->rclosed, __ATOMIC_SEQ_CST)) {
+	 __atomic_store_n(&ring->waitspace, 0, __ATOMIC_SEQ_CST);
+	 continue;
+      }
+      if (deadline != NULL) {
+	 gettimeofday(&now, NULL);
+	 if (!timercmp(&now, deadline, <)) {
+	    errno = ETIMEDOUT;
+	    return -1;
+	 }
+	 timersub(deadline, &now, &rest);
+      }
+      pfd.fd = ring->spacefd;
+      pfd.events = POLLIN;
+      if (xiopoll(&pfd, 1, deadline != NULL ? &rest : NULL) < 0) {
+	 if (errno == EINTR)  continue;
+	 Error2("poll({%d,POLLIN,}, 1, ...): %s", ring->spacefd,
+		strerror(errno));
+	 return -1;
+      }
+      xioring_drain(ring->spacefd);
+   }
+}
+
+/* producer: publishes a record; wakes the consumer when it sleeps */
+static void xioring_publish(struct xioring *ring, int type, const void *buff,
+			    size_t bytes) {
+   struct xioring_rec rec;
+   size_t head = ring->head;
+
+   rec.type = type;
+   rec.len  = bytes;
+   xioring_put(ring, head, &rec, XIORING_HDRLEN);
+   if (bytes > 0) {
+      xioring_put(ring, head+XIORING_HDRLEN, buff, bytes);
+   }
+   __atomic_store_n(&ring->head, head+XIORING_HDRLEN+XIORING_PAD(bytes),
+		    __ATOMIC_SEQ_CST);
+   if (__atomic_load_n(&ring->waitdata, __ATOMIC_SEQ_CST) &&
+       __atomic_exchange_n(&ring->waitdata, 0, __ATOMIC_SEQ_CST)) {
+      xioring_signal(ring->datafd);
+   }
+}
+
+/* writes as much data to the ring as fits, like a nonblocking write().
+   returns the number of bytes, or -1 with EAGAIN when the ring is full (see
+   xioring_pollout()), or with EPIPE when the consumer has gone */
+ssize_t xioring_write(struct xioring *ring, const void *buff, size_t bytes) {
+   size_t done = 0, n;
+
+   if (ring->wstate != XIORING_OPEN ||
+       __atomic_load_n(&ring->rclosed, __ATOMIC_ACQUIRE)) {
+      errno = EPIPE;
+      return -1;
+   }
+   while (done < bytes && (n = xioring_space(ring)) >= XIORING_HDRLEN+1) {
+      /* all free space but the header, which is a multiple of the padding */
+      n = Min(n - XIORING_HDRLEN, bytes-done);
+      xioring_publish(ring, XIORING_DATA, (const char *)buff+done, n);
+      done += n;
+   }
+   if (done == 0 && bytes > 0) {
+      errno = EAGAIN;
+      return -1;
+   }
+   return done;
+}
+
+/* writes all data to the ring, waiting for space when it is full, but not
+   longer than tmo (NULL: no limit).
+   returns bytes, or -1 with EPIPE, or with ETIMEDOUT */
+ssize_t xioring_writefull(struct xioring *ring, const void *buff,
+			  size_t bytes, const struct timeval *tmo) {
+   struct timeval deadline;
+   ssize_t writt;
+   size_t done = 0;
+
+   if (tmo != NULL) {
+      gettimeofday(&deadline, NULL);
+      timeradd(&deadline, tmo, &deadline);
+   }
+   while (done < bytes) {
+      if ((writt = xioring_write(ring, (const char *)buff+done, bytes-done))
+	  >= 0) {
+	 done += writt;
+      } else if (errno != EAGAIN ||
+		 xioring_waitspace(ring, XIORING_HDRLEN+1,
+				   tmo != NULL ? &deadline : NULL) < 0) {
+	 return -1;
+      }
+   }
+   return done;
+}
+
+/* writer: sends EOF to the consumer. reader: tells the producer that no more
+   data is read */
+int xioring_shutdown(struct xioring *ring, bool writer) {
+   struct timeval deadline;
+
+   if (!writer) {
+      if (!__atomic_exchange_n(&ring->rclosed, 1, __ATOMIC_SEQ_CST)) {
+	 xioring_signal(ring->spacefd);
+      }
+      return 0;
+   }
+   if (ring->wstate != XIORING_OPEN) {
+      return 0;
+   }
+   /* like a drain, the EOF record waits for space at most for the closing
+      timeout; without it, closing the ring tells the consumer */
+   gettimeofday(&deadline, NULL);
+   timeradd(&deadline, &xioparams->closwait, &deadline);
+   if (xioring_waitspace(ring, XIORING_HDRLEN, &deadline) < 0) {
+      int _errno = errno;
+      ring->wstate = XIORING_EOFSENT;
+      if (_errno == ETIMEDOUT) {
+	 Warn1("ring (eventfd %d) stays full: closing timeout expired, EOF is passed on close",
+	       ring->spacefd);
+      }
+      return _errno == EPIPE ? 0 : -1;
+   }
+   xioring_publish(ring, XIORING_EOF, NULL, 0);
+   ring->wstate = XIORING_EOFSENT;
+   return 0;
+}
+
+/* releases the producer (writer) or consumer side of the ring; the second
+   call frees it */
+void xioring_close(struct xioring *ring, bool writer) {
+   if (writer) {
+      /* does not wait for space: a closed producer without EOF record is
+	 EOF for the consumer as soon as the ring is empty */
+      __atomic_store_n(&ring->wstate, XIORING_CLOSED, __ATOMIC_SEQ_CST);
+      xioring_signal(ring->datafd);
+   } else {
+      xioring_shutdown(ring, false);
+   }
+   if (__atomic_sub_fetch(&ring->refs, 1, __ATOMIC_ACQ_REL) > 0) {
+      return;
+   }
+   Info1("releasing ring at %p", ring->data);
+   Close(ring->datafd);
+   Close(ring->spacefd);
+   munmap(ring, ring->mapsize);
+}
+
+#endif /* HAVE_SHMRINGS */
@@ -58,6 +58,11 @@ int xioshutdown(xiofile_t *sock, int how) {
       how = ((how+1) & ~(SHUT_WR+1)) - 1;
    }
 
+   if ((how+1) & 2) {
+      /* output still pending from nonblocking writes must precede EOF */
+      xiodrain(&sock->stream);
+   }
+
    switch (sock->stream.howtoshut) {
 #if WITH_PTY
    case XIOSHUT_PTYEOF:
@@ -99,6 +104,18 @@ int xioshutdown(xiofile_t *sock, int how) {
       /*! what about half/full close? */
       return 0;
 #endif /* WITH_OPENSSL */
+   case XIOSHUT_LAYER:
+      return xioshutdown(sock->stream.lower, how);
+#if HAVE_SHMRINGS
+   case XIOSHUT_RING:
+      if (((how+1) & 1) && sock->stream.rring != NULL) {
+	 xioring_shutdown(sock->stream.rring, false);
+      }
+      if (((how+1) & 2) && sock->stream.wring != NULL) {
+	 result = xioring_shutdown(sock->stream.wring, true);
+      }
+      return result;
+#endif /* HAVE_SHMRINGS */
    default:
       break;
    }
@@ -273,6 +273,7 @@ int xiocommpair(int commtype, bool lefttoright, bool righttoleft,
       break;
    }
 
+   left->rring = left->wring = right->rring = right->wring = NULL;
    switch (commtype) {
    default: /* unspec */
       Warn1("internal: undefined communication type %d, defaulting to 0",
@@ -366,6 +367,36 @@ int xiocommpair(int commtype, bool lefttoright, bool righttoleft,
       left->howtoshut  = right->howtoshut  = XIOSHUT_DOWN;
       left->howtoclose = right->howtoclose = XIOCLOSE_CLOSE;
       break;
+
+#if HAVE_SHMRINGS
+   case XIOCOMM_SHMRINGS: /* two shared memory rings, between threads */
+      /* the reader polls the data eventfd [0], the writer the space eventfd
+	 [1] */
+      if (lefttoright) {
+	 if ((left->wring = right->rring =
+	      xioring_create(4*xioparams->bufsiz, &svlr[0], &svlr[1]))
+	     == NULL) {
+	    return -1;
+	 }
+      }
+      if (righttoleft) {
+	 if ((right->wring = left->rring =
+	      xioring_create(4*xioparams->bufsiz, &svrl[0], &svrl[1]))
+	     == NULL) {
+	    if (left->wring != NULL) {
+	       /* both sides release it */
+	       xioring_close(left->wring, true);
+	       xioring_close(right->rring, false);
+	    }
+	    return -1;
+	 }
+      }
+      left->single     = right->single     = false;
+      left->dtype      = right->dtype      = XIODATA_RING;
+      left->howtoshut  = right->howtoshut  = XIOSHUT_RING;
+      left->howtoclose = right->howtoclose = XIOCLOSE_RING;
+      break;
+#endif /* HAVE_SHMRINGS */
    }
 
    if (dual && left->single) {
@@ -0,0 +1,509 @@
+/* source: xiosslcache.c */
+/* Copyright Gerhard Rieger */
+/* Published under the GNU General Public License V.2, see file COPYING */
+
+/* this is the source of the TLS session cache that the forked children of an
+   OpenSSL server share (option openssl-session-cache), and of the session
+   store of OpenSSL clients (option openssl-session-store) */
+
+/* OPENSSL-LISTEN prepares its SSL_CTX before _xioopen_listen() forks, so
+   every child would start with an empty copy of OpenSSL's internal session
+   cache, and a client could never resume a session with another child.
+   Here the sessions are kept in a shared anonymous mapping that is created
+   in the parent; OpenSSL reaches it through the external cache callbacks.
+   The mapping is a set associative table: the session ID selects a set of
+   XIOSSLCACHE_WAYS entries, a new session takes a free or expired entry of
+   its set, or the one that expires first. The sessions are stored DER
+   encoded; one that is larger than an entry is not cached.
+   The same mapping holds the keys for session tickets, so a ticket that one
+   child issued can be decrypted by any other. The parent generates the
+   first key; when it is older than the rotation interval, the next child
+   that needs a key makes a new one and keeps the former one for decryption
+   of tickets that are still in use.
+   A process-shared robust mutex protects the mapping, so a child that dies
+   while it holds the lock does not block the others. */
+
+#include "xiosysincludes.h"
+#if WITH_OPENSSL
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#else
+#include <openssl/hmac.h>
+#endif
+#include "xioopen.h"
+
+#include "xio-openssl.h"
+
+#define XIOSSLCACHE_WAYS	4	/* entries per set */
+#define XIOSSLCACHE_SESSMAX	4096	/* DER encoded session with cert chain */
+#define XIOSSLCACHE_ROTATE	3600	/* seconds, without ticket-key-rotate */
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+#  define XIOSSLCACHE_CONST const
+#else
+#  define XIOSSLCACHE_CONST
+#endif
+
+struct xiosslcache_entry {
+   unsigned char id[SSL_MAX_SSL_SESSION_ID_LENGTH];
+   unsigned int idlen;		/* 0: entry is free */
+   time_t expires;
+   unsigned int derlen;
+   unsigned char der[XIOSSLCACHE_SESSMAX];
+} ;
+
+struct xiosslcache_key {
+   unsigned char name[16];
+   unsigned char aeskey[32];
+   unsigned char hmackey[32];
+} ;
+
+struct xiosslcache {
+   pthread_mutex_t lock;
+   size_t mapsize;
+   unsigned int sets;
+   struct xiosslcache_key keys[2];	/* current, previous */
+   time_t keytime;			/* when keys[0] was made */
+   time_t rotate;			/* seconds per ticket key */
+   unsigned long hits, misses, stores, evictions, toolarge, rotations;
+   pid_t pid;				/* the process that reports */
+   struct xiosslcache *next;		/* all caches, for the report */
+   struct xiosslcache_entry entries[1];	/* sets*XIOSSLCACHE_WAYS */
+} ;
+
+static int xiosslcache_index = -1;	/* of the SSL_CTX ex_data */
+
+
+static struct xiosslcache *xiosslcache_get(SSL *ssl) {
+   return SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), xiosslcache_index);
+}
+
+static void xiosslcache_lock(struct xiosslcache *cache) {
+   int rc;
+
+   if ((rc = pthread_mutex_lock(&cache->lock)) == EOWNERDEAD) {
+      /* an entry that it left incomplete has idlen 0 or fails to decode */
+      Warn("TLS session cache: a process died while holding the lock");
+      pthread_mutex_consistent(&cache->lock);
+   } else if (rc != 0) {
+      Error2("pthread_mutex_lock(%p): %s", &cache->lock, strerror(rc));
+   }
+}
+
+static void xiosslcache_unlock(struct xiosslcache *cache) {
+   pthread_mutex_unlock(&cache->lock);
+}
+
+static struct xiosslcache_entry *
+   xiosslcache_set(struct xiosslcache *cache,
+		   const unsigned char *id, unsigned int idlen) {
+   unsigned int hash = 2166136261U, i;
+
+   for (i = 0; i < idlen; ++i) {
+      hash = (hash ^ id[i]) * 16777619U;
+   }
+   return &cache->entries[(hash % cache->sets) * XIOSSLCACHE_WAYS];
+}
+
+/* returns the entry of the session, or NULL. call with lock held */
+static struct xiosslcache_entry *
+   xiosslcache_find(struct xiosslcache *cache,
+		    const unsigned char *id, unsigned int idlen) {
+   struct xiosslcache_entry *set = xiosslcache_set(cache, id, idlen);
+   unsigned int i;
+
+   for (i = 0; i < XIOSSLCACHE_WAYS; ++i) {
+      if (set[i].idlen == idlen && !memcmp(set[i].id, id, idlen)) {
+	 return &set[i];
+      }
+   }
+   return NULL;
+}
+
+/* makes a new current ticket key when the current one is older than the
+   rotation interval. call with lock held */
+static void xiosslcache_rotate(struct xiosslcache *cache, time_t now) {
+   struct xiosslcache_key key;
+
+   if (now - cache->keytime < cache->rotate) {
+      return;
+   }
+   if (RAND_bytes((unsigned char *)&key, sizeof(key)) != 1) {
+      Warn("TLS session cache: RAND_bytes() failed, keeping ticket key");
+      return;
+   }
+   cache->keys[1] = cache->keys[0];
+   cache->keys[0] = key;
+   cache->keytime = now;
+   ++cache->rotations;
+   Info("TLS session cache: new session ticket key");
+}
+
+
+static int xiosslcache_new_cb(SSL *ssl, SSL_SESSION *sess) {
+   struct xiosslcache *cache = xiosslcache_get(ssl);
+   struct xiosslcache_entry *set, *entry;
+   unsigned char der[XIOSSLCACHE_SESSMAX], *p = der;
+   const unsigned char *id;
+   unsigned int idlen, i;
+   time_t now = time(NULL);
+   int derlen;
+
+   id = SSL_SESSION_get_id(sess, &idlen);
+   derlen = i2d_SSL_SESSION(sess, NULL);
+   if (idlen == 0 || idlen > SSL_MAX_SSL_SESSION_ID_LENGTH ||
+       derlen <= 0 || derlen > XIOSSLCACHE_SESSMAX) {
+      xiosslcache_lock(cache);
+      ++cache->toolarge;
+      xiosslcache_unlock(cache);
+      Info1("TLS session cache: not storing session of %d bytes", derlen);
+      return 0;
+   }
+   i2d_SSL_SESSION(sess, &p);
+
+   xiosslcache_lock(cache);
+   if ((entry = xiosslcache_find(cache, id, idlen)) == NULL) {
+      set = xiosslcache_set(cache, id, idlen);
+      entry = &set[0];
+      for (i = 0; i < XIOSSLCACHE_WAYS; ++i) {
+	 if (set[i].idlen == 0 || set[i].expires <= now) {
+	    entry = &set[i];
+	    break;
+	 }
+	 if (set[i].expires < entry->expires) {
+	    entry = &set[i];
+	 }
+      }
+      if (i == XIOSSLCACHE_WAYS) {
+	 ++cache->evictions;
+      }
+   }
+   entry->idlen = 0;
+   memcpy(entry->der, der, derlen);
+   entry->derlen = derlen;
+   entry->expires = SSL_SESSION_get_time(sess) + SSL_SESSION_get_timeout(sess);
+   memcpy(entry->id, id, idlen);
+   entry->idlen = idlen;
+   ++cache->stores;
+   xiosslcache_unlock(cache);
+   return 0;	/* we hold no reference */
+}
+
+static SSL_SESSION *xiosslcache_get_cb(SSL *ssl,
+				       XIOSSLCACHE_CONST unsigned char *id,
+				       int idlen, int *copy) {
+   struct xiosslcache *cache = xiosslcache_get(ssl);
+   struct xiosslcache_entry *entry;
+   unsigned char der[XIOSSLCACHE_SESSMAX];
+   const unsigned char *p = der;
+   unsigned int derlen = 0;
+
+   *copy = 0;
+   xiosslcache_lock(cache);
+   if ((entry = xiosslcache_find(cache, id, idlen)) != NULL &&
+       entry->expires > time(NULL)) {
+      derlen = entry->derlen;
+      memcpy(der, entry->der, derlen);
+      ++cache->hits;
+   } else {
+      ++cache->misses;
+   }
+   xiosslcache_unlock(cache);
+   if (derlen == 0) {
+      return NULL;
+   }
+   return d2i_SSL_SESSION(NULL, &p, derlen);
+}
+
+static void xiosslcache_remove_cb(SSL_CTX *ctx, SSL_SESSION *sess) {
+   struct xiosslcache *cache =
+      SSL_CTX_get_ex_data(ctx, xiosslcache_index);
+   struct xiosslcache_entry *entry;
+   const unsigned char *id;
+   unsigned int idlen;
+
+   id = SSL_SESSION_get_id(sess, &idlen);
+   xiosslcache_lock(cache);
+   if ((entry = xiosslcache_find(cache, id, idlen)) != NULL) {
+      entry->idlen = 0;
+   }
+   xiosslcache_unlock(cache);
+}
+
+
+/* selects the ticket key by its name and sets up the cipher and MAC context
+   like the callbacks of SSL_CTX_set_tlsext_ticket_key_cb() must do.
+   returns 1 with the current key, 2 with the previous one (ticket should be
+   renewed), 0 when the key is unknown, -1 on error */
+static int xiosslcache_ticket_key(SSL *ssl, unsigned char *name,
+				  unsigned char *iv, EVP_CIPHER_CTX *ectx,
+				  struct xiosslcache_key *key, int enc) {
+   struct xiosslcache *cache = xiosslcache_get(ssl);
+   int result = 1;
+
+   xiosslcache_lock(cache);
+   xiosslcache_rotate(cache, time(NULL));
+   if (enc) {
+      *key = cache->keys[0];
+   } else if (!memcmp(name, cache->keys[0].name, sizeof(key->name))) {
+      *key = cache->keys[0];
+   } else if (!memcmp(name, cache->keys[1].name, sizeof(key->name))) {
+      *key = cache->keys[1];
+      result = 2;
+   } else {
+      result = 0;
+   }
+   xiosslcache_unlock(cache);
+
+   if (enc) {
+      if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1) {
+	 return -1;
+      }
+      memcpy(name, key->name, sizeof(key->name));
+      if (!EVP_EncryptInit_ex(ectx, EVP_aes_256_cbc(), NULL,
+			      key->aeskey, iv)) {
+	 return -1;
+      }
+   } else if (result > 0) {
+      if (!EVP_DecryptInit_ex(ectx, EVP_aes_256_cbc(), NULL,
+			      key->aeskey, iv)) {
+	 return -1;
+      }
+   }
+   return result;
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+static int xiosslcache_ticket_cb(SSL *ssl, unsigned char *name,
+				 unsigned char *iv, EVP_CIPHER_CTX *ectx,
+				 EVP_MAC_CTX *hctx, int enc) {
+   struct xiosslcache_key key;
+   OSSL_PARAM params[3];
+   int result;
+
+   if ((result = xiosslcache_ticket_key(ssl, name, iv, ectx, &key, enc)) <= 0) {
+      return result;
+   }
+   params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY,
+						 key.hmackey,
+						 sizeof(key.hmackey));
+   params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+						"SHA256", 0);
+   params[2] = OSSL_PARAM_construct_end();
+   if (!EVP_MAC_CTX_set_params(hctx, params)) {
+      return -1;
+   }
+   return result;
+}
+#else /* OPENSSL_VERSION_NUMBER < 0x30000000L */
+static int xiosslcache_ticket_cb(SSL *ssl, unsigned char *name,
+				 unsigned char *iv, EVP_CIPHER_CTX *ectx,
+				 HMAC_CTX *hctx, int enc) {
+   struct xiosslcache_key key;
+   int result;
+
+   if ((result = xiosslcache_ticket_key(ssl, name, iv, ectx, &key, enc)) <= 0) {
+      return result;
+   }
+   if (!HMAC_Init_ex(hctx, key.hmackey, sizeof(key.hmackey), EVP_sha256(),
+		     NULL)) {
+      return -1;
+   }
+   return result;
+}
+#endif /* OPENSSL_VERSION_NUMBER < 0x30000000L */
+
+
+static struct xiosslcache *xiosslcache_list;
+
+static void xiosslcache_exit(void) {
+   struct xiosslcache *cache;
+
+   for (cache = xiosslcache_list; cache != NULL; cache = cache->next) {
+      if (cache->pid != Getpid())  continue;
+      Info6("TLS session cache: %lu hits, %lu misses, %lu stored, %lu evicted, %lu too large, %lu key rotations",
+	    cache->hits, cache->misses, cache->stores, cache->evictions,
+	    cache->toolarge, cache->rotations);
+   }
+}
+
+/* creates a session cache for entries sessions in shared memory and installs
+   it and the session ticket keys in ctx. Must be called before the server
+   forks. returns 0 on success, or -1 on error */
+int xiosslcache_install(SSL_CTX *ctx, unsigned int entries,
+			const struct timespec *rotate) {
+   static const unsigned char sidctx[] = "socat";
+   struct xiosslcache *cache;
+   pthread_mutexattr_t attr;
+   unsigned int sets;
+   size_t mapsize;
+   void *map;
+   int rc;
+
+   if (xiosslcache_index < 0) {
+      xiosslcache_index = SSL_CTX_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+      if (xiosslcache_index < 0) {
+	 Error("SSL_CTX_get_ex_new_index() failed");
+	 return -1;
+      }
+   }
+   sets = (entries + XIOSSLCACHE_WAYS - 1) / XIOSSLCACHE_WAYS;
+   mapsize = sizeof(struct xiosslcache) +
+      (sets*XIOSSLCACHE_WAYS - 1) * sizeof(struct xiosslcache_entry);
+   map = mmap(NULL, mapsize, PROT_READ|PROT_WRITE,
+	      MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+   if (map == MAP_FAILED) {
+      Error2("mmap(NULL, "F_Zu", ...): %s", mapsize, strerror(errno));
+      return -1;
+   }
+   cache = map;		/* zeroed by mmap() */
+   cache->mapsize = mapsize;
+   cache->sets = sets;
+   cache->rotate = rotate->tv_sec > 0 ? rotate->tv_sec : XIOSSLCACHE_ROTATE;
+   cache->pid = Getpid();
+
+   pthread_mutexattr_init(&attr);
+   pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+   pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+   rc = pthread_mutex_init(&cache->lock, &attr);
+   pthread_mutexattr_destroy(&attr);
+   if (rc != 0) {
+      Error2("pthread_mutex_init(%p, {PTHREAD_PROCESS_SHARED,PTHREAD_MUTEX_ROBUST}): %s",
+	     &cache->lock, strerror(rc));
+      munmap(map, mapsize);
+      return -1;
+   }
+   if (RAND_bytes((unsigned char *)cache->keys, sizeof(cache->keys)) != 1) {
+      Error("RAND_bytes() failed for session ticket keys");
+      munmap(map, mapsize);
+      return -1;
+   }
+   cache->keytime = time(NULL);
+
+   SSL_CTX_set_ex_data(ctx, xiosslcache_index, cache);
+   /* resumption requires a session id context when peers are verified */
+   SSL_CTX_set_session_id_context(ctx, sidctx, sizeof(sidctx)-1);
+   SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER|
+				  SSL_SESS_CACHE_NO_INTERNAL);
+   SSL_CTX_sess_set_new_cb(ctx, xiosslcache_new_cb);
+   SSL_CTX_sess_set_get_cb(ctx, xiosslcache_get_cb);
+   SSL_CTX_sess_set_remove_cb(ctx, xiosslcache_remove_cb);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+   SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, xiosslcache_ticket_cb);
+#else
+   SSL_CTX_set_tlsext_ticket_key_cb(ctx, xiosslcache_ticket_cb);
+#endif
+
+   if (xiosslcache_list == NULL) {
+      atexit(xiosslcache_exit);
+   }
+   cache->next = xiosslcache_list;
+   xiosslcache_list = cache;
+   Info4("TLS session cache of %u entries ("F_Zu" bytes) at %p, ticket keys rotated every "F_tv_sec"s",
+	 sets*XIOSSLCACHE_WAYS, mapsize, cache, (long)cache->rotate);
+   return 0;
+}
+
+/* the client side: with option openssl-session-store OPENSSL-CONNECT offers
+   the session that an earlier connection, possibly of another socat process,
+   saved in a file; every session that the server issues replaces it. The
+   file holds the session's master secret, so it is created with mode 0600
+   and renamed into place */
+
+static int xiosslcache_fileindex = -1;	/* of the SSL ex_data: path */
+
+static int xiosslcache_store_cb(SSL *ssl, SSL_SESSION *sess) {
+   const char *path = SSL_get_ex_data(ssl, xiosslcache_fileindex);
+   char tmppath[PATH_MAX];
+   FILE *fp;
+   int fd, ok;
+
+   if (path == NULL) {
+      return 0;
+   }
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+   if (!SSL_SESSION_is_resumable(sess)) {
+      return 0;
+   }
+#endif
+   if (snprintf(tmppath, sizeof(tmppath), "%s."F_pid, path, Getpid())
+       >= (int)sizeof(tmppath)) {
+      Warn1("\"%s\": path too long for TLS session store", path);
+      return 0;
+   }
+   if ((fd = Open(tmppath, O_WRONLY|O_CREAT|O_TRUNC|O_EXCL, 0600)) < 0) {
+      Warn2("open(\"%s\", O_WRONLY|O_CREAT|O_TRUNC|O_EXCL, 0600): %s",
+	    tmppath, strerror(errno));
+      return 0;
+   }
+   if ((fp = fdopen(fd, "w")) == NULL) {
+      Warn2("fdopen(%d, \"w\"): %s", fd, strerror(errno));
+      Close(fd);
+      Unlink(tmppath);
+      return 0;
+   }
+   ok = PEM_write_SSL_SESSION(fp, sess);
+   if (fclose(fp) != 0 || !ok) {
+      Warn1("\"%s\": failed to write TLS session", tmppath);
+      Unlink(tmppath);
+      return 0;
+   }
+   if (rename(tmppath, path) < 0) {
+      Warn3("rename(\"%s\", \"%s\"): %s", tmppath, path, strerror(errno));
+      Unlink(tmppath);
+      return 0;
+   }
+   Info1("stored TLS session in \"%s\"", path);
+   return 0;	/* we hold no reference */
+}
+
+/* lets the client ctx pass new sessions to xiosslcache_store_cb() instead of
+   OpenSSL's internal cache. returns 0 on success, or -1 on error */
+int xiosslcache_client(SSL_CTX *ctx) {
+   if (xiosslcache_fileindex < 0) {
+      xiosslcache_fileindex = SSL_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+      if (xiosslcache_fileindex < 0) {
+	 Error("SSL_get_ex_new_index() failed");
+	 return -1;
+      }
+   }
+   SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT|
+				  SSL_SESS_CACHE_NO_INTERNAL_STORE);
+   SSL_CTX_sess_set_new_cb(ctx, xiosslcache_store_cb);
+   return 0;
+}
+
+/* makes ssl save its sessions to path and offers the session that is already
+   stored there. returns 1 when a session is offered, 0 otherwise */
+int xiosslcache_load(SSL *ssl, const char *path) {
+   SSL_SESSION *sess;
+   FILE *fp;
+
+   SSL_set_ex_data(ssl, xiosslcache_fileindex, (void *)path);
+   if ((fp = fopen(path, "r")) == NULL) {
+      if (errno == ENOENT) {
+	 Info1("no TLS session stored in \"%s\"", path);
+      } else {
+	 Warn2("fopen(\"%s\", \"r\"): %s", path, strerror(errno));
+      }
+      return 0;
+   }
+   sess = PEM_read_SSL_SESSION(fp, NULL, NULL, NULL);
+   fclose(fp);
+   if (sess == NULL) {
+      Warn1("\"%s\": no valid TLS session, ignoring it", path);
+      ERR_clear_error();
+      return 0;
+   }
+   if (SSL_set_session(ssl, sess) != 1) {
+      Warn1("SSL_set_session(): cannot offer session from \"%s\"", path);
+      ERR_clear_error();
+      SSL_SESSION_free(sess);
+      return 0;
+   }
+   SSL_SESSION_free(sess);	/* ssl keeps its own reference */
+   Info1("offering TLS session from \"%s\"", path);
+   return 1;
+}
+
+#endif /* WITH_OPENSSL */
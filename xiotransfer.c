@@ -15,6 +15,18 @@
 
 static 
 int cv_newline(unsigned char **buff, ssize_t *bytes, int lineterm1, int lineterm2);
+#if HAVE_SPLICE || HAVE_SENDFILE
+#define XIOSPLICE_FALLBACK (-2)
+static bool xiotransfer_plain(xiofile_t *inpipe, xiofile_t *outpipe);
+#endif /* HAVE_SPLICE || HAVE_SENDFILE */
+#if HAVE_SENDFILE
+static ssize_t xiotransfer_sendfile(xiofile_t *inpipe, xiofile_t *outpipe,
+				    size_t bufsiz);
+#endif /* HAVE_SENDFILE */
+#if HAVE_SPLICE
+static ssize_t xiotransfer_splice(xiofile_t *inpipe, xiofile_t *outpipe,
+				  unsigned char *buff, size_t bufsiz);
+#endif /* HAVE_SPLICE */
 
 
 #define MAXTIMESTAMPLEN 128
@@ -63,26 +75,21 @@ int gettimestamp(char *timestamp) {
 
 static const char *prefixltor = "> ";
 static const char *prefixrtol = "< ";
-static unsigned long numltor;
-static unsigned long numrtol;
-/* print block header (during verbose or hex dump)
+/* print block header (during verbose or hex dump); pos is the number of
+   bytes read before from this direction and is advanced.
    returns 0 on success or -1 if an error occurred */
 static int
-   xioprintblockheader(FILE *file, size_t bytes, bool righttoleft) {
+   xioprintblockheader(FILE *file, size_t bytes, bool righttoleft,
+		       unsigned long *pos) {
    char timestamp[MAXTIMESTAMPLEN];
    char buff[128+MAXTIMESTAMPLEN];
    if (gettimestamp(timestamp) < 0) {
       return -1;
    }
-   if (righttoleft) {
-      sprintf(buff, "%s%s length="F_Zu" from=%lu to=%lu\n",
-	      prefixrtol, timestamp, bytes, numrtol, numrtol+bytes-1);
-      numrtol+=bytes;
-   } else {
-      sprintf(buff, "%s%s length="F_Zu" from=%lu to=%lu\n",
-	      prefixltor, timestamp, bytes, numltor, numltor+bytes-1);
-      numltor+=bytes;
-   }
+   sprintf(buff, "%s%s length="F_Zu" from=%lu to=%lu\n",
+	   righttoleft?prefixrtol:prefixltor, timestamp, bytes,
+	   *pos, *pos+bytes-1);
+   *pos += bytes;
    fputs(buff, file);
    return 0;
 }
@@ -103,6 +110,31 @@ static int
 int xiotransfer(xiofile_t *inpipe, xiofile_t *outpipe,
 		unsigned char **buff, size_t bufsiz, bool righttoleft) {
    ssize_t bytes, writt = 0;
+#if HAVE_UDP_GSO
+   ssize_t rdbytes;
+#endif
+
+#if HAVE_SPLICE || HAVE_SENDFILE
+   /* without conversions the data need not pass through user space */
+   if (xiotransfer_plain(inpipe, outpipe)) {
+#if HAVE_SENDFILE
+      if (XIO_RDSTREAM(inpipe)->usesendfile >= 0) {
+	 writt = xiotransfer_sendfile(inpipe, outpipe, bufsiz);
+	 if (writt != XIOSPLICE_FALLBACK) {
+	    return writt;
+	 }
+      }
+#endif /* HAVE_SENDFILE */
+#if HAVE_SPLICE
+      if (!XIO_RDSTREAM(inpipe)->nosplice) {
+	 writt = xiotransfer_splice(inpipe, outpipe, *buff, bufsiz);
+	 if (writt != XIOSPLICE_FALLBACK) {
+	    return writt;
+	 }
+      }
+#endif /* HAVE_SPLICE */
+   }
+#endif /* HAVE_SPLICE || HAVE_SENDFILE */
 
 	 bytes = xioread(inpipe, *buff, bufsiz);
 	 if (bytes < 0) {
@@ -111,12 +143,16 @@ int xiotransfer(xiofile_t *inpipe, xiofile_t *outpipe,
 	    /*xioshutdown(inpipe, SHUT_RD);*/
 	    return -1;
 	 }
+#if HAVE_UDP_GSO
+	 rdbytes = bytes;
+#endif
 	 if (bytes == 0 && XIO_RDSTREAM(inpipe)->ignoreeof &&
-	     !inpipe->stream.closing) {
+	     !XIO_RDSTREAM(inpipe)->closing) {
 	    ;
 	 } else if (bytes == 0) {
 	    XIO_RDSTREAM(inpipe)->eof = 2;
-	    inpipe->stream.closing = MAX(inpipe->stream.closing, 1);
+	    XIO_RDSTREAM(inpipe)->closing =
+	       MAX(XIO_RDSTREAM(inpipe)->closing, 1);
 	 }
 
       if (bytes > 0) {
@@ -160,7 +196,8 @@ int xiotransfer(xiofile_t *inpipe, xiofile_t *outpipe,
 	       const unsigned char *end, *s, *t;
 	       s = *buff;
 	       end = (*buff)+bytes;
-	       xioprintblockheader(stderr, bytes, righttoleft);
+	       xioprintblockheader(stderr, bytes, righttoleft,
+				   &XIO_RDSTREAM(inpipe)->verbpos);
 	       while (s < end) {
 		  /*! prefix? */
 		  j = Min(N, (size_t)(end-s));
@@ -203,7 +240,8 @@ int xiotransfer(xiofile_t *inpipe, xiofile_t *outpipe,
 	       fputs("--\n", stderr);
 	    } else if (xioparams->verbose) {
 	       size_t i = 0;
-	       xioprintblockheader(stderr, bytes, righttoleft);
+	       xioprintblockheader(stderr, bytes, righttoleft,
+				   &XIO_RDSTREAM(inpipe)->verbpos);
 	       while (i < (size_t)bytes) {
 		  int c = (*buff)[i];
 		  if (i > 0 && (*buff)[i-1] == '\n')
@@ -228,19 +266,25 @@ int xiotransfer(xiofile_t *inpipe, xiofile_t *outpipe,
 	    } else if (xioparams->verbhex) {
 	       int i;
 	       /* print prefix */
-	       xioprintblockheader(stderr, bytes, righttoleft);
+	       xioprintblockheader(stderr, bytes, righttoleft,
+				   &XIO_RDSTREAM(inpipe)->verbpos);
 	       for (i = 0; i < bytes; ++i) {
 		  fprintf(stderr, " %02x", (*buff)[i]);
 	       }
 	       fputc('\n', stderr);
 	    }
 
+#if HAVE_UDP_GSO
+	    /* a datagram coalesced by UDP GRO is written in segments of the
+	       same size, unless a conversion changed its length */
+	    XIO_WRSTREAM(outpipe)->segsize =
+	       (bytes == rdbytes ? XIO_RDSTREAM(inpipe)->segsize : 0);
+#endif
 	    writt = xiowrite(outpipe, *buff, bytes);
 	    if (writt < 0) {
-	       /* EAGAIN when nonblocking but a mandatory lock is on file.
-		  the problem with EAGAIN is that the read cannot be repeated,
-		  so we need to buffer the data and try to write it later
-		  again. not yet implemented, sorry. */
+	       /* data that a nonblocking fd did not take is kept by
+		  xiowrite() and written later by xioflush(), so we do not
+		  see EAGAIN here */
 #if 0
 	       if (errno == EPIPE) {
 		  return 0;	/* can no longer write; handle like EOF */
@@ -254,6 +298,240 @@ int xiotransfer(xiofile_t *inpipe, xiofile_t *outpipe,
    return writt;
 }
 
+#if HAVE_SPLICE || HAVE_SENDFILE
+/* returns true when the data from inpipe to outpipe can be moved with
+   sendfile() or splice(): both sides are plain read()/write() streams, and
+   no escape character, line terminator conversion, or data dump is active.
+   This is checked for every block, so switching on a conversion takes effect
+   immediately */
+static bool xiotransfer_plain(xiofile_t *inpipe, xiofile_t *outpipe) {
+   struct single *in  = XIO_RDSTREAM(inpipe);
+   struct single *out = XIO_WRSTREAM(outpipe);
+
+   if ((in->dtype & XIODATA_READMASK) != XIOREAD_STREAM ||
+       (out->dtype & XIODATA_WRITEMASK) != XIOWRITE_STREAM ||
+       (out->dtype & XIODATA_READMASK) == XIOREAD_READLINE)
+      return false;
+   if (in->escape != -1 || in->lineterm != out->lineterm)
+      return false;
+   if (xioparams->verbose || xioparams->verbhex)
+      return false;
+   return true;
+}
+#endif /* HAVE_SPLICE || HAVE_SENDFILE */
+
+#if HAVE_SENDFILE
+/* when the read side is a regular file, sends at most bufsiz bytes from its
+   current offset directly to outpipe.
+   Returns the number of bytes written, 0 on EOF, or -1 on error like
+   xiotransfer(). Returns XIOSPLICE_FALLBACK when nothing was transferred
+   and the block has to take another path: always when the input is not a
+   regular file or the output does not support sendfile() (the stream is
+   then marked), and for this block when the output fd is full, so that
+   xiowrite() queues the data and the engine polls for writeability */
+static ssize_t xiotransfer_sendfile(xiofile_t *inpipe, xiofile_t *outpipe,
+				    size_t bufsiz) {
+   struct single *in  = XIO_RDSTREAM(inpipe);
+   struct single *out = XIO_WRSTREAM(outpipe);
+   int rfd = XIO_GETRDFD(inpipe), wfd = XIO_GETWRFD(outpipe);
+   ssize_t writt;
+   int _errno;
+
+   if (in->usesendfile == 0) {
+      struct stat buf;
+      if (Fstat(rfd, &buf) < 0 || !S_ISREG(buf.st_mode)) {
+	 in->usesendfile = -1;
+	 return XIOSPLICE_FALLBACK;
+      }
+      in->usesendfile = 1;
+   }
+
+   if (in->readbytes) {
+      if (in->actbytes == 0) {
+	 writt = 0;	/* EOF by count */
+	 goto eof;
+      }
+      if (in->actbytes < bufsiz) {
+	 bufsiz = in->actbytes;
+      }
+   }
+
+   /* NULL offset: start at and advance the current file offset */
+   do {
+      writt = Sendfile(wfd, rfd, NULL, bufsiz);
+   } while (writt < 0 && errno == EINTR);
+   if (writt < 0) {
+      _errno = errno;
+      switch (_errno) {
+      case EAGAIN:
+	 return XIOSPLICE_FALLBACK;
+      case EINVAL: case ENOSYS:
+	 Info2("sendfile() not supported from fd %d to fd %d", rfd, wfd);
+	 in->usesendfile = -1;
+	 return XIOSPLICE_FALLBACK;
+      case EPIPE:
+      case ECONNRESET:
+	 if (out->cool_write) {
+	    Notice4("sendfile(%d, %d, NULL, "F_Zu"): %s",
+		    wfd, rfd, bufsiz, strerror(_errno));
+	    break;
+	 }
+	 /*PASSTRHOUGH*/
+      default:
+	 Error4("sendfile(%d, %d, NULL, "F_Zu"): %s",
+		wfd, rfd, bufsiz, strerror(_errno));
+      }
+      errno = _errno;
+      return -1;
+   }
+   if (in->readbytes) {
+      in->actbytes -= writt;
+   }
+ eof:
+   if (writt == 0) {
+      if (!(in->ignoreeof && !in->closing)) {
+	 in->eof = 2;
+	 in->closing = MAX(in->closing, 1);
+      }
+      return 0;
+   }
+   Info3("transferred "F_Zd" bytes from %d to %d (sendfile)", writt, rfd, wfd);
+   return writt;
+}
+#endif /* HAVE_SENDFILE */
+
+#if HAVE_SPLICE
+/* moves at most bufsiz bytes from inpipe to outpipe through a kernel pipe
+   without copying them to user space. buff is only used when the output fd
+   turns out not to support splice() after data has already been moved into
+   the kernel pipe.
+   Returns the number of bytes written, 0 on EOF, or -1 on error like
+   xiotransfer(). Returns XIOSPLICE_FALLBACK when nothing was transferred and
+   the fds do not support splice(); the stream is then marked so that
+   following blocks take the read()/write() path */
+static ssize_t xiotransfer_splice(xiofile_t *inpipe, xiofile_t *outpipe,
+				  unsigned char *buff, size_t bufsiz) {
+   struct single *in  = XIO_RDSTREAM(inpipe);
+   struct single *out = XIO_WRSTREAM(outpipe);
+   int rfd = XIO_GETRDFD(inpipe), wfd = XIO_GETWRFD(outpipe);
+   ssize_t bytes, writt, done = 0;
+   int _errno;
+
+   if (in->splicefd[0] < 0) {
+      if (Pipe(in->splicefd) < 0) {
+	 Info1("pipe(): %s, not using splice()", strerror(errno));
+	 in->splicefd[0] = in->splicefd[1] = -1;
+	 in->nosplice = true;
+	 return XIOSPLICE_FALLBACK;
+      }
+      Fcntl_l(in->splicefd[0], F_SETFD, FD_CLOEXEC);
+      Fcntl_l(in->splicefd[1], F_SETFD, FD_CLOEXEC);
+   }
+
+   if (in->readbytes) {
+      if (in->actbytes == 0) {
+	 bytes = 0;	/* EOF by count */
+	 goto eof;
+      }
+      if (in->actbytes < bufsiz) {
+	 bufsiz = in->actbytes;
+      }
+   }
+
+   do {
+      bytes = Splice(rfd, NULL, in->splicefd[1], NULL, bufsiz,
+		     SPLICE_F_MOVE);
+   } while (bytes < 0 && errno == EINTR);
+   if (bytes < 0) {
+      _errno = errno;
+      switch (_errno) {
+      case EINVAL:
+	 Info1("splice() not supported on fd %d, using read()", rfd);
+	 in->nosplice = true;
+	 return XIOSPLICE_FALLBACK;
+      case EAGAIN:
+	 break;
+      case EPIPE: case ECONNRESET:
+	 Warn4("splice(%d, NULL, %d, NULL, "F_Zu", ...): %s",
+	       rfd, in->splicefd[1], bufsiz, strerror(_errno));
+	 in->eof = 2;
+	 break;
+      default:
+	 Error4("splice(%d, NULL, %d, NULL, "F_Zu", ...): %s",
+		rfd, in->splicefd[1], bufsiz, strerror(_errno));
+	 in->eof = 2;
+      }
+      errno = _errno;
+      return -1;
+   }
+   in->actbytes -= bytes;
+ eof:
+   if (bytes == 0) {
+      if (!(in->ignoreeof && !in->closing)) {
+	 in->eof = 2;
+	 in->closing = MAX(in->closing, 1);
+      }
+      return 0;
+   }
+
+   /* the kernel pipe must be empty again before we return */
+   while (done < bytes) {
+      do {
+	 writt = Splice(in->splicefd[0], NULL, wfd, NULL, bytes-done,
+			SPLICE_F_MOVE);
+      } while (writt < 0 && errno == EINTR);
+      if (writt >= 0) {
+	 done += writt;
+	 continue;
+      }
+      _errno = errno;
+      if (_errno == EAGAIN || _errno == EINVAL) {
+	 /* output fd is full or does not support splice(); pass the
+	    remaining data through the buffer, xiowrite() keeps what the fd
+	    does not take */
+	 if (_errno == EINVAL) {
+	    Info1("splice() not supported on fd %d, using write()", wfd);
+	    in->nosplice = true;
+	 }
+	 while (done < bytes) {
+	    ssize_t n;
+	    do {
+	       n = Read(in->splicefd[0], buff, Min(bufsiz, (size_t)(bytes-done)));
+	    } while (n < 0 && errno == EINTR);
+	    if (n <= 0) {
+	       Error2("read(%d, ...): %s", in->splicefd[0],
+		      n<0?strerror(errno):"unexpected EOF");
+	       return -1;
+	    }
+	    if (xiowrite(outpipe, buff, n) < 0) {
+	       return -1;
+	    }
+	    done += n;
+	 }
+	 break;
+      }
+      switch (_errno) {
+      case EPIPE:
+      case ECONNRESET:
+	 if (out->cool_write) {
+	    Notice4("splice(%d, NULL, %d, NULL, "F_Zu", ...): %s",
+		    in->splicefd[0], wfd, bytes-done, strerror(_errno));
+	    break;
+	 }
+	 /*PASSTRHOUGH*/
+      default:
+	 Error4("splice(%d, NULL, %d, NULL, "F_Zu", ...): %s",
+		in->splicefd[0], wfd, bytes-done, strerror(_errno));
+      }
+      errno = _errno;
+      return -1;
+   }
+   Info3("transferred "F_Zd" bytes from %d to %d (splice)", done, rfd, wfd);
+   return done;
+}
+#endif /* HAVE_SPLICE */
+
+
 #define CR '\r'
 #define LF '\n'
 
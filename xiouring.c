@@ -0,0 +1,494 @@
+/* source: xiouring.c */
+/* Copyright Gerhard Rieger */
+/* Published under the GNU General Public License V.2, see file COPYING */
+
+/* this is the source of the io_uring data transfer engine (option -e) */
+
+#include "xiosysincludes.h"
+
+#include "mytypes.h"
+#include "compat.h"
+#include "error.h"
+
+#include "sycls.h"
+#include "xio.h"
+
+#if HAVE_IO_URING
+
+#define XIOURING_ENTRIES 16	/* per direction at most poll+read+write */
+
+/* kinds of submitted requests, in user_data together with the direction */
+#define XIOURING_READ  0
+#define XIOURING_WRITE 1
+#define XIOURING_POLLIN  2	/* on the input fd, before a read */
+#define XIOURING_POLLOUT 3	/* on the output fd, before a write */
+#define XIOURING_UDATA(dir,op) ((__u64)(dir)<<2|(op))
+
+/* the mapped submission and completion rings */
+struct xiouring {
+   int fd;
+   unsigned int features;
+   void *sqmap;  size_t sqmapsz;
+   void *cqmap;  size_t cqmapsz;
+   struct io_uring_sqe *sqes;  size_t sqessz;
+   unsigned int *sqhead, *sqtail, *sqmask, *sqarray;
+   unsigned int *cqhead, *cqtail, *cqmask;
+   struct io_uring_cqe *cqes;
+   unsigned int sqlocal;	/* our tail, published with xiouring_enter() */
+   unsigned int tosubmit;
+   bool fixed;			/* buffers are registered */
+} ;
+
+/* state of one transfer direction */
+struct xiouring_dir {
+   int num;			/* 1: sock1 to sock2, 2: sock2 to sock1 */
+   xiofile_t *in, *out;
+   int rfd, wfd;
+   unsigned char *buff;	/* registered with index num-1 */
+   size_t wlen;			/* bytes read into buff */
+   size_t woff;			/* bytes of buff already written */
+   int inflight;		/* submitted but not yet completed requests */
+   bool rdagain;		/* read returned EAGAIN, poll first */
+   bool wragain;		/* write returned EAGAIN, poll first */
+   bool eof;			/* EOF or error, do not read again */
+   bool done;			/* EOF handled */
+   bool idle;			/* input fd not open for reading */
+   bool moved;			/* data were read or written since last wait */
+} ;
+
+static int xiouring_init(struct xiouring *ring);
+static void xiouring_exit(struct xiouring *ring);
+static bool xiouring_usable(xiofile_t *in, xiofile_t *out);
+
+
+/* the rings are shared with the kernel: read its indices with acquire and
+   publish ours with release semantics */
+static struct io_uring_sqe *xiouring_sqe(struct xiouring *ring) {
+   unsigned int head = __atomic_load_n(ring->sqhead, __ATOMIC_ACQUIRE);
+   struct io_uring_sqe *sqe;
+
+   if (ring->sqlocal - head >= XIOURING_ENTRIES) {
+      return NULL;	/* cannot happen with our few requests */
+   }
+   sqe = &ring->sqes[ring->sqlocal & *ring->sqmask];
+   memset(sqe, 0, sizeof(*sqe));
+   ring->sqarray[ring->sqlocal & *ring->sqmask] =
+      ring->sqlocal & *ring->sqmask;
+   ++ring->sqlocal;
+   ++ring->tosubmit;
+   return sqe;
+}
+
+static void xiouring_prep_rw(struct xiouring *ring, struct io_uring_sqe *sqe,
+			     int op, int fd, void *addr, size_t len,
+			     int bufindex) {
+   if (ring->fixed) {
+      sqe->opcode = (op == XIOURING_READ) ?
+	 IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+      sqe->buf_index = bufindex;
+   } else {
+      sqe->opcode = (op == XIOURING_READ) ? IORING_OP_READ : IORING_OP_WRITE;
+   }
+   sqe->fd = fd;
+   sqe->addr = (__u64)(unsigned long)addr;
+   sqe->len = len;
+   sqe->off = (__u64)-1;	/* use and advance the file position */
+}
+
+static void xiouring_prep_poll(struct io_uring_sqe *sqe, int fd,
+			       unsigned int events) {
+   sqe->opcode = IORING_OP_POLL_ADD;
+   sqe->fd = fd;
+   sqe->poll32_events = events;
+}
+
+/* submits the next requests of a direction: a read of at most bufsiz bytes
+   that is linked to a write of the full buffer, so a complete block is
+   written without another round trip. When the read is short the kernel
+   cancels the write and we submit it with the correct length. */
+static int xiouring_submit(struct xiouring *ring, struct xiouring_dir *dir,
+			   size_t bufsiz) {
+   struct single *in = XIO_RDSTREAM(dir->in);
+   struct io_uring_sqe *sqe;
+
+   if (dir->woff < dir->wlen) {
+      /* the last write was short or failed with EAGAIN */
+      if (dir->wragain) {
+	 if ((sqe = xiouring_sqe(ring)) == NULL)  return -1;
+	 xiouring_prep_poll(sqe, dir->wfd, POLLOUT);
+	 sqe->flags = IOSQE_IO_LINK;
+	 sqe->user_data = XIOURING_UDATA(dir->num, XIOURING_POLLOUT);
+	 ++dir->inflight;
+	 dir->wragain = false;
+      }
+      if ((sqe = xiouring_sqe(ring)) == NULL)  return -1;
+      xiouring_prep_rw(ring, sqe, XIOURING_WRITE, dir->wfd,
+		       dir->buff+dir->woff, dir->wlen-dir->woff, dir->num-1);
+      sqe->user_data = XIOURING_UDATA(dir->num, XIOURING_WRITE);
+      ++dir->inflight;
+      return 0;
+   }
+
+   if (in->readbytes) {
+      if (in->actbytes == 0) {
+	 dir->eof = true;	/* EOF by count */
+	 return 0;
+      }
+      if (in->actbytes < bufsiz) {
+	 bufsiz = in->actbytes;
+      }
+   }
+   dir->wlen = dir->woff = 0;
+   if (dir->rdagain) {
+      if ((sqe = xiouring_sqe(ring)) == NULL)  return -1;
+      xiouring_prep_poll(sqe, dir->rfd, POLLIN);
+      sqe->flags = IOSQE_IO_LINK;
+      sqe->user_data = XIOURING_UDATA(dir->num, XIOURING_POLLIN);
+      ++dir->inflight;
+      dir->rdagain = false;
+   }
+   if ((sqe = xiouring_sqe(ring)) == NULL)  return -1;
+   xiouring_prep_rw(ring, sqe, XIOURING_READ, dir->rfd, dir->buff, bufsiz,
+		    dir->num-1);
+   sqe->flags = IOSQE_IO_LINK;
+   sqe->user_data = XIOURING_UDATA(dir->num, XIOURING_READ);
+   ++dir->inflight;
+   if ((sqe = xiouring_sqe(ring)) == NULL)  return -1;
+   xiouring_prep_rw(ring, sqe, XIOURING_WRITE, dir->wfd, dir->buff, bufsiz,
+		    dir->num-1);
+   sqe->user_data = XIOURING_UDATA(dir->num, XIOURING_WRITE);
+   ++dir->inflight;
+   return 0;
+}
+
+/* evaluates one completion */
+static void xiouring_complete(struct xiouring_dir *dir, int op, int res) {
+   struct single *in  = XIO_RDSTREAM(dir->in);
+   struct single *out = XIO_WRSTREAM(dir->out);
+
+   --dir->inflight;
+   switch (op) {
+   case XIOURING_READ:
+      if (res > 0) {
+	 dir->wlen = res;
+	 dir->moved = true;
+	 if (in->readbytes) {
+	    in->actbytes -= res;
+	 }
+      } else if (res == 0) {
+	 dir->eof = true;
+      } else if (res == -EAGAIN) {
+	 dir->rdagain = true;
+      } else if (res != -ECANCELED) {
+	 Error2("read(%d, ...): %s", dir->rfd, strerror(-res));
+	 dir->eof = true;
+      }
+      break;
+   case XIOURING_WRITE:
+      if (res >= 0) {
+	 Info3("transferred %d bytes from %d to %d", res, dir->rfd, dir->wfd);
+	 dir->woff += res;
+	 dir->moved = true;
+      } else if (res == -EAGAIN) {
+	 dir->wragain = true;
+      } else if (res == -ECANCELED) {
+	 ;	/* short read before, or poll failed */
+      } else if ((res == -EPIPE || res == -ECONNRESET) && out->cool_write) {
+	 Notice2("write(%d, ...): %s", dir->wfd, strerror(-res));
+	 dir->eof = true;
+      } else {
+	 Error2("write(%d, ...): %s", dir->wfd, strerror(-res));
+	 dir->eof = true;
+      }
+      break;
+   case XIOURING_POLLIN:
+   case XIOURING_POLLOUT:
+      if (res < 0 && res != -ECANCELED) {
+	 Error2("poll(%d, ...): %s",
+		op == XIOURING_POLLIN ? dir->rfd : dir->wfd, strerror(-res));
+	 dir->eof = true;
+      }
+      break;
+   }
+}
+
+/* submits what is queued and waits for at least one completion or the
+   timeout. Returns the number of reaped completions, or -1 on error.
+   An expired timeout or a signal just return 0; the caller compares the time
+   with its deadline and reevaluates the closing state */
+static int xiouring_wait(struct xiouring *ring, struct xiouring_dir dirs[2],
+			 const struct timeval *timeout) {
+   struct io_uring_getevents_arg arg;
+   struct __kernel_timespec ts;
+   unsigned int head, tail;
+   int n = 0, result;
+
+   memset(&arg, 0, sizeof(arg));
+   if (timeout) {
+      ts.tv_sec = timeout->tv_sec;
+      ts.tv_nsec = timeout->tv_usec * 1000;
+      arg.ts = (__u64)(unsigned long)&ts;
+   }
+   __atomic_store_n(ring->sqtail, ring->sqlocal, __ATOMIC_RELEASE);
+   result = Io_uring_enter(ring->fd, ring->tosubmit, 1,
+			   IORING_ENTER_GETEVENTS|IORING_ENTER_EXT_ARG,
+			   &arg, sizeof(arg));
+   if (result >= 0) {
+      ring->tosubmit -= Min((unsigned int)result, ring->tosubmit);
+   } else if (errno != ETIME && errno != EINTR && errno != EBUSY) {
+      Error2("io_uring_enter(%d, ...): %s", ring->fd, strerror(errno));
+      return -1;
+   }
+
+   head = *ring->cqhead;
+   tail = __atomic_load_n(ring->cqtail, __ATOMIC_ACQUIRE);
+   while (head != tail) {
+      struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cqmask];
+      int num = cqe->user_data >> 2;
+      xiouring_complete(&dirs[num-1], cqe->user_data & 3, cqe->res);
+      ++head;  ++n;
+   }
+   __atomic_store_n(ring->cqhead, head, __ATOMIC_RELEASE);
+   return n;
+}
+
+/* when the end of a direction is reached and nothing is pending any more
+   pass the EOF on to the other side, like the poll engine does */
+static void xiouring_finish(struct xiouring_dir *dir) {
+   Notice2("socket %d (fd %d) is at EOF", dir->num, dir->rfd);
+   xioshutdown(dir->out, SHUT_WR);
+   XIO_RDSTREAM(dir->in)->eof = 2;
+   XIO_RDSTREAM(dir->out)->closing =
+      MAX(XIO_RDSTREAM(dir->out)->closing, 1);
+   dir->done = true;
+}
+
+
+/* transfers data between sock1 and sock2 like _socat(), but with io_uring.
+   Returns XIOURING_FALLBACK when the kernel or the addresses do not allow
+   it; otherwise closes both sockets and returns 0, or -1 on error */
+int xiouring_socat(xiofile_t *sock1, xiofile_t *sock2) {
+   struct xiouring ring;
+   struct xiouring_dir dirs[2];
+   size_t bufsiz = xioparams->bufsiz;
+   struct iovec iov[2];
+   struct timeval now, deadline, rest;
+   bool timed, closing = false;
+   int i, result = 0;
+
+   /* the process does not wait for the threads of inter addresses when it
+      exits; their engine must pass the last data on with minimal latency,
+      which poll() does better than io_uring's deferred completions */
+   if (Gettid() != Getpid()) {
+      Info("io_uring engine is only used in the main thread, using poll");
+      return XIOURING_FALLBACK;
+   }
+
+   memset(dirs, 0, sizeof(dirs));
+   dirs[0].num = 1;  dirs[0].in = sock1;  dirs[0].out = sock2;
+   dirs[1].num = 2;  dirs[1].in = sock2;  dirs[1].out = sock1;
+   for (i = 0; i < 2; ++i) {
+      if (!XIO_READABLE(dirs[i].in)) {
+	 dirs[i].done = true;
+	 continue;
+      }
+      if (!xiouring_usable(dirs[i].in, dirs[i].out)) {
+	 Info("addresses need features that io_uring engine does not provide, using poll");
+	 return XIOURING_FALLBACK;
+      }
+      dirs[i].rfd = XIO_GETRDFD(dirs[i].in);
+      dirs[i].wfd = XIO_GETWRFD(dirs[i].out);
+      /* e.g. FD:1 in bidirectional context; poll() would never report it
+	 readable, so this direction just never transfers data */
+      if ((Fcntl(dirs[i].rfd, F_GETFL) & O_ACCMODE) == O_WRONLY) {
+	 Info1("fd %d is not open for reading", dirs[i].rfd);
+	 dirs[i].idle = true;
+      }
+   }
+
+   if (xiouring_init(&ring) < 0) {
+      return XIOURING_FALLBACK;
+   }
+   for (i = 0; i < 2; ++i) {
+      if ((dirs[i].buff = Malloc(bufsiz)) == NULL) {
+	 xiouring_exit(&ring);
+	 free(dirs[0].buff);
+	 return -1;
+      }
+      iov[i].iov_base = dirs[i].buff;
+      iov[i].iov_len  = bufsiz;
+   }
+   /* registered buffers save the page mapping per request; it is only an
+      optimization, e.g. RLIMIT_MEMLOCK may not allow it */
+   if (Io_uring_register(ring.fd, IORING_REGISTER_BUFFERS, iov, 2) < 0) {
+      Info1("io_uring_register(): %s, not using fixed buffers",
+	    strerror(errno));
+   } else {
+      ring.fixed = true;
+   }
+
+   Notice4("starting io_uring data transfer loop with FDs [%d,%d] and [%d,%d]",
+	   XIO_READABLE(sock1)?XIO_GETRDFD(sock1):-1,
+	   XIO_WRITABLE(sock1)?XIO_GETWRFD(sock1):-1,
+	   XIO_READABLE(sock2)?XIO_GETRDFD(sock2):-1,
+	   XIO_WRITABLE(sock2)?XIO_GETWRFD(sock2):-1);
+   /* one deadline for the inactivity timeout, moved only when data were
+      transferred, and after the first EOF one for the closing timeout */
+   timed = (xioparams->total_timeout.tv_sec != 0 ||
+	    xioparams->total_timeout.tv_usec != 0);
+   if (timed) {
+      gettimeofday(&now, NULL);
+      timeradd(&now, &xioparams->total_timeout, &deadline);
+   }
+   while (!dirs[0].done || !dirs[1].done) {
+
+      for (i = 0; i < 2; ++i) {
+	 struct xiouring_dir *dir = &dirs[i];
+	 if (dir->done || dir->idle || dir->inflight > 0)
+	    continue;
+	 if (!dir->eof && xiouring_submit(&ring, dir, bufsiz) < 0) {
+	    Error("io_uring submission queue overflow");
+	    result = -1;
+	    break;
+	 }
+	 if (dir->eof && dir->inflight == 0) {
+	    xiouring_finish(dir);
+	 }
+      }
+      if (result < 0 || (dirs[0].done && dirs[1].done))
+	 break;
+
+      if (!closing &&
+	  (XIO_RDSTREAM(sock1)->closing>=1 || XIO_RDSTREAM(sock2)->closing>=1)) {
+	 /* first eof already occurred, start end timer */
+	 closing = timed = true;
+	 gettimeofday(&now, NULL);
+	 timeradd(&now, &xioparams->closwait, &deadline);
+      }
+      if (timed) {
+	 gettimeofday(&now, NULL);
+	 if (!timercmp(&now, &deadline, <)) {
+	    if (!closing) {
+	       Notice("inactivity timeout triggered");
+	    }
+	    break;
+	 }
+	 timersub(&deadline, &now, &rest);
+      }
+      if (xiouring_wait(&ring, dirs, timed ? &rest : NULL) < 0) {
+	 result = -1;
+	 break;
+      }
+      if (!closing && timed && (dirs[0].moved || dirs[1].moved)) {
+	 gettimeofday(&now, NULL);
+	 timeradd(&now, &xioparams->total_timeout, &deadline);
+      }
+      dirs[0].moved = dirs[1].moved = false;
+   }
+
+   /* closing the ring cancels requests that are still pending */
+   xiouring_exit(&ring);
+   free(dirs[0].buff);
+   free(dirs[1].buff);
+   xioclose(sock1);
+   xioclose(sock2);
+   return result;
+}
+
+/* the io_uring engine does plain reads and writes only */
+static bool xiouring_usable(xiofile_t *inpipe, xiofile_t *outpipe) {
+   struct single *in  = XIO_RDSTREAM(inpipe);
+   struct single *out = XIO_WRSTREAM(outpipe);
+
+   if ((in->dtype & XIODATA_READMASK) != XIOREAD_STREAM ||
+       (out->dtype & XIODATA_WRITEMASK) != XIOWRITE_STREAM ||
+       (out->dtype & XIODATA_READMASK) == XIOREAD_READLINE)
+      return false;
+   if (in->escape != -1 || in->lineterm != out->lineterm || in->ignoreeof)
+      return false;
+   if (xioparams->verbose || xioparams->verbhex)
+      return false;
+   return true;
+}
+
+/* creates the ring and maps its queues into our address space.
+   returns 0 on success, or -1 when the kernel does not support what we
+   need */
+static int xiouring_init(struct xiouring *ring) {
+   struct io_uring_params p;
+
+   memset(ring, 0, sizeof(*ring));
+   memset(&p, 0, sizeof(p));
+   if ((ring->fd = Io_uring_setup(XIOURING_ENTRIES, &p)) < 0) {
+      Info1("io_uring_setup(): %s, using poll", strerror(errno));
+      return -1;
+   }
+   Fcntl_l(ring->fd, F_SETFD, FD_CLOEXEC);
+   ring->features = p.features;
+   if (!(p.features & IORING_FEAT_EXT_ARG)) {
+      Info("io_uring does not support timeouts, using poll");
+      Close(ring->fd);
+      return -1;
+   }
+
+   ring->sqmapsz = p.sq_off.array + p.sq_entries*sizeof(unsigned int);
+   ring->cqmapsz = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+   if (p.features & IORING_FEAT_SINGLE_MMAP) {
+      ring->sqmapsz = ring->cqmapsz = Max(ring->sqmapsz, ring->cqmapsz);
+   }
+   ring->sqmap = mmap(NULL, ring->sqmapsz, PROT_READ|PROT_WRITE,
+		      MAP_SHARED|MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+   if (ring->sqmap == MAP_FAILED) {
+      Info1("mmap(io_uring): %s, using poll", strerror(errno));
+      Close(ring->fd);
+      return -1;
+   }
+   if (p.features & IORING_FEAT_SINGLE_MMAP) {
+      ring->cqmap = ring->sqmap;
+   } else {
+      ring->cqmap = mmap(NULL, ring->cqmapsz, PROT_READ|PROT_WRITE,
+			 MAP_SHARED|MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+      if (ring->cqmap == MAP_FAILED) {
+	 Info1("mmap(io_uring): %s, using poll", strerror(errno));
+	 munmap(ring->sqmap, ring->sqmapsz);
+	 Close(ring->fd);
+	 return -1;
+      }
+   }
+   ring->sqessz = p.sq_entries*sizeof(struct io_uring_sqe);
+   ring->sqes = mmap(NULL, ring->sqessz, PROT_READ|PROT_WRITE,
+		     MAP_SHARED|MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+   if (ring->sqes == MAP_FAILED) {
+      Info1("mmap(io_uring): %s, using poll", strerror(errno));
+      if (ring->cqmap != ring->sqmap)  munmap(ring->cqmap, ring->cqmapsz);
+      munmap(ring->sqmap, ring->sqmapsz);
+      Close(ring->fd);
+      return -1;
+   }
+
+   ring->sqhead  = (unsigned int *)((char *)ring->sqmap + p.sq_off.head);
+   ring->sqtail  = (unsigned int *)((char *)ring->sqmap + p.sq_off.tail);
+   ring->sqmask  = (unsigned int *)((char *)ring->sqmap + p.sq_off.ring_mask);
+   ring->sqarray = (unsigned int *)((char *)ring->sqmap + p.sq_off.array);
+   ring->cqhead  = (unsigned int *)((char *)ring->cqmap + p.cq_off.head);
+   ring->cqtail  = (unsigned int *)((char *)ring->cqmap + p.cq_off.tail);
+   ring->cqmask  = (unsigned int *)((char *)ring->cqmap + p.cq_off.ring_mask);
+   ring->cqes = (struct io_uring_cqe *)((char *)ring->cqmap + p.cq_off.cqes);
+   ring->sqlocal = *ring->sqtail;
+   return 0;
+}
+
+static void xiouring_exit(struct xiouring *ring) {
+   munmap(ring->sqes, ring->sqessz);
+   if (ring->cqmap != ring->sqmap)  munmap(ring->cqmap, ring->cqmapsz);
+   munmap(ring->sqmap, ring->sqmapsz);
+   Close(ring->fd);
+}
+
+#else /* !HAVE_IO_URING */
+
+int xiouring_socat(xiofile_t *sock1, xiofile_t *sock2) {
+   return XIOURING_FALLBACK;
+}
+
+#endif /* !HAVE_IO_URING */
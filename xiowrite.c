@@ -13,6 +13,22 @@
 #include "xio-openssl.h"
 
 
+static int xiowqueue(struct single *pipe, const void *buff, size_t bytes);
+#if HAVE_UDP_GSO
+#define XIOGSO_FALLBACK	(-2)	/* not a datagram socket, write as is */
+#define XIOGSO_MAXSEGS	64	/* UDP_MAX_SEGMENTS of older kernels */
+static ssize_t xiowrite_segments(struct single *pipe, const void *buff,
+				 size_t bytes, size_t segsize);
+#endif /* HAVE_UDP_GSO */
+#if WITH_OPENSSL
+static ssize_t xiowrite_ssl(struct single *pipe, const void *buff,
+			    size_t bytes);
+static ssize_t xiocoalesce(struct single *pipe, const void *buff,
+			   size_t bytes);
+static int xiocoalesce_flush(struct single *pipe);
+#endif /* WITH_OPENSSL */
+
+
 /* ...
    note that the write() call can block even if the select()/poll() call
    reported the FD writeable: in case the FD is not nonblocking and a lock
@@ -23,6 +39,9 @@ ssize_t xiowrite(xiofile_t *file, const void *buff, size_t bytes) {
    struct single *pipe;
    int fd;
    int _errno;
+#if HAVE_UDP_GSO
+   size_t segsize;
+#endif
 
    if (file->tag == XIO_TAG_INVALID) {
       Error1("xiowrite(): invalid xiofile descriptor %p", file);
@@ -49,11 +68,46 @@ ssize_t xiowrite(xiofile_t *file, const void *buff, size_t bytes) {
 #endif /* WITH_READLINE */
 
    fd = XIO_GETWRFD(file);
+#if HAVE_UDP_GSO
+   /* the data is a datagram that UDP GRO coalesced from segments of this
+      size; only valid for this call */
+   segsize = pipe->segsize;
+   pipe->segsize = 0;
+#endif
 
    switch (pipe->dtype & XIODATA_WRITEMASK) {
 
    case XIOWRITE_STREAM:
-      writt = writefull(pipe->wfd, buff, bytes);
+   case XIOWRITE_PIPE:
+   case XIOWRITE_2PIPE:
+      if (pipe->wqlen > 0) {
+	 /* keep the order: append to what is already pending */
+	 if (xiowqueue(pipe, buff, bytes) < 0) {
+	    return -1;
+	 }
+	 writt = bytes;
+	 break;
+      }
+#if HAVE_UDP_GSO
+      if (segsize != 0 && bytes > segsize &&
+	  (writt = xiowrite_segments(pipe, buff, bytes, segsize))
+	  != XIOGSO_FALLBACK) {
+	 /* xiowrite_segments() printed its error messages */
+	 if (writt < 0) {
+	    return -1;
+	 }
+	 break;
+      }
+#endif /* HAVE_UDP_GSO */
+      writt = writeavail(pipe->wfd, buff, bytes);
+      if (writt >= 0 && (size_t)writt < bytes) {
+	 /* nonblocking fd is full; the rest is written by xioflush() */
+	 if (xiowqueue(pipe, (const char *)buff+writt, bytes-writt) < 0) {
+	    return -1;
+	 }
+	 writt = bytes;
+	 break;
+      }
       if (writt < 0) {
 	 _errno = errno;
 	 switch (_errno) {
@@ -82,6 +136,28 @@ ssize_t xiowrite(xiofile_t *file, const void *buff, size_t bytes) {
 	 } from;*/
       /*socklen_t fromlen;*/
 
+#if HAVE_UDP_GSO
+      if (segsize != 0 && bytes > segsize) {
+	 /* this function prints its own error messages */
+	 if ((writt = xiowrite_segments(pipe, buff, bytes, segsize)) < 0) {
+	    return -1;
+	 }
+	 break;
+      }
+#endif /* HAVE_UDP_GSO */
+#if HAVE_MMSG
+      if (xiommsg_usable(pipe, true)) {
+	 /* the batch is sent by xioflush() */
+	 if ((writt = xiommsg_send(pipe, buff, bytes)) < 0) {
+	    return -1;
+	 }
+	 if (writt > 0) {
+	    writt = bytes;
+	    break;
+	 }
+	 /* too large for the batch, send it now */
+      }
+#endif /* HAVE_MMSG */
       do {
 	 writt = Sendto(fd, buff, bytes, 0,
 			&pipe->peersa.soa, pipe->salen);
@@ -106,29 +182,25 @@ ssize_t xiowrite(xiofile_t *file, const void *buff, size_t bytes) {
 	       pipe->salen, writt, bytes);
       } else {
       }
-      {
+      if (diag_get_int('D') <= E_NOTICE) {
+	 /* the local address does not change after the first packet, when
+	    the socket has been bound at the latest */
 	 char infobuff[256];
-	 union sockaddr_union us;
-	 socklen_t uslen = sizeof(us);
-	 Getsockname(fd, &us.soa, &uslen);
-	 Notice1("local address: %s",
-		 sockaddr_info(&us.soa, uslen, infobuff, sizeof(infobuff)));
+	 if (pipe->loclen == 0) {
+	    socklen_t uslen = sizeof(pipe->locsa);
+	    if (Getsockname(fd, &pipe->locsa.soa, &uslen) == 0) {
+	       pipe->loclen = uslen;
+	    }
+	 }
+	 if (pipe->loclen != 0) {
+	    Notice1("local address: %s",
+		    sockaddr_info(&pipe->locsa.soa, pipe->loclen,
+				  infobuff, sizeof(infobuff)));
+	 }
       }
       break;
 #endif /* _WITH_SOCKET */
 
-   case XIOWRITE_PIPE:
-   case XIOWRITE_2PIPE:
-      writt = Write(pipe->wfd, buff, bytes);
-      _errno = errno;
-      if (writt < 0) {
-	 Error4("write(%d, %p, "F_Zu"): %s",
-		fd, buff, bytes, strerror(_errno));
-	 errno = _errno;
-	 return -1;
-      }
-      break;
-
 #if WITH_TEST
    case XIOWRITE_TEST:
       /* this function prints its own error messages */
@@ -140,10 +212,54 @@ ssize_t xiowrite(xiofile_t *file, const void *buff, size_t bytes) {
 
 #if WITH_OPENSSL
    case XIOWRITE_OPENSSL:
-      /* this function prints its own error messages */
-      return xiowrite_openssl(pipe, buff, bytes);
+      if (pipe->para.openssl.coalescing) {
+	 return xiocoalesce(pipe, buff, bytes);
+      }
+      return xiowrite_ssl(pipe, buff, bytes);
 #endif /* WITH_OPENSSL */
 
+   case XIOWRITE_LAYER:
+      /* the layer and the lower addresses print their error messages */
+      writt = pipe->layer->write(pipe, buff, bytes);
+      /* what the lower address queued is pending for the layer too, so the
+	 transfer engine waits for it */
+      pipe->wqlen = XIO_WRSTREAM(pipe->lower)->wqlen;
+      return writt;
+
+#if HAVE_SHMRINGS
+   case XIOWRITE_RING:
+      if (pipe->wqlen > 0) {
+	 /* keep the order: append to what is already pending */
+	 if (xiowqueue(pipe, buff, bytes) < 0) {
+	    return -1;
+	 }
+	 writt = bytes;
+	 break;
+      }
+      /* like a nonblocking write(), takes what fits into the ring */
+      if ((writt = xioring_write(pipe->wring, buff, bytes)) < 0) {
+	 _errno = errno;
+	 if (_errno != EAGAIN) {
+	    if (_errno == EPIPE && pipe->cool_write) {
+	       Notice2("write to ring (eventfd %d): %s", fd, strerror(_errno));
+	    } else {
+	       Error2("write to ring (eventfd %d): %s", fd, strerror(_errno));
+	    }
+	    errno = _errno;
+	    return -1;
+	 }
+	 writt = 0;
+      }
+      if ((size_t)writt < bytes) {
+	 /* the ring is full; the rest is written by xioflush() */
+	 if (xiowqueue(pipe, (const char *)buff+writt, bytes-writt) < 0) {
+	    return -1;
+	 }
+	 writt = bytes;
+      }
+      break;
+#endif /* HAVE_SHMRINGS */
+
    default:
       Error1("xiowrite(): bad data type specification %d", pipe->dtype);
       errno = EINVAL;
@@ -151,3 +267,401 @@ ssize_t xiowrite(xiofile_t *file, const void *buff, size_t bytes) {
    }
    return writt;
 }
+
+
+/* stores data that a nonblocking write() did not take. While data is pending
+   the transfer engine does not read more data for this direction but waits
+   until the fd becomes writeable and calls xioflush() */
+static int xiowqueue(struct single *pipe, const void *buff, size_t bytes) {
+   if (pipe->wqlen + bytes > pipe->wqsize) {
+      unsigned char *wqbuff;
+      if ((wqbuff = Realloc(pipe->wqbuff, pipe->wqlen + bytes)) == NULL) {
+	 return -1;
+      }
+      pipe->wqbuff = wqbuff;
+      pipe->wqsize = pipe->wqlen + bytes;
+   }
+   memcpy(pipe->wqbuff + pipe->wqlen, buff, bytes);
+   pipe->wqlen += bytes;
+   Info2("write(%d, ...): "F_Zu" bytes pending", pipe->wfd, pipe->wqlen);
+   return 0;
+}
+
+#if WITH_OPENSSL
+/* passes data to SSL_write(). While earlier data is pending, or when
+   SSL_write() cannot complete on a nonblocking fd, the data are queued and
+   xioflush() repeats the SSL_write() with them */
+static ssize_t xiowrite_ssl(struct single *pipe, const void *buff,
+			    size_t bytes) {
+   ssize_t writt;
+
+   if (pipe->wqlen > 0) {
+      /* keep the order: append to what is already pending */
+      if (xiowqueue(pipe, buff, bytes) < 0) {
+	 return -1;
+      }
+      return bytes;
+   }
+   /* this function prints its own error messages */
+   writt = xiowrite_openssl(pipe, buff, bytes);
+   if (writt < 0 && errno == EAGAIN) {
+      if (xiowqueue(pipe, buff, bytes) < 0) {
+	 return -1;
+      }
+      pipe->para.openssl.wretry = bytes;
+      return bytes;
+   }
+   return writt;
+}
+
+/* with option coalesce: collects data in cbuff instead of making a TLS
+   record of each write. The collected data are encrypted when they fill a
+   record, or when xioflush() finds that they waited long enough */
+static ssize_t xiocoalesce(struct single *pipe, const void *buff,
+			   size_t bytes) {
+   const unsigned char *data = buff;
+   size_t rest = bytes, n;
+
+   if (pipe->para.openssl.clen == 0 && bytes >= SSL3_RT_MAX_PLAIN_LENGTH) {
+      /* nothing to combine with, SSL_write() makes full records */
+      return xiowrite_ssl(pipe, buff, bytes);
+   }
+   if (pipe->para.openssl.cbuff == NULL &&
+       (pipe->para.openssl.cbuff = Malloc(SSL3_RT_MAX_PLAIN_LENGTH))
+       == NULL) {
+      return -1;
+   }
+   while (rest > 0) {
+      if (pipe->para.openssl.clen == 0) {
+	 gettimeofday(&pipe->para.openssl.csince, NULL);
+      }
+      n = MIN(rest, SSL3_RT_MAX_PLAIN_LENGTH - pipe->para.openssl.clen);
+      memcpy(pipe->para.openssl.cbuff + pipe->para.openssl.clen, data, n);
+      pipe->para.openssl.clen += n;
+      data += n;  rest -= n;
+      if (pipe->para.openssl.clen == SSL3_RT_MAX_PLAIN_LENGTH &&
+	  xiocoalesce_flush(pipe) < 0) {
+	 return -1;
+      }
+   }
+   return bytes;
+}
+
+/* encrypts the collected data, see xiocoalesce().
+   returns 0 on success, or -1 on error */
+static int xiocoalesce_flush(struct single *pipe) {
+   size_t len = pipe->para.openssl.clen;
+
+   if (len == 0) {
+      return 0;
+   }
+   Debug2("SSL_write(): "F_Zu" bytes collected with coalesce, fd %d",
+	  len, pipe->wfd);
+   pipe->para.openssl.clen = 0;
+   return xiowrite_ssl(pipe, pipe->para.openssl.cbuff, len) < 0 ? -1 : 0;
+}
+#endif /* WITH_OPENSSL */
+
+#if HAVE_UDP_GSO
+/* writes a datagram that UDP GRO coalesced from segments of segsize bytes to
+   the datagram socket of pipe so that the segments arrive as individual
+   packets: on a UDP socket with sendmsg() and UDP_SEGMENT (GSO), up to
+   XIOGSO_MAXSEGS segments per call; on other datagram sockets, or when the
+   kernel refuses GSO for the socket, with one sendmsg() per segment.
+   returns the number of bytes, or -1 on error, or XIOGSO_FALLBACK when pipe
+   is not a datagram socket */
+static ssize_t xiowrite_segments(struct single *pipe, const void *buff,
+				 size_t bytes, size_t segsize) {
+   struct msghdr msgh = {0};
+   struct iovec iov;
+   union {
+      char space[CMSG_SPACE(sizeof(uint16_t))];
+      struct cmsghdr align;
+   } ctrl;
+   struct cmsghdr *cmsg;
+   uint16_t gsosize = segsize;
+   size_t done;
+   ssize_t writt;
+   int _errno;
+
+   if (pipe->usegso == 0) {
+      int type = 0, proto = 0;
+      socklen_t optlen = sizeof(type);
+
+      if (Getsockopt(pipe->wfd, SOL_SOCKET, SO_TYPE, &type, &optlen) < 0 ||
+	  type != SOCK_DGRAM) {
+	 pipe->usegso = -2;
+      } else {
+	 optlen = sizeof(proto);
+	 Getsockopt(pipe->wfd, SOL_SOCKET, SO_PROTOCOL, &proto, &optlen);
+	 pipe->usegso = (proto == IPPROTO_UDP ? 1 : -1);
+      }
+      Info2("fd %d: coalesced datagrams are written %s", pipe->wfd,
+	    pipe->usegso == 1 ? "with UDP_SEGMENT" :
+	    (pipe->usegso == -1 ? "segment by segment" : "as is"));
+   }
+   if (pipe->usegso == -2) {
+      return XIOGSO_FALLBACK;
+   }
+#if HAVE_MMSG
+   /* keep the order of the packets */
+   if (pipe->wbatch != NULL && xiommsg_flush(pipe) < 0) {
+      return -1;
+   }
+#endif /* HAVE_MMSG */
+
+   if ((pipe->dtype & XIODATA_WRITEMASK) == XIOWRITE_SENDTO) {
+      msgh.msg_name = &pipe->peersa;
+      msgh.msg_namelen = pipe->salen;
+   }
+   msgh.msg_iov = &iov;
+   msgh.msg_iovlen = 1;
+   for (done = 0; done < bytes; done += iov.iov_len) {
+      iov.iov_base = (char *)buff + done;
+      if (pipe->usegso > 0) {
+	 iov.iov_len = Min(bytes-done, XIOGSO_MAXSEGS*segsize);
+      } else {
+	 iov.iov_len = Min(bytes-done, segsize);
+      }
+      if (iov.iov_len > segsize) {
+	 msgh.msg_control = ctrl.space;
+	 msgh.msg_controllen = sizeof(ctrl.space);
+	 cmsg = CMSG_FIRSTHDR(&msgh);
+	 cmsg->cmsg_level = SOL_UDP;
+	 cmsg->cmsg_type = UDP_SEGMENT;
+	 cmsg->cmsg_len = CMSG_LEN(sizeof(gsosize));
+	 memcpy(CMSG_DATA(cmsg), &gsosize, sizeof(gsosize));
+      } else {
+	 msgh.msg_control = NULL;
+	 msgh.msg_controllen = 0;
+      }
+      do {
+	 writt = Sendmsg(pipe->wfd, &msgh, 0);
+      } while (writt < 0 && errno == EINTR);
+      if (writt < 0) {
+	 char infobuff[256];
+	 _errno = errno;
+	 if (msgh.msg_control != NULL &&
+	     (_errno == EINVAL || _errno == EIO || _errno == EOPNOTSUPP)) {
+	    /* e.g. segments larger than the MTU, or no checksum offload on the
+	       output device; retry this part segment by segment */
+	    Info2("sendmsg(%d, UDP_SEGMENT): %s, sending segment by segment",
+		  pipe->wfd, strerror(_errno));
+	    pipe->usegso = -1;
+	    iov.iov_len = 0;
+	    continue;
+	 }
+	 Error6("sendmsg(%d, {%s,,%p,"F_Zu"}, 0): %s, dropping "F_Zu" bytes",
+		pipe->wfd,
+		msgh.msg_name ?
+		sockaddr_info(&pipe->peersa.soa, pipe->salen,
+			      infobuff, sizeof(infobuff)) : "",
+		iov.iov_base, iov.iov_len, strerror(_errno), bytes-done);
+	 errno = _errno;
+	 return -1;
+      }
+   }
+   return bytes;
+}
+#endif /* HAVE_UDP_GSO */
+
+/* writes as much of the pending output of file as its fd takes without
+   blocking.
+   Returns the number of bytes still pending, or -1 on error (errno valid) */
+ssize_t xioflush(xiofile_t *file) {
+   struct single *pipe = XIO_WRSTREAM(file);
+   ssize_t writt;
+   int _errno;
+
+   if ((pipe->dtype & XIODATA_WRITEMASK) == XIOWRITE_LAYER) {
+      writt = xioflush(pipe->lower);
+      pipe->wqlen = XIO_WRSTREAM(pipe->lower)->wqlen;
+      return writt;
+   }
+#if HAVE_MMSG
+   /* batched packets do not wait for the fd to become writeable */
+   if (pipe->wbatch != NULL && xiommsg_flush(pipe) < 0) {
+      return -1;
+   }
+#endif /* HAVE_MMSG */
+#if WITH_OPENSSL
+   if ((pipe->dtype & XIODATA_WRITEMASK) == XIOWRITE_OPENSSL) {
+      struct timeval due;
+      /* these functions print their own error messages */
+      if (xioflush_openssl(pipe) < 0) {
+	 return -1;
+      }
+      /* collected data go behind the queue */
+      if (xioflushtimer(file, &due) && !timerisset(&due) &&
+	  xiocoalesce_flush(pipe) < 0) {
+	 return -1;
+      }
+      return pipe->wqlen;
+   }
+#endif /* WITH_OPENSSL */
+   if (pipe->wqlen == 0) {
+      return 0;
+   }
+#if HAVE_SHMRINGS
+   if ((pipe->dtype & XIODATA_WRITEMASK) == XIOWRITE_RING) {
+      if ((writt = xioring_write(pipe->wring, pipe->wqbuff, pipe->wqlen)) < 0
+	  && errno == EAGAIN) {
+	 writt = 0;
+      }
+   } else
+#endif /* HAVE_SHMRINGS */
+   writt = writeavail(pipe->wfd, pipe->wqbuff, pipe->wqlen);
+   if (writt < 0) {
+      _errno = errno;
+      switch (_errno) {
+      case EPIPE:
+      case ECONNRESET:
+	 if (pipe->cool_write) {
+	    Notice4("write(%d, %p, "F_Zu"): %s",
+		    pipe->wfd, pipe->wqbuff, pipe->wqlen, strerror(_errno));
+	    break;
+	 }
+	 /*PASSTRHOUGH*/
+      default:
+	 Error4("write(%d, %p, "F_Zu"): %s",
+		pipe->wfd, pipe->wqbuff, pipe->wqlen, strerror(_errno));
+      }
+      pipe->wqlen = 0;	/* cannot be delivered anymore */
+      errno = _errno;
+      return -1;
+   }
+   if (writt > 0) {
+      memmove(pipe->wqbuff, pipe->wqbuff + writt, pipe->wqlen - writt);
+      pipe->wqlen -= writt;
+   }
+   return pipe->wqlen;
+}
+
+/* with option coalesce: stores in *due how long the data that file collected
+   for the next TLS record may still wait (0 when they are due) and returns 1;
+   returns 0 when no data are collected */
+int xioflushtimer(xiofile_t *file, struct timeval *due) {
+#if WITH_OPENSSL
+   struct single *pipe = XIO_WRSTREAM(file);
+   struct timeval now, deadline;
+
+   if ((pipe->dtype & XIODATA_WRITEMASK) != XIOWRITE_OPENSSL ||
+       pipe->para.openssl.clen == 0) {
+      return 0;
+   }
+   gettimeofday(&now, NULL);
+   timeradd(&pipe->para.openssl.csince, &pipe->para.openssl.coalesce,
+	    &deadline);
+   if (timercmp(&now, &deadline, <)) {
+      timersub(&deadline, &now, due);
+   } else {
+      timerclear(due);
+   }
+   return 1;
+#else
+   return 0;
+#endif /* !WITH_OPENSSL */
+}
+
+/* writes the pending output of pipe, waiting for the fd when necessary but
+   not longer than the closing timeout (-t), and releases the queue. Used
+   before shutdown and close. With wqdrop, does not wait but drops what the
+   fd does not take at once.
+   Returns 0 on success, or -1 on error or when data was dropped */
+int xiodrain(struct single *pipe) {
+   int result = 0;
+
+   if ((pipe->dtype & XIODATA_WRITEMASK) == XIOWRITE_LAYER) {
+      /* the queue is the lower address's, it drains on its own shutdown */
+      pipe->wqlen = 0;
+      return 0;
+   }
+   if (pipe->draining) {
+      return -1;
+   }
+   pipe->draining = true;
+#if HAVE_MMSG
+   if (pipe->wbatch != NULL && xiommsg_flush(pipe) < 0) {
+      result = -1;
+   }
+#endif /* HAVE_MMSG */
+#if WITH_OPENSSL
+   if ((pipe->dtype & XIODATA_WRITEMASK) == XIOWRITE_OPENSSL &&
+       pipe->para.openssl.ssl != NULL) {
+      if (xiocoalesce_flush(pipe) < 0) {
+	 result = -1;
+      }
+      free(pipe->para.openssl.cbuff);
+      pipe->para.openssl.cbuff = NULL;
+   }
+#endif /* WITH_OPENSSL */
+   if (pipe->wqlen > 0) {
+      Info2("write(%d, ...): draining "F_Zu" pending bytes",
+	    pipe->wfd, pipe->wqlen);
+#if WITH_OPENSSL
+      if ((pipe->dtype & XIODATA_WRITEMASK) == XIOWRITE_OPENSSL) {
+	 if (pipe->wqdrop) {
+	    if (xioflush_openssl(pipe) < 0) {
+	       result = -1;
+	    }
+	 } else if (xiodrain_openssl(pipe, &xioparams->closwait) < 0) {
+	    if (errno == ETIMEDOUT) {
+	       Warn2("SSL_write(%d, ...): closing timeout expired, dropping up to "F_Zu" pending bytes",
+		     pipe->wfd, pipe->wqlen);
+	    }
+	    result = -1;
+	 }
+      } else
+#endif /* WITH_OPENSSL */
+#if HAVE_SHMRINGS
+      if ((pipe->dtype & XIODATA_WRITEMASK) == XIOWRITE_RING) {
+	 if (xioring_writefull(pipe->wring, pipe->wqbuff, pipe->wqlen,
+			       &xioparams->closwait) < 0) {
+	    if (errno == ETIMEDOUT) {
+	       Warn2("write to ring (eventfd %d): closing timeout expired, dropping up to "F_Zu" pending bytes",
+		     pipe->wfd, pipe->wqlen);
+	    } else if (errno != EPIPE || !pipe->cool_write) {
+	       Error2("write to ring (eventfd %d): %s",
+		      pipe->wfd, strerror(errno));
+	    }
+	    result = -1;
+	 } else {
+	    pipe->wqlen = 0;
+	 }
+      } else
+#endif /* HAVE_SHMRINGS */
+      if (pipe->wqdrop) {
+	 ssize_t writt;
+	 if ((writt = writeavail(pipe->wfd, pipe->wqbuff, pipe->wqlen)) < 0) {
+	    Error4("write(%d, %p, "F_Zu"): %s",
+		   pipe->wfd, pipe->wqbuff, pipe->wqlen, strerror(errno));
+	    result = -1;
+	 } else {
+	    pipe->wqlen -= writt;
+	 }
+      } else if (writefull(pipe->wfd, pipe->wqbuff, pipe->wqlen,
+			   &xioparams->closwait) < 0) {
+	 if (errno == ETIMEDOUT) {
+	    Warn2("write(%d, ...): closing timeout expired, dropping up to "
+		  F_Zu" pending bytes", pipe->wfd, pipe->wqlen);
+	 } else {
+	    Error4("write(%d, %p, "F_Zu"): %s",
+		   pipe->wfd, pipe->wqbuff, pipe->wqlen, strerror(errno));
+	 }
+	 result = -1;
+      } else {
+	 pipe->wqlen = 0;
+      }
+      if (pipe->wqlen > 0 && result == 0) {
+	 Warn2("write(%d, ...): dropping "F_Zu" bytes that were not taken",
+	       pipe->wfd, pipe->wqlen);
+	 result = -1;
+      }
+      pipe->wqlen = 0;
+   }
+   free(pipe->wqbuff);
+   pipe->wqbuff = NULL;
+   pipe->wqsize = 0;
+   pipe->draining = false;
+   return result;
+}